@@ -0,0 +1,267 @@
+// host/hal.c - Peripheral shim for the host build
+//
+// Stands in for hardware.c, mmc.c and the stage2.S helpers: the SD card
+// is a disk image file, the UART is stdin/stdout and TIMER_CLO is the
+// monotonic clock in microseconds since start-up.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "host.h"
+#include "hardware.h"
+#include "mmc.h"
+#include "mfboot.h"
+#include "protocols.h"
+
+host_state_t host = {
+    .disk_fd = -1,
+    .menu_pin = 1,
+    .fb_width = HOST_FB_WIDTH,
+    .fb_height = HOST_FB_HEIGHT,
+    .fb_depth = HOST_FB_DEPTH,
+};
+uint8_t* host_ram;
+
+// stage2.S and linker.ld symbols
+uint32_t stage2_entry_time;
+uint32_t stage2_mmu_time;
+uint8_t __bss_start, __bss_end;
+
+static uint64_t clock_base_ns;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+uint32_t get_timer_count(void) {
+    if (!clock_base_ns) {
+        clock_base_ns = now_ns();
+    }
+    return (uint32_t)((now_ns() - clock_base_ns) / 1000);
+}
+
+void delay_us(uint32_t us) {
+    fflush(stdout);
+    usleep(us);
+}
+
+void delay_ms(uint32_t ms) {
+    delay_us(ms * 1000);
+}
+
+// GPIO: only the boot menu pin has a level
+void gpio_set_function(uint32_t pin, uint32_t func) {
+    (void)pin;
+    (void)func;
+}
+
+void gpio_set(uint32_t pin) {
+    (void)pin;
+}
+
+void gpio_clear(uint32_t pin) {
+    (void)pin;
+}
+
+uint32_t gpio_read(uint32_t pin) {
+    return pin == BOOT_MENU_PIN ? host.menu_pin : 1;
+}
+
+// UART on stdin/stdout. Input ending is treated as the operator walking
+// away: there is nothing left to wait for, so the run ends.
+void uart_putc(char c) {
+    if (!host.quiet) {
+        putchar(c);
+    }
+}
+
+char uart_getc(void) {
+    unsigned char c;
+
+    fflush(stdout);
+    if (read(STDIN_FILENO, &c, 1) != 1) {
+        fprintf(stderr, "\n[host] End of input\n");
+        host_exit(3);
+    }
+    return (char)c;
+}
+
+// stdout never pushes back
+int uart_tx_ready(void) {
+    return 1;
+}
+
+int uart_tx_idle(void) {
+    return 1;
+}
+
+int uart_readable(void) {
+    struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+    fflush(stdout);
+    return poll(&pfd, 1, 0) > 0;
+}
+
+// Cycle counter: the TSC where there is one
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+void cycle_counter_init(void) {
+}
+
+uint32_t get_cycle_count(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return (uint32_t)__rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Bytes per framebuffer line, padded to a word like the firmware's
+uint32_t host_fb_pitch(void) {
+    return (host.fb_width * host.fb_depth / 8 + 3) & ~3u;
+}
+
+// Mailbox: the property tags memmap.c and termlink.c ask for, answered
+// from the simulated board
+int mbox_property(uint32_t* buf) {
+    uint32_t i = 2;
+
+    while (i + 3 <= buf[0] / 4 && buf[i] != MBOX_TAG_END) {
+        uint32_t* val = &buf[i + 3];
+        if ((buf[i] >> 16) == (MBOX_TAG_FB_ALLOCATE >> 16) && !host.fb_width) {
+            buf[1] = 0x80000001;
+            return -1;
+        }
+        switch (buf[i]) {
+        case MBOX_TAG_ARM_MEMORY:
+            val[0] = 0;
+            val[1] = HOST_ARM_RAM;
+            break;
+        case MBOX_TAG_VC_MEMORY:
+            val[0] = HOST_ARM_RAM;
+            val[1] = HOST_BOARD_RAM - HOST_ARM_RAM;
+            break;
+        case MBOX_TAG_BOARD_REVISION:
+            val[0] = 0x9000C1;
+            break;
+        case MBOX_TAG_FB_PHYS_SIZE:
+            val[0] = host.fb_width;
+            val[1] = host.fb_height;
+            break;
+        case MBOX_TAG_FB_DEPTH:
+            val[0] = host.fb_depth;
+            break;
+        case MBOX_TAG_FB_PIXEL_ORDER:
+            val[0] = 1;
+            break;
+        case MBOX_TAG_FB_ALLOCATE:
+            val[0] = HOST_FB_ADDR | 0xC0000000;
+            val[1] = host_fb_pitch() * host.fb_height;
+            break;
+        case MBOX_TAG_FB_PITCH:
+            val[0] = host_fb_pitch();
+            break;
+        default:
+            buf[1] = 0x80000001;
+            return -1;
+        }
+        buf[i + 2] = 0x80000000 | buf[i + 1];
+        i += 3 + buf[i + 1] / 4;
+    }
+    buf[1] = MBOX_RESPONSE_OK;
+    return 0;
+}
+
+// The ATAG list RETROS-BIOS hands over: CORE, one MEM bank, NONE
+uint32_t host_write_atags(void) {
+    uint32_t* p = PHYS_PTR(HOST_ATAGS_ADDR);
+
+    *p++ = 5;
+    *p++ = ATAG_CORE;
+    *p++ = 0;
+    *p++ = 4096;
+    *p++ = 0;
+    *p++ = 4;
+    *p++ = ATAG_MEM;
+    *p++ = HOST_ARM_RAM;
+    *p++ = 0;
+    *p++ = 0;
+    *p++ = ATAG_NONE;
+    return HOST_ATAGS_ADDR;
+}
+
+void dcache_clean_inv_range(uint32_t start, uint32_t len) {
+    (void)start;
+    (void)len;
+}
+
+// SD card backed by a disk image. Background reads complete at once.
+int host_open_disk(const char* path) {
+    struct stat st;
+
+    // Writable when the file allows it, for the boot index
+    host.disk_fd = open(path, O_RDWR);
+    if (host.disk_fd < 0) {
+        host.disk_fd = open(path, O_RDONLY);
+    }
+    if (host.disk_fd < 0 || fstat(host.disk_fd, &st) != 0) {
+        return -1;
+    }
+    host.disk_blocks = (uint32_t)(st.st_size / MMC_BLOCK_SIZE);
+    return 0;
+}
+
+int mmc_init(void) {
+    return host.disk_fd >= 0 ? 0 : -1;
+}
+
+int mmc_read_blocks(uint32_t lba, uint32_t count, void* buffer) {
+    size_t len = (size_t)count * MMC_BLOCK_SIZE;
+
+    if (host.disk_fd < 0 || count == 0 || lba >= host.disk_blocks ||
+        count > host.disk_blocks - lba) {
+        return -1;
+    }
+    host.read_cmds++;
+    host.read_blocks += count;
+    if (pread(host.disk_fd, buffer, len, (off_t)lba * MMC_BLOCK_SIZE) != (ssize_t)len) {
+        return -1;
+    }
+    return 0;
+}
+
+int mmc_read_block(uint32_t block, void* buffer) {
+    return mmc_read_blocks(block, 1, buffer);
+}
+
+int mmc_read_start(uint32_t lba, uint32_t count, void* buffer) {
+    if (((uintptr_t)buffer % HOST_DMA_ALIGN) == 0) {
+        host.async_reads++;
+    }
+    return mmc_read_blocks(lba, count, buffer);
+}
+
+int mmc_read_finish(void) {
+    return 0;
+}
+
+int mmc_write_block(uint32_t block, const void* buffer) {
+    if (host.disk_fd < 0 || block >= host.disk_blocks) {
+        return -1;
+    }
+    host.write_blocks++;
+    if (pwrite(host.disk_fd, buffer, MMC_BLOCK_SIZE, (off_t)block * MMC_BLOCK_SIZE) != MMC_BLOCK_SIZE) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+#ifndef HOST_H
+#define HOST_H
+
+// Host (Linux) build of the bootloader core: the peripherals in
+// hardware.h and mmc.h are replaced by the shim in host/hal.c.
+
+#include <stdint.h>
+
+// Guest RAM mapped at host_ram, addressed through PHYS_PTR()
+#define HOST_RAM_SIZE       0x40000000  // 1 GB, reserved lazily
+
+// The board the shim reports: a 512 MB BCM2835 with gpu_mem=64, the ARM
+// RAM below the GPU share. RETROS-BIOS leaves its ATAG list at
+// HOST_ATAGS_ADDR.
+#define HOST_BOARD_RAM      0x20000000
+#define HOST_ARM_RAM        0x1C000000
+#define HOST_ATAGS_ADDR     0x00000100
+
+// The HDMI framebuffer RETROS-BIOS sets up, at the bottom of the GPU
+// share; -F changes the mode
+#define HOST_FB_ADDR        HOST_ARM_RAM
+#define HOST_FB_WIDTH       1024
+#define HOST_FB_HEIGHT      768
+#define HOST_FB_DEPTH       32
+
+// mmc_read_start() leaves a read in flight only for buffers aligned like
+// this (MMC_DMA_ALIGN in src/drivers/mmc.c); the rest are read at once
+#define HOST_DMA_ALIGN      64
+
+// Shim settings and counters
+typedef struct {
+    int disk_fd;                // Backing file for the SD card
+    uint32_t disk_blocks;
+    uint32_t menu_pin;          // Level returned for BOOT_MENU_PIN (0 = menu)
+    int quiet;                  // Drop bootloader console output
+    uint32_t fb_width;          // Framebuffer mode, width 0 for none
+    uint32_t fb_height;
+    uint32_t fb_depth;
+    uint64_t read_cmds;         // Block device requests
+    uint64_t read_blocks;
+    uint64_t async_reads;       // ... left in flight by mmc_read_start()
+    uint64_t write_blocks;
+} host_state_t;
+
+extern host_state_t host;
+
+int host_open_disk(const char* path);
+uint32_t host_write_atags(void);
+uint32_t host_fb_pitch(void);
+void host_exit(int code);
+
+#endif // HOST_H
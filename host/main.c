@@ -0,0 +1,346 @@
+// host/main.c - Run the bootloader on Linux against a disk image
+//
+//   mfboot-host [options] disk.img
+//
+// The boot runs end to end through mfboot_main() and stops at the kernel
+// jump, which prints the entry point and registers and exits. Exit codes:
+// 0 jumped (and every --expect matched), 1 --expect mismatch, 2 usage,
+// 3 console input ran out (menu or emergency shell waiting), 4 returned.
+// --bench mounts the image and runs the maintenance benchmarks instead.
+// --handoff saves the ATAG list or device tree the kernel receives, and
+// --termlink the Termlink boot block (boot.protocol = termlink).
+// --fb-dump saves the framebuffer console as a PPM image at exit.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/mman.h>
+
+#include "host.h"
+#include "hardware.h"
+#include "mfboot.h"
+#include "memory_mgr.h"
+#include "memmap.h"
+#include "bcache.h"
+#include "filesystem.h"
+#include "protocols.h"
+#include "fdt.h"
+#include "fbcon.h"
+#include "termlink.h"
+
+#define MAX_EXPECT          8
+
+typedef struct {
+    uint32_t addr;
+    const char* path;
+} expect_t;
+
+static expect_t expects[MAX_EXPECT];
+static int num_expects;
+static int show_stats;
+static int bench;
+static int no_atags;
+static const char* firmware_dtb;
+static const char* handoff_path;
+static const char* termlink_path;
+static const char* fb_dump_path;
+static int tty_raw;
+static struct termios tty_saved;
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "usage: %s [options] disk.img\n"
+            "  -m, --menu            hold the boot menu pin (show the menu)\n"
+            "  -s, --slow            keep the cosmetic pauses\n"
+            "  -q, --quiet           drop console output\n"
+            "  -e, --expect ADDR=FILE  at the jump, RAM at ADDR must match FILE\n"
+            "  -S, --stats           print block device counters at exit\n"
+            "  -A, --no-atags        pass no ATAG list (RAM size from the mailbox)\n"
+            "  -D, --dtb FILE        pass FILE as the firmware device tree instead of ATAGS\n"
+            "  -H, --handoff FILE    at the jump, save the ATAGS or device tree in r2 to FILE\n"
+            "  -T, --termlink FILE   at the jump, check and save the Termlink block in r0 to FILE\n"
+            "  -F, --fb WxHxD        framebuffer mode (default %ux%ux%u), 0 for none\n"
+            "  -P, --fb-dump FILE    at exit, save the framebuffer to FILE (PPM)\n"
+            "  -b, --bench           run the boot path benchmarks, not the boot\n",
+            prog, HOST_FB_WIDTH, HOST_FB_HEIGHT, HOST_FB_DEPTH);
+}
+
+// Bytes of FILE compared with guest RAM at ADDR; 0 if equal
+static int check_expect(const expect_t* e) {
+    FILE* f = fopen(e->path, "rb");
+    if (!f) {
+        fprintf(stderr, "[host] %s: cannot open\n", e->path);
+        return -1;
+    }
+
+    const uint8_t* ram = PHYS_PTR(e->addr);
+    uint8_t buf[65536];
+    uint64_t offset = 0;
+    size_t n;
+    int rc = 0;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        if (e->addr + offset + n > HOST_RAM_SIZE || memcmp(ram + offset, buf, n) != 0) {
+            rc = -1;
+            break;
+        }
+        offset += n;
+    }
+    fclose(f);
+
+    fprintf(stderr, "[host] 0x%08X %s: %s\n", e->addr, e->path, rc ? "MISMATCH" : "ok");
+    return rc;
+}
+
+// The framebuffer as a binary PPM; 8 bpp pixels become gray levels
+static void save_fb_dump(void) {
+    FILE* f = fopen(fb_dump_path, "wb");
+    if (!f) {
+        perror(fb_dump_path);
+        return;
+    }
+
+    fprintf(f, "P6\n%u %u\n255\n", host.fb_width, host.fb_height);
+    for (uint32_t y = 0; y < host.fb_height; y++) {
+        const uint8_t* line = (const uint8_t*)PHYS_PTR(HOST_FB_ADDR) + y * host_fb_pitch();
+        for (uint32_t x = 0; x < host.fb_width; x++) {
+            uint8_t rgb[3];
+            uint32_t px;
+            switch (host.fb_depth) {
+            case 8:
+                rgb[0] = rgb[1] = rgb[2] = (uint8_t)(line[x] * 17);
+                break;
+            case 16:
+                px = line[x * 2] | (line[x * 2 + 1] << 8);
+                rgb[0] = (uint8_t)((px >> 11) << 3);
+                rgb[1] = (uint8_t)(((px >> 5) & 0x3F) << 2);
+                rgb[2] = (uint8_t)((px & 0x1F) << 3);
+                break;
+            case 24:
+                rgb[0] = line[x * 3 + 2];
+                rgb[1] = line[x * 3 + 1];
+                rgb[2] = line[x * 3];
+                break;
+            default:
+                rgb[0] = line[x * 4 + 2];
+                rgb[1] = line[x * 4 + 1];
+                rgb[2] = line[x * 4];
+                break;
+            }
+            fwrite(rgb, 1, 3, f);
+        }
+    }
+    fclose(f);
+}
+
+void host_exit(int code) {
+    fflush(stdout);
+    if (fb_dump_path && host.fb_width) {
+        fbcon_update(1);
+        save_fb_dump();
+    }
+    if (tty_raw) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &tty_saved);
+    }
+    if (show_stats) {
+        fprintf(stderr, "[host] %u us, %llu block reads (%llu background), %llu blocks, "
+                "%llu written\n",
+                get_timer_count(), (unsigned long long)host.read_cmds,
+                (unsigned long long)host.async_reads, (unsigned long long)host.read_blocks,
+                (unsigned long long)host.write_blocks);
+    }
+    exit(code);
+}
+
+// Bytes of the ATAG list or device tree at guest address 'r2'
+static uint32_t handoff_size(uint32_t r2) {
+    const uint32_t* p = PHYS_PTR(r2);
+
+    if (fdt_be32(p[0]) == FDT_MAGIC) {
+        return fdt_total_size(p);
+    }
+    uint32_t words = 0;
+    while (words < ATAGS_MAX_SIZE / 4 && p[words] != 0) {
+        words += p[words];
+    }
+    return (words + 2) * 4;
+}
+
+// Bytes of the Termlink block at guest address 'r0', 0 if it is not one
+static uint32_t termlink_size(uint32_t r0) {
+    const termlink_info_t* info = PHYS_PTR(r0);
+    const termlink_boot_t* boot = (const termlink_boot_t*)(info + 1);
+
+    if (info->magic != TERMLINK_MAGIC || boot->magic != TERMLINK_BOOT_MAGIC ||
+        boot->size < sizeof(*info) + sizeof(*boot) || boot->size > HOST_RAM_SIZE - r0) {
+        return 0;
+    }
+    termlink_boot_t copy = *boot;
+    copy.checksum = 0;
+    uint32_t crc = crc32(0, info, sizeof(*info));
+    crc = crc32(crc, &copy, sizeof(copy));
+    crc = crc32(crc, boot + 1, boot->size - sizeof(*info) - sizeof(*boot));
+    return crc == boot->checksum ? boot->size : 0;
+}
+
+static int save_guest(const char* path, const char* what, uint32_t addr, uint32_t size) {
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    int rc = fwrite(PHYS_PTR(addr), 1, size, f) == size ? 0 : -1;
+    if (fclose(f) != 0) {
+        rc = -1;
+    }
+    fprintf(stderr, "[host] %s: %u bytes to %s\n", what, size, path);
+    return rc;
+}
+
+// The whole file at guest 'addr', as the firmware would leave it
+static int load_guest_file(const char* path, uint32_t addr) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    size_t n = fread(PHYS_PTR(addr), 1, HOST_RAM_SIZE - addr, f);
+    fclose(f);
+    return n ? 0 : -1;
+}
+
+// The kernel "runs": report the handoff and check the loaded images
+void jump_to_kernel_asm(uint32_t addr, uint32_t r0, uint32_t r1, uint32_t r2) {
+    int rc = 0;
+
+    fflush(stdout);
+    fprintf(stderr, "[host] Jump to 0x%08X (r0=0x%08X r1=0x%08X r2=0x%08X)\n", addr, r0, r1, r2);
+    if (handoff_path && (r2 == 0 ||
+                         save_guest(handoff_path, "r2 handoff", r2, handoff_size(r2)) != 0)) {
+        rc = 1;
+    }
+    if (termlink_path) {
+        uint32_t size = r0 ? termlink_size(r0) : 0;
+        if (size == 0) {
+            fprintf(stderr, "[host] r0 is not a valid Termlink block\n");
+            rc = 1;
+        } else if (save_guest(termlink_path, "r0 Termlink block", r0, size) != 0) {
+            rc = 1;
+        }
+    }
+    for (int i = 0; i < num_expects; i++) {
+        if (check_expect(&expects[i]) != 0) {
+            rc = 1;
+        }
+    }
+    host_exit(rc);
+}
+
+int main(int argc, char** argv) {
+    const char* disk = NULL;
+
+    fast_boot = 1;
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        if (!strcmp(a, "-m") || !strcmp(a, "--menu")) {
+            host.menu_pin = 0;
+        } else if (!strcmp(a, "-s") || !strcmp(a, "--slow")) {
+            fast_boot = 0;
+        } else if (!strcmp(a, "-q") || !strcmp(a, "--quiet")) {
+            host.quiet = 1;
+        } else if (!strcmp(a, "-b") || !strcmp(a, "--bench")) {
+            bench = 1;
+        } else if (!strcmp(a, "-A") || !strcmp(a, "--no-atags")) {
+            no_atags = 1;
+        } else if ((!strcmp(a, "-D") || !strcmp(a, "--dtb")) && i + 1 < argc) {
+            firmware_dtb = argv[++i];
+        } else if ((!strcmp(a, "-H") || !strcmp(a, "--handoff")) && i + 1 < argc) {
+            handoff_path = argv[++i];
+        } else if ((!strcmp(a, "-F") || !strcmp(a, "--fb")) && i + 1 < argc) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "0") == 0) {
+                host.fb_width = 0;
+            } else if (sscanf(mode, "%ux%ux%u", &host.fb_width, &host.fb_height,
+                              &host.fb_depth) != 3 || !host.fb_width || !host.fb_height ||
+                       host.fb_width > 4096 || host.fb_height > 4096) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if ((!strcmp(a, "-T") || !strcmp(a, "--termlink")) && i + 1 < argc) {
+            termlink_path = argv[++i];
+        } else if ((!strcmp(a, "-P") || !strcmp(a, "--fb-dump")) && i + 1 < argc) {
+            fb_dump_path = argv[++i];
+        } else if (!strcmp(a, "-S") || !strcmp(a, "--stats")) {
+            show_stats = 1;
+        } else if ((!strcmp(a, "-e") || !strcmp(a, "--expect")) && i + 1 < argc &&
+                   num_expects < MAX_EXPECT) {
+            char* eq = strchr(argv[++i], '=');
+            if (!eq) {
+                usage(argv[0]);
+                return 2;
+            }
+            expects[num_expects].addr = (uint32_t)strtoul(argv[i], NULL, 0);
+            expects[num_expects].path = eq + 1;
+            num_expects++;
+        } else if (a[0] != '-' && !disk) {
+            disk = a;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (!disk) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (host_open_disk(disk) != 0) {
+        perror(disk);
+        return 2;
+    }
+    host_ram = mmap(NULL, HOST_RAM_SIZE, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (host_ram == MAP_FAILED) {
+        perror("mmap");
+        return 2;
+    }
+
+    // Keys arrive one at a time, like the UART
+    if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &tty_saved) == 0) {
+        struct termios raw = tty_saved;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_iflag &= ~ICRNL;
+        tty_raw = tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0;
+    }
+
+    stage2_entry_time = get_timer_count();
+    uint32_t atags = no_atags ? 0 : host_write_atags();
+    if (firmware_dtb) {
+        if (load_guest_file(firmware_dtb, HOST_ATAGS_ADDR) != 0) {
+            return 2;
+        }
+        atags = HOST_ATAGS_ADDR;
+    }
+    if (bench) {
+        extern void run_benchmarks(void);
+        static termlink_info_t termlink;
+        memmap_init(atags);
+        memory_init();
+        termlink_init(&termlink);
+        fbcon_init(&termlink);
+        bcache_init(BCACHE_DEFAULT_SIZE);
+        if (fs_init() != 0) {
+            fprintf(stderr, "[host] %s: no FAT32 volume\n", disk);
+            host_exit(2);
+        }
+        run_benchmarks();
+        host_exit(0);
+    }
+    mfboot_main(0, 0, atags);
+
+    fprintf(stderr, "[host] mfboot_main returned\n");
+    host_exit(4);
+    return 4;
+}
@@ -0,0 +1,32 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Block cache between the filesystem and the MMC driver
+#define BCACHE_BLOCK_SIZE       512
+#define BCACHE_WAYS             4
+#define BCACHE_MAX_READAHEAD    8       // Blocks per read-ahead request
+
+#ifndef BCACHE_DEFAULT_SIZE
+#define BCACHE_DEFAULT_SIZE     0x8000  // 32 KB of block storage
+#endif
+
+// Cache counters
+typedef struct {
+    uint32_t blocks;            // Capacity in blocks
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t readahead;         // Blocks fetched ahead of use
+    uint32_t readahead_hits;    // ... that were later used
+} bcache_stats_t;
+
+// Function declarations
+int bcache_init(size_t size);
+const uint8_t* bcache_get(uint32_t lba);
+int bcache_read(uint32_t lba, uint32_t count, void* buffer);
+void bcache_invalidate(void);
+void bcache_get_stats(bcache_stats_t* stats);
+
+#endif // BCACHE_H
@@ -0,0 +1,58 @@
+#ifndef BOOTINDEX_H
+#define BOOTINDEX_H
+
+#include <stdint.h>
+#include "mfboot.h"
+#include "filesystem.h"
+
+// Boot entry index: what the last full scan found, kept in a file that
+// is allocated once (tools/mkdiskimg.py --boot-index) and rewritten in
+// place. It is trusted while the volume generation, the CRC of every
+// searched directory and the scan settings from the configuration still
+// match, so a boot with nothing changed skips the probes, and the loader
+// opens files from their cached extents.
+#define BOOTINDEX_PATH          "/boot/mfboot.idx"
+#define BOOTINDEX_MAGIC         0x58444942  // "BIDX"
+#define BOOTINDEX_VERSION       2
+#define BOOTINDEX_MAX_ENTRIES   6
+#define BOOTINDEX_MAX_DIRS      8
+#define BOOTINDEX_PATH_MAX      64
+
+typedef struct {
+    char name[32];
+    char path[BOOTINDEX_PATH_MAX];
+    char initrd_path[BOOTINDEX_PATH_MAX];
+    uint32_t type;              // From the image header, as loader_probe()
+    uint32_t load_addr;
+    uint32_t size;
+    fs_location_t image;
+    fs_location_t initrd;       // Zero size without an initrd file
+} bootindex_entry_t;
+
+// A directory the scan searched, so a file appearing there is noticed
+typedef struct {
+    char path[BOOTINDEX_PATH_MAX];
+    uint32_t crc;               // fs_dir_crc() at save time
+    uint32_t missing;           // Did not exist then, so 'crc' is unused
+} bootindex_dir_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;              // Bytes covered by 'checksum'
+    uint32_t checksum;          // CRC-32 of the rest, this field as 0
+    uint32_t generation;        // fs_volume_generation() at save time
+    uint32_t scan_key;          // Caller's fingerprint of its scan settings
+    uint32_t num_dirs;
+    uint32_t num_entries;
+    bootindex_dir_t dirs[BOOTINDEX_MAX_DIRS];
+    bootindex_entry_t entries[BOOTINDEX_MAX_ENTRIES];
+} bootindex_t;
+
+// Function declarations
+int bootindex_load(boot_entry_t* entries, int max, uint32_t scan_key);
+int bootindex_save(const boot_entry_t* entries, int count,
+                   const char* const* search_paths, int num_paths, uint32_t scan_key);
+file_handle_t* bootindex_open(const char* path);
+
+#endif // BOOTINDEX_H
@@ -0,0 +1,116 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+
+// Boot configuration: config/bootmenu.conf and config/devices.conf,
+// installed on the card under 8.3 names, or both precompiled into one
+// blob by tools/mkconfig.py. Either is read once into a fixed table of
+// typed values. Keys are matched by the FNV-1a hash of "section.key"
+// while parsing, and code reads a value by its CONFIG_* index. Strings
+// point into the file buffer, tokenized in place; nothing is allocated.
+#define CONFIG_MENU_PATH        "/boot/bootmenu.cfg"
+#define CONFIG_DEVICES_PATH     "/boot/devices.cfg"
+#define CONFIG_BLOB_PATH        "/boot/config.bin"  // Used instead when present
+
+#define CONFIG_BUF_SIZE         0x2000      // Both text files, or the blob
+#define CONFIG_LIST_POOL        32          // List items over all keys
+
+// Precompiled blob: header, then one record per key set in the files
+#define CONFIG_BLOB_MAGIC       0x46434D46  // "MFCF"
+#define CONFIG_BLOB_VERSION     1
+
+// Value types
+#define CONFIG_TYPE_INT         0           // Decimal or 0x hex, unsigned
+#define CONFIG_TYPE_BOOL        1           // true/false, yes/no, on/off, 1/0
+#define CONFIG_TYPE_STRING      2
+#define CONFIG_TYPE_LIST        3           // Comma separated strings
+
+// Where the table came from (config_load())
+#define CONFIG_SRC_DEFAULT      0
+#define CONFIG_SRC_TEXT         1
+#define CONFIG_SRC_BLOB         2
+
+// Keys (names in config.c and tools/mkconfig.py follow this order)
+enum {
+    CONFIG_MENU_TIMEOUT = 0,            // Seconds, 0 = boot the default at once
+    CONFIG_MENU_DEFAULT,                // Boot entry index
+    CONFIG_MENU_ADVANCED,
+    CONFIG_DISPLAY_COLOR_NORMAL,
+    CONFIG_DISPLAY_COLOR_HIGHLIGHT,
+    CONFIG_DISPLAY_COLOR_ERROR,
+    CONFIG_DISPLAY_BORDER,
+    CONFIG_DISPLAY_SHOW_TIMESTAMPS,
+    CONFIG_SECURITY_PASSWORD_REQUIRED,
+    CONFIG_SECURITY_SECURE_BOOT,
+    CONFIG_SDCARD_ENABLED,
+    CONFIG_SDCARD_SEARCH_PATHS,
+    CONFIG_USB_ENABLED,
+    CONFIG_USB_SEARCH_PATHS,
+    CONFIG_NETWORK_ENABLED,
+    CONFIG_NETWORK_SERVER,
+    CONFIG_NETWORK_FILENAME,
+    CONFIG_HOLOTAPE_ENABLED,
+    CONFIG_HOLOTAPE_DEVICE,
+    CONFIG_SEARCH_KERNEL_PATTERNS,
+    CONFIG_SEARCH_MAX_DEPTH,
+    CONFIG_SEARCH_IGNORE_HIDDEN,
+    CONFIG_BOOT_PROTOCOL,
+    CONFIG_BOOT_CMDLINE,                // Empty: the firmware's
+    CONFIG_BOOT_LOAD_ADDRESS,           // 0: KERNEL_LOAD_ADDR
+    CONFIG_BOOT_INITRD,                 // "auto" or "none"
+    CONFIG_NUM_KEYS
+};
+
+typedef struct {
+    uint8_t type;               // CONFIG_TYPE_*
+    uint8_t set;                // From a file rather than the default
+    uint16_t count;             // List items
+    union {
+        uint32_t i;
+        const char* s;
+        const char* const* list;
+    } v;
+} config_value_t;
+
+typedef struct {
+    config_value_t values[CONFIG_NUM_KEYS];
+    const char* pool[CONFIG_LIST_POOL]; // List items parsed from text
+    uint32_t pool_used;
+} config_t;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;             // Records
+    uint32_t size;              // Whole blob, header included
+    uint32_t schema;            // config_schema() of the tool's key table
+    uint32_t checksum;          // CRC-32 of the records
+} config_blob_header_t;
+
+// Record: hash, type, list item count and payload length, then the
+// payload padded to 4 bytes: a uint32_t for INT and BOOL, the string
+// with its NUL, or each list item with its NUL
+typedef struct {
+    uint32_t hash;
+    uint8_t type;
+    uint8_t count;
+    uint16_t len;
+} config_record_t;
+
+// The table the boot uses
+extern config_t boot_config;
+
+// Function declarations
+uint32_t config_hash(const char* s);
+uint32_t config_schema(void);
+const char* config_key_name(uint32_t key);
+void config_defaults(config_t* cfg);
+int config_parse(config_t* cfg, char* text, uint32_t len, uint32_t* bad_line);
+int config_load_blob(config_t* cfg, const void* blob, uint32_t size);
+int config_load(void);
+uint32_t config_int(uint32_t key);
+const char* config_string(uint32_t key);
+uint32_t config_list(uint32_t key, const char* const** items);
+
+#endif // CONFIG_H
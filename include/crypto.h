@@ -0,0 +1,54 @@
+#ifndef CRYPTO_H
+#define CRYPTO_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHA256_BLOCK_SIZE       64
+#define SHA256_DIGEST_SIZE      32
+#define SHA512_BLOCK_SIZE       128
+#define SHA512_DIGEST_SIZE      64
+#define ED25519_KEY_SIZE        32
+#define ED25519_SIG_SIZE        64
+
+// Signed image trailer (tools/sign_payload.py): the signed bytes, the
+// Ed25519 signature of their SHA-256 digest, then this trailer
+#define SIGN_MAGIC              0x4753464D  // "MFSG"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t signed_len;        // Bytes covered by the signature
+} sign_trailer_t;
+
+// Incremental hash state
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;            // Bytes hashed so far
+    uint8_t buffer[SHA256_BLOCK_SIZE];
+    uint32_t buffered;
+} sha256_ctx_t;
+
+typedef struct {
+    uint64_t state[8];
+    uint64_t length;
+    uint8_t buffer[SHA512_BLOCK_SIZE];
+    uint32_t buffered;
+} sha512_ctx_t;
+
+// Trusted keys (src/trusted_keys.c)
+extern const uint8_t trusted_keys[][ED25519_KEY_SIZE];
+extern const uint32_t trusted_key_count;
+
+// Function declarations
+void sha256_init(sha256_ctx_t* ctx);
+void sha256_update(sha256_ctx_t* ctx, const void* data, size_t len);
+void sha256_final(sha256_ctx_t* ctx, uint8_t digest[SHA256_DIGEST_SIZE]);
+void sha512_init(sha512_ctx_t* ctx);
+void sha512_update(sha512_ctx_t* ctx, const void* data, size_t len);
+void sha512_final(sha512_ctx_t* ctx, uint8_t digest[SHA512_DIGEST_SIZE]);
+int ed25519_verify(const uint8_t sig[ED25519_SIG_SIZE], const uint8_t* msg, size_t len,
+                   const uint8_t key[ED25519_KEY_SIZE]);
+int verify_boot_signature(const uint8_t* data, size_t len, const uint8_t* signature);
+int load_public_keys(void);
+
+#endif // CRYPTO_H
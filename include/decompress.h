@@ -0,0 +1,30 @@
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+#include <stdint.h>
+
+// Compression codecs (values shared with tools/mkbootimg.py)
+#define CODEC_NONE          0
+#define CODEC_LZ4           1
+#define CODEC_GZIP          2
+
+#define LZ4_FRAME_MAGIC     0x184D2204
+#define GZIP_MAGIC          0x8B1F
+
+// Compressed input, consumed from [pos, end). When the window runs dry
+// refill() points it at the next chunk, returning -1 at end of input.
+typedef struct decomp_src {
+    const uint8_t* pos;
+    const uint8_t* end;
+    int (*refill)(struct decomp_src* src);
+    void* ctx;
+} decomp_src_t;
+
+// Function declarations
+int decomp_detect(const uint8_t* data, uint32_t len);
+const char* decomp_codec_name(int codec);
+int decomp_run(int codec, decomp_src_t* src, uint8_t* out, uint32_t out_max);
+int lz4_decompress(decomp_src_t* src, uint8_t* out, uint32_t out_max);
+int gzip_decompress(decomp_src_t* src, uint8_t* out, uint32_t out_max);
+
+#endif // DECOMPRESS_H
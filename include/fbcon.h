@@ -0,0 +1,26 @@
+#ifndef FBCON_H
+#define FBCON_H
+
+#include <stdint.h>
+#include "termlink.h"
+
+// Glyphs: printable ASCII at their codes, the box drawing lines the
+// menus use below the space
+#define FBCON_GLYPHS        128
+#define FBCON_GLYPH_HLINE   0x01        // U+2500 ─
+#define FBCON_GLYPH_DHLINE  0x02        // U+2550 ═
+
+// Expanded glyphs are cached for this many colors at once
+#define FBCON_CACHE_SLOTS   4
+
+// While output keeps coming the screen is redrawn at most this often, so
+// a burst of lines costs one redraw
+#define FBCON_REFRESH_US    20000
+
+// Function declarations
+int fbcon_init(const termlink_info_t* info);
+int fbcon_active(void);
+void fbcon_write(const char* s, uint32_t len);
+void fbcon_update(int force);
+
+#endif // FBCON_H
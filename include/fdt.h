@@ -0,0 +1,48 @@
+#ifndef FDT_H
+#define FDT_H
+
+#include <stdint.h>
+
+// Flattened device tree editing in place. The blob sits in a buffer
+// larger than the tree; growing a property or adding a node slides the
+// rest of the structure and strings blocks up into that slack, so the
+// tree is never copied to a new buffer. Node offsets are offsets into
+// the structure block and change when anything before them is edited.
+#define FDT_MAGIC               0xD00DFEED
+#define FDT_MIN_VERSION         17          // First with size_dt_struct
+#define FDT_EDIT_SLACK          0x2000      // Room reserved for the boot edits
+
+// Structure block tokens
+#define FDT_BEGIN_NODE          1
+#define FDT_END_NODE            2
+#define FDT_PROP                3
+#define FDT_NOP                 4
+#define FDT_END                 9
+
+// Header, all fields big-endian
+typedef struct {
+    uint32_t magic;
+    uint32_t totalsize;
+    uint32_t off_dt_struct;
+    uint32_t off_dt_strings;
+    uint32_t off_mem_rsvmap;
+    uint32_t version;
+    uint32_t last_comp_version;
+    uint32_t boot_cpuid_phys;
+    uint32_t size_dt_strings;
+    uint32_t size_dt_struct;
+} fdt_header_t;
+
+// Function declarations
+int fdt_check(const void* fdt, uint32_t size);
+uint32_t fdt_total_size(const void* fdt);
+int fdt_open(void* fdt, uint32_t capacity);
+int fdt_path_offset(const void* fdt, const char* path);
+int fdt_add_subnode(void* fdt, int parent, const char* name);
+const void* fdt_getprop(const void* fdt, int node, const char* name, uint32_t* len);
+int fdt_setprop(void* fdt, int node, const char* name, const void* val, uint32_t len);
+int fdt_setprop_cells(void* fdt, int node, const char* name, const uint32_t* cells, int count);
+int fdt_delprop(void* fdt, int node, const char* name);
+uint32_t fdt_be32(uint32_t v);
+
+#endif // FDT_H
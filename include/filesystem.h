@@ -4,19 +4,54 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#define FS_SECTOR_SIZE      512
+#define FS_MAX_EXTENTS      16      // Contiguous runs mapped per window
+#define FS_MAX_OPEN         4
+#define FS_LOC_EXTENTS      4       // Extents kept in an fs_location_t
+
+// Contiguous run of file data on disk
+typedef struct {
+    uint32_t lba;               // First sector of the run
+    uint32_t count;             // Run length in sectors
+} fs_extent_t;
+
 // File handle structure
 typedef struct {
-    uint32_t start_sector;
+    uint32_t start_sector;      // First data sector of the file
     uint32_t size;
     uint32_t position;
     uint8_t valid;
+    uint8_t num_extents;        // Extents in the current window
+    uint32_t first_cluster;
+    uint32_t map_sector;        // File sector index covered by extents[0]
+    uint32_t map_next;          // Cluster following the window (0 = none)
+    fs_extent_t extents[FS_MAX_EXTENTS];
 } file_handle_t;
 
+// Where a file is on the volume: enough to open it again without a
+// path lookup, and to tell whether it changed
+typedef struct {
+    uint32_t first_cluster;
+    uint32_t size;
+    uint32_t mtime;             // FAT write date << 16 | write time
+    uint32_t next_cluster;      // Cluster after 'extents', 0 if they end the file
+    uint32_t num_extents;
+    fs_extent_t extents[FS_LOC_EXTENTS];
+} fs_location_t;
+
 // Function declarations
 int fs_init(void);
 file_handle_t* fs_open(const char* path);
 int fs_read(file_handle_t* fh, void* buffer, size_t size);
+int fs_read_start(file_handle_t* fh, void* buffer, size_t size);
+int fs_read_finish(void);
+int fs_seek(file_handle_t* fh, uint32_t offset);
 void fs_close(file_handle_t* fh);
 int fs_exists(const char* path);
+int fs_locate(const char* path, fs_location_t* loc);
+file_handle_t* fs_open_location(const fs_location_t* loc);
+int fs_write(file_handle_t* fh, const void* buffer, size_t size);
+int fs_dir_crc(const char* path, uint32_t* crc);
+uint32_t fs_volume_generation(void);
 
 #endif // FILESYSTEM_H
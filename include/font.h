@@ -0,0 +1,15 @@
+#ifndef FONT_H
+#define FONT_H
+
+#include <stdint.h>
+
+// 8x16 console font: printable ASCII, one byte per row, top row first,
+// the leftmost pixel in bit 7
+#define FONT_WIDTH      8
+#define FONT_HEIGHT     16
+#define FONT_FIRST      0x20
+#define FONT_LAST       0x7E
+
+extern const uint8_t font8x16[FONT_LAST - FONT_FIRST + 1][FONT_HEIGHT];
+
+#endif // FONT_H
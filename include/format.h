@@ -0,0 +1,17 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+// Receives formatted output in runs as it is produced; 's' is not
+// NUL-terminated
+typedef void (*format_sink_fn)(void* ctx, const char* s, uint32_t len);
+
+// Function declarations
+int format_vprint(format_sink_fn sink, void* ctx, const char* fmt, va_list args);
+int format_snprintf(char* buf, size_t size, const char* fmt, ...);
+int format_vsnprintf(char* buf, size_t size, const char* fmt, va_list args);
+
+#endif // FORMAT_H
@@ -1,7 +1,9 @@
 #ifndef HARDWARE_H
 #define HARDWARE_H
 
+#ifndef __ASSEMBLER__
 #include <stdint.h>
+#endif
 
 // Peripheral base addresses (set by RETROS-BIOS)
 #ifdef BCM2835
@@ -23,11 +25,78 @@
 #define UART0_BASE      (PERIPHERAL_BASE + 0x201000)
 #define UART0_DR        ((volatile uint32_t*)(UART0_BASE + 0x00))
 #define UART0_FR        ((volatile uint32_t*)(UART0_BASE + 0x18))
+#define UART_FR_BUSY    (1 << 3)    // Still shifting out a byte
+#define UART_FR_RXFE    (1 << 4)    // Receive FIFO empty
+#define UART_FR_TXFF    (1 << 5)    // Transmit FIFO (16 bytes) full
 
 // System Timer registers
 #define TIMER_BASE      (PERIPHERAL_BASE + 0x3000)
 #define TIMER_CLO       ((volatile uint32_t*)(TIMER_BASE + 0x04))
 
+// DMA controller (channel n at DMA_BASE + n * 0x100)
+#define DMA_BASE        (PERIPHERAL_BASE + 0x7000)
+#define DMA_ENABLE      ((volatile uint32_t*)(DMA_BASE + 0xFF0))
+
+// EMMC (Arasan SDHCI) controller
+#define EMMC_BASE       (PERIPHERAL_BASE + 0x300000)
+
+// VideoCore mailbox 0: the ARM reads replies, writes go to mailbox 1
+#define MBOX_BASE       (PERIPHERAL_BASE + 0xB880)
+#define MBOX_READ       ((volatile uint32_t*)(MBOX_BASE + 0x00))
+#define MBOX_STATUS     ((volatile uint32_t*)(MBOX_BASE + 0x18))
+#define MBOX_WRITE      ((volatile uint32_t*)(MBOX_BASE + 0x20))
+#define MBOX_FULL       0x80000000
+#define MBOX_EMPTY      0x40000000
+#define MBOX_CH_PROP    8           // Property tags, ARM to VC
+#define MBOX_TIMEOUT_US 100000
+
+// Property tags and the response code of a processed buffer
+#define MBOX_REQUEST            0x00000000
+#define MBOX_RESPONSE_OK        0x80000000
+#define MBOX_TAG_BOARD_REVISION 0x00010002
+#define MBOX_TAG_ARM_MEMORY     0x00010005  // Base, size
+#define MBOX_TAG_VC_MEMORY      0x00010006  // Base, size
+#define MBOX_TAG_FB_ALLOCATE    0x00040001  // Alignment in; base, size out
+#define MBOX_TAG_FB_PHYS_SIZE   0x00040003  // Width, height
+#define MBOX_TAG_FB_DEPTH       0x00040005  // Bits per pixel
+#define MBOX_TAG_FB_PIXEL_ORDER 0x00040006  // 0 BGR, 1 RGB
+#define MBOX_TAG_FB_PITCH       0x00040008  // Bytes per line
+#define MBOX_TAG_END            0x00000000
+
+// ARM local peripherals (BCM2836/7). Each core has four mailboxes: a
+// write to a set register ORs bits in, writing bits to the read/clear
+// register clears them. Core n's mailbox m is at + 0x10 * n + 4 * m.
+#define LOCAL_BASE              0x40000000
+#define LOCAL_MAILBOX_SET       (LOCAL_BASE + 0x80)
+#define LOCAL_MAILBOX_CLR       (LOCAL_BASE + 0xC0)
+
+// VideoCore bus addresses, as programmed into DMA control blocks
+#define BUS_PERIPHERAL_BASE 0x7E000000
+#ifdef BCM2835
+    #define BUS_RAM_ALIAS   0x40000000  // L2 cache coherent alias
+#else
+    #define BUS_RAM_ALIAS   0xC0000000  // Uncached alias
+#endif
+#define PHYS_TO_BUS(addr)   ((uint32_t)(addr) | BUS_RAM_ALIAS)
+
+
+#ifndef __ASSEMBLER__
+
+// Physical RAM addresses as CPU pointers and back. RAM is identity
+// mapped on the Pi; the host build (host/) keeps guest RAM in a mapping.
+#ifdef HOST_BUILD
+extern uint8_t* host_ram;
+#define PHYS_PTR(addr)      ((void*)(host_ram + (uint32_t)(addr)))
+#define PTR_PHYS(ptr)       ((uint32_t)((uint8_t*)(ptr) - host_ram))
+#else
+#define PHYS_PTR(addr)      ((void*)(uintptr_t)(addr))
+#define PTR_PHYS(ptr)       ((uint32_t)(uintptr_t)(ptr))
+#endif
+
+// Boot-time counters recorded by stage2.S (TIMER_CLO values)
+extern uint32_t stage2_entry_time;
+extern uint32_t stage2_mmu_time;    // 0 when built without ENABLE_MMU
+
 // Function declarations
 void delay_ms(uint32_t ms);
 void delay_us(uint32_t us);
@@ -39,5 +108,20 @@ uint32_t gpio_read(uint32_t pin);
 void uart_putc(char c);
 char uart_getc(void);
 int uart_readable(void);
+int uart_tx_ready(void);
+int uart_tx_idle(void);
+
+// Cache maintenance (stage2.S); start/len need not be line aligned
+void dcache_clean_inv_range(uint32_t start, uint32_t len);
+
+// Run a property tag buffer through the mailbox. 'buf' is 16-byte
+// aligned, buf[0] its size in bytes; 0 once the firmware answered.
+int mbox_property(uint32_t* buf);
+
+// PMU cycle counter; wraps every 2^32 cycles
+void cycle_counter_init(void);
+uint32_t get_cycle_count(void);
+
+#endif // __ASSEMBLER__
 
 #endif // HARDWARE_H
@@ -3,13 +3,129 @@
 
 #include <stdint.h>
 #include "mfboot.h"
+#include "filesystem.h"
 
 // ELF header magic
 #define ELF_MAGIC 0x464C457F  // "\x7FELF"
 
+// mkbootimg.py boot image header
+#define BOOT_MAGIC              0x544F4F42  // "BOOT"
+#define BOOT_VERSION_MAJOR(v)   ((v) >> 16)
+#define BOOT_TYPE_MASK          0xFF
+#define BOOT_CODEC_SHIFT        8           // v1.1: codec in type bits 15:8
+#define BOOT_MAX_SECTIONS       4
+
+// Section kinds (v2)
+#define BOOT_SECTION_KERNEL     1
+#define BOOT_SECTION_INITRD     2
+#define BOOT_SECTION_DTB        3
+
+// v1 header, followed by the kernel payload
+typedef struct {
+    uint32_t magic;
+    uint32_t version;           // 0x0001xxxx
+    uint32_t type;              // Boot type, codec
+    uint32_t load_addr;
+    uint32_t size;              // Stored payload bytes
+    uint32_t checksum;          // Byte sum of the stored payload
+} boot_header_t;
+
+// v2 header, followed by num_sections section descriptors
+typedef struct {
+    uint32_t magic;
+    uint32_t version;           // 0x0002xxxx
+    uint32_t type;              // Boot type
+    uint32_t header_size;       // This header plus the section table
+    uint32_t num_sections;
+    uint32_t table_checksum;    // Byte sum of the section table
+} boot_header_v2_t;
+
+typedef struct {
+    uint32_t kind;              // BOOT_SECTION_*
+    uint32_t codec;             // CODEC_* (decompress.h)
+    uint32_t offset;            // File offset of the stored bytes
+    uint32_t size;              // Stored (possibly compressed) bytes
+    uint32_t load_addr;         // 0 = placed by the loader
+    uint32_t checksum;          // Byte sum of the stored bytes
+} boot_section_t;
+
+// Parsed header of either version
+typedef struct {
+    uint32_t version;
+    uint32_t type;
+    uint32_t num_sections;
+    boot_section_t sections[BOOT_MAX_SECTIONS];
+} boot_image_t;
+
+// Upper bound for a decompressed image at its load address
+#define LOAD_MAX_IMAGE  0x04000000  // 64 MB
+
+// Linux zImage header (arch/arm/boot/compressed/head.S)
+#define ZIMAGE_HEADER_OFFSET    0x24
+#define ZIMAGE_MAGIC            0x016F2818
+#define ZIMAGE_TABLE_MAGIC      0x45454545  // 'table' below is valid
+#define ZIMAGE_TAG_KRNL_SIZE    0x5A534C4B  // "KLSZ": size_ptr, bss_size
+
+typedef struct {
+    uint32_t magic;             // ZIMAGE_MAGIC
+    uint32_t start;             // Link address, 0 when position independent
+    uint32_t end;               // Link address of the image end
+    uint32_t endian;            // 0x04030201
+    uint32_t table_magic;       // ZIMAGE_TABLE_MAGIC since Linux 4.15
+    uint32_t table;             // Offset of the extension tag list
+} zimage_header_t;
+
+// ELF32 identification and types accepted by the loader
+#define ELFCLASS32      1
+#define ELFDATA2LSB     1
+#define ET_EXEC         2
+#define EM_ARM          40
+#define PT_LOAD         1
+#define ELF_MAX_PHDRS   16
+
+// ELF32 file header
+typedef struct {
+    uint8_t e_ident[16];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    uint32_t e_entry;
+    uint32_t e_phoff;
+    uint32_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+} elf32_ehdr_t;
+
+// ELF32 program header
+typedef struct {
+    uint32_t p_type;
+    uint32_t p_offset;
+    uint32_t p_vaddr;
+    uint32_t p_paddr;
+    uint32_t p_filesz;
+    uint32_t p_memsz;
+    uint32_t p_flags;
+    uint32_t p_align;
+} elf32_phdr_t;
+
+// Poll hook for loads running under the boot menu: nonzero cancels
+typedef int (*loader_poll_fn)(void* ctx);
+
 // Function declarations
+int loader_probe(boot_entry_t* entry);
 int load_kernel(boot_entry_t* entry);
+void loader_set_poll(loader_poll_fn fn, void* ctx);
+int loader_prefetch(boot_entry_t* entry);
+const boot_entry_t* loader_prefetched(void);
+void loader_discard(void);
 int verify_signature(boot_entry_t* entry);
+int loader_parse_header(file_handle_t* fh, boot_image_t* img);
+uint32_t loader_checksum(uint32_t sum, const uint8_t* p, uint32_t len);
 void jump_to_kernel(uint32_t addr, uint32_t r0, uint32_t r1, uint32_t atags);
 
 #endif // LOADER_H
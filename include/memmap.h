@@ -0,0 +1,72 @@
+#ifndef MEMMAP_H
+#define MEMMAP_H
+
+#include <stdint.h>
+
+// Physical memory map: the ARM RAM found at boot (ATAG_MEM from
+// RETROS-BIOS, else the VideoCore mailbox) and the ranges reserved in
+// it. Reservations never overlap each other, so a kernel, initrd or DTB
+// can only land in RAM nothing else is using.
+#define MEMMAP_MAX_REGIONS      16
+
+// RAM assumed when neither ATAGS nor the mailbox answer: the smallest
+// ARM share of any supported board and GPU split
+#define MEMMAP_DEFAULT_RAM      0x04000000  // 64 MB
+
+// Low memory kept for the firmware: vectors, the ATAG list at 0x100 and
+// the page tables the kernel decompressor builds below its image
+#define MEMMAP_FIRMWARE_END     0x00008000
+
+// Where the RAM size came from
+#define MEMMAP_SRC_DEFAULT      0
+#define MEMMAP_SRC_ATAGS        1
+#define MEMMAP_SRC_MAILBOX      2
+
+// Placement for memmap_find() and memmap_alloc()
+#define MEMMAP_LOW              0           // Lowest free address
+#define MEMMAP_HIGH             1           // Highest free address
+
+// What a range is reserved for (names in memmap.c follow this order)
+enum {
+    MEMMAP_FIRMWARE = 0,
+    MEMMAP_BOOTLOADER,          // Code, data and BSS at the link address
+    MEMMAP_STACK,
+    MEMMAP_HEAP,
+    MEMMAP_KERNEL,
+    MEMMAP_INITRD,
+    MEMMAP_DTB,
+    MEMMAP_SCRATCH,             // Temporary buffers (benchmarks)
+    MEMMAP_TERMLINK,            // Termlink boot block for the kernel
+    MEMMAP_NUM_KINDS
+};
+
+typedef struct {
+    uint32_t base;
+    uint32_t size;
+    uint32_t kind;
+} memmap_region_t;
+
+typedef struct {
+    uint32_t ram_base;          // ARM RAM
+    uint32_t ram_size;
+    uint32_t vc_base;           // GPU share, 0 size when unknown
+    uint32_t vc_size;
+    uint32_t source;            // MEMMAP_SRC_*
+    uint32_t reserved;          // Bytes in reserved ranges
+    uint32_t largest_free;
+} memmap_info_t;
+
+// Function declarations
+int memmap_init(uint32_t atags);
+int memmap_reserve(uint32_t base, uint32_t size, uint32_t kind);
+uint32_t memmap_find(uint32_t lo, uint32_t hi, uint32_t size, uint32_t align, int where);
+uint32_t memmap_alloc(uint32_t size, uint32_t align, uint32_t kind, int where);
+void memmap_release(uint32_t kind);
+const memmap_region_t* memmap_overlap(uint32_t base, uint32_t size);
+uint32_t memmap_copy(memmap_region_t* out, uint32_t max);
+uint32_t memmap_free_span(uint32_t base);
+void memmap_get_info(memmap_info_t* info);
+const char* memmap_kind_name(uint32_t kind);
+void memmap_show(void);
+
+#endif // MEMMAP_H
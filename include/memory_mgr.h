@@ -4,16 +4,51 @@
 #include <stdint.h>
 #include <stddef.h>
 
-// Memory regions
-#define MEM_LOWER_START     0x00000000
-#define MEM_KERNEL_START    0x00008000
-#define MEM_UPPER_START     0x00100000
+// Heap: the UPPERMEM_SIZE pool in the bootloader image, then a block
+// of RAM from the top of the memory map (memmap.h), an eighth of the
+// ARM's RAM within these bounds. memmap_init() has to run first.
+#define MEM_HEAP_MIN        0x00400000  // 4 MB
+#define MEM_HEAP_MAX        0x04000000  // 64 MB
+#define MEM_HEAP_ALIGN      0x00100000
+#define MEM_MAX_REGIONS     4
+
+// Small objects come from per-class slabs; larger requests are
+// best-fit blocks that coalesce when freed
+#define MEM_NUM_CLASSES     6           // 16, 32, ... 512 bytes
+#define MEM_SMALL_MAX       512
+
+// Arenas: each allocation is tagged with the current arena, and
+// memory_arena_reset() frees everything in one arena at once
+#define MEM_ARENA_SYSTEM    0           // Lives until the kernel jump
+#define MEM_ARENA_BOOT      1           // One boot attempt
+#define MEM_MAX_ARENAS      4
+
+typedef struct {
+    uint32_t total;             // Heap bytes over all regions
+    uint32_t used;              // Live allocations, headers included
+    uint32_t peak;              // High-water mark of 'used'
+    uint32_t free;              // Bytes in free blocks
+    uint32_t free_blocks;
+    uint32_t largest_free;
+    uint32_t slab_bytes;        // Blocks carved into small objects
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t failures;          // Requests that returned NULL
+    uint32_t class_live[MEM_NUM_CLASSES];
+    uint32_t class_peak[MEM_NUM_CLASSES];
+    uint32_t arena_used[MEM_MAX_ARENAS];
+    uint32_t arena_peak[MEM_MAX_ARENAS];
+} mem_stats_t;
 
 // Function declarations
-void memory_init(void);
-void* memory_allocate_upper(size_t size);
-void memory_free_upper(void* ptr);
+int memory_init(void);
+int memory_add_region(void* base, size_t size);
 void* memory_alloc(size_t size);
 void memory_free(void* ptr);
+int memory_arena_enter(int arena);
+void memory_arena_reset(int arena);
+void memory_get_stats(mem_stats_t* st);
+uint32_t memory_class_size(int cls);
+void* memory_upper_base(void);
 
 #endif // MEMORY_MGR_H
@@ -24,12 +24,19 @@ typedef enum {
 typedef struct {
     char name[32];
     char path[256];
+    char initrd_path[256];      // Separate initial ramdisk, "" if none
     uint32_t load_addr;
     uint32_t size;
     uint8_t signature[64];
     boot_type_t type;
 } boot_entry_t;
 
+// Skip cosmetic pauses (FAST_BOOT build option)
+extern int fast_boot;
+
+// r2 from RETROS-BIOS: its ATAG list or device tree (0 if neither)
+extern uint32_t boot_tags;
+
 // GPIO pins
 #define BOOT_MENU_PIN 17
 
@@ -39,19 +46,24 @@ void enter_emergency_mode(void);
 void enter_maintenance_mode(void);
 boot_entry_t* scan_boot_devices(void);
 int count_boot_entries(boot_entry_t* entries);
-void display_boot_menu(boot_entry_t* entries);
+void display_boot_menu(boot_entry_t* entries, uint32_t timeout);
 void boot_selected(boot_entry_t* entry);
+int boot_prefetch(boot_entry_t* entry, int (*poll)(void* ctx), void* ctx);
+void boot_discard_prefetch(void);
 void auto_boot_primary(void);
 int check_holotape_present(void);
 void load_holotape_boot(void);
 uint32_t get_boot_count(void);
+void boot_pause_ms(uint32_t ms);
 
 // Standard library replacements
 void* memset(void* s, int c, size_t n);
 void* memcpy(void* dest, const void* src, size_t n);
+void* memmove(void* dest, const void* src, size_t n);
 int memcmp(const void* s1, const void* s2, size_t n);
 size_t strlen(const char* s);
 char* strcpy(char* dest, const char* src);
 int strcmp(const char* s1, const char* s2);
+uint32_t crc32(uint32_t crc, const void* data, size_t len);
 
 #endif // MFBOOT_H
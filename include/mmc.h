@@ -0,0 +1,17 @@
+#ifndef MMC_H
+#define MMC_H
+
+#include <stdint.h>
+
+// SD/MMC block size (SDHC/SDXC fixed, SDSC configured to match)
+#define MMC_BLOCK_SIZE 512
+
+// Function declarations
+int mmc_init(void);
+int mmc_read_block(uint32_t block, void* buffer);
+int mmc_read_blocks(uint32_t lba, uint32_t count, void* buffer);
+int mmc_read_start(uint32_t lba, uint32_t count, void* buffer);
+int mmc_read_finish(void);
+int mmc_write_block(uint32_t block, const void* buffer);
+
+#endif // MMC_H
@@ -1,7 +1,9 @@
 #ifndef PROTOCOLS_H
 #define PROTOCOLS_H
 
+#ifndef __ASSEMBLER__
 #include <stdint.h>
+#endif
 
 // Boot protocol types
 #define PROTOCOL_LINUX_ARM  0x01
@@ -19,6 +21,8 @@
 #define ATAG_VIDEOLFB   0x54410008
 #define ATAG_CMDLINE    0x54410009
 
+#ifndef __ASSEMBLER__
+
 typedef struct {
     uint32_t size;
     uint32_t tag;
@@ -39,26 +43,69 @@ typedef struct {
     char cmdline[1];
 } atag_cmdline_t;
 
+typedef struct {
+    uint32_t start;
+    uint32_t size;
+} atag_initrd2_t;
+
+typedef struct {
+    uint32_t rev;
+} atag_revision_t;
+
 typedef struct {
     atag_header_t hdr;
     union {
         atag_core_t core;
         atag_mem_t mem;
         atag_cmdline_t cmdline;
+        atag_initrd2_t initrd2;
+        atag_revision_t revision;
     } u;
 } atag_t;
 
+#endif // __ASSEMBLER__
+
+// The ATAG list handed to the kernel sits where firmware puts it, below
+// the spin loop of parked cores (SMP_PARK_ADDR) and the page tables the
+// decompressor builds at 0x4000
+#define ATAGS_ADDR          0x00000100
+#define ATAGS_MAX_SIZE      0x00000E00
+
+// Machine types for an ATAGS boot; a DTB boot passes ~0 in r1
+#ifdef BCM2835
+#define MACH_TYPE_RPI       3138        // BCM2708
+#else
+#define MACH_TYPE_RPI       3139        // BCM2709
+#endif
+#define MACH_TYPE_DT        0xFFFFFFFF
+
+// Used when neither RETROS-BIOS nor the boot image DTB has a command line
+#define BOOT_DEFAULT_CMDLINE "console=ttyAMA0,115200 root=/dev/mmcblk0p2 rootwait"
+#define BOOT_CMDLINE_MAX    1024        // Linux COMMAND_LINE_SIZE on ARM
+
+#ifndef __ASSEMBLER__
+
 // Boot parameter structure
 typedef struct {
+    uint32_t protocol;          // PROTOCOL_*, from boot.protocol
     uint32_t machine_type;
     uint32_t boot_device;
-    char cmdline[256];
+    char cmdline[BOOT_CMDLINE_MAX];     // From the firmware, empty for the default
     uint32_t initrd_start;
     uint32_t initrd_size;
+    uint32_t mem_start;
+    uint32_t mem_size;
+    uint32_t revision;          // Board revision, 0 if unknown
+    uint32_t dtb;               // Device tree for the kernel, 0 for ATAGS
+    uint32_t dtb_size;          // Its buffer: the tree plus edit slack
 } boot_params_t;
 
 // Function declarations
-void setup_boot_params(boot_params_t* params);
-atag_t* create_atags(uint32_t mem_size, const char* cmdline);
+const void* firmware_fdt(uint32_t firmware_tags);
+void setup_boot_params(boot_params_t* params, uint32_t firmware_tags);
+uint32_t create_atags(const boot_params_t* params);
+int setup_fdt(void* fdt, const boot_params_t* params);
+
+#endif // __ASSEMBLER__
 
 #endif // PROTOCOLS_H
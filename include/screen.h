@@ -0,0 +1,17 @@
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include <stdint.h>
+
+// Rows the model tracks, and bytes of one row (a box-drawing character
+// takes three)
+#define SCREEN_ROWS         24
+#define SCREEN_LINE_MAX     128
+
+// Function declarations
+void screen_invalidate(void);
+void screen_begin(void);
+void screen_printf(int row, uint8_t color, const char* fmt, ...);
+void screen_end(void);
+
+#endif // SCREEN_H
@@ -0,0 +1,45 @@
+#ifndef SMP_H
+#define SMP_H
+
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+#endif
+
+// Secondary cores as workers for core 0 (BCM2836/BCM2837). Claiming a
+// job uses exclusive loads and stores, which need cacheable memory, so
+// builds without the MMU stay on one core like BCM2835.
+#if (defined(BCM2836) || defined(BCM2837)) && defined(ENABLE_MMU)
+#define SMP_ENABLED
+#endif
+
+#define SMP_MAX_CORES           4
+#define SMP_STACK_SHIFT         14          // 16 KB stack per secondary core
+#define SMP_STACK_SIZE          (1 << SMP_STACK_SHIFT)
+#define SMP_QUEUE_SIZE          16          // Jobs in flight, power of two
+#define SMP_START_TIMEOUT_US    10000
+
+// Mailboxes: cores wait for a start address in their mailbox 3 (the
+// firmware stub and Linux use the same one), and a parked core sets its
+// bit in core 0's mailbox 1
+#define SMP_START_MAILBOX       3
+#define SMP_PARK_MAILBOX        1
+
+// Spin loop the parked cores wait in for the kernel: the end of the
+// first page, which the firmware device tree reserves for its own stub,
+// past the ATAG list (ATAGS_MAX_SIZE)
+#define SMP_PARK_ADDR           0x00000F00
+
+#ifndef __ASSEMBLER__
+
+typedef void (*smp_job_fn)(void* arg);
+
+// Function declarations
+int smp_init(void);
+uint32_t smp_submit(smp_job_fn fn, void* arg);
+void smp_wait(uint32_t ticket);
+void smp_park(void);
+void smp_worker(uint32_t core);
+
+#endif // __ASSEMBLER__
+
+#endif // SMP_H
@@ -4,18 +4,40 @@
 #include <stdint.h>
 #include <stdarg.h>
 
-// Terminal colors (VGA-style)
+// Terminal colors, in ANSI order (term_set_color() sends SGR codes)
 #define COLOR_BLACK     0
+#define COLOR_RED       1
 #define COLOR_GREEN     2
 #define COLOR_AMBER     3
 #define COLOR_WHITE     7
 
+// Transmit ring for term_print() output, power of two
+#define TERM_TX_RING_SIZE   0x1000
+
+// A console that mirrors the UART: write() is handed every run of output
+// and update() is called wherever the UART is pumped, with 'force' set
+// when everything printed must be shown (term_flush())
+typedef struct {
+    void (*write)(const char* s, uint32_t len);
+    void (*update)(int force);
+} term_console_t;
+
+#define TERM_MAX_CONSOLES   2
+
 // Function declarations
 void terminal_init(void);
+int term_buffer_init(void);
+int term_add_console(const term_console_t* con);
+void term_pump(void);
+void term_flush(void);
 void term_clear(void);
+void term_putc(char c);
 void term_print(const char* str);
 void term_printf(const char* fmt, ...);
 void term_set_color(uint8_t color);
+void term_set_muted(int muted);
+uint32_t term_output_count(void);
+int term_poll_key(void);
 char wait_for_key(void);
 
 // Key codes
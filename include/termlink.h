@@ -13,6 +13,10 @@
 #define TERM_CAP_AUDIO      (1 << 2)
 #define TERM_CAP_GPIO       (1 << 3)
 
+// Framebuffer pixel order, as the VideoCore mailbox reports it
+#define TERMLINK_FB_BGR     0
+#define TERMLINK_FB_RGB     1
+
 // Terminal state structure
 typedef struct {
     uint32_t magic;
@@ -24,10 +28,77 @@ typedef struct {
     uint32_t fb_pitch;
     uint32_t fb_depth;
     uint32_t peripheral_base;
+    uint32_t fb_pixel_order;    // TERMLINK_FB_BGR or TERMLINK_FB_RGB
 } termlink_info_t;
 
+// Boot block of the Termlink protocol (boot.protocol = termlink). The
+// kernel gets its address in r0: termlink_info_t, then termlink_boot_t,
+// then the tables the boot block points at, in a reserved range at the
+// top of RAM. A kernel that finds the magics and a matching checksum
+// can skip probing the terminal, RAM and boot device itself.
+#define TERMLINK_BOOT_MAGIC     0x4B4E4C54  // "TLNK"
+#define TERMLINK_BOOT_VERSION   1
+#define TERMLINK_BLOCK_ALIGN    0x1000      // Whole pages, for the kernel to keep
+
+// Boot devices
+#define TERMLINK_DEV_SDCARD     0
+#define TERMLINK_DEV_USB        1
+#define TERMLINK_DEV_NETWORK    2
+#define TERMLINK_DEV_HOLOTAPE   3
+
+// State of the image digest
+#define TERMLINK_HASH_NONE      0           // Unsigned image, no digest
+#define TERMLINK_HASH_VERIFIED  1           // Signature checked against a trusted key
+#define TERMLINK_HASH_FAILED    2           // Signature did not verify (booted anyway)
+
+// Extended boot block. Offsets are from the start of termlink_info_t;
+// the tables are memmap_region_t (memmap.h) and trace_entry_t (trace.h).
+typedef struct {
+    uint32_t magic;             // TERMLINK_BOOT_MAGIC
+    uint32_t version;           // TERMLINK_BOOT_VERSION
+    uint32_t size;              // Bytes from termlink_info_t to the last table's end
+    uint32_t checksum;          // CRC-32 of those bytes, with this field 0
+
+    // Boot device and image
+    uint32_t boot_device;       // TERMLINK_DEV_*
+    uint32_t boot_type;         // boot_type_t
+    uint32_t entry_point;
+    uint32_t image_size;        // Bytes of the image file
+    char name[32];
+    char path[256];
+    uint32_t hash_state;        // TERMLINK_HASH_*
+    uint8_t sha256[32];         // Digest of the signed bytes
+
+    // Kernel parameters, as also passed in r1/r2
+    uint32_t machine_type;      // r1
+    uint32_t boot_tags;         // r2: ATAG list or device tree
+    uint32_t revision;          // Board revision, 0 if unknown
+    uint32_t initrd_start;
+    uint32_t initrd_size;
+
+    // Memory: ARM RAM, the GPU share and the ranges reserved in RAM,
+    // this block included
+    uint32_t ram_base;
+    uint32_t ram_size;
+    uint32_t vc_base;
+    uint32_t vc_size;
+    uint32_t mem_offset;
+    uint32_t mem_count;
+    uint32_t mem_entry_size;
+
+    // Timing, TIMER_CLO microseconds: stage2.S entry, the block being
+    // written just before the jump, and the boot trace up to then
+    uint32_t stage2_time;
+    uint32_t handoff_time;
+    uint32_t load_us;           // Reading, decompressing and hashing the image
+    uint32_t trace_offset;
+    uint32_t trace_count;
+    uint32_t trace_entry_size;
+    uint32_t trace_lost;        // Oldest events the ring overwrote
+} termlink_boot_t;
+
 // Function declarations
 void termlink_init(termlink_info_t* info);
-void termlink_handoff(termlink_info_t* info);
+uint32_t termlink_handoff(termlink_boot_t* boot);
 
 #endif // TERMLINK_H
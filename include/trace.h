@@ -0,0 +1,76 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// Boot-phase trace: timestamped events in a ring carved from upper
+// memory. Built with TRACE=0 the TRACE_* macros compile to nothing.
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE         512     // Entries, power of two
+#endif
+
+// Binary dump framing (tools/trace_view.py)
+#define TRACE_DUMP_MAGIC        0x5254464D  // "MFTR"
+#define TRACE_DUMP_VERSION      1
+
+// Event phases
+#define TRACE_PHASE_BEGIN       0
+#define TRACE_PHASE_END         1
+#define TRACE_PHASE_MARK        2
+
+// Events (names in trace.c and tools/trace_view.py follow this order)
+enum {
+    TRACE_STAGE2 = 0,           // Mark: stage2.S entry
+    TRACE_MMU,                  // Mark: MMU and caches on
+    TRACE_MEMORY_INIT,
+    TRACE_BCACHE_INIT,
+    TRACE_FS_INIT,
+    TRACE_SCAN,                 // scan_boot_devices()
+    TRACE_FS_EXISTS,            // End arg: 1 if found
+    TRACE_PROBE,                // loader_probe()
+    TRACE_MENU,                 // Mark: boot menu or auto-boot
+    TRACE_LOAD,                 // load_kernel()
+    TRACE_READ,                 // Synchronous extent read, arg: sectors
+    TRACE_READ_ASYNC,           // Background extent read, arg: sectors
+    TRACE_DECOMPRESS,           // End arg: output bytes
+    TRACE_VERIFY,               // Signature check, end arg: result
+    TRACE_JUMP,                 // Mark: arg is the entry point
+    TRACE_NUM_EVENTS
+};
+
+typedef struct {
+    uint32_t time;              // TIMER_CLO, microseconds
+    uint8_t event;
+    uint8_t phase;
+    uint16_t reserved;
+    uint32_t arg;
+} trace_entry_t;
+
+#ifdef ENABLE_TRACE
+
+void trace_init(void);
+void trace_record_at(uint32_t time, uint32_t event, uint32_t phase, uint32_t arg);
+void trace_record(uint32_t event, uint32_t phase, uint32_t arg);
+
+#define TRACE_BEGIN(ev, arg)    trace_record((ev), TRACE_PHASE_BEGIN, (arg))
+#define TRACE_END(ev, arg)      trace_record((ev), TRACE_PHASE_END, (arg))
+#define TRACE_MARK(ev, arg)     trace_record((ev), TRACE_PHASE_MARK, (arg))
+
+#else
+
+#define trace_init()                        do { } while (0)
+#define trace_record_at(t, ev, phase, arg)  do { (void)(t); } while (0)
+
+#define TRACE_BEGIN(ev, arg)    do { } while (0)
+#define TRACE_END(ev, arg)      do { } while (0)
+#define TRACE_MARK(ev, arg)     do { } while (0)
+
+#endif // ENABLE_TRACE
+
+// Maintenance screen, UART dump (report tracing is off when disabled)
+// and a copy of the ring for the kernel (none when disabled)
+void trace_show(void);
+void trace_dump_uart(void);
+uint32_t trace_copy(trace_entry_t* out, uint32_t max, uint32_t* lost);
+
+#endif // TRACE_H
@@ -0,0 +1,446 @@
+// payloads/benchmark.c - Boot path microbenchmarks
+//
+// Times the hot paths of a boot: the utils.c string routines, term_printf
+// formatting, drawing boot log lines on the framebuffer console, FAT path
+// lookup, fs_read from the card, the image checksum, SHA-256, the kernel
+// decompressors and reading the configuration. Each case is repeated until a
+// sample takes BENCH_MIN_US and the best of BENCH_SAMPLES samples is
+// reported, one machine-readable line per case:
+//
+//   BENCH <name> iters=<n> us=<best> ns_op=<n> cycles_op=<n> mbps=<n.n> cpb=<n.nn>
+//
+// tools/bench_check.py compares a capture of these lines against a
+// baseline. Runs from the maintenance menu, or on the host with
+// `mfboot-host --bench`.
+
+#include "mfboot.h"
+#include "terminal.h"
+#include "hardware.h"
+#include "filesystem.h"
+#include "loader.h"
+#include "decompress.h"
+#include "crypto.h"
+#include "memmap.h"
+#include "config.h"
+#include "format.h"
+#include "fbcon.h"
+
+#define BENCH_MIN_US        20000
+#define BENCH_SAMPLES       5
+#define BENCH_MAX_ITERS     (1u << 24)
+
+// Scratch RAM reserved in the memory map for the run
+#define BENCH_BUF_SIZE      0x00200000  // Two 1 MB working buffers
+#define BENCH_FILE_MAX      0x02000000  // Whole boot image
+#define BENCH_OUT_MAX       0x02000000  // Decompressed kernel
+
+#define BENCH_COPY_SIZE     0x10000     // memcpy/memset/memcmp
+#define BENCH_HASH_SIZE     0x100000    // checksum/SHA-256
+#define BENCH_CHUNK_SIZE    0x8000      // As the loader streams the card
+
+// Boot images to read and decompress, as scan_boot_devices() names them
+static const char* const bench_files[] = { "/boot/uos.img", "/boot/pipos.img" };
+
+typedef int (*bench_fn_t)(uint32_t iters);
+
+static uint8_t* buf_a;
+static uint8_t* buf_b;
+static uint8_t* file_buf;
+static uint8_t* out_buf;
+static const char* file_path;
+static uint32_t file_size;
+static const uint8_t* comp_data;
+static uint32_t comp_size;
+static int comp_codec;
+static uint32_t comp_out;
+static char* conf_text;         // Both text files, each with a spare byte
+static char* conf_work;
+static uint32_t conf_len[2];
+static const void* conf_blob;
+static uint32_t conf_blob_size;
+static char fb_lines[2][64];    // Boot log lines, alternated so each draws
+static uint32_t fb_line_len[2];
+
+static int bench_memcpy_aligned(uint32_t iters) {
+    while (iters--) {
+        memcpy(buf_b, buf_a, BENCH_COPY_SIZE);
+    }
+    return 0;
+}
+
+static int bench_memcpy_unaligned(uint32_t iters) {
+    while (iters--) {
+        memcpy(buf_b + 1, buf_a + 3, BENCH_COPY_SIZE);
+    }
+    return 0;
+}
+
+static int bench_memset(uint32_t iters) {
+    while (iters--) {
+        memset(buf_b, (int)iters, BENCH_COPY_SIZE);
+    }
+    return 0;
+}
+
+static int bench_memcmp(uint32_t iters) {
+    memcpy(buf_b, buf_a, BENCH_COPY_SIZE);
+    while (iters--) {
+        if (memcmp(buf_a, buf_b, BENCH_COPY_SIZE) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int bench_printf(uint32_t iters) {
+    term_set_muted(1);
+    while (iters--) {
+        term_printf("Loading %s: %d bytes at 0x%08X (%x)\n", file_path, iters, iters, iters);
+    }
+    term_set_muted(0);
+    return 0;
+}
+
+// One boot log line drawn in place, as soon as it is printed
+static int bench_fbcon_line(uint32_t iters) {
+    while (iters--) {
+        fbcon_write("\r", 1);
+        fbcon_write(fb_lines[iters & 1], fb_line_len[iters & 1]);
+        fbcon_update(1);
+    }
+    return 0;
+}
+
+// A line at the bottom of a full screen, scrolling it, drawn at once
+static int bench_fbcon_scroll(uint32_t iters) {
+    while (iters--) {
+        fbcon_write("\n", 1);
+        fbcon_write(fb_lines[iters & 1], fb_line_len[iters & 1]);
+        fbcon_update(1);
+    }
+    return 0;
+}
+
+static int bench_fs_lookup(uint32_t iters) {
+    while (iters--) {
+        if (!fs_exists(file_path)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int bench_fs_read(uint32_t iters) {
+    while (iters--) {
+        file_handle_t* fh = fs_open(file_path);
+        if (!fh) {
+            return -1;
+        }
+        uint8_t* dest = file_buf;
+        int n;
+        while ((n = fs_read(fh, dest, BENCH_CHUNK_SIZE)) > 0) {
+            dest += n;
+        }
+        fs_close(fh);
+        if (n < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int bench_checksum(uint32_t iters) {
+    volatile uint32_t sum = 0;
+    while (iters--) {
+        sum = loader_checksum(sum, buf_a, BENCH_HASH_SIZE);
+    }
+    return 0;
+}
+
+static int bench_sha256(uint32_t iters) {
+    sha256_ctx_t ctx;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+
+    while (iters--) {
+        sha256_init(&ctx);
+        for (uint32_t off = 0; off < BENCH_HASH_SIZE; off += BENCH_CHUNK_SIZE) {
+            sha256_update(&ctx, buf_a + off, BENCH_CHUNK_SIZE);
+        }
+        sha256_final(&ctx, digest);
+    }
+    return 0;
+}
+
+// The whole stream is in memory
+static int end_of_input(decomp_src_t* src) {
+    (void)src;
+    return -1;
+}
+
+static int bench_decompress(uint32_t iters) {
+    while (iters--) {
+        decomp_src_t src = { comp_data, comp_data + comp_size, end_of_input, NULL };
+        if (decomp_run(comp_codec, &src, out_buf, BENCH_OUT_MAX) !=
+            (int)comp_out) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// The text files as config_load() parses them, from a fresh copy each
+// time since the parse writes into its buffer
+static int bench_config_parse(uint32_t iters) {
+    config_t cfg;
+
+    while (iters--) {
+        config_defaults(&cfg);
+        memcpy(conf_work, conf_text, conf_len[0] + conf_len[1] + 2);
+        char* text = conf_work;
+        for (int i = 0; i < 2; i++) {
+            if (config_parse(&cfg, text, conf_len[i], NULL) != 0) {
+                return -1;
+            }
+            text += conf_len[i] + 1;
+        }
+    }
+    return 0;
+}
+
+static int bench_config_blob(uint32_t iters) {
+    config_t cfg;
+
+    while (iters--) {
+        config_defaults(&cfg);
+        if (config_load_blob(&cfg, conf_blob, conf_blob_size) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Decimal with 'digits' fixed fraction digits, value scaled by 10^digits
+static void print_fixed(uint64_t scaled, int digits) {
+    uint32_t div = digits == 1 ? 10 : 100;
+    term_printf("%u.%0*u", (uint32_t)(scaled / div), digits, (uint32_t)(scaled % div));
+}
+
+// Calibrate, then report the best of BENCH_SAMPLES runs. 'bytes' is the
+// data processed per iteration; 0 reports latency only.
+static void bench_run(const char* name, uint32_t bytes, bench_fn_t fn) {
+    uint32_t iters = 1;
+    uint32_t us;
+
+    // Double the iteration count until one sample is long enough to time
+    for (;;) {
+        uint32_t t0 = get_timer_count();
+        if (fn(iters) != 0) {
+            term_printf("BENCH %s FAILED\n", name);
+            return;
+        }
+        us = get_timer_count() - t0;
+        if (us >= BENCH_MIN_US || iters >= BENCH_MAX_ITERS) {
+            break;
+        }
+        iters *= 2;
+    }
+
+    uint32_t best_us = us;
+    uint32_t best_cycles = 0;
+    for (int s = 0; s < BENCH_SAMPLES; s++) {
+        uint32_t t0 = get_timer_count();
+        uint32_t c0 = get_cycle_count();
+        fn(iters);
+        uint32_t cycles = get_cycle_count() - c0;
+        us = get_timer_count() - t0;
+        if (s == 0 || us < best_us) {
+            best_us = us;
+            best_cycles = cycles;
+        }
+    }
+    if (best_us == 0) {
+        best_us = 1;
+    }
+
+    uint64_t total = (uint64_t)bytes * iters;
+    term_printf("BENCH %s iters=%d us=%d ns_op=%d cycles_op=%d", name, iters, best_us,
+                (uint32_t)((uint64_t)best_us * 1000 / iters), best_cycles / iters);
+    if (bytes) {
+        // bytes per microsecond is MB/s
+        term_print(" mbps=");
+        print_fixed(total * 10 / best_us, 1);
+        term_print(" cpb=");
+        print_fixed((uint64_t)best_cycles * 100 / total, 2);
+    }
+    term_print("\n");
+}
+
+// Read a boot image into scratch RAM and locate its kernel payload
+static int bench_load_file(const char* path) {
+    boot_image_t img;
+
+    file_handle_t* fh = fs_open(path);
+    if (!fh) {
+        return -1;
+    }
+    file_path = path;
+    file_size = fh->size;
+    comp_codec = CODEC_NONE;
+
+    int rc = -1;
+    if (file_size <= BENCH_FILE_MAX &&
+        fs_read(fh, file_buf, file_size) == (int)file_size) {
+        rc = 0;
+        if (fs_seek(fh, 0) == 0 && loader_parse_header(fh, &img) > 0) {
+            for (uint32_t i = 0; i < img.num_sections; i++) {
+                const boot_section_t* sec = &img.sections[i];
+                if (sec->kind == BOOT_SECTION_KERNEL) {
+                    comp_codec = (int)sec->codec;
+                    comp_data = file_buf + sec->offset;
+                    comp_size = sec->size;
+                }
+            }
+        }
+    }
+    fs_close(fh);
+    return rc;
+}
+
+// Whole file into 'dest'; its size, or -1
+static int bench_read_small(const char* path, void* dest, uint32_t max) {
+    file_handle_t* fh = fs_open(path);
+    if (!fh) {
+        return -1;
+    }
+    int n = fh->size <= max ? fs_read(fh, dest, fh->size) : -1;
+    fs_close(fh);
+    return n;
+}
+
+// Parse the configuration the card has, text and precompiled
+static void bench_config(void) {
+    conf_text = (char*)out_buf;
+    conf_work = conf_text + CONFIG_BUF_SIZE;
+    conf_blob = conf_work + CONFIG_BUF_SIZE;
+
+    int menu = bench_read_small(CONFIG_MENU_PATH, conf_text, CONFIG_BUF_SIZE / 2 - 1);
+    int devices = bench_read_small(CONFIG_DEVICES_PATH, conf_text + (menu > 0 ? menu : 0) + 1,
+                                   CONFIG_BUF_SIZE / 2 - 1);
+    if (menu > 0 && devices > 0) {
+        conf_len[0] = (uint32_t)menu;
+        conf_len[1] = (uint32_t)devices;
+        bench_run("config_parse", conf_len[0] + conf_len[1], bench_config_parse);
+    } else {
+        term_print("No " CONFIG_MENU_PATH " and " CONFIG_DEVICES_PATH ", skipping config_parse\n");
+    }
+
+    int blob = bench_read_small(CONFIG_BLOB_PATH, (void*)conf_blob, CONFIG_BUF_SIZE);
+    if (blob > 0) {
+        conf_blob_size = (uint32_t)blob;
+        bench_run("config_blob", conf_blob_size, bench_config_blob);
+    } else {
+        term_print("No " CONFIG_BLOB_PATH ", skipping config_blob\n");
+    }
+}
+
+// Draw boot log lines on the framebuffer console: one line, then a full
+// screen scrolling, each line shown before the next is printed (the
+// console normally batches them). The screen is cleared afterwards.
+static void bench_fbcon(void) {
+    if (!fbcon_active()) {
+        term_print("No framebuffer console, skipping fbcon\n");
+        return;
+    }
+    fb_line_len[0] = (uint32_t)format_snprintf(fb_lines[0], sizeof(fb_lines[0]),
+                                               "Loading %s: %u bytes at 0x%08X",
+                                               bench_files[0], 3000000u, KERNEL_LOAD_ADDR);
+    fb_line_len[1] = (uint32_t)format_snprintf(fb_lines[1], sizeof(fb_lines[1]),
+                                               "Kernel loaded successfully");
+
+    term_flush();
+    fbcon_write("\033[2J\033[H", 7);
+    bench_run("fbcon_line", 0, bench_fbcon_line);
+    for (int i = 0; i < 256; i++) {
+        fbcon_write("\n", 1);
+        fbcon_write(fb_lines[i & 1], fb_line_len[i & 1]);
+    }
+    bench_run("fbcon_scroll", 0, bench_fbcon_scroll);
+    fbcon_write("\033[2J\033[H", 7);
+    fbcon_update(1);
+}
+
+// Time decompressing the current image's kernel, once per codec
+static void bench_kernel(uint32_t* codecs_done) {
+    if (comp_codec != CODEC_LZ4 && comp_codec != CODEC_GZIP) {
+        return;
+    }
+    if (*codecs_done & (1u << comp_codec)) {
+        return;
+    }
+    *codecs_done |= 1u << comp_codec;
+
+    decomp_src_t src = { comp_data, comp_data + comp_size, end_of_input, NULL };
+    int out = decomp_run(comp_codec, &src, out_buf, BENCH_OUT_MAX);
+    if (out <= 0) {
+        term_printf("%s: kernel does not decompress\n", file_path);
+        return;
+    }
+    comp_out = (uint32_t)out;
+    bench_run(comp_codec == CODEC_LZ4 ? "decompress_lz4" : "decompress_gzip",
+              comp_out, bench_decompress);
+}
+
+void run_benchmarks(void) {
+    uint32_t codecs_done = 0;
+    int found = 0;
+
+    term_print("Boot Path Benchmarks:\n");
+    term_print("─────────────────────────────────────\n");
+
+    uint32_t bufs = memmap_alloc(BENCH_BUF_SIZE, 0x1000, MEMMAP_SCRATCH, MEMMAP_LOW);
+    uint32_t file = memmap_alloc(BENCH_FILE_MAX, 0x1000, MEMMAP_SCRATCH, MEMMAP_LOW);
+    uint32_t out = memmap_alloc(BENCH_OUT_MAX, 0x1000, MEMMAP_SCRATCH, MEMMAP_LOW);
+    if (!bufs || !file || !out) {
+        term_print("Not enough free RAM for the benchmark buffers\n");
+        memmap_release(MEMMAP_SCRATCH);
+        return;
+    }
+
+    cycle_counter_init();
+    buf_a = PHYS_PTR(bufs);
+    buf_b = buf_a + BENCH_HASH_SIZE;
+    file_buf = PHYS_PTR(file);
+    out_buf = PHYS_PTR(out);
+    for (uint32_t i = 0; i < BENCH_HASH_SIZE; i++) {
+        buf_a[i] = (uint8_t)(i * 7 + (i >> 11));
+    }
+
+    bench_run("memcpy_aligned", BENCH_COPY_SIZE, bench_memcpy_aligned);
+    bench_run("memcpy_unaligned", BENCH_COPY_SIZE, bench_memcpy_unaligned);
+    bench_run("memset", BENCH_COPY_SIZE, bench_memset);
+    bench_run("memcmp", BENCH_COPY_SIZE, bench_memcmp);
+    bench_run("checksum", BENCH_HASH_SIZE, bench_checksum);
+    bench_run("sha256", BENCH_HASH_SIZE, bench_sha256);
+
+    file_path = bench_files[0];
+    bench_run("printf", 0, bench_printf);
+    bench_fbcon();
+    bench_config();
+
+    // Filesystem cases use the first image; every compressed kernel
+    // found times its codec
+    for (uint32_t i = 0; i < sizeof(bench_files) / sizeof(bench_files[0]); i++) {
+        if (bench_load_file(bench_files[i]) != 0) {
+            continue;
+        }
+        if (!found++) {
+            bench_run("fs_lookup", 0, bench_fs_lookup);
+            bench_run("fs_read", file_size, bench_fs_read);
+        }
+        bench_kernel(&codecs_done);
+    }
+    if (!found) {
+        term_print("No boot image found, skipping filesystem and decompression\n");
+    }
+    memmap_release(MEMMAP_SCRATCH);
+}
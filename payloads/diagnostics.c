@@ -3,6 +3,7 @@
 #include "mfboot.h"
 #include "terminal.h"
 #include "hardware.h"
+#include "memory_mgr.h"
 
 void run_diagnostics(void) {
     term_clear();
@@ -20,13 +21,16 @@ void run_diagnostics(void) {
     // Test 2: Memory
     term_print("[2/5] Memory Test... ");
     uint32_t test_val = 0xDEADBEEF;
-    volatile uint32_t* mem = (volatile uint32_t*)0x00100000;
-    *mem = test_val;
-    if (*mem == test_val) {
+    volatile uint32_t* mem = memory_alloc(sizeof(uint32_t));
+    if (mem) {
+        *mem = test_val;
+    }
+    if (mem && *mem == test_val) {
         term_print("PASS\n");
     } else {
         term_print("FAIL\n");
     }
+    memory_free((void*)mem);
     
     // Test 3: Timer
     term_print("[3/5] System Timer Test... ");
@@ -42,6 +46,7 @@ void run_diagnostics(void) {
     
     // Test 4: UART
     term_print("[4/5] UART Test... ");
+    term_flush();
     uart_putc('X');
     delay_ms(100);
     term_print("PASS\n");
@@ -26,6 +26,7 @@ void emergency_reboot(void) {
     
     // Trigger watchdog or reset
     // For now, just halt
+    term_flush();
     while (1) {
         __asm__ volatile("wfe");
     }
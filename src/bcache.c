@@ -0,0 +1,196 @@
+// src/bcache.c - Block cache with sequential read-ahead
+//
+// Set-associative cache of 512-byte blocks allocated from the heap.
+// Metadata reads (BPB, FAT sectors, directory clusters, partial data
+// sectors) go through bcache_get(); bulk file data bypasses the cache
+// since it is read exactly once. A miss that continues the previous
+// miss run doubles the read-ahead window, so FAT and directory walks
+// turn into a few multi-block requests.
+
+#include "bcache.h"
+#include "mfboot.h"
+#include "memory_mgr.h"
+#include "mmc.h"
+
+#define LBA_INVALID         0xFFFFFFFF
+
+// Per-slot metadata
+typedef struct {
+    uint32_t lba;
+    uint32_t age;               // Last-use tick for LRU within a set
+    uint8_t readahead;          // Filled ahead of use and not yet touched
+} bcache_slot_t;
+
+static bcache_slot_t* slots;
+static uint8_t* data;           // sets * ways blocks
+static uint8_t* staging;        // Read-ahead landing area
+static uint32_t num_sets;       // Power of two
+static uint32_t tick;
+static uint32_t next_seq_lba = LBA_INVALID;
+static uint32_t ra_window = 1;
+static bcache_stats_t stats;
+
+// Used when no cache could be allocated
+static uint8_t fallback_block[BCACHE_BLOCK_SIZE] __attribute__((aligned(64)));
+
+static inline uint8_t* slot_data(uint32_t index) {
+    return &data[index * BCACHE_BLOCK_SIZE];
+}
+
+static int lookup(uint32_t lba) {
+    uint32_t base = (lba & (num_sets - 1)) * BCACHE_WAYS;
+    for (uint32_t w = 0; w < BCACHE_WAYS; w++) {
+        if (slots[base + w].lba == lba) {
+            return (int)(base + w);
+        }
+    }
+    return -1;
+}
+
+// Least recently used (or empty) way of the block's set
+static uint32_t victim(uint32_t lba) {
+    uint32_t base = (lba & (num_sets - 1)) * BCACHE_WAYS;
+    uint32_t best = base;
+    for (uint32_t w = 0; w < BCACHE_WAYS; w++) {
+        bcache_slot_t* s = &slots[base + w];
+        if (s->lba == LBA_INVALID) {
+            return base + w;
+        }
+        if (s->age < slots[best].age) {
+            best = base + w;
+        }
+    }
+    return best;
+}
+
+int bcache_init(size_t size) {
+    uint32_t blocks = size / BCACHE_BLOCK_SIZE;
+
+    slots = NULL;
+    num_sets = 0;
+    memset(&stats, 0, sizeof(stats));
+
+    // Round sets down to a power of two
+    uint32_t sets = 1;
+    while (sets * 2 * BCACHE_WAYS <= blocks) {
+        sets *= 2;
+    }
+    if (sets * BCACHE_WAYS > blocks) {
+        return -1;
+    }
+    blocks = sets * BCACHE_WAYS;
+
+    data = memory_alloc(blocks * BCACHE_BLOCK_SIZE);
+    // Staging is cache-line aligned so read-ahead can use DMA
+    uint8_t* raw_staging = memory_alloc(BCACHE_MAX_READAHEAD * BCACHE_BLOCK_SIZE + 64);
+    slots = memory_alloc(blocks * sizeof(bcache_slot_t));
+    if (!data || !raw_staging || !slots) {
+        // Give back whatever was allocated; bcache_get() falls back to
+        // uncached reads
+        memory_free(slots);
+        memory_free(raw_staging);
+        memory_free(data);
+        slots = NULL;
+        data = NULL;
+        staging = NULL;
+        return -1;
+    }
+    staging = (uint8_t*)(((uintptr_t)raw_staging + 63) & ~(uintptr_t)63);
+
+    num_sets = sets;
+    stats.blocks = blocks;
+    bcache_invalidate();
+    return 0;
+}
+
+void bcache_invalidate(void) {
+    for (uint32_t i = 0; i < num_sets * BCACHE_WAYS; i++) {
+        slots[i].lba = LBA_INVALID;
+        slots[i].age = 0;
+        slots[i].readahead = 0;
+    }
+    next_seq_lba = LBA_INVALID;
+    ra_window = 1;
+}
+
+// Return a pointer to the cached copy of 'lba', valid until the next
+// cache call. NULL on I/O error.
+const uint8_t* bcache_get(uint32_t lba) {
+    if (!slots) {
+        return mmc_read_blocks(lba, 1, fallback_block) == 0 ? fallback_block : NULL;
+    }
+
+    tick++;
+
+    int hit = lookup(lba);
+    if (hit >= 0) {
+        bcache_slot_t* s = &slots[hit];
+        stats.hits++;
+        if (s->readahead) {
+            s->readahead = 0;
+            stats.readahead_hits++;
+        }
+        s->age = tick;
+        return slot_data((uint32_t)hit);
+    }
+
+    stats.misses++;
+
+    // Grow the window while misses keep landing just past the last run
+    if (lba == next_seq_lba) {
+        if (ra_window < BCACHE_MAX_READAHEAD) {
+            ra_window *= 2;
+        }
+    } else {
+        ra_window = 1;
+    }
+
+    // Never fetch more blocks than there are sets, or the read-ahead
+    // could evict the block being asked for
+    uint32_t count = ra_window < num_sets ? ra_window : num_sets;
+    if (mmc_read_blocks(lba, count, staging) != 0) {
+        // Read-ahead may run off the end of the card; retry just this block
+        count = 1;
+        if (mmc_read_blocks(lba, 1, staging) != 0) {
+            return NULL;
+        }
+    }
+    next_seq_lba = lba + count;
+
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (i > 0 && lookup(lba + i) >= 0) {
+            continue;
+        }
+        uint32_t v = victim(lba + i);
+        slots[v].lba = lba + i;
+        slots[v].age = tick;
+        slots[v].readahead = i > 0;
+        memcpy(slot_data(v), &staging[i * BCACHE_BLOCK_SIZE], BCACHE_BLOCK_SIZE);
+        if (i == 0) {
+            result = v;
+        } else {
+            stats.readahead++;
+        }
+    }
+
+    return slot_data(result);
+}
+
+// Multi-block read. Runs of several blocks are streamed straight to the
+// caller, single blocks are served through the cache.
+int bcache_read(uint32_t lba, uint32_t count, void* buffer) {
+    if (count == 1) {
+        const uint8_t* block = bcache_get(lba);
+        if (!block) {
+            return -1;
+        }
+        memcpy(buffer, block, BCACHE_BLOCK_SIZE);
+        return 0;
+    }
+    return mmc_read_blocks(lba, count, buffer);
+}
+
+void bcache_get_stats(bcache_stats_t* out) {
+    *out = stats;
+}
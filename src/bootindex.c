@@ -0,0 +1,199 @@
+// src/bootindex.c - Boot entry index
+//
+// A full scan probes every search path and reads each image's header
+// and signature trailer. Its result is saved to BOOTINDEX_PATH together
+// with a fingerprint of what it depended on: the volume generation, the
+// CRC of each directory searched and the settings the scan used. The
+// next boot reads the index, checks the fingerprint (the directory
+// sectors are the same ones a lookup would read) and takes the entries
+// as they are.
+
+#include "bootindex.h"
+#include "terminal.h"
+
+#define BOOTINDEX_SECTORS   ((sizeof(bootindex_t) + FS_SECTOR_SIZE - 1) / FS_SECTOR_SIZE)
+
+// The index padded to whole sectors, as fs_write() wants it
+static union {
+    bootindex_t idx;
+    uint8_t raw[BOOTINDEX_SECTORS * FS_SECTOR_SIZE];
+} buf __attribute__((aligned(64)));
+
+static int index_valid;         // buf matches the volume
+
+static uint32_t index_checksum(bootindex_t* idx) {
+    uint32_t saved = idx->checksum;
+    idx->checksum = 0;
+    uint32_t crc = crc32(0, idx, sizeof(*idx));
+    idx->checksum = saved;
+    return crc;
+}
+
+static int copy_string(char* dst, const char* src, uint32_t size) {
+    uint32_t len = strlen(src);
+    if (len >= size) {
+        return -1;
+    }
+    memcpy(dst, src, len + 1);
+    return 0;
+}
+
+// Directory part of an absolute path: "/boot/uos.img" -> "/boot"
+static int parent_dir(const char* path, char* out) {
+    uint32_t len = 0;
+    for (uint32_t i = 0; path[i]; i++) {
+        if (path[i] == '/') {
+            len = i;
+        }
+    }
+    if (path[0] != '/' || len >= BOOTINDEX_PATH_MAX) {
+        return -1;
+    }
+    if (len == 0) {
+        len = 1;                // The root itself
+    }
+    memcpy(out, path, len);
+    out[len] = '\0';
+    return 0;
+}
+
+// Fill 'entries' from the index if nothing it depends on has changed.
+// Returns the number of entries, or -1 when a full scan is needed.
+int bootindex_load(boot_entry_t* entries, int max, uint32_t scan_key) {
+    bootindex_t* idx = &buf.idx;
+    uint32_t crc;
+
+    index_valid = 0;
+    file_handle_t* fh = fs_open(BOOTINDEX_PATH);
+    if (!fh) {
+        return -1;
+    }
+    int n = fs_read(fh, buf.raw, sizeof(buf.raw));
+    fs_close(fh);
+
+    if (n < (int)sizeof(*idx) || idx->magic != BOOTINDEX_MAGIC ||
+        idx->version != BOOTINDEX_VERSION || idx->size != sizeof(*idx) ||
+        idx->checksum != index_checksum(idx) ||
+        idx->num_dirs > BOOTINDEX_MAX_DIRS || idx->num_entries > BOOTINDEX_MAX_ENTRIES ||
+        (int)idx->num_entries > max || idx->scan_key != scan_key ||
+        idx->generation != fs_volume_generation()) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < idx->num_dirs; i++) {
+        bootindex_dir_t* d = &idx->dirs[i];
+        d->path[BOOTINDEX_PATH_MAX - 1] = '\0';
+        int rc = fs_dir_crc(d->path, &crc);
+        if (d->missing ? rc == 0 : rc != 0 || crc != d->crc) {
+            return -1;
+        }
+    }
+
+    for (uint32_t i = 0; i < idx->num_entries; i++) {
+        bootindex_entry_t* e = &idx->entries[i];
+        boot_entry_t* entry = &entries[i];
+
+        e->name[sizeof(e->name) - 1] = '\0';
+        e->path[BOOTINDEX_PATH_MAX - 1] = '\0';
+        e->initrd_path[BOOTINDEX_PATH_MAX - 1] = '\0';
+        memset(entry, 0, sizeof(*entry));
+        strcpy(entry->name, e->name);
+        strcpy(entry->path, e->path);
+        strcpy(entry->initrd_path, e->initrd_path);
+        entry->type = (boot_type_t)e->type;
+        entry->load_addr = e->load_addr;
+        entry->size = e->size;
+    }
+    index_valid = 1;
+    return (int)idx->num_entries;
+}
+
+// Record the entries a full scan found and the directories it searched.
+// Only written when the index file exists and is large enough.
+int bootindex_save(const boot_entry_t* entries, int count,
+                   const char* const* search_paths, int num_paths, uint32_t scan_key) {
+    bootindex_t* idx = &buf.idx;
+    char dir[BOOTINDEX_PATH_MAX];
+
+    index_valid = 0;
+    memset(&buf, 0, sizeof(buf));
+    if (count > BOOTINDEX_MAX_ENTRIES) {
+        return -1;
+    }
+
+    for (int i = 0; i < num_paths; i++) {
+        if (parent_dir(search_paths[i], dir) != 0) {
+            return -1;
+        }
+        uint32_t d = 0;
+        while (d < idx->num_dirs && strcmp(idx->dirs[d].path, dir) != 0) {
+            d++;
+        }
+        if (d < idx->num_dirs) {
+            continue;
+        }
+        if (d == BOOTINDEX_MAX_DIRS) {
+            return -1;
+        }
+        // A directory that appears later must be noticed too
+        idx->dirs[d].missing = fs_dir_crc(dir, &idx->dirs[d].crc) != 0;
+        strcpy(idx->dirs[d].path, dir);
+        idx->num_dirs++;
+    }
+
+    for (int i = 0; i < count; i++) {
+        const boot_entry_t* entry = &entries[i];
+        bootindex_entry_t* e = &idx->entries[i];
+
+        if (copy_string(e->name, entry->name, sizeof(e->name)) != 0 ||
+            copy_string(e->path, entry->path, BOOTINDEX_PATH_MAX) != 0 ||
+            copy_string(e->initrd_path, entry->initrd_path, BOOTINDEX_PATH_MAX) != 0 ||
+            fs_locate(entry->path, &e->image) != 0 ||
+            (entry->initrd_path[0] && fs_locate(entry->initrd_path, &e->initrd) != 0)) {
+            return -1;
+        }
+        e->type = entry->type;
+        e->load_addr = entry->load_addr;
+        e->size = entry->size;
+    }
+
+    idx->magic = BOOTINDEX_MAGIC;
+    idx->version = BOOTINDEX_VERSION;
+    idx->size = sizeof(*idx);
+    idx->generation = fs_volume_generation();
+    idx->scan_key = scan_key;
+    idx->num_entries = (uint32_t)count;
+    idx->checksum = index_checksum(idx);
+
+    file_handle_t* fh = fs_open(BOOTINDEX_PATH);
+    if (!fh) {
+        return -1;
+    }
+    int rc = fs_write(fh, buf.raw, sizeof(buf.raw)) == (int)sizeof(buf.raw) ? 0 : -1;
+    fs_close(fh);
+    if (rc != 0) {
+        term_print("  WARNING: Cannot write " BOOTINDEX_PATH "\n");
+        return -1;
+    }
+    index_valid = 1;
+    return 0;
+}
+
+// Open an indexed image or initrd from its cached extents, skipping the
+// path lookup. NULL if the index does not know the file.
+file_handle_t* bootindex_open(const char* path) {
+    const bootindex_t* idx = &buf.idx;
+
+    if (!index_valid) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < idx->num_entries; i++) {
+        const bootindex_entry_t* e = &idx->entries[i];
+        if (strcmp(e->path, path) == 0) {
+            return fs_open_location(&e->image);
+        }
+        if (e->initrd_path[0] && strcmp(e->initrd_path, path) == 0) {
+            return fs_open_location(&e->initrd);
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,522 @@
+// src/config.c - Boot configuration
+//
+// One pass over each text file: lines are split, trimmed and
+// NUL-terminated where they lie, and each key is hashed as it is
+// scanned, carrying on from the hash of its "[section]." prefix. The
+// hash selects the table slot, the name is compared once so that an
+// unknown key with a colliding hash is not taken for a known one, and
+// the value is converted to that slot's type there and then. A blob
+// from tools/mkconfig.py has the same values already converted and is
+// only checked and pointed into.
+
+#include "config.h"
+#include "mfboot.h"
+#include "filesystem.h"
+#include "terminal.h"
+
+#define FNV_OFFSET          0x811C9DC5u
+#define FNV_PRIME           0x01000193u
+
+// Open-addressed slots mapping a key hash to its index
+#define HASH_SLOTS          64
+#define SLOT_EMPTY          0xFF
+
+_Static_assert(CONFIG_NUM_KEYS < HASH_SLOTS / 2, "config hash table too full");
+
+static const char* const default_search_paths[] = { "/boot/uos.img", "/boot/pipos.img" };
+
+// Names, types and defaults, in CONFIG_* order. Defaults are what the
+// boot did before it read any configuration.
+static const struct {
+    const char* name;
+    uint8_t type;
+    uint32_t def;               // INT or BOOL value, list item count
+    const void* def_ptr;        // STRING value, list items
+} keys[CONFIG_NUM_KEYS] = {
+    { "menu.timeout",                   CONFIG_TYPE_INT,    0, NULL },
+    { "menu.default",                   CONFIG_TYPE_INT,    0, NULL },
+    { "menu.advanced",                  CONFIG_TYPE_BOOL,   0, NULL },
+    { "display.color_normal",           CONFIG_TYPE_INT,    2, NULL },
+    { "display.color_highlight",        CONFIG_TYPE_INT,    3, NULL },
+    { "display.color_error",            CONFIG_TYPE_INT,    1, NULL },
+    { "display.border",                 CONFIG_TYPE_BOOL,   1, NULL },
+    { "display.show_timestamps",        CONFIG_TYPE_BOOL,   0, NULL },
+    { "security.password_required",     CONFIG_TYPE_BOOL,   0, NULL },
+    { "security.secure_boot",           CONFIG_TYPE_BOOL,   0, NULL },
+    { "devices.sdcard.enabled",         CONFIG_TYPE_BOOL,   1, NULL },
+    { "devices.sdcard.search_paths",    CONFIG_TYPE_LIST,   2, default_search_paths },
+    { "devices.usb.enabled",            CONFIG_TYPE_BOOL,   0, NULL },
+    { "devices.usb.search_paths",       CONFIG_TYPE_LIST,   0, NULL },
+    { "devices.network.enabled",        CONFIG_TYPE_BOOL,   0, NULL },
+    { "devices.network.server",         CONFIG_TYPE_STRING, 0, "" },
+    { "devices.network.filename",       CONFIG_TYPE_STRING, 0, "" },
+    { "devices.holotape.enabled",       CONFIG_TYPE_BOOL,   0, NULL },
+    { "devices.holotape.device",        CONFIG_TYPE_STRING, 0, "" },
+    { "search.kernel_patterns",         CONFIG_TYPE_LIST,   0, NULL },
+    { "search.max_depth",               CONFIG_TYPE_INT,    1, NULL },
+    { "search.ignore_hidden",           CONFIG_TYPE_BOOL,   1, NULL },
+    { "boot.protocol",                  CONFIG_TYPE_STRING, 0, "linux" },
+    { "boot.cmdline",                   CONFIG_TYPE_STRING, 0, "" },
+    { "boot.load_address",              CONFIG_TYPE_INT,    0, NULL },
+    { "boot.initrd",                    CONFIG_TYPE_STRING, 0, "auto" },
+};
+
+static uint32_t key_hashes[CONFIG_NUM_KEYS];
+static uint8_t slots[HASH_SLOTS];
+static uint32_t schema;
+static int hashes_ready;
+
+config_t boot_config;
+
+static inline uint32_t fnv_step(uint32_t h, char c) {
+    return (h ^ (uint8_t)c) * FNV_PRIME;
+}
+
+uint32_t config_hash(const char* s) {
+    uint32_t h = FNV_OFFSET;
+    while (*s) {
+        h = fnv_step(h, *s++);
+    }
+    return h;
+}
+
+const char* config_key_name(uint32_t key) {
+    return key < CONFIG_NUM_KEYS ? keys[key].name : "";
+}
+
+static int find_key(uint32_t hash) {
+    for (uint32_t i = hash % HASH_SLOTS; slots[i] != SLOT_EMPTY; i = (i + 1) % HASH_SLOTS) {
+        if (key_hashes[slots[i]] == hash) {
+            return slots[i];
+        }
+    }
+    return -1;
+}
+
+// Key hashes, and the schema: a fingerprint of the key table, so a blob
+// built against another one is not trusted
+static void init_hashes(void) {
+    if (!hashes_ready) {
+        memset(slots, SLOT_EMPTY, sizeof(slots));
+        schema = 0;
+        for (uint32_t i = 0; i < CONFIG_NUM_KEYS; i++) {
+            key_hashes[i] = config_hash(keys[i].name);
+            uint32_t s = key_hashes[i] % HASH_SLOTS;
+            while (slots[s] != SLOT_EMPTY) {
+                s = (s + 1) % HASH_SLOTS;
+            }
+            slots[s] = (uint8_t)i;
+            schema = crc32(schema, keys[i].name, strlen(keys[i].name) + 1);
+            schema = crc32(schema, &keys[i].type, 1);
+        }
+        hashes_ready = 1;
+    }
+}
+
+uint32_t config_schema(void) {
+    init_hashes();
+    return schema;
+}
+
+void config_defaults(config_t* cfg) {
+    init_hashes();
+    memset(cfg, 0, sizeof(*cfg));
+    for (uint32_t i = 0; i < CONFIG_NUM_KEYS; i++) {
+        config_value_t* val = &cfg->values[i];
+        val->type = keys[i].type;
+        switch (keys[i].type) {
+        case CONFIG_TYPE_STRING:
+            val->v.s = keys[i].def_ptr;
+            break;
+        case CONFIG_TYPE_LIST:
+            val->v.list = keys[i].def_ptr;
+            val->count = (uint16_t)keys[i].def;
+            break;
+        default:
+            val->v.i = keys[i].def;
+            break;
+        }
+    }
+}
+
+static inline int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Trim [start, end) and terminate it in place
+static char* trim(char* start, char* end) {
+    while (start < end && is_space(*start)) {
+        start++;
+    }
+    while (end > start && is_space(end[-1])) {
+        end--;
+    }
+    *end = '\0';
+    return start;
+}
+
+static int parse_int(const char* s, uint32_t* out) {
+    uint32_t v = 0;
+    uint32_t base = 10;
+
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        base = 16;
+        s += 2;
+    }
+    if (!*s) {
+        return -1;
+    }
+    for (; *s; s++) {
+        uint32_t d;
+        if (*s >= '0' && *s <= '9') {
+            d = (uint32_t)(*s - '0');
+        } else if (base == 16 && (*s | 0x20) >= 'a' && (*s | 0x20) <= 'f') {
+            d = (uint32_t)((*s | 0x20) - 'a' + 10);
+        } else {
+            return -1;
+        }
+        if (v > (0xFFFFFFFFu - d) / base) {
+            return -1;
+        }
+        v = v * base + d;
+    }
+    *out = v;
+    return 0;
+}
+
+static int parse_bool(const char* s, uint32_t* out) {
+    if (!strcmp(s, "true") || !strcmp(s, "yes") || !strcmp(s, "on") || !strcmp(s, "1")) {
+        *out = 1;
+    } else if (!strcmp(s, "false") || !strcmp(s, "no") || !strcmp(s, "off") || !strcmp(s, "0")) {
+        *out = 0;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// Split a terminated value at commas into the list pool
+static int parse_list(config_t* cfg, config_value_t* val, char* s, char* end) {
+    uint32_t first = cfg->pool_used;
+
+    while (s < end) {
+        char* comma = s;
+        while (comma < end && *comma != ',') {
+            comma++;
+        }
+        char* item = trim(s, comma);
+        if (*item) {
+            if (cfg->pool_used == CONFIG_LIST_POOL) {
+                cfg->pool_used = first;
+                return -1;
+            }
+            cfg->pool[cfg->pool_used++] = item;
+        }
+        s = comma + 1;
+    }
+    val->v.list = &cfg->pool[first];
+    val->count = (uint16_t)(cfg->pool_used - first);
+    return 0;
+}
+
+// Current "[section]" while parsing: the hash of its "section." prefix,
+// and its name, NULL before the first one
+typedef struct {
+    uint32_t hash;
+    const char* name;
+} section_t;
+
+// Whether the key [p, end) in 'section' names table key 'key', in one
+// walk of the table name; its NUL ends the walk on any mismatch
+static int key_matches(int key, const section_t* section, const char* p, const char* end) {
+    const char* name = keys[key].name;
+    if (section->name) {
+        for (const char* s = section->name; *s; s++, name++) {
+            if (*name != *s) {
+                return 0;
+            }
+        }
+        if (*name++ != '.') {
+            return 0;
+        }
+    }
+    for (; p < end; p++, name++) {
+        if (*name != *p) {
+            return 0;
+        }
+    }
+    return *name == '\0';
+}
+
+// One line, already terminated at 'end'. Returns -1 for a line that is
+// not understood.
+static int parse_line(config_t* cfg, char* p, char* end, section_t* section) {
+    p = trim(p, end);
+    if (*p == '\0' || *p == '#' || *p == ';') {
+        return 0;
+    }
+    end = p + strlen(p);
+
+    if (*p == '[') {
+        char* close = p + 1;
+        while (close < end && *close != ']') {
+            close++;
+        }
+        if (close == end) {
+            return -1;
+        }
+        uint32_t h = FNV_OFFSET;
+        section->name = trim(p + 1, close);
+        for (const char* c = section->name; *c; c++) {
+            h = fnv_step(h, *c);
+        }
+        section->hash = fnv_step(h, '.');
+        return 0;
+    }
+
+    // Key, hashed on the way to the '='
+    uint32_t h = section->hash;
+    uint32_t pending = FNV_OFFSET;  // Hash so far, less trailing blanks
+    char* key_end = p;
+    char* eq = p;
+    for (; eq < end && *eq != '='; eq++) {
+        h = fnv_step(h, *eq);
+        if (!is_space(*eq)) {
+            pending = h;
+            key_end = eq + 1;
+        }
+    }
+    if (eq == end || eq == p) {
+        return -1;
+    }
+    int key = find_key(pending);
+    if (key < 0 || !key_matches(key, section, p, key_end)) {
+        return -1;
+    }
+
+    // Value: a '#' at its start or after a blank begins a comment
+    char* v = eq + 1;
+    char* vend = v;
+    while (vend < end && !(*vend == '#' && (vend == v || is_space(vend[-1])))) {
+        vend++;
+    }
+    v = trim(v, vend);
+    vend = v + strlen(v);
+
+    config_value_t* val = &cfg->values[key];
+    switch (val->type) {
+    case CONFIG_TYPE_INT:
+        if (parse_int(v, &val->v.i) != 0) {
+            return -1;
+        }
+        break;
+    case CONFIG_TYPE_BOOL:
+        if (parse_bool(v, &val->v.i) != 0) {
+            return -1;
+        }
+        break;
+    case CONFIG_TYPE_STRING:
+        val->v.s = v;
+        break;
+    default:
+        if (parse_list(cfg, val, v, vend) != 0) {
+            return -1;
+        }
+        break;
+    }
+    val->set = 1;
+    return 0;
+}
+
+// Parse 'len' bytes of INI text into 'cfg' over its current values.
+// text[len] must be writable. Bad lines are skipped; returns how many
+// there were, with the first one's number in 'bad_line'.
+int config_parse(config_t* cfg, char* text, uint32_t len, uint32_t* bad_line) {
+    section_t section = { FNV_OFFSET, NULL };
+    uint32_t line = 0;
+    int errors = 0;
+    char* p = text;
+    char* end = text + len;
+
+    init_hashes();
+    if (bad_line) {
+        *bad_line = 0;
+    }
+    while (p <= end) {
+        char* eol = p;
+        while (eol < end && *eol != '\n') {
+            eol++;
+        }
+        *eol = '\0';
+        line++;
+        if (parse_line(cfg, p, eol, &section) != 0) {
+            if (errors++ == 0 && bad_line) {
+                *bad_line = line;
+            }
+        }
+        p = eol + 1;
+    }
+    return errors;
+}
+
+// Check one blob record at 'off'; returns its key, or -1
+static int check_record(const uint8_t* data, uint32_t off, uint32_t size) {
+    if (size - off < sizeof(config_record_t)) {
+        return -1;
+    }
+    const config_record_t* rec = (const config_record_t*)(data + off);
+    const char* payload = (const char*)(rec + 1);
+    uint32_t avail = size - off - sizeof(*rec);
+
+    int key = find_key(rec->hash);
+    if (key < 0 || rec->type != keys[key].type || ((rec->len + 3u) & ~3u) > avail) {
+        return -1;
+    }
+    switch (rec->type) {
+    case CONFIG_TYPE_INT:
+        return rec->len == 4 ? key : -1;
+    case CONFIG_TYPE_BOOL: {
+        uint32_t v;
+        if (rec->len != 4) {
+            return -1;
+        }
+        memcpy(&v, payload, 4);
+        return v <= 1 ? key : -1;
+    }
+    case CONFIG_TYPE_STRING:
+        return rec->len && payload[rec->len - 1] == '\0' ? key : -1;
+    default: {
+        uint32_t pos = 0;
+        for (uint32_t i = 0; i < rec->count; i++) {
+            while (pos < rec->len && payload[pos]) {
+                pos++;
+            }
+            if (pos++ == rec->len) {
+                return -1;
+            }
+        }
+        return pos == rec->len ? key : -1;
+    }
+    }
+}
+
+// Take the values in a tools/mkconfig.py blob, which stays where it is
+// for as long as 'cfg' is used. Nothing is applied unless all of it is
+// valid.
+int config_load_blob(config_t* cfg, const void* blob, uint32_t size) {
+    const config_blob_header_t* hdr = blob;
+    const uint8_t* data = blob;
+
+    init_hashes();
+    if (size < sizeof(*hdr) || ((uintptr_t)blob & 3) || hdr->magic != CONFIG_BLOB_MAGIC ||
+        hdr->version != CONFIG_BLOB_VERSION || hdr->size < sizeof(*hdr) || hdr->size > size ||
+        hdr->schema != schema ||
+        hdr->checksum != crc32(0, hdr + 1, hdr->size - sizeof(*hdr))) {
+        return -1;
+    }
+    size = hdr->size;
+
+    uint32_t off = sizeof(*hdr);
+    uint32_t items = 0;
+    for (uint32_t n = 0; n < hdr->count; n++) {
+        if (check_record(data, off, size) < 0) {
+            return -1;
+        }
+        const config_record_t* rec = (const config_record_t*)(data + off);
+        items += rec->type == CONFIG_TYPE_LIST ? rec->count : 0;
+        off += sizeof(*rec) + ((rec->len + 3u) & ~3u);
+    }
+    if (items > CONFIG_LIST_POOL - cfg->pool_used) {
+        return -1;
+    }
+
+    off = sizeof(*hdr);
+    for (uint32_t n = 0; n < hdr->count; n++) {
+        const config_record_t* rec = (const config_record_t*)(data + off);
+        const char* payload = (const char*)(rec + 1);
+        config_value_t* val = &cfg->values[find_key(rec->hash)];
+
+        switch (rec->type) {
+        case CONFIG_TYPE_INT:
+        case CONFIG_TYPE_BOOL:
+            memcpy(&val->v.i, payload, 4);
+            break;
+        case CONFIG_TYPE_STRING:
+            val->v.s = payload;
+            break;
+        default:
+            val->v.list = &cfg->pool[cfg->pool_used];
+            val->count = rec->count;
+            for (uint32_t i = 0; i < rec->count; i++) {
+                cfg->pool[cfg->pool_used++] = payload;
+                payload += strlen(payload) + 1;
+            }
+            break;
+        }
+        val->set = 1;
+        off += sizeof(*rec) + ((rec->len + 3u) & ~3u);
+    }
+    return 0;
+}
+
+// Read the configuration from the card into boot_config: the blob if
+// there is a valid one, else the text files. Returns CONFIG_SRC_*.
+int config_load(void) {
+    static char buf[CONFIG_BUF_SIZE] __attribute__((aligned(4)));
+    static const char* const paths[] = { CONFIG_MENU_PATH, CONFIG_DEVICES_PATH };
+    uint32_t used = 0;
+    uint32_t line;
+    int src = CONFIG_SRC_DEFAULT;
+
+    config_defaults(&boot_config);
+
+    file_handle_t* fh = fs_open(CONFIG_BLOB_PATH);
+    if (fh) {
+        int n = fh->size <= CONFIG_BUF_SIZE ? fs_read(fh, buf, fh->size) : -1;
+        fs_close(fh);
+        if (n > 0 && config_load_blob(&boot_config, buf, (uint32_t)n) == 0) {
+            return CONFIG_SRC_BLOB;
+        }
+        term_print("  WARNING: Bad " CONFIG_BLOB_PATH ", reading the text files\n");
+        config_defaults(&boot_config);
+    }
+
+    for (uint32_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        fh = fs_open(paths[i]);
+        if (!fh) {
+            continue;
+        }
+        // Each file needs a byte after it for the last line's terminator
+        int n = -1;
+        if (fh->size < CONFIG_BUF_SIZE - used) {
+            n = fs_read(fh, buf + used, fh->size);
+        }
+        fs_close(fh);
+        if (n < 0) {
+            term_printf("  WARNING: Cannot read %s\n", paths[i]);
+            continue;
+        }
+        int errors = config_parse(&boot_config, buf + used, (uint32_t)n, &line);
+        if (errors) {
+            term_printf("  WARNING: %s: %d bad line(s), first at line %d\n",
+                        paths[i], errors, line);
+        }
+        used += (uint32_t)n + 1;
+        src = CONFIG_SRC_TEXT;
+    }
+    return src;
+}
+
+uint32_t config_int(uint32_t key) {
+    return boot_config.values[key].v.i;
+}
+
+const char* config_string(uint32_t key) {
+    return boot_config.values[key].v.s;
+}
+
+// Items of a list key; returns the count
+uint32_t config_list(uint32_t key, const char* const** items) {
+    *items = boot_config.values[key].v.list;
+    return boot_config.values[key].count;
+}
@@ -0,0 +1,747 @@
+// src/decompress.c - Streaming LZ4 frame and gzip decompression
+//
+// Both decoders pull compressed bytes through a decomp_src_t, so input
+// can arrive in whatever chunks the card delivers and is never held in
+// memory as a whole. Output goes straight to its final location, which
+// doubles as the history window for LZ4 offsets and deflate distances.
+//
+// Each stream is checked against what it carries: the LZ4 header
+// checksum, content size and content checksum (xxHash32 of the whole
+// frame's output, when the frame has one), and the gzip CRC32 and
+// ISIZE. LZ4 block checksums cover the compressed bytes, which are not
+// kept, and are skipped.
+
+#include "decompress.h"
+#include "mfboot.h"
+
+// LZ4 frame descriptor
+#define LZ4_SKIP_MAGIC      0x184D2A50  // Skippable frames: 0x184D2A50-5F
+#define LZ4_FLG_VERSION     0xC0
+#define LZ4_FLG_VERSION_1   0x40
+#define LZ4_FLG_BLOCK_SUM   0x10
+#define LZ4_FLG_SIZE        0x08
+#define LZ4_FLG_CONTENT_SUM 0x04
+#define LZ4_FLG_DICT_ID     0x01
+#define LZ4_BLOCK_RAW       0x80000000
+#define LZ4_MIN_MATCH       4
+#define LZ4_MAX_DESC        14          // FLG, BD, content size, dictionary ID
+
+// xxHash32 primes
+#define XXH_PRIME1          0x9E3779B1u
+#define XXH_PRIME2          0x85EBCA77u
+#define XXH_PRIME3          0xC2B2AE3Du
+#define XXH_PRIME4          0x27D4EB2Fu
+#define XXH_PRIME5          0x165667B1u
+
+// gzip member header
+#define GZIP_CM_DEFLATE     8
+#define GZIP_FHCRC          0x02
+#define GZIP_FEXTRA         0x04
+#define GZIP_FNAME          0x08
+#define GZIP_FCOMMENT       0x10
+
+// Deflate Huffman decoding: codes up to INFL_FAST_BITS long resolve with
+// one table lookup, longer ones fall back to a canonical bit-by-bit walk
+#define INFL_FAST_BITS      9
+#define INFL_FAST_MASK      ((1 << INFL_FAST_BITS) - 1)
+#define INFL_MAX_BITS       15
+#define INFL_NUM_LIT        288
+#define INFL_NUM_DIST       30
+
+static inline int src_byte(decomp_src_t* src) {
+    if (src->pos == src->end && src->refill(src) != 0) {
+        return -1;
+    }
+    return *src->pos++;
+}
+
+// Copy 'n' input bytes to 'out' a chunk at a time
+static int src_copy(decomp_src_t* src, uint8_t* out, uint32_t n) {
+    while (n) {
+        if (src->pos == src->end && src->refill(src) != 0) {
+            return -1;
+        }
+        uint32_t avail = src->end - src->pos;
+        if (avail > n) {
+            avail = n;
+        }
+        memcpy(out, src->pos, avail);
+        src->pos += avail;
+        out += avail;
+        n -= avail;
+    }
+    return 0;
+}
+
+static int src_skip(decomp_src_t* src, uint32_t n) {
+    while (n) {
+        if (src->pos == src->end && src->refill(src) != 0) {
+            return -1;
+        }
+        uint32_t avail = src->end - src->pos;
+        if (avail > n) {
+            avail = n;
+        }
+        src->pos += avail;
+        n -= avail;
+    }
+    return 0;
+}
+
+static int src_le32(decomp_src_t* src, uint32_t* value) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        int b = src_byte(src);
+        if (b < 0) {
+            return -1;
+        }
+        v |= (uint32_t)b << (i * 8);
+    }
+    *value = v;
+    return 0;
+}
+
+// Copy a back-reference of 'len' bytes from 'dist' bytes behind 'out'.
+// Short matches go byte by byte; long overlapping ones replicate the
+// period with growing non-overlapping memcpy()s.
+static inline void copy_match(uint8_t* out, uint32_t dist, uint32_t len) {
+    const uint8_t* from = out - dist;
+
+    if (len <= 16) {
+        while (len--) {
+            *out++ = *from++;
+        }
+        return;
+    }
+    while (len) {
+        uint32_t n = out - from;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(out, from, n);
+        out += n;
+        len -= n;
+    }
+}
+
+int decomp_detect(const uint8_t* data, uint32_t len) {
+    if (len >= 4) {
+        uint32_t magic = (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+                         ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+        if (magic == LZ4_FRAME_MAGIC) {
+            return CODEC_LZ4;
+        }
+    }
+    if (len >= 3 && (data[0] | (data[1] << 8)) == GZIP_MAGIC &&
+        data[2] == GZIP_CM_DEFLATE) {
+        return CODEC_GZIP;
+    }
+    return CODEC_NONE;
+}
+
+const char* decomp_codec_name(int codec) {
+    switch (codec) {
+        case CODEC_NONE: return "none";
+        case CODEC_LZ4:  return "lz4";
+        case CODEC_GZIP: return "gzip";
+        default:         return "unknown";
+    }
+}
+
+// Decompress the whole stream to 'out'. Returns the output length or -1.
+int decomp_run(int codec, decomp_src_t* src, uint8_t* out, uint32_t out_max) {
+    switch (codec) {
+        case CODEC_LZ4:  return lz4_decompress(src, out, out_max);
+        case CODEC_GZIP: return gzip_decompress(src, out, out_max);
+        default:         return -1;
+    }
+}
+
+// ---------------------------------------------------------------------
+// LZ4 frame format
+// ---------------------------------------------------------------------
+
+static inline uint32_t load_le32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t rotl32(uint32_t x, uint32_t r) {
+    return (x << r) | (x >> (32 - r));
+}
+
+static inline uint32_t xxh32_round(uint32_t v, uint32_t lane) {
+    return rotl32(v + lane * XXH_PRIME2, 13) * XXH_PRIME1;
+}
+
+// xxHash32 with seed 0, as the LZ4 frame format uses it
+static uint32_t xxh32(const uint8_t* p, uint32_t len) {
+    const uint8_t* end = p + len;
+    uint32_t h;
+
+    if (len >= 16) {
+        uint32_t v1 = XXH_PRIME1 + XXH_PRIME2;
+        uint32_t v2 = XXH_PRIME2;
+        uint32_t v3 = 0;
+        uint32_t v4 = 0 - XXH_PRIME1;
+        const uint8_t* limit = end - 16;
+        do {
+            v1 = xxh32_round(v1, load_le32(p));
+            v2 = xxh32_round(v2, load_le32(p + 4));
+            v3 = xxh32_round(v3, load_le32(p + 8));
+            v4 = xxh32_round(v4, load_le32(p + 12));
+            p += 16;
+        } while (p <= limit);
+        h = rotl32(v1, 1) + rotl32(v2, 7) + rotl32(v3, 12) + rotl32(v4, 18);
+    } else {
+        h = XXH_PRIME5;
+    }
+    h += len;
+
+    for (; end - p >= 4; p += 4) {
+        h = rotl32(h + load_le32(p) * XXH_PRIME3, 17) * XXH_PRIME4;
+    }
+    for (; p < end; p++) {
+        h = rotl32(h + *p * XXH_PRIME5, 11) * XXH_PRIME1;
+    }
+    h ^= h >> 15;
+    h *= XXH_PRIME2;
+    h ^= h >> 13;
+    h *= XXH_PRIME3;
+    h ^= h >> 16;
+    return h;
+}
+
+// LZ4 length: 4-bit nibble extended by 255-valued bytes
+static int lz4_length(decomp_src_t* src, uint32_t len, uint32_t* block_left) {
+    if (len != 15) {
+        return (int)len;
+    }
+    int b;
+    do {
+        if (*block_left == 0 || (b = src_byte(src)) < 0) {
+            return -1;
+        }
+        (*block_left)--;
+        len += (uint32_t)b;
+    } while (b == 255);
+    return (int)len;
+}
+
+// One compressed block. 'out' points at the next byte to produce;
+// everything from 'out_start' on may be referenced.
+static int lz4_block(decomp_src_t* src, uint32_t block_left, uint8_t* out_start,
+                     uint8_t** out_pos, uint8_t* out_end) {
+    uint8_t* out = *out_pos;
+
+    while (block_left) {
+        int token = src_byte(src);
+        if (token < 0) {
+            return -1;
+        }
+        block_left--;
+
+        int lit = lz4_length(src, (uint32_t)token >> 4, &block_left);
+        if (lit < 0 || (uint32_t)lit > block_left || (uint32_t)lit > (uint32_t)(out_end - out) ||
+            src_copy(src, out, (uint32_t)lit) != 0) {
+            return -1;
+        }
+        out += lit;
+        block_left -= (uint32_t)lit;
+
+        // The last sequence of a block carries literals only
+        if (block_left == 0) {
+            break;
+        }
+
+        int lo, hi;
+        if (block_left < 2 || (lo = src_byte(src)) < 0 || (hi = src_byte(src)) < 0) {
+            return -1;
+        }
+        block_left -= 2;
+
+        uint32_t offset = (uint32_t)lo | ((uint32_t)hi << 8);
+        int match = lz4_length(src, (uint32_t)token & 0x0F, &block_left);
+        if (match < 0 || offset == 0 || offset > (uint32_t)(out - out_start)) {
+            return -1;
+        }
+        match += LZ4_MIN_MATCH;
+        if ((uint32_t)match > (uint32_t)(out_end - out)) {
+            return -1;
+        }
+        copy_match(out, offset, (uint32_t)match);
+        out += match;
+    }
+
+    *out_pos = out;
+    return 0;
+}
+
+// Frames are decoded back to back until the input ends
+int lz4_decompress(decomp_src_t* src, uint8_t* out, uint32_t out_max) {
+    uint8_t* pos = out;
+    uint8_t* out_end = out + out_max;
+    uint32_t magic;
+
+    while (src_le32(src, &magic) == 0) {
+        if ((magic & 0xFFFFFFF0) == LZ4_SKIP_MAGIC) {
+            uint32_t len;
+            if (src_le32(src, &len) != 0 || src_skip(src, len) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        if (magic != LZ4_FRAME_MAGIC) {
+            return -1;
+        }
+
+        // Descriptor, kept whole for its checksum
+        uint8_t desc[LZ4_MAX_DESC];
+        if (src_copy(src, desc, 2) != 0 || (desc[0] & LZ4_FLG_VERSION) != LZ4_FLG_VERSION_1) {
+            return -1;
+        }
+        uint8_t flg = desc[0];
+        uint32_t desc_len = 2 + ((flg & LZ4_FLG_SIZE) ? 8 : 0) + ((flg & LZ4_FLG_DICT_ID) ? 4 : 0);
+        int hc;
+        if (src_copy(src, desc + 2, desc_len - 2) != 0 || (hc = src_byte(src)) < 0 ||
+            (uint32_t)hc != ((xxh32(desc, desc_len) >> 8) & 0xFF)) {
+            return -1;
+        }
+
+        // Block maximum size: 64 KB << (2 * (id - 4)), id 4..7
+        uint32_t block_id = ((uint32_t)desc[1] >> 4) & 7;
+        if (block_id < 4) {
+            return -1;
+        }
+        uint32_t block_max = 0x10000u << (2 * (block_id - 4));
+
+        // A dictionary ID is covered by the checksum but otherwise unused
+        uint32_t content_size = 0;
+        if (flg & LZ4_FLG_SIZE) {
+            content_size = load_le32(desc + 2);
+            if (load_le32(desc + 6) != 0 || content_size > (uint32_t)(out_end - pos)) {
+                return -1;
+            }
+        }
+
+        uint8_t* frame_start = pos;
+        for (;;) {
+            uint32_t block;
+            if (src_le32(src, &block) != 0) {
+                return -1;
+            }
+            if (block == 0) {
+                break;
+            }
+
+            uint32_t len = block & ~LZ4_BLOCK_RAW;
+            if (len > block_max) {
+                return -1;
+            }
+            if (block & LZ4_BLOCK_RAW) {
+                if (len > (uint32_t)(out_end - pos) || src_copy(src, pos, len) != 0) {
+                    return -1;
+                }
+                pos += len;
+            } else if (lz4_block(src, len, out, &pos, out_end) != 0) {
+                return -1;
+            }
+
+            if ((flg & LZ4_FLG_BLOCK_SUM) && src_skip(src, 4) != 0) {
+                return -1;
+            }
+        }
+
+        uint32_t frame_len = (uint32_t)(pos - frame_start);
+        if ((flg & LZ4_FLG_SIZE) && frame_len != content_size) {
+            return -1;
+        }
+        uint32_t sum;
+        if ((flg & LZ4_FLG_CONTENT_SUM) &&
+            (src_le32(src, &sum) != 0 || sum != xxh32(frame_start, frame_len))) {
+            return -1;
+        }
+    }
+
+    return (int)(pos - out);
+}
+
+// ---------------------------------------------------------------------
+// gzip / deflate (RFC 1951, RFC 1952)
+// ---------------------------------------------------------------------
+
+typedef struct {
+    uint16_t fast[1 << INFL_FAST_BITS]; // (symbol << 4) | length, 0 = long code
+    uint16_t count[INFL_MAX_BITS + 1];  // Codes per length
+    uint16_t symbol[INFL_NUM_LIT];      // Symbols in canonical order
+} huffman_t;
+
+typedef struct {
+    decomp_src_t* src;
+    uint32_t bitbuf;
+    uint32_t bitcnt;
+    uint8_t* out_start;
+    uint8_t* out;
+    uint8_t* out_end;
+    uint32_t crc;                       // CRC32 of the output so far
+    huffman_t lit;
+    huffman_t dist;
+} inflate_t;
+
+static const uint16_t len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577
+};
+static const uint8_t dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+static const uint8_t codelen_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+// Decoder state is ~3 KB; keep it off the stack
+static inflate_t inflater;
+
+// Top up the bit buffer to 'n' bits. Past the end of input zero bytes
+// are shifted in; a stream cut short fails later on its trailer.
+static inline void need_bits(inflate_t* z, uint32_t n) {
+    while (z->bitcnt < n) {
+        int b = src_byte(z->src);
+        z->bitbuf |= (uint32_t)(b < 0 ? 0 : b) << z->bitcnt;
+        z->bitcnt += 8;
+    }
+}
+
+static inline uint32_t get_bits(inflate_t* z, uint32_t n) {
+    need_bits(z, n);
+    uint32_t v = z->bitbuf & ((1u << n) - 1);
+    z->bitbuf >>= n;
+    z->bitcnt -= n;
+    return v;
+}
+
+// Next byte after discarding the partial byte in the bit buffer
+static int aligned_byte(inflate_t* z) {
+    z->bitbuf >>= z->bitcnt & 7;
+    z->bitcnt &= ~7u;
+    if (z->bitcnt) {
+        int b = (int)(z->bitbuf & 0xFF);
+        z->bitbuf >>= 8;
+        z->bitcnt -= 8;
+        return b;
+    }
+    return src_byte(z->src);
+}
+
+static int huffman_build(huffman_t* h, const uint8_t* lengths, uint32_t n) {
+    uint16_t offs[INFL_MAX_BITS + 2];
+
+    memset(h, 0, sizeof(*h));
+    for (uint32_t i = 0; i < n; i++) {
+        h->count[lengths[i]]++;
+    }
+    h->count[0] = 0;
+
+    // Reject over-subscribed codes; incomplete ones are legal
+    int left = 1;
+    for (int len = 1; len <= INFL_MAX_BITS; len++) {
+        left = (left << 1) - h->count[len];
+        if (left < 0) {
+            return -1;
+        }
+    }
+
+    offs[1] = 0;
+    for (int len = 1; len <= INFL_MAX_BITS; len++) {
+        offs[len + 1] = offs[len] + h->count[len];
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (lengths[i]) {
+            h->symbol[offs[lengths[i]]++] = (uint16_t)i;
+        }
+    }
+
+    // Deflate sends codes MSB first into an LSB-first stream, so the
+    // lookup index is the bit-reversed code
+    uint32_t code = 0;
+    uint32_t index = 0;
+    for (uint32_t len = 1; len <= INFL_FAST_BITS; len++) {
+        for (uint32_t k = 0; k < h->count[len]; k++, index++, code++) {
+            uint32_t rev = 0;
+            for (uint32_t b = 0; b < len; b++) {
+                rev |= ((code >> b) & 1) << (len - 1 - b);
+            }
+            uint16_t entry = (uint16_t)((h->symbol[index] << 4) | len);
+            for (uint32_t j = rev; j <= INFL_FAST_MASK; j += 1u << len) {
+                h->fast[j] = entry;
+            }
+        }
+        code <<= 1;
+    }
+    return 0;
+}
+
+static int huffman_decode(inflate_t* z, const huffman_t* h) {
+    need_bits(z, INFL_FAST_BITS);
+    uint16_t entry = h->fast[z->bitbuf & INFL_FAST_MASK];
+    if (entry) {
+        uint32_t len = entry & 0x0F;
+        z->bitbuf >>= len;
+        z->bitcnt -= len;
+        return entry >> 4;
+    }
+
+    // Long code: canonical walk one bit at a time
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (int len = 1; len <= INFL_MAX_BITS; len++) {
+        code |= (int)get_bits(z, 1);
+        int count = h->count[len];
+        if (code - first < count) {
+            return h->symbol[index + code - first];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+static int inflate_stored(inflate_t* z) {
+    int b0 = aligned_byte(z);
+    int b1 = aligned_byte(z);
+    int b2 = aligned_byte(z);
+    int b3 = aligned_byte(z);
+    if (b0 < 0 || b1 < 0 || b2 < 0 || b3 < 0) {
+        return -1;
+    }
+
+    uint32_t len = (uint32_t)b0 | ((uint32_t)b1 << 8);
+    if ((len ^ ((uint32_t)b2 | ((uint32_t)b3 << 8))) != 0xFFFF ||
+        len > (uint32_t)(z->out_end - z->out)) {
+        return -1;
+    }
+
+    // Bytes already in the bit buffer first, the rest in bulk
+    while (len && z->bitcnt) {
+        *z->out++ = (uint8_t)aligned_byte(z);
+        len--;
+    }
+    if (src_copy(z->src, z->out, len) != 0) {
+        return -1;
+    }
+    z->out += len;
+    return 0;
+}
+
+static int inflate_codes(inflate_t* z) {
+    for (;;) {
+        int sym = huffman_decode(z, &z->lit);
+        if (sym < 0) {
+            return -1;
+        }
+
+        if (sym < 256) {
+            if (z->out == z->out_end) {
+                return -1;
+            }
+            *z->out++ = (uint8_t)sym;
+            continue;
+        }
+        if (sym == 256) {
+            return 0;
+        }
+
+        sym -= 257;
+        if (sym >= 29) {
+            return -1;
+        }
+        uint32_t len = len_base[sym] + get_bits(z, len_extra[sym]);
+
+        int dsym = huffman_decode(z, &z->dist);
+        if (dsym < 0 || dsym >= INFL_NUM_DIST) {
+            return -1;
+        }
+        uint32_t dist = dist_base[dsym] + get_bits(z, dist_extra[dsym]);
+
+        if (dist > (uint32_t)(z->out - z->out_start) ||
+            len > (uint32_t)(z->out_end - z->out)) {
+            return -1;
+        }
+        copy_match(z->out, dist, len);
+        z->out += len;
+    }
+}
+
+static int inflate_fixed(inflate_t* z) {
+    uint8_t lengths[INFL_NUM_LIT];
+    uint32_t i;
+
+    for (i = 0; i < 144; i++) lengths[i] = 8;
+    for (; i < 256; i++) lengths[i] = 9;
+    for (; i < 280; i++) lengths[i] = 7;
+    for (; i < INFL_NUM_LIT; i++) lengths[i] = 8;
+    huffman_build(&z->lit, lengths, INFL_NUM_LIT);
+
+    for (i = 0; i < INFL_NUM_DIST; i++) lengths[i] = 5;
+    huffman_build(&z->dist, lengths, INFL_NUM_DIST);
+
+    return inflate_codes(z);
+}
+
+static int inflate_dynamic(inflate_t* z) {
+    uint8_t lengths[INFL_NUM_LIT + INFL_NUM_DIST];
+
+    uint32_t nlen = get_bits(z, 5) + 257;
+    uint32_t ndist = get_bits(z, 5) + 1;
+    uint32_t ncode = get_bits(z, 4) + 4;
+    if (nlen > 286 || ndist > INFL_NUM_DIST) {
+        return -1;
+    }
+
+    // Code length code, temporarily held in the distance table
+    memset(lengths, 0, 19);
+    for (uint32_t i = 0; i < ncode; i++) {
+        lengths[codelen_order[i]] = (uint8_t)get_bits(z, 3);
+    }
+    if (huffman_build(&z->dist, lengths, 19) != 0) {
+        return -1;
+    }
+
+    uint32_t i = 0;
+    while (i < nlen + ndist) {
+        int sym = huffman_decode(z, &z->dist);
+        if (sym < 0) {
+            return -1;
+        }
+        if (sym < 16) {
+            lengths[i++] = (uint8_t)sym;
+            continue;
+        }
+
+        uint8_t value = 0;
+        uint32_t repeat;
+        if (sym == 16) {
+            if (i == 0) {
+                return -1;
+            }
+            value = lengths[i - 1];
+            repeat = 3 + get_bits(z, 2);
+        } else if (sym == 17) {
+            repeat = 3 + get_bits(z, 3);
+        } else {
+            repeat = 11 + get_bits(z, 7);
+        }
+        if (i + repeat > nlen + ndist) {
+            return -1;
+        }
+        while (repeat--) {
+            lengths[i++] = value;
+        }
+    }
+
+    // End-of-block must be codable
+    if (lengths[256] == 0 ||
+        huffman_build(&z->lit, lengths, nlen) != 0 ||
+        huffman_build(&z->dist, lengths + nlen, ndist) != 0) {
+        return -1;
+    }
+    return inflate_codes(z);
+}
+
+// Each block's output is added to the CRC as soon as it is complete,
+// while it is still in the cache
+static int inflate_stream(inflate_t* z) {
+    uint32_t last;
+    do {
+        uint8_t* block = z->out;
+        last = get_bits(z, 1);
+        int rc;
+        switch (get_bits(z, 2)) {
+            case 0:  rc = inflate_stored(z); break;
+            case 1:  rc = inflate_fixed(z); break;
+            case 2:  rc = inflate_dynamic(z); break;
+            default: rc = -1; break;
+        }
+        if (rc != 0) {
+            return -1;
+        }
+        z->crc = crc32(z->crc, block, (uint32_t)(z->out - block));
+    } while (!last);
+    return 0;
+}
+
+// Skip a zero-terminated header string
+static int gzip_skip_string(decomp_src_t* src) {
+    int b;
+    while ((b = src_byte(src)) > 0) {
+    }
+    return b == 0 ? 0 : -1;
+}
+
+// A single gzip member
+int gzip_decompress(decomp_src_t* src, uint8_t* out, uint32_t out_max) {
+    uint8_t hdr[10];
+
+    if (src_copy(src, hdr, sizeof(hdr)) != 0 ||
+        (hdr[0] | (hdr[1] << 8)) != GZIP_MAGIC || hdr[2] != GZIP_CM_DEFLATE) {
+        return -1;
+    }
+
+    uint8_t flags = hdr[3];
+    if (flags & GZIP_FEXTRA) {
+        int lo = src_byte(src);
+        int hi = src_byte(src);
+        if (lo < 0 || hi < 0 || src_skip(src, (uint32_t)lo | ((uint32_t)hi << 8)) != 0) {
+            return -1;
+        }
+    }
+    if ((flags & GZIP_FNAME) && gzip_skip_string(src) != 0) {
+        return -1;
+    }
+    if ((flags & GZIP_FCOMMENT) && gzip_skip_string(src) != 0) {
+        return -1;
+    }
+    if ((flags & GZIP_FHCRC) && src_skip(src, 2) != 0) {
+        return -1;
+    }
+
+    inflate_t* z = &inflater;
+    z->src = src;
+    z->bitbuf = 0;
+    z->bitcnt = 0;
+    z->out_start = out;
+    z->out = out;
+    z->out_end = out + out_max;
+    z->crc = 0;
+
+    if (inflate_stream(z) != 0) {
+        return -1;
+    }
+
+    // Trailer: CRC32 and length mod 2^32 of the output
+    uint32_t trailer[2] = { 0, 0 };
+    for (int i = 0; i < 8; i++) {
+        int b = aligned_byte(z);
+        if (b < 0) {
+            return -1;
+        }
+        trailer[i / 4] |= (uint32_t)b << ((i % 4) * 8);
+    }
+    uint32_t produced = (uint32_t)(z->out - out);
+    if (trailer[1] != produced || trailer[0] != z->crc) {
+        return -1;
+    }
+    return (int)produced;
+}
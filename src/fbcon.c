@@ -0,0 +1,562 @@
+// src/fbcon.c - Framebuffer text console
+//
+// Mirrors the serial console on the framebuffer RETROS-BIOS set up for
+// HDMI. Output only updates a grid of character cells (term_print()
+// stays cheap); fbcon_update() later draws the cells that differ from
+// what the framebuffer shows, at most every FBCON_REFRESH_US while
+// output keeps coming, so a burst of boot log lines is drawn once.
+//
+// Glyphs are expanded from the 8x16 font into blocks of the
+// framebuffer's own pixels, one cache slot per color, and a character is
+// drawn with word stores, one glyph row of 8 pixels (2 to 8 words) at a
+// time. Lines scrolled off since the last redraw are moved up with one
+// memmove of the screen rows that have text on them, unless redrawing
+// the cells that differ is cheaper.
+//
+// The ANSI sequences the boot agent sends (screen.c) are interpreted:
+// cursor position, erase screen and line, and the SGR colors.
+
+#include "fbcon.h"
+#include "font.h"
+#include "terminal.h"
+#include "hardware.h"
+#include "memory_mgr.h"
+#include "mfboot.h"
+
+#define BLANK_GLYPH     ' '
+
+typedef struct {
+    uint8_t glyph;
+    uint8_t color;              // 0 for blanks, which draw the same in any
+} cell_t;
+
+typedef struct {
+    uint8_t color;
+    uint32_t used;              // Clock at the last lookup, for eviction
+    uint32_t ready[FBCON_GLYPHS / 32];
+    uint32_t* blocks;           // FONT_HEIGHT rows of row_words per glyph
+} glyph_slot_t;
+
+// Output parser states
+enum { PARSE_TEXT, PARSE_ESC, PARSE_CSI };
+
+#define CSI_MAX_PARAMS  2
+
+static struct {
+    int active;
+    uint8_t* fb;
+    uint32_t fb_phys;
+    uint32_t pitch;
+    uint32_t depth;             // Bits per pixel: 8, 16, 24 or 32
+    uint32_t row_words;         // Words in one 8-pixel glyph row
+    uint32_t cols;
+    uint32_t rows;
+    uint32_t palette[16];       // Colors as framebuffer pixels
+
+    cell_t* cells;              // What the screen should show
+    cell_t* shown;              // What the framebuffer has
+    uint8_t* dirty;             // Per row: cells may differ from shown
+    int pending;                // Some row is dirty
+    uint32_t scrolled;          // Rows scrolled since the last redraw
+    uint32_t used_rows;         // Rows of shown below which all is blank
+    uint32_t last_update;
+
+    glyph_slot_t slots[FBCON_CACHE_SLOTS];
+    uint32_t clock;
+
+    uint32_t row;               // Cursor
+    uint32_t col;
+    uint8_t color;
+    uint8_t state;
+    uint8_t nparams;
+    uint16_t params[CSI_MAX_PARAMS];
+    uint8_t utf8_left;          // Continuation bytes still to come
+    uint32_t codepoint;
+} con;
+
+// VGA values of the ANSI colors, 0xRRGGBB
+static const uint32_t ansi_rgb[16] = {
+    0x000000, 0xAA0000, 0x00AA00, 0xAA5500, 0x0000AA, 0xAA00AA, 0x00AAAA, 0xAAAAAA,
+    0x555555, 0xFF5555, 0x55FF55, 0xFFFF55, 0x5555FF, 0xFF55FF, 0x55FFFF, 0xFFFFFF,
+};
+
+static uint32_t rgb_to_pixel(uint32_t rgb, uint32_t color, uint32_t order) {
+    uint32_t r = rgb >> 16;
+    uint32_t g = (rgb >> 8) & 0xFF;
+    uint32_t b = rgb & 0xFF;
+
+    switch (con.depth) {
+        case 8:
+            return color;
+        case 16:
+            return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+        default:
+            return order == TERMLINK_FB_RGB ? (r << 16) | (g << 8) | b : (b << 16) | (g << 8) | r;
+    }
+}
+
+// Font rows of a glyph; the box lines are drawn rather than stored
+static void glyph_bits(uint32_t glyph, uint8_t bits[FONT_HEIGHT]) {
+    memset(bits, 0, FONT_HEIGHT);
+    if (glyph >= FONT_FIRST && glyph <= FONT_LAST) {
+        memcpy(bits, font8x16[glyph - FONT_FIRST], FONT_HEIGHT);
+    } else if (glyph == FBCON_GLYPH_HLINE) {
+        bits[FONT_HEIGHT / 2] = 0xFF;
+    } else if (glyph == FBCON_GLYPH_DHLINE) {
+        bits[FONT_HEIGHT / 2 - 2] = 0xFF;
+        bits[FONT_HEIGHT / 2 + 1] = 0xFF;
+    }
+}
+
+static void expand_glyph(glyph_slot_t* slot, uint32_t glyph) {
+    uint8_t bits[FONT_HEIGHT];
+    uint32_t fg = con.palette[slot->color];
+    uint32_t bg = con.palette[0];
+    uint8_t* out = (uint8_t*)(slot->blocks + glyph * FONT_HEIGHT * con.row_words);
+
+    glyph_bits(glyph, bits);
+    for (int y = 0; y < FONT_HEIGHT; y++) {
+        for (int x = 0; x < FONT_WIDTH; x++) {
+            uint32_t px = (bits[y] & (0x80 >> x)) ? fg : bg;
+            switch (con.depth) {
+                case 8:
+                    *out++ = (uint8_t)px;
+                    break;
+                case 16:
+                    *(uint16_t*)out = (uint16_t)px;
+                    out += 2;
+                    break;
+                case 24:
+                    *out++ = (uint8_t)px;
+                    *out++ = (uint8_t)(px >> 8);
+                    *out++ = (uint8_t)(px >> 16);
+                    break;
+                default:
+                    *(uint32_t*)out = px;
+                    out += 4;
+                    break;
+            }
+        }
+    }
+    slot->ready[glyph >> 5] |= 1u << (glyph & 31);
+}
+
+// Cache slot for a color, taking over the least recently used one
+static glyph_slot_t* glyph_slot(uint8_t color) {
+    glyph_slot_t* victim = &con.slots[0];
+
+    con.clock++;
+    for (int i = 0; i < FBCON_CACHE_SLOTS; i++) {
+        glyph_slot_t* slot = &con.slots[i];
+        if (slot->color == color) {
+            slot->used = con.clock;
+            return slot;
+        }
+        if (slot->used < victim->used) {
+            victim = slot;
+        }
+    }
+    victim->color = color;
+    victim->used = con.clock;
+    memset(victim->ready, 0, sizeof(victim->ready));
+    return victim;
+}
+
+static inline const uint32_t* glyph_block(glyph_slot_t* slot, uint32_t glyph) {
+    if (!(slot->ready[glyph >> 5] & (1u << (glyph & 31)))) {
+        expand_glyph(slot, glyph);
+    }
+    return slot->blocks + glyph * FONT_HEIGHT * con.row_words;
+}
+
+// One glyph into the framebuffer; 'words' is a constant at each call so
+// the row copy unrolls
+static inline void blit(uint8_t* dst, const uint32_t* src, uint32_t words) {
+    for (int y = 0; y < FONT_HEIGHT; y++) {
+        uint32_t* d = (uint32_t*)dst;
+        for (uint32_t w = 0; w < words; w++) {
+            d[w] = src[w];
+        }
+        src += words;
+        dst += con.pitch;
+    }
+}
+
+// Draw the cells of a row that differ from the framebuffer
+static void draw_row(uint32_t row) {
+    cell_t* want = con.cells + row * con.cols;
+    cell_t* have = con.shown + row * con.cols;
+    uint8_t* line = con.fb + row * FONT_HEIGHT * con.pitch;
+    glyph_slot_t* slot = NULL;
+    uint32_t first = con.cols;
+    uint32_t last = 0;
+
+    for (uint32_t col = 0; col < con.cols; col++) {
+        cell_t c = want[col];
+        if (c.glyph == have[col].glyph && c.color == have[col].color) {
+            continue;
+        }
+        if (!slot || slot->color != c.color) {
+            slot = glyph_slot(c.color);
+        }
+        const uint32_t* src = glyph_block(slot, c.glyph);
+        uint8_t* dst = line + col * con.depth;
+        switch (con.row_words) {
+            case 2:
+                blit(dst, src, 2);
+                break;
+            case 4:
+                blit(dst, src, 4);
+                break;
+            case 6:
+                blit(dst, src, 6);
+                break;
+            default:
+                blit(dst, src, 8);
+                break;
+        }
+        have[col] = c;
+        if (col < first) {
+            first = col;
+        }
+        last = col;
+        if (c.glyph != BLANK_GLYPH && row >= con.used_rows) {
+            con.used_rows = row + 1;
+        }
+    }
+
+    if (first <= last) {
+        dcache_clean_inv_range(con.fb_phys + row * FONT_HEIGHT * con.pitch + first * con.depth,
+                               (FONT_HEIGHT - 1) * con.pitch + (last - first + 1) * con.depth);
+    }
+}
+
+static int row_blank(const cell_t* row) {
+    for (uint32_t col = 0; col < con.cols; col++) {
+        if (row[col].glyph != BLANK_GLYPH) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Move what the framebuffer shows up by the rows scrolled since the last
+// redraw, when that costs less than drawing the cells it would save:
+// short lines on a wide screen redraw faster than the move copies.
+static void scroll_framebuffer(void) {
+    uint32_t n = con.scrolled;
+
+    con.scrolled = 0;
+    while (con.used_rows && row_blank(con.shown + (con.used_rows - 1) * con.cols)) {
+        con.used_rows--;
+    }
+    if (n >= con.used_rows) {
+        return;
+    }
+
+    uint32_t keep = con.used_rows - n;
+    uint32_t saved = 0;
+    for (uint32_t i = 0; i < keep * con.cols; i++) {
+        cell_t want = con.cells[i];
+        cell_t moved = con.shown[i + n * con.cols];
+        cell_t stays = con.shown[i];
+        saved += (want.glyph == moved.glyph && want.color == moved.color) -
+                 (want.glyph == stays.glyph && want.color == stays.color);
+    }
+    // A cell is FONT_HEIGHT rows of 'depth' bytes, a text row
+    // FONT_HEIGHT rows of 'pitch'
+    if ((int32_t)saved <= 0 || saved * con.depth <= keep * con.pitch) {
+        return;
+    }
+
+    uint32_t line = FONT_HEIGHT * con.pitch;
+    memmove(con.fb, con.fb + n * line, keep * line);
+    memmove(con.shown, con.shown + n * con.cols, keep * con.cols * sizeof(cell_t));
+    dcache_clean_inv_range(con.fb_phys, keep * line);
+}
+
+// Bring the framebuffer up to date: every 'force', otherwise once
+// FBCON_REFRESH_US has passed since the last redraw
+void fbcon_update(int force) {
+    if (!con.pending) {
+        return;
+    }
+    uint32_t now = get_timer_count();
+    if (!force && now - con.last_update < FBCON_REFRESH_US) {
+        return;
+    }
+
+    if (con.scrolled) {
+        scroll_framebuffer();
+    }
+    for (uint32_t row = 0; row < con.rows; row++) {
+        if (con.dirty[row]) {
+            con.dirty[row] = 0;
+            draw_row(row);
+        }
+    }
+    con.pending = 0;
+    con.last_update = now;
+}
+
+static void set_cell(uint32_t row, uint32_t col, uint8_t glyph, uint8_t color) {
+    cell_t* c = &con.cells[row * con.cols + col];
+    if (glyph == BLANK_GLYPH) {
+        color = 0;
+    }
+    if (c->glyph != glyph || c->color != color) {
+        c->glyph = glyph;
+        c->color = color;
+        con.dirty[row] = 1;
+        con.pending = 1;
+    }
+}
+
+static void erase(uint32_t row, uint32_t from, uint32_t to) {
+    for (uint32_t col = from; col < to; col++) {
+        set_cell(row, col, BLANK_GLYPH, 0);
+    }
+}
+
+static void erase_screen(void) {
+    for (uint32_t row = 0; row < con.rows; row++) {
+        erase(row, 0, con.cols);
+    }
+    // Nothing of the scrolled lines survives
+    con.scrolled = 0;
+}
+
+static void newline(void) {
+    con.col = 0;
+    if (con.row + 1 < con.rows) {
+        con.row++;
+        return;
+    }
+
+    uint32_t keep = (con.rows - 1) * con.cols;
+    memmove(con.cells, con.cells + con.cols, keep * sizeof(cell_t));
+    for (uint32_t col = 0; col < con.cols; col++) {
+        con.cells[keep + col].glyph = BLANK_GLYPH;
+        con.cells[keep + col].color = 0;
+    }
+    // Every row now holds another line than the framebuffer
+    memset(con.dirty, 1, con.rows);
+    con.pending = 1;
+    if (con.scrolled < con.rows) {
+        con.scrolled++;
+    }
+}
+
+static void put_glyph(uint8_t glyph) {
+    if (con.col >= con.cols) {
+        newline();
+    }
+    set_cell(con.row, con.col++, glyph, con.color);
+}
+
+static uint8_t unicode_glyph(uint32_t cp) {
+    switch (cp) {
+        case 0x2500:
+            return FBCON_GLYPH_HLINE;
+        case 0x2550:
+            return FBCON_GLYPH_DHLINE;
+    }
+    return '?';
+}
+
+static void csi_final(char c) {
+    uint32_t p0 = con.params[0];
+    uint32_t p1 = con.params[1];
+
+    switch (c) {
+        case 'H':
+        case 'f':
+            con.row = p0 ? p0 - 1 : 0;
+            con.col = p1 ? p1 - 1 : 0;
+            if (con.row >= con.rows) {
+                con.row = con.rows - 1;
+            }
+            if (con.col >= con.cols) {
+                con.col = con.cols - 1;
+            }
+            break;
+        case 'J':
+            if (p0 == 2) {
+                erase_screen();
+            } else if (p0 == 0) {
+                erase(con.row, con.col, con.cols);
+                for (uint32_t row = con.row + 1; row < con.rows; row++) {
+                    erase(row, 0, con.cols);
+                }
+            }
+            break;
+        case 'K':
+            erase(con.row, p0 == 2 ? 0 : con.col, con.cols);
+            break;
+        case 'm':
+            for (uint32_t i = 0; i <= con.nparams && i < CSI_MAX_PARAMS; i++) {
+                uint32_t p = con.params[i];
+                if (p == 0 || p == 39) {
+                    con.color = COLOR_GREEN;
+                } else if (p >= 30 && p <= 37) {
+                    con.color = (uint8_t)(p - 30);
+                } else if (p >= 90 && p <= 97) {
+                    con.color = (uint8_t)(p - 90 + 8);
+                }
+            }
+            break;
+    }
+}
+
+void fbcon_write(const char* s, uint32_t len) {
+    if (!con.active) {
+        return;
+    }
+
+    while (len--) {
+        uint8_t c = (uint8_t)*s++;
+
+        if (con.state == PARSE_ESC) {
+            con.state = c == '[' ? PARSE_CSI : PARSE_TEXT;
+            con.params[0] = con.params[1] = 0;
+            con.nparams = 0;
+            continue;
+        }
+        if (con.state == PARSE_CSI) {
+            if (c >= '0' && c <= '9') {
+                if (con.nparams < CSI_MAX_PARAMS && con.params[con.nparams] < 1000) {
+                    con.params[con.nparams] = (uint16_t)(con.params[con.nparams] * 10 + c - '0');
+                }
+            } else if (c == ';') {
+                con.nparams++;
+            } else if (c >= 0x40) {
+                csi_final((char)c);
+                con.state = PARSE_TEXT;
+            }
+            continue;
+        }
+
+        if (c >= 0x80) {
+            // UTF-8: lead bytes start a character, which is drawn once
+            // its continuation bytes are in
+            if ((c & 0xC0) == 0x80) {
+                if (con.utf8_left) {
+                    con.codepoint = (con.codepoint << 6) | (c & 0x3F);
+                    if (--con.utf8_left == 0) {
+                        put_glyph(unicode_glyph(con.codepoint));
+                    }
+                }
+            } else if ((c & 0xE0) == 0xC0) {
+                con.codepoint = c & 0x1F;
+                con.utf8_left = 1;
+            } else if ((c & 0xF0) == 0xE0) {
+                con.codepoint = c & 0x0F;
+                con.utf8_left = 2;
+            } else {
+                con.codepoint = c & 0x07;
+                con.utf8_left = 3;
+            }
+            continue;
+        }
+        con.utf8_left = 0;
+
+        if (c >= FONT_FIRST && c <= FONT_LAST) {
+            put_glyph(c);
+            continue;
+        }
+        switch (c) {
+            case '\033':
+                con.state = PARSE_ESC;
+                break;
+            case '\n':
+                newline();
+                break;
+            case '\r':
+                con.col = 0;
+                break;
+            case '\b':
+                if (con.col) {
+                    con.col--;
+                }
+                break;
+            case '\t':
+                while (con.col < con.cols && (++con.col & 7)) {
+                }
+                break;
+        }
+    }
+}
+
+static const term_console_t fbcon_console = { fbcon_write, fbcon_update };
+
+int fbcon_active(void) {
+    return con.active;
+}
+
+// Take over the framebuffer in 'info' and attach to the terminal. Fails
+// without a framebuffer in a depth the glyph blits handle.
+// Give back the buffers of a console that failed to come up, leaving it
+// inactive
+static void fbcon_free(void) {
+    for (int i = 0; i < FBCON_CACHE_SLOTS; i++) {
+        memory_free(con.slots[i].blocks);
+    }
+    memory_free(con.dirty);
+    memory_free(con.shown);
+    memory_free(con.cells);
+    memset(&con, 0, sizeof(con));
+}
+
+int fbcon_init(const termlink_info_t* info) {
+    if (!(info->capabilities & TERM_CAP_FRAMEBUF) ||
+        (info->fb_depth != 8 && info->fb_depth != 16 &&
+         info->fb_depth != 24 && info->fb_depth != 32) ||
+        (info->fb_pitch & 3) || info->fb_width < FONT_WIDTH || info->fb_height < FONT_HEIGHT) {
+        return -1;
+    }
+
+    memset(&con, 0, sizeof(con));
+    con.fb_phys = info->fb_addr;
+    con.fb = PHYS_PTR(info->fb_addr);
+    con.pitch = info->fb_pitch;
+    con.depth = info->fb_depth;
+    con.row_words = info->fb_depth / 4;
+    con.cols = info->fb_width / FONT_WIDTH;
+    con.rows = info->fb_height / FONT_HEIGHT;
+    con.color = COLOR_GREEN;
+
+    uint32_t cells = con.cols * con.rows;
+    con.cells = memory_alloc(cells * sizeof(cell_t));
+    con.shown = memory_alloc(cells * sizeof(cell_t));
+    con.dirty = memory_alloc(con.rows);
+    if (!con.cells || !con.shown || !con.dirty) {
+        fbcon_free();
+        return -1;
+    }
+    for (int i = 0; i < FBCON_CACHE_SLOTS; i++) {
+        con.slots[i].color = 0xFF;
+        con.slots[i].blocks = memory_alloc(FBCON_GLYPHS * FONT_HEIGHT * con.row_words * 4);
+        if (!con.slots[i].blocks) {
+            fbcon_free();
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i < 16; i++) {
+        con.palette[i] = rgb_to_pixel(ansi_rgb[i], i, info->fb_pixel_order);
+    }
+
+    // Start from a blank screen, whatever the firmware left on it
+    for (uint32_t i = 0; i < cells; i++) {
+        con.cells[i].glyph = BLANK_GLYPH;
+        con.shown[i] = con.cells[i];
+    }
+    memset(con.fb, 0, info->fb_height * con.pitch);
+    dcache_clean_inv_range(con.fb_phys, info->fb_height * con.pitch);
+
+    con.active = 1;
+    if (term_add_console(&fbcon_console) != 0) {
+        fbcon_free();
+        return -1;
+    }
+    return 0;
+}
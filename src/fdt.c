@@ -0,0 +1,382 @@
+// src/fdt.c - Flattened device tree editor
+//
+// Just enough of the devicetree specification to patch a DTB before the
+// kernel gets it: walk the structure block, look nodes up by path, and
+// set, add or delete properties and add nodes in place. An edit moves
+// only the bytes after it, with one memmove into the slack at the end
+// of the buffer (fdt_open()). That needs the strings block after the
+// structure block, as dtc writes them; fdt_open() moves it there in a
+// tree that has it first.
+
+#include "fdt.h"
+#include "mfboot.h"
+
+#define FDT_MAX_CELLS       8
+
+uint32_t fdt_be32(uint32_t v) {
+    return __builtin_bswap32(v);
+}
+
+static inline uint32_t get32(const void* p) {
+    return fdt_be32(*(const uint32_t*)p);
+}
+
+static inline void put32(void* p, uint32_t v) {
+    *(uint32_t*)p = fdt_be32(v);
+}
+
+static inline uint32_t align4(uint32_t n) {
+    return (n + 3) & ~3u;
+}
+
+#define FIELD(fdt, f)           get32(&((const fdt_header_t*)(fdt))->f)
+#define SET_FIELD(fdt, f, v)    put32(&((fdt_header_t*)(fdt))->f, (v))
+
+static inline const uint8_t* struct_block(const void* fdt) {
+    return (const uint8_t*)fdt + FIELD(fdt, off_dt_struct);
+}
+
+static inline const char* strings_block(const void* fdt) {
+    return (const char*)fdt + FIELD(fdt, off_dt_strings);
+}
+
+// Tag of the token at 'off'; '*next' is the offset of the token after
+// it. -1 past the end of the block or on a malformed token.
+static int next_token(const void* fdt, int off, int* next) {
+    uint32_t size = FIELD(fdt, size_dt_struct);
+    const uint8_t* s = struct_block(fdt);
+
+    if (off < 0 || (uint32_t)off + 4 > size) {
+        return -1;
+    }
+    uint32_t tag = get32(s + off);
+    uint32_t pos = (uint32_t)off + 4;
+
+    switch (tag) {
+    case FDT_BEGIN_NODE: {
+        uint32_t n = 0;
+        while (pos + n < size && s[pos + n]) {
+            n++;
+        }
+        if (pos + n >= size) {
+            return -1;
+        }
+        pos += align4(n + 1);
+        break;
+    }
+    case FDT_PROP:
+        if (pos + 8 > size) {
+            return -1;
+        }
+        pos += 8 + align4(get32(s + pos));
+        break;
+    case FDT_END_NODE:
+    case FDT_NOP:
+    case FDT_END:
+        break;
+    default:
+        return -1;
+    }
+    if (pos > size) {
+        return -1;
+    }
+    *next = (int)pos;
+    return (int)tag;
+}
+
+int fdt_check(const void* fdt, uint32_t size) {
+    if (size < sizeof(fdt_header_t) || ((uintptr_t)fdt & 3) ||
+        FIELD(fdt, magic) != FDT_MAGIC || FIELD(fdt, version) < FDT_MIN_VERSION) {
+        return -1;
+    }
+
+    uint32_t total = FIELD(fdt, totalsize);
+    uint32_t rsv = FIELD(fdt, off_mem_rsvmap);
+    uint32_t st = FIELD(fdt, off_dt_struct);
+    uint32_t st_size = FIELD(fdt, size_dt_struct);
+    uint32_t str = FIELD(fdt, off_dt_strings);
+    uint32_t str_size = FIELD(fdt, size_dt_strings);
+
+    // The specification allows the blocks in either order, but they
+    // must not overlap
+    if (total > size || rsv < sizeof(fdt_header_t) || rsv > st || rsv > str || (st & 3) ||
+        st > total || st_size > total - st || str > total || str_size > total - str ||
+        (str < st + st_size && st < str + str_size)) {
+        return -1;
+    }
+    return 0;
+}
+
+uint32_t fdt_total_size(const void* fdt) {
+    return FIELD(fdt, totalsize);
+}
+
+// Make the whole 'capacity' bytes of the buffer the tree's, so edits
+// can grow it up to there. Edits slide the strings block along with the
+// structure, so one stored before the structure is copied after it.
+int fdt_open(void* fdt, uint32_t capacity) {
+    if (fdt_check(fdt, capacity) != 0) {
+        return -1;
+    }
+
+    uint32_t st_end = FIELD(fdt, off_dt_struct) + FIELD(fdt, size_dt_struct);
+    uint32_t str = FIELD(fdt, off_dt_strings);
+    uint32_t str_size = FIELD(fdt, size_dt_strings);
+    if (str < st_end) {
+        if (str_size > capacity - st_end) {
+            return -1;
+        }
+        memcpy((uint8_t*)fdt + st_end, (const uint8_t*)fdt + str, str_size);
+        SET_FIELD(fdt, off_dt_strings, st_end);
+    }
+    SET_FIELD(fdt, totalsize, capacity);
+    return 0;
+}
+
+// Resize the 'old_len' bytes at structure offset 'at' to 'new_len',
+// sliding everything after them, strings block included
+static int make_room(void* fdt, int at, uint32_t old_len, uint32_t new_len) {
+    uint8_t* base = fdt;
+    uint32_t start = FIELD(fdt, off_dt_struct) + (uint32_t)at + old_len;
+    uint32_t end = FIELD(fdt, off_dt_strings) + FIELD(fdt, size_dt_strings);
+
+    if (new_len > old_len && new_len - old_len > FIELD(fdt, totalsize) - end) {
+        return -1;
+    }
+    memmove(base + start + new_len - old_len, base + start, end - start);
+    SET_FIELD(fdt, size_dt_struct, FIELD(fdt, size_dt_struct) + new_len - old_len);
+    SET_FIELD(fdt, off_dt_strings, FIELD(fdt, off_dt_strings) + new_len - old_len);
+    return 0;
+}
+
+// Offset of a name in the strings block, appending it if missing
+static int string_offset(void* fdt, const char* name) {
+    const char* strs = strings_block(fdt);
+    uint32_t size = FIELD(fdt, size_dt_strings);
+    uint32_t len = strlen(name) + 1;
+
+    for (uint32_t off = 0; off < size; off += strlen(strs + off) + 1) {
+        if (strcmp(strs + off, name) == 0) {
+            return (int)off;
+        }
+    }
+
+    uint32_t end = FIELD(fdt, off_dt_strings) + size;
+    if (len > FIELD(fdt, totalsize) - end) {
+        return -1;
+    }
+    memcpy((char*)fdt + end, name, len);
+    SET_FIELD(fdt, size_dt_strings, size + len);
+    return (int)size;
+}
+
+// A node name matches "name", or "name@unit" when 'name' has no unit
+static int name_matches(const char* node, const char* name, uint32_t len) {
+    if (memcmp(node, name, len) != 0) {
+        return 0;
+    }
+    if (node[len] == '\0') {
+        return 1;
+    }
+    if (node[len] != '@') {
+        return 0;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        if (name[i] == '@') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Direct child of 'node' called 'name' (first 'len' bytes), or -1
+static int find_child(const void* fdt, int node, const char* name, uint32_t len) {
+    int off, next;
+    int depth = 0;
+
+    if (next_token(fdt, node, &off) != FDT_BEGIN_NODE) {
+        return -1;
+    }
+    for (;;) {
+        int tag = next_token(fdt, off, &next);
+        if (tag < 0 || tag == FDT_END) {
+            return -1;
+        }
+        if (tag == FDT_BEGIN_NODE) {
+            if (depth == 0 &&
+                name_matches((const char*)struct_block(fdt) + off + 4, name, len)) {
+                return off;
+            }
+            depth++;
+        } else if (tag == FDT_END_NODE) {
+            if (depth-- == 0) {
+                return -1;
+            }
+        }
+        off = next;
+    }
+}
+
+// Offset of the END_NODE closing 'node', or -1
+static int node_end(const void* fdt, int node) {
+    int off, next;
+    int depth = 0;
+
+    if (next_token(fdt, node, &off) != FDT_BEGIN_NODE) {
+        return -1;
+    }
+    for (;;) {
+        int tag = next_token(fdt, off, &next);
+        if (tag < 0 || tag == FDT_END) {
+            return -1;
+        }
+        if (tag == FDT_BEGIN_NODE) {
+            depth++;
+        } else if (tag == FDT_END_NODE && depth-- == 0) {
+            return off;
+        }
+        off = next;
+    }
+}
+
+// Property 'name' of 'node' (properties come before subnodes), or -1
+static int find_prop(const void* fdt, int node, const char* name) {
+    const uint8_t* s = struct_block(fdt);
+    const char* strs = strings_block(fdt);
+    uint32_t str_size = FIELD(fdt, size_dt_strings);
+    int off, next;
+
+    if (next_token(fdt, node, &off) != FDT_BEGIN_NODE) {
+        return -1;
+    }
+    for (;;) {
+        int tag = next_token(fdt, off, &next);
+        if (tag == FDT_PROP) {
+            uint32_t nameoff = get32(s + off + 8);
+            if (nameoff < str_size && strcmp(strs + nameoff, name) == 0) {
+                return off;
+            }
+        } else if (tag != FDT_NOP) {
+            return -1;
+        }
+        off = next;
+    }
+}
+
+// Node at an absolute path such as "/chosen" or "/memory", or -1
+int fdt_path_offset(const void* fdt, const char* path) {
+    int node = 0;
+    int next;
+
+    if (path[0] != '/') {
+        return -1;
+    }
+    // The root node follows any leading NOPs
+    while (next_token(fdt, node, &next) == FDT_NOP) {
+        node = next;
+    }
+
+    while (*path) {
+        while (*path == '/') {
+            path++;
+        }
+        uint32_t len = 0;
+        while (path[len] && path[len] != '/') {
+            len++;
+        }
+        if (len == 0) {
+            break;
+        }
+        node = find_child(fdt, node, path, len);
+        if (node < 0) {
+            return -1;
+        }
+        path += len;
+    }
+    return next_token(fdt, node, &next) == FDT_BEGIN_NODE ? node : -1;
+}
+
+// Child 'name' of 'parent', added after its last subnode if missing
+int fdt_add_subnode(void* fdt, int parent, const char* name) {
+    uint32_t name_len = strlen(name);
+    int node = find_child(fdt, parent, name, name_len);
+    if (node >= 0) {
+        return node;
+    }
+
+    int at = node_end(fdt, parent);
+    uint32_t name_size = align4(name_len + 1);
+    if (at < 0 || make_room(fdt, at, 0, 8 + name_size) != 0) {
+        return -1;
+    }
+    uint8_t* p = (uint8_t*)struct_block(fdt) + at;
+    put32(p, FDT_BEGIN_NODE);
+    memset(p + 4, 0, name_size);
+    memcpy(p + 4, name, name_len);
+    put32(p + 4 + name_size, FDT_END_NODE);
+    return at;
+}
+
+const void* fdt_getprop(const void* fdt, int node, const char* name, uint32_t* len) {
+    int prop = find_prop(fdt, node, name);
+    if (prop < 0) {
+        return NULL;
+    }
+    const uint8_t* p = struct_block(fdt) + prop;
+    if (len) {
+        *len = get32(p + 4);
+    }
+    return p + 12;
+}
+
+// Replace or add a property. An existing one is resized where it is; a
+// new one goes first in the node.
+int fdt_setprop(void* fdt, int node, const char* name, const void* val, uint32_t len) {
+    int at = find_prop(fdt, node, name);
+    uint32_t old_len = 0;
+    uint32_t nameoff;
+
+    if (at >= 0) {
+        const uint8_t* p = struct_block(fdt) + at;
+        old_len = 12 + align4(get32(p + 4));
+        nameoff = get32(p + 8);
+    } else {
+        int off = string_offset(fdt, name);
+        if (off < 0 || next_token(fdt, node, &at) != FDT_BEGIN_NODE) {
+            return -1;
+        }
+        nameoff = (uint32_t)off;
+    }
+
+    if (make_room(fdt, at, old_len, 12 + align4(len)) != 0) {
+        return -1;
+    }
+    uint8_t* p = (uint8_t*)struct_block(fdt) + at;
+    put32(p, FDT_PROP);
+    put32(p + 4, len);
+    put32(p + 8, nameoff);
+    memcpy(p + 12, val, len);
+    memset(p + 12 + len, 0, align4(len) - len);
+    return 0;
+}
+
+// Property of 32-bit cells, given in CPU order
+int fdt_setprop_cells(void* fdt, int node, const char* name, const uint32_t* cells, int count) {
+    uint32_t be[FDT_MAX_CELLS];
+
+    if (count < 0 || count > FDT_MAX_CELLS) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        be[i] = fdt_be32(cells[i]);
+    }
+    return fdt_setprop(fdt, node, name, be, (uint32_t)count * 4);
+}
+
+int fdt_delprop(void* fdt, int node, const char* name) {
+    int at = find_prop(fdt, node, name);
+    if (at < 0) {
+        return 0;
+    }
+    return make_room(fdt, at, 12 + align4(get32(struct_block(fdt) + at + 4)), 0);
+}
@@ -1,60 +1,725 @@
-// src/filesystem.c - Basic FAT32 filesystem support
+// src/filesystem.c - FAT32 filesystem support
+//
+// FAT32 on top of the MMC block interface. Files are opened by absolute
+// path (8.3 or long names, case-insensitive). On open, the cluster chain
+// is folded into a small table of contiguous extents so fs_read() can
+// move whole runs of sectors per request instead of walking the FAT
+// cluster by cluster. The only writes are in place, inside a file's
+// existing clusters; the FAT and directories are never modified.
 
 #include "filesystem.h"
 #include "mfboot.h"
+#include "mmc.h"
+#include "bcache.h"
+#include "trace.h"
 
-// For now, this is a stub implementation
-// A full FAT32 driver would be quite complex
+// Partition types carrying FAT32
+#define PART_FAT32_CHS      0x0B
+#define PART_FAT32_LBA      0x0C
+
+// Directory entry layout
+#define DIRENT_SIZE         32
+#define ATTR_VOLUME_ID      0x08
+#define ATTR_DIRECTORY      0x10
+#define ATTR_LFN            0x0F
+#define DIRENT_END          0x00
+#define DIRENT_DELETED      0xE5
+#define LFN_LAST            0x40
+#define LFN_CHARS           13
+#define LFN_MAX             255
+
+// FSInfo sector signatures
+#define FSINFO_LEAD_SIG     0x41615252
+#define FSINFO_STRUCT_SIG   0x61417272
+
+// FAT32 cluster values
+#define FAT_MASK            0x0FFFFFFF
+#define FAT_BAD             0x0FFFFFF7
+
+// Volume geometry
+static struct {
+    uint32_t fat_start;         // LBA of first FAT
+    uint32_t data_start;        // LBA of cluster 2
+    uint32_t root_cluster;
+    uint32_t cluster_count;
+    uint32_t fsinfo_lba;        // 0 if the volume has none
+    uint32_t serial;
+    uint8_t sectors_per_cluster;
+    uint8_t cluster_shift;      // log2(sectors_per_cluster)
+} vol;
+
+// Located directory entry
+typedef struct {
+    uint32_t first_cluster;
+    uint32_t size;
+    uint32_t mtime;
+    uint8_t attr;
+} fat_dirent_t;
 
 static int fs_initialized = 0;
+static file_handle_t handles[FS_MAX_OPEN];
+static int async_pending;       // fs_read_start() issued a card read
+
+static inline uint16_t rd16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t rd32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline char to_upper(char c) {
+    return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+}
+
+// Metadata and partial sectors come through the block cache
+static inline const uint8_t* read_sector(uint32_t lba) {
+    return bcache_get(lba);
+}
+
+static inline int read_sectors(uint32_t lba, uint32_t count, void* buffer) {
+    return bcache_read(lba, count, buffer);
+}
+
+static inline uint32_t cluster_to_lba(uint32_t cluster) {
+    return vol.data_start + ((cluster - 2) << vol.cluster_shift);
+}
+
+static inline int cluster_valid(uint32_t cluster) {
+    return cluster >= 2 && cluster < vol.cluster_count + 2;
+}
+
+// Next cluster in the chain, 0 at end of chain or on error
+static uint32_t fat_next(uint32_t cluster) {
+    uint32_t offset = cluster * 4;
+    uint32_t lba = vol.fat_start + offset / FS_SECTOR_SIZE;
+
+    const uint8_t* fat = read_sector(lba);
+    if (!fat) {
+        return 0;
+    }
+
+    uint32_t next = rd32(&fat[offset % FS_SECTOR_SIZE]) & FAT_MASK;
+    if (next >= FAT_BAD || !cluster_valid(next)) {
+        return 0;
+    }
+    return next;
+}
+
+// Does sector 0 of the volume look like a FAT32 boot sector?
+static int is_fat32_bpb(const uint8_t* bs) {
+    if (bs[510] != 0x55 || bs[511] != 0xAA) {
+        return 0;
+    }
+    if (bs[0] != 0xEB && bs[0] != 0xE9) {
+        return 0;
+    }
+    // FAT32: no fixed root directory, 16-bit FAT size zero
+    return rd16(&bs[11]) == FS_SECTOR_SIZE &&
+           rd16(&bs[17]) == 0 && rd16(&bs[22]) == 0 &&
+           rd32(&bs[36]) != 0;
+}
+
+static int mount_volume(uint32_t part_lba) {
+    const uint8_t* bs = read_sector(part_lba);
+    if (!bs || !is_fat32_bpb(bs)) {
+        return -1;
+    }
+
+    uint8_t spc = bs[13];
+    if (spc == 0 || (spc & (spc - 1)) != 0) {
+        return -1;
+    }
+
+    uint16_t reserved = rd16(&bs[14]);
+    uint8_t num_fats = bs[16];
+    uint32_t total = rd16(&bs[19]);
+    if (total == 0) {
+        total = rd32(&bs[32]);
+    }
+    uint32_t fat_size = rd32(&bs[36]);
+
+    vol.sectors_per_cluster = spc;
+    vol.cluster_shift = 0;
+    while ((1u << vol.cluster_shift) < spc) {
+        vol.cluster_shift++;
+    }
+    vol.fat_start = part_lba + reserved;
+    vol.data_start = vol.fat_start + num_fats * fat_size;
+    vol.root_cluster = rd32(&bs[44]);
+    uint16_t fsinfo = rd16(&bs[48]);
+    vol.fsinfo_lba = fsinfo && fsinfo < reserved ? part_lba + fsinfo : 0;
+    vol.serial = bs[66] == 0x29 ? rd32(&bs[67]) : 0;
+    vol.cluster_count = (total - (vol.data_start - part_lba)) >> vol.cluster_shift;
+
+    // Clusters beyond what the FAT can describe are unreachable
+    if (vol.cluster_count + 2 > fat_size * (FS_SECTOR_SIZE / 4)) {
+        vol.cluster_count = fat_size * (FS_SECTOR_SIZE / 4) - 2;
+    }
+
+    return cluster_valid(vol.root_cluster) ? 0 : -1;
+}
+
+// Compare one path component against a directory entry name
+static int name_matches(const char* comp, size_t len, const char* name) {
+    size_t i;
+    for (i = 0; i < len; i++) {
+        if (name[i] == '\0' || to_upper(comp[i]) != to_upper(name[i])) {
+            return 0;
+        }
+    }
+    return name[i] == '\0';
+}
+
+// Render an 8.3 entry as "NAME.EXT"
+static void short_name(const uint8_t* e, char* out) {
+    int n = 0;
+    for (int i = 0; i < 8 && e[i] != ' '; i++) {
+        out[n++] = (char)e[i];
+    }
+    if (e[8] != ' ') {
+        out[n++] = '.';
+        for (int i = 8; i < 11 && e[i] != ' '; i++) {
+            out[n++] = (char)e[i];
+        }
+    }
+    out[n] = '\0';
+    // 0x05 stands in for a leading 0xE5 byte
+    if ((uint8_t)out[0] == 0x05) {
+        out[0] = (char)0xE5;
+    }
+}
+
+static uint8_t lfn_checksum(const uint8_t* e) {
+    uint8_t sum = 0;
+    for (int i = 0; i < 11; i++) {
+        sum = (uint8_t)(((sum & 1) << 7) + (sum >> 1) + e[i]);
+    }
+    return sum;
+}
+
+// Byte offsets of the 13 UCS-2 characters inside an LFN entry
+static const uint8_t lfn_offsets[LFN_CHARS] = {
+    1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30
+};
+
+// Search one directory for a component. Returns 0 and fills *out on match.
+static int dir_find(uint32_t dir_cluster, const char* comp, size_t len,
+                    fat_dirent_t* out) {
+    char lfn[LFN_MAX + 1];
+    char sname[13];
+    int lfn_valid = 0;
+    uint8_t lfn_sum = 0;
+    uint32_t cluster = dir_cluster;
+
+    while (cluster) {
+        uint32_t lba = cluster_to_lba(cluster);
+
+        for (uint32_t s = 0; s < vol.sectors_per_cluster; s++) {
+            const uint8_t* sector = read_sector(lba + s);
+            if (!sector) {
+                return -1;
+            }
+
+            for (uint32_t off = 0; off < FS_SECTOR_SIZE; off += DIRENT_SIZE) {
+                const uint8_t* e = &sector[off];
+                uint8_t attr = e[11];
+
+                if (e[0] == DIRENT_END) {
+                    return -1;
+                }
+                if (e[0] == DIRENT_DELETED) {
+                    lfn_valid = 0;
+                    continue;
+                }
+
+                if (attr == ATTR_LFN) {
+                    uint8_t seq = e[0];
+                    int idx = (seq & 0x1F) - 1;
+                    if (seq & LFN_LAST) {
+                        memset(lfn, 0, sizeof(lfn));
+                        lfn_valid = 1;
+                        lfn_sum = e[13];
+                    }
+                    if (!lfn_valid || idx < 0 || idx * LFN_CHARS >= LFN_MAX ||
+                        e[13] != lfn_sum) {
+                        lfn_valid = 0;
+                        continue;
+                    }
+                    for (int i = 0; i < LFN_CHARS; i++) {
+                        int pos = idx * LFN_CHARS + i;
+                        uint16_t ch = rd16(&e[lfn_offsets[i]]);
+                        if (pos >= LFN_MAX || ch == 0x0000 || ch == 0xFFFF) {
+                            break;
+                        }
+                        // Bootloader paths are ASCII; anything else can't match
+                        lfn[pos] = ch < 0x80 ? (char)ch : '?';
+                    }
+                    continue;
+                }
+
+                if (attr & ATTR_VOLUME_ID) {
+                    lfn_valid = 0;
+                    continue;
+                }
+
+                short_name(e, sname);
+                int match = name_matches(comp, len, sname);
+                if (!match && lfn_valid && lfn_checksum(e) == lfn_sum) {
+                    match = name_matches(comp, len, lfn);
+                }
+                lfn_valid = 0;
+
+                if (match) {
+                    out->first_cluster = ((uint32_t)rd16(&e[20]) << 16) | rd16(&e[26]);
+                    out->size = rd32(&e[28]);
+                    out->mtime = ((uint32_t)rd16(&e[24]) << 16) | rd16(&e[22]);
+                    out->attr = attr;
+                    return 0;
+                }
+            }
+        }
+
+        cluster = fat_next(cluster);
+    }
+
+    return -1;
+}
+
+// Resolve an absolute path to its directory entry
+static int fat_lookup(const char* path, fat_dirent_t* out) {
+    if (!fs_initialized || path == NULL) {
+        return -1;
+    }
+
+    out->first_cluster = vol.root_cluster;
+    out->size = 0;
+    out->mtime = 0;
+    out->attr = ATTR_DIRECTORY;
+
+    const char* p = path;
+    while (*p) {
+        while (*p == '/') {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+
+        const char* comp = p;
+        while (*p && *p != '/') {
+            p++;
+        }
+
+        if (!(out->attr & ATTR_DIRECTORY)) {
+            return -1;
+        }
+        // ".." to the root is stored as cluster 0
+        uint32_t dir = out->first_cluster ? out->first_cluster : vol.root_cluster;
+        if (dir_find(dir, comp, (size_t)(p - comp), out) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// Fold the cluster chain from 'cluster' (file sector 'sector') into
+// extents, merging clusters that follow each other on disk. Mapping
+// stops at the end of the file or when the table is full; map_next
+// records where to resume.
+static void map_extents(file_handle_t* fh, uint32_t cluster, uint32_t sector) {
+    uint32_t clusters_left = 0;
+    uint32_t file_sectors = (fh->size + FS_SECTOR_SIZE - 1) / FS_SECTOR_SIZE;
+
+    if (sector < file_sectors) {
+        clusters_left = ((file_sectors - sector) + vol.sectors_per_cluster - 1)
+                        >> vol.cluster_shift;
+    }
+
+    fh->num_extents = 0;
+    fh->map_sector = sector;
+    fh->map_next = 0;
+
+    while (cluster && clusters_left) {
+        if (fh->num_extents == FS_MAX_EXTENTS) {
+            fh->map_next = cluster;
+            return;
+        }
+
+        fs_extent_t* ext = &fh->extents[fh->num_extents++];
+        uint32_t run = 1;
+        clusters_left--;
+
+        uint32_t next = clusters_left ? fat_next(cluster) : 0;
+        while (clusters_left && next == cluster + run) {
+            run++;
+            clusters_left--;
+            next = clusters_left ? fat_next(cluster + run - 1) : 0;
+        }
+
+        ext->lba = cluster_to_lba(cluster);
+        ext->count = run << vol.cluster_shift;
+        cluster = next;
+    }
+}
+
+// Locate the extent holding file sector 'sector'. Returns the extent
+// index and the sector offset within it, remapping the window as needed.
+static int find_extent(file_handle_t* fh, uint32_t sector, uint32_t* offset) {
+    if (sector < fh->map_sector) {
+        map_extents(fh, fh->first_cluster, 0);
+    }
+
+    while (1) {
+        uint32_t base = fh->map_sector;
+        for (int i = 0; i < fh->num_extents; i++) {
+            if (sector < base + fh->extents[i].count) {
+                *offset = sector - base;
+                return i;
+            }
+            base += fh->extents[i].count;
+        }
+
+        if (fh->map_next == 0) {
+            return -1;
+        }
+        map_extents(fh, fh->map_next, base);
+    }
+}
 
 int fs_init(void) {
-    // Initialize SD card and read FAT32 structures
-    // For now, just stub
+    fs_initialized = 0;
+
+    if (mmc_init() != 0) {
+        return -1;
+    }
+    bcache_invalidate();
+
+    // MBR with a FAT32 partition, or an unpartitioned (superfloppy) volume
+    const uint8_t* mbr = read_sector(0);
+    if (!mbr) {
+        return -1;
+    }
+
+    uint32_t part_lba = 0;
+    if (!is_fat32_bpb(mbr) && mbr[510] == 0x55 && mbr[511] == 0xAA) {
+        for (int i = 0; i < 4; i++) {
+            const uint8_t* pe = &mbr[446 + i * 16];
+            if (pe[4] == PART_FAT32_CHS || pe[4] == PART_FAT32_LBA) {
+                part_lba = rd32(&pe[8]);
+                break;
+            }
+        }
+        if (part_lba == 0) {
+            return -1;
+        }
+    }
+
+    if (mount_volume(part_lba) != 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < FS_MAX_OPEN; i++) {
+        handles[i].valid = 0;
+    }
+
     fs_initialized = 1;
     return 0;
 }
 
+// Free handle set up for a file at 'cluster', extents not yet mapped
+static file_handle_t* new_handle(uint32_t cluster, uint32_t size) {
+    for (int i = 0; i < FS_MAX_OPEN; i++) {
+        file_handle_t* fh = &handles[i];
+        if (!fh->valid) {
+            fh->size = size;
+            fh->position = 0;
+            fh->first_cluster = cluster_valid(cluster) ? cluster : 0;
+            fh->start_sector = fh->first_cluster ? cluster_to_lba(fh->first_cluster) : 0;
+            return fh;
+        }
+    }
+    return NULL;
+}
+
 file_handle_t* fs_open(const char* path) {
-    (void)path;
-    
-    if (!fs_initialized) {
+    fat_dirent_t de;
+
+    if (fat_lookup(path, &de) != 0 || (de.attr & ATTR_DIRECTORY)) {
         return NULL;
     }
-    
-    // Would search directory entries for file
-    // For now, return NULL (file not found)
-    return NULL;
+
+    file_handle_t* fh = new_handle(de.first_cluster, de.size);
+    if (!fh) {
+        return NULL;
+    }
+    map_extents(fh, fh->first_cluster, 0);
+    fh->valid = 1;
+
+    return fh;
 }
 
+// Read up to 'size' bytes from the current position. Returns the number
+// of bytes read (short at end of file) or -1 on error.
 int fs_read(file_handle_t* fh, void* buffer, size_t size) {
-    (void)fh;
-    (void)buffer;
-    (void)size;
-    
-    if (!fs_initialized) {
+    if (!fs_initialized || fh == NULL || !fh->valid) {
+        return -1;
+    }
+
+    if (fh->position >= fh->size) {
+        return 0;
+    }
+    if (size > fh->size - fh->position) {
+        size = fh->size - fh->position;
+    }
+
+    uint8_t* dst = buffer;
+    size_t remaining = size;
+
+    while (remaining) {
+        uint32_t sector = fh->position / FS_SECTOR_SIZE;
+        uint32_t in_sector = fh->position % FS_SECTOR_SIZE;
+        uint32_t ext_off;
+        int idx = find_extent(fh, sector, &ext_off);
+        if (idx < 0) {
+            return -1;
+        }
+
+        const fs_extent_t* ext = &fh->extents[idx];
+        uint32_t lba = ext->lba + ext_off;
+        size_t chunk;
+
+        if (in_sector != 0 || remaining < FS_SECTOR_SIZE) {
+            // Partial sector through the block cache
+            const uint8_t* sector = read_sector(lba);
+            if (!sector) {
+                return -1;
+            }
+            chunk = FS_SECTOR_SIZE - in_sector;
+            if (chunk > remaining) {
+                chunk = remaining;
+            }
+            memcpy(dst, &sector[in_sector], chunk);
+        } else {
+            // Whole sectors straight into the caller's buffer, up to the
+            // end of this extent in one request
+            uint32_t count = ext->count - ext_off;
+            if (count > remaining / FS_SECTOR_SIZE) {
+                count = remaining / FS_SECTOR_SIZE;
+            }
+            TRACE_BEGIN(TRACE_READ, count);
+            if (read_sectors(lba, count, dst) != 0) {
+                return -1;
+            }
+            TRACE_END(TRACE_READ, count);
+            chunk = (size_t)count * FS_SECTOR_SIZE;
+        }
+
+        dst += chunk;
+        remaining -= chunk;
+        fh->position += chunk;
+    }
+
+    return (int)size;
+}
+
+// Start reading up to 'size' bytes in the background; the data is valid
+// once fs_read_finish() succeeds. Only whole sectors of the current
+// extent are issued, so the returned byte count may be short. Unaligned
+// positions and the partial last sector are read synchronously.
+int fs_read_start(file_handle_t* fh, void* buffer, size_t size) {
+    if (!fs_initialized || fh == NULL || !fh->valid) {
+        return -1;
+    }
+
+    if (fh->position >= fh->size) {
+        return 0;
+    }
+    if (size > fh->size - fh->position) {
+        size = fh->size - fh->position;
+    }
+    if (fh->position % FS_SECTOR_SIZE != 0 || size < FS_SECTOR_SIZE) {
+        return fs_read(fh, buffer, size);
+    }
+
+    uint32_t ext_off;
+    int idx = find_extent(fh, fh->position / FS_SECTOR_SIZE, &ext_off);
+    if (idx < 0) {
         return -1;
     }
-    
-    // Would read sectors from SD card
+
+    const fs_extent_t* ext = &fh->extents[idx];
+    uint32_t count = ext->count - ext_off;
+    if (count > size / FS_SECTOR_SIZE) {
+        count = size / FS_SECTOR_SIZE;
+    }
+    if (mmc_read_start(ext->lba + ext_off, count, buffer) != 0) {
+        return -1;
+    }
+    TRACE_BEGIN(TRACE_READ_ASYNC, count);
+    async_pending = 1;
+
+    fh->position += count * FS_SECTOR_SIZE;
+    return (int)(count * FS_SECTOR_SIZE);
+}
+
+// Wait for the read issued by fs_read_start()
+int fs_read_finish(void) {
+    int rc = mmc_read_finish();
+    if (async_pending) {
+        TRACE_END(TRACE_READ_ASYNC, 0);
+        async_pending = 0;
+    }
+    return rc;
+}
+
+// Move the read position. Seeking to the end of the file is allowed.
+int fs_seek(file_handle_t* fh, uint32_t offset) {
+    if (fh == NULL || !fh->valid || offset > fh->size) {
+        return -1;
+    }
+    fh->position = offset;
     return 0;
 }
 
 void fs_close(file_handle_t* fh) {
-    (void)fh;
+    if (fh) {
+        fh->valid = 0;
+    }
 }
 
 int fs_exists(const char* path) {
-    (void)path;
-    
-    if (!fs_initialized) {
-        return 0;
+    fat_dirent_t de;
+    TRACE_BEGIN(TRACE_FS_EXISTS, 0);
+    int found = fat_lookup(path, &de) == 0;
+    TRACE_END(TRACE_FS_EXISTS, found);
+    return found;
+}
+
+// Look a file up and record where it is, with its first extents
+int fs_locate(const char* path, fs_location_t* loc) {
+    fat_dirent_t de;
+    file_handle_t tmp;
+
+    if (fat_lookup(path, &de) != 0 || (de.attr & ATTR_DIRECTORY)) {
+        return -1;
+    }
+
+    tmp.size = de.size;
+    tmp.first_cluster = cluster_valid(de.first_cluster) ? de.first_cluster : 0;
+    map_extents(&tmp, tmp.first_cluster, 0);
+
+    memset(loc, 0, sizeof(*loc));
+    loc->first_cluster = tmp.first_cluster;
+    loc->size = de.size;
+    loc->mtime = de.mtime;
+    loc->next_cluster = tmp.map_next;
+    loc->num_extents = tmp.num_extents;
+    if (loc->num_extents > FS_LOC_EXTENTS) {
+        // Resume at the first cluster of the extent that did not fit
+        const fs_extent_t* rest = &tmp.extents[FS_LOC_EXTENTS];
+        loc->next_cluster = ((rest->lba - vol.data_start) >> vol.cluster_shift) + 2;
+        loc->num_extents = FS_LOC_EXTENTS;
+    }
+    memcpy(loc->extents, tmp.extents, loc->num_extents * sizeof(fs_extent_t));
+    return 0;
+}
+
+// Open a file found earlier by fs_locate(), with its first extents
+// already mapped. The caller vouches that the file has not changed.
+file_handle_t* fs_open_location(const fs_location_t* loc) {
+    if (!fs_initialized || loc->num_extents > FS_LOC_EXTENTS ||
+        (loc->next_cluster && !cluster_valid(loc->next_cluster))) {
+        return NULL;
+    }
+
+    file_handle_t* fh = new_handle(loc->first_cluster, loc->size);
+    if (!fh) {
+        return NULL;
+    }
+    fh->num_extents = (uint8_t)loc->num_extents;
+    fh->map_sector = 0;
+    fh->map_next = loc->next_cluster;
+    memcpy(fh->extents, loc->extents, loc->num_extents * sizeof(fs_extent_t));
+    fh->valid = 1;
+    return fh;
+}
+
+// Overwrite whole sectors at the current position, inside the file's
+// sector-rounded size. Returns the bytes written or -1.
+int fs_write(file_handle_t* fh, const void* buffer, size_t size) {
+    const uint8_t* src = buffer;
+    uint32_t file_sectors;
+
+    if (!fs_initialized || fh == NULL || !fh->valid ||
+        fh->position % FS_SECTOR_SIZE != 0 || size % FS_SECTOR_SIZE != 0) {
+        return -1;
+    }
+    file_sectors = (fh->size + FS_SECTOR_SIZE - 1) / FS_SECTOR_SIZE;
+    if (size / FS_SECTOR_SIZE > file_sectors - fh->position / FS_SECTOR_SIZE) {
+        return -1;
     }
-    
-    // For testing purposes, pretend some files exist
-    if (strcmp(path, "/boot/uos.img") == 0) {
-        return 1;
+
+    for (size_t done = 0; done < size; done += FS_SECTOR_SIZE) {
+        uint32_t ext_off;
+        int idx = find_extent(fh, (fh->position + done) / FS_SECTOR_SIZE, &ext_off);
+        if (idx < 0 || mmc_write_block(fh->extents[idx].lba + ext_off, src + done) != 0) {
+            bcache_invalidate();
+            return -1;
+        }
+    }
+    // The cache has no write path; drop whatever it held of these sectors
+    bcache_invalidate();
+    fh->position += size;
+    return (int)size;
+}
+
+// CRC-32 of a directory's entries up to its end marker. Any file added,
+// removed, renamed, resized or rewritten in it changes the result.
+int fs_dir_crc(const char* path, uint32_t* crc) {
+    fat_dirent_t de;
+
+    if (fat_lookup(path, &de) != 0 || !(de.attr & ATTR_DIRECTORY)) {
+        return -1;
     }
-    
+
+    uint32_t c = 0;
+    uint32_t cluster = de.first_cluster ? de.first_cluster : vol.root_cluster;
+    while (cluster) {
+        uint32_t lba = cluster_to_lba(cluster);
+        for (uint32_t s = 0; s < vol.sectors_per_cluster; s++) {
+            const uint8_t* sector = read_sector(lba + s);
+            if (!sector) {
+                return -1;
+            }
+            uint32_t len = 0;
+            while (len < FS_SECTOR_SIZE && sector[len] != DIRENT_END) {
+                len += DIRENT_SIZE;
+            }
+            c = crc32(c, sector, len);
+            if (len < FS_SECTOR_SIZE) {
+                *crc = c;
+                return 0;
+            }
+        }
+        cluster = fat_next(cluster);
+    }
+    *crc = c;
     return 0;
 }
+
+// Changes whenever the volume is reformatted or any cluster is
+// allocated or freed: the serial number and the FSInfo free count and
+// allocation hint
+uint32_t fs_volume_generation(void) {
+    uint32_t info[3] = { vol.serial, 0, 0 };
+
+    const uint8_t* fsi = vol.fsinfo_lba ? read_sector(vol.fsinfo_lba) : NULL;
+    if (fsi && rd32(&fsi[0]) == FSINFO_LEAD_SIG && rd32(&fsi[484]) == FSINFO_STRUCT_SIG) {
+        info[1] = rd32(&fsi[488]);
+        info[2] = rd32(&fsi[492]);
+    }
+    return crc32(0, info, sizeof(info));
+}
@@ -0,0 +1,455 @@
+// src/format.c - printf-style formatting
+//
+// format_vprint() walks the format once and hands the result to a sink
+// in runs (literal text, padding, each converted field) without
+// building the whole line first. term_printf() sinks into the console
+// and format_snprintf() into a caller's buffer.
+//
+// Conversions are %d %i %u %o %x %X %c %s %p and %%, with the flags
+// - 0 + space #, a width and a precision (either may be *), and the
+// length modifiers hh h l ll j z t. There is no floating point and no %n.
+//
+// Nothing divides: ARMv6 has no divide instruction and a 64-bit division
+// is a libgcc call even by a constant. Decimal digits come two at a time
+// from a multiply by the reciprocal of 100, and 64-bit values are
+// brought below 2^32 with shifts and adds first.
+
+#include "format.h"
+#include "mfboot.h"
+
+#define FLAG_LEFT       0x01
+#define FLAG_ZERO       0x02
+#define FLAG_PLUS       0x04
+#define FLAG_SPACE      0x08
+#define FLAG_ALT        0x10
+
+enum { LEN_INT, LEN_CHAR, LEN_SHORT, LEN_LONG, LEN_LLONG, LEN_SIZE };
+
+// A 64-bit value in octal, plus room for zeros and a prefix
+#define NUM_BUF_SIZE    48
+
+typedef struct {
+    format_sink_fn sink;
+    void* ctx;
+    int count;                  // Characters produced so far
+} format_out_t;
+
+typedef struct {
+    int flags;
+    int width;
+    int prec;                   // -1 when not given
+} format_spec_t;
+
+typedef struct {
+    char* buf;
+    size_t size;
+    size_t len;                 // Characters stored, not counting the NUL
+} format_buf_t;
+
+static const char digit_pairs[200] =
+    "00010203040506070809" "10111213141516171819"
+    "20212223242526272829" "30313233343536373839"
+    "40414243444546474849" "50515253545556575859"
+    "60616263646566676869" "70717273747576777879"
+    "80818283848586878889" "90919293949596979899";
+
+static const char digits_lower[16] = "0123456789abcdef";
+static const char digits_upper[16] = "0123456789ABCDEF";
+
+static const char pad_spaces[16] = "                ";
+static const char pad_zeros[16] = "0000000000000000";
+
+static void emit(format_out_t* out, const char* s, int len) {
+    if (len > 0) {
+        if (out->sink) {
+            out->sink(out->ctx, s, (uint32_t)len);
+        }
+        out->count += len;
+    }
+}
+
+static void pad(format_out_t* out, const char* fill, int n) {
+    while (n > 0) {
+        int run = n < 16 ? n : 16;
+        emit(out, fill, run);
+        n -= run;
+    }
+}
+
+// Decimal digits of 'v' written backwards from 'end'; returns the first
+static char* put_dec32(char* end, uint32_t v) {
+    while (v >= 100) {
+        // v / 100 for any 32-bit v (multiplier is 2^37 / 100 rounded up)
+        uint32_t q = (uint32_t)(((uint64_t)v * 0x51EB851Fu) >> 37);
+        const char* pair = &digit_pairs[2 * (v - q * 100)];
+        *--end = pair[1];
+        *--end = pair[0];
+        v = q;
+    }
+    if (v >= 10) {
+        *--end = digit_pairs[2 * v + 1];
+        *--end = digit_pairs[2 * v];
+    } else {
+        *--end = (char)('0' + v);
+    }
+    return end;
+}
+
+static char* put_dec(char* end, uint64_t v) {
+    while (v >> 32) {
+        // q = v / 10 from a shift-and-add estimate that is at most a
+        // little low, corrected from the remainder
+        uint64_t q = (v >> 1) + (v >> 2);
+        q += q >> 4;
+        q += q >> 8;
+        q += q >> 16;
+        q += q >> 32;
+        q >>= 3;
+        uint32_t r = (uint32_t)(v - ((q << 3) + (q << 1)));
+        while (r > 9) {
+            q++;
+            r -= 10;
+        }
+        *--end = (char)('0' + r);
+        v = q;
+    }
+    return put_dec32(end, (uint32_t)v);
+}
+
+// Octal or hex digits of 'v', 'shift' bits each
+static char* put_pow2(char* end, uint64_t v, int shift, const char* digits) {
+    uint32_t mask = (1u << shift) - 1;
+
+    while (v >> 32) {
+        *--end = digits[(uint32_t)v & mask];
+        v >>= shift;
+    }
+    uint32_t w = (uint32_t)v;
+    do {
+        *--end = digits[w & mask];
+        w >>= shift;
+    } while (w);
+    return end;
+}
+
+// A converted number: sign or 0x prefix, zeros up to the precision (or
+// the width, with the 0 flag), then the digits at first..end. The zeros
+// and prefix go in front of the digits in 'num' when there is room, so
+// the field reaches the sink in one run.
+static void put_number(format_out_t* out, const format_spec_t* spec, char* num,
+                       const char* prefix, int prefix_len, char* first, char* end) {
+    int ndigits = (int)(end - first);
+    int zeros = 0;
+    int spaces = 0;
+
+    // Bare %d and %x skip the padding sums
+    if (spec->width || spec->prec >= 0) {
+        if (spec->prec >= 0) {
+            if (spec->prec > ndigits) {
+                zeros = spec->prec - ndigits;
+            }
+        } else if ((spec->flags & (FLAG_ZERO | FLAG_LEFT)) == FLAG_ZERO) {
+            zeros = spec->width - prefix_len - ndigits;
+            if (zeros < 0) {
+                zeros = 0;
+            }
+        }
+        spaces = spec->width - prefix_len - zeros - ndigits;
+    }
+
+    if (!(spec->flags & FLAG_LEFT)) {
+        pad(out, pad_spaces, spaces);
+    }
+    if (zeros + prefix_len <= first - num) {
+        while (zeros--) {
+            *--first = '0';
+        }
+        for (int i = prefix_len; i > 0; i--) {
+            *--first = prefix[i - 1];
+        }
+        emit(out, first, (int)(end - first));
+    } else {
+        emit(out, prefix, prefix_len);
+        pad(out, pad_zeros, zeros);
+        emit(out, first, ndigits);
+    }
+    if (spec->flags & FLAG_LEFT) {
+        pad(out, pad_spaces, spaces);
+    }
+}
+
+static inline void put_string(format_out_t* out, const format_spec_t* spec, const char* s) {
+    int len = 0;
+
+    if (!s) {
+        s = "(null)";
+    }
+    if (spec->prec < 0) {
+        while (s[len]) {
+            len++;
+        }
+    } else {
+        while (len < spec->prec && s[len]) {
+            len++;
+        }
+    }
+    if (!(spec->flags & FLAG_LEFT)) {
+        pad(out, pad_spaces, spec->width - len);
+    }
+    emit(out, s, len);
+    if (spec->flags & FLAG_LEFT) {
+        pad(out, pad_spaces, spec->width - len);
+    }
+}
+
+static int parse_int(const char** p) {
+    int n = 0;
+    while (**p >= '0' && **p <= '9') {
+        n = n * 10 + (*(*p)++ - '0');
+    }
+    return n;
+}
+
+// Returns the number of characters produced; a NULL sink only counts them
+int format_vprint(format_sink_fn sink, void* ctx, const char* fmt, va_list args) {
+    format_out_t out = { sink, ctx, 0 };
+    char num[NUM_BUF_SIZE];
+    char* end = num + NUM_BUF_SIZE;
+
+    while (*fmt) {
+        const char* run = fmt;
+        while (*fmt && *fmt != '%') {
+            fmt++;
+        }
+        emit(&out, run, (int)(fmt - run));
+        if (!*fmt) {
+            break;
+        }
+
+        const char* start = fmt++;
+        format_spec_t spec = { 0, 0, -1 };
+
+        // Flags, width and precision; a bare conversion skips all three
+        if (*fmt < 'A') {
+            while (1) {
+                if (*fmt == '-') {
+                    spec.flags |= FLAG_LEFT;
+                } else if (*fmt == '0') {
+                    spec.flags |= FLAG_ZERO;
+                } else if (*fmt == '+') {
+                    spec.flags |= FLAG_PLUS;
+                } else if (*fmt == ' ') {
+                    spec.flags |= FLAG_SPACE;
+                } else if (*fmt == '#') {
+                    spec.flags |= FLAG_ALT;
+                } else {
+                    break;
+                }
+                fmt++;
+            }
+
+            if (*fmt == '*') {
+                spec.width = va_arg(args, int);
+                if (spec.width < 0) {
+                    spec.flags |= FLAG_LEFT;
+                    spec.width = -spec.width;
+                }
+                fmt++;
+            } else {
+                spec.width = parse_int(&fmt);
+            }
+            if (*fmt == '.') {
+                fmt++;
+                if (*fmt == '*') {
+                    spec.prec = va_arg(args, int);
+                    if (spec.prec < 0) {
+                        spec.prec = -1;
+                    }
+                    fmt++;
+                } else {
+                    spec.prec = parse_int(&fmt);
+                }
+            }
+        }
+
+        // Length
+        int length = LEN_INT;
+        if (*fmt == 'h') {
+            fmt++;
+            length = LEN_SHORT;
+            if (*fmt == 'h') {
+                fmt++;
+                length = LEN_CHAR;
+            }
+        } else if (*fmt == 'l') {
+            fmt++;
+            length = LEN_LONG;
+            if (*fmt == 'l') {
+                fmt++;
+                length = LEN_LLONG;
+            }
+        } else if (*fmt == 'j') {
+            fmt++;
+            length = LEN_LLONG;
+        } else if (*fmt == 'z' || *fmt == 't') {
+            fmt++;
+            length = LEN_SIZE;
+        }
+
+        char conv = *fmt;
+        if (!conv) {
+            emit(&out, start, (int)(fmt - start));
+            break;
+        }
+        fmt++;
+
+        uint64_t value;
+        char prefix[2];
+        int prefix_len = 0;
+
+        switch (conv) {
+            case 'd':
+            case 'i': {
+                int64_t v;
+                if (length == LEN_LLONG) {
+                    v = va_arg(args, long long);
+                } else if (length == LEN_LONG) {
+                    v = va_arg(args, long);
+                } else if (length == LEN_SIZE) {
+                    v = va_arg(args, ptrdiff_t);
+                } else {
+                    v = va_arg(args, int);
+                    if (length == LEN_CHAR) {
+                        v = (signed char)v;
+                    } else if (length == LEN_SHORT) {
+                        v = (short)v;
+                    }
+                }
+                if (v < 0) {
+                    prefix[prefix_len++] = '-';
+                    value = -(uint64_t)v;
+                } else {
+                    if (spec.flags & FLAG_PLUS) {
+                        prefix[prefix_len++] = '+';
+                    } else if (spec.flags & FLAG_SPACE) {
+                        prefix[prefix_len++] = ' ';
+                    }
+                    value = (uint64_t)v;
+                }
+                break;
+            }
+
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                if (length == LEN_LLONG) {
+                    value = va_arg(args, unsigned long long);
+                } else if (length == LEN_LONG) {
+                    value = va_arg(args, unsigned long);
+                } else if (length == LEN_SIZE) {
+                    value = va_arg(args, size_t);
+                } else {
+                    value = va_arg(args, unsigned int);
+                    if (length == LEN_CHAR) {
+                        value = (unsigned char)value;
+                    } else if (length == LEN_SHORT) {
+                        value = (unsigned short)value;
+                    }
+                }
+                break;
+
+            case 'p':
+                value = (uintptr_t)va_arg(args, void*);
+                if (!value) {
+                    spec.prec = -1;
+                    put_string(&out, &spec, "(nil)");
+                    continue;
+                }
+                spec.flags |= FLAG_ALT;
+                break;
+
+            case 'c': {
+                char c = (char)va_arg(args, int);
+                if (!(spec.flags & FLAG_LEFT)) {
+                    pad(&out, pad_spaces, spec.width - 1);
+                }
+                emit(&out, &c, 1);
+                if (spec.flags & FLAG_LEFT) {
+                    pad(&out, pad_spaces, spec.width - 1);
+                }
+                continue;
+            }
+
+            case 's':
+                put_string(&out, &spec, va_arg(args, const char*));
+                continue;
+
+            case '%':
+                emit(&out, "%", 1);
+                continue;
+
+            default:
+                // Not a conversion: print it as written
+                emit(&out, start, (int)(fmt - start));
+                continue;
+        }
+
+        // The integer conversions
+        char* first = end;
+        if (value || spec.prec) {
+            if (conv == 'd' || conv == 'i' || conv == 'u') {
+                first = put_dec(end, value);
+            } else if (conv == 'o') {
+                first = put_pow2(end, value, 3, digits_lower);
+            } else {
+                first = put_pow2(end, value, 4, conv == 'X' ? digits_upper : digits_lower);
+            }
+        }
+        if (spec.flags & FLAG_ALT) {
+            if (conv == 'o') {
+                // The precision may already give the leading zero
+                if ((first == end || *first != '0') && spec.prec <= end - first) {
+                    *--first = '0';
+                }
+            } else if ((conv == 'x' || conv == 'X' || conv == 'p') && value) {
+                prefix[prefix_len++] = '0';
+                prefix[prefix_len++] = conv == 'X' ? 'X' : 'x';
+            }
+        }
+        put_number(&out, &spec, num, prefix, prefix_len, first, end);
+    }
+
+    return out.count;
+}
+
+// Keeps what fits, always NUL-terminated when there is any room
+static void buf_sink(void* ctx, const char* s, uint32_t len) {
+    format_buf_t* b = ctx;
+
+    if (b->len + 1 < b->size) {
+        size_t room = b->size - 1 - b->len;
+        size_t n = len < room ? len : room;
+        memcpy(b->buf + b->len, s, n);
+        b->len += n;
+    }
+}
+
+// Returns the length the whole output would have, like snprintf
+int format_vsnprintf(char* buf, size_t size, const char* fmt, va_list args) {
+    format_buf_t b = { buf, size, 0 };
+    int count = format_vprint(buf_sink, &b, fmt, args);
+
+    if (size) {
+        buf[b.len] = '\0';
+    }
+    return count;
+}
+
+int format_snprintf(char* buf, size_t size, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int count = format_vsnprintf(buf, size, fmt, args);
+    va_end(args);
+    return count;
+}
@@ -1,29 +1,38 @@
 // src/hardware.c - Hardware abstraction layer
 
 #include "hardware.h"
+#include "terminal.h"
 
 void delay_ms(uint32_t ms) {
     uint32_t start = *TIMER_CLO;
     uint32_t target = start + (ms * 1000);
     
-    // Handle timer wraparound
+    // Handle timer wraparound; queued console output drains meanwhile
     if (target < start) {
-        while (*TIMER_CLO >= start) {}
+        while (*TIMER_CLO >= start) {
+            term_pump();
+        }
     }
     
-    while (*TIMER_CLO < target) {}
+    while (*TIMER_CLO < target) {
+        term_pump();
+    }
 }
 
 void delay_us(uint32_t us) {
     uint32_t start = *TIMER_CLO;
     uint32_t target = start + us;
     
-    // Handle timer wraparound
+    // Handle timer wraparound; queued console output drains meanwhile
     if (target < start) {
-        while (*TIMER_CLO >= start) {}
+        while (*TIMER_CLO >= start) {
+            term_pump();
+        }
     }
     
-    while (*TIMER_CLO < target) {}
+    while (*TIMER_CLO < target) {
+        term_pump();
+    }
 }
 
 uint32_t get_timer_count(void) {
@@ -64,17 +73,78 @@ uint32_t gpio_read(uint32_t pin) {
 
 void uart_putc(char c) {
     // Wait for UART to be ready
-    while (*UART0_FR & (1 << 5)) {}
+    while (*UART0_FR & UART_FR_TXFF) {}
     *UART0_DR = c;
 }
 
 char uart_getc(void) {
     // Wait for data
-    while (*UART0_FR & (1 << 4)) {}
+    while (*UART0_FR & UART_FR_RXFE) {}
     return (char)(*UART0_DR & 0xFF);
 }
 
 int uart_readable(void) {
     // Check if data is available (RX FIFO not empty)
-    return !(*UART0_FR & (1 << 4));
+    return !(*UART0_FR & UART_FR_RXFE);
+}
+
+// Room in the transmit FIFO: uart_putc() would not wait
+int uart_tx_ready(void) {
+    return !(*UART0_FR & UART_FR_TXFF);
+}
+
+// Everything written has left the UART
+int uart_tx_idle(void) {
+    return !(*UART0_FR & UART_FR_BUSY);
+}
+
+// Property call: hand the buffer's bus address to the VideoCore and
+// wait for the reply on the same channel. The buffer goes through the
+// data cache both ways, the firmware only sees memory.
+int mbox_property(uint32_t* buf) {
+    uint32_t addr = PTR_PHYS(buf);
+    uint32_t start = get_timer_count();
+
+    dcache_clean_inv_range(addr, buf[0]);
+    while (*MBOX_STATUS & MBOX_FULL) {
+        if (get_timer_count() - start > MBOX_TIMEOUT_US) {
+            return -1;
+        }
+    }
+    *MBOX_WRITE = PHYS_TO_BUS(addr) | MBOX_CH_PROP;
+
+    for (;;) {
+        while (*MBOX_STATUS & MBOX_EMPTY) {
+            if (get_timer_count() - start > MBOX_TIMEOUT_US) {
+                return -1;
+            }
+        }
+        if (*MBOX_READ == (PHYS_TO_BUS(addr) | MBOX_CH_PROP)) {
+            break;
+        }
+    }
+    dcache_clean_inv_range(addr, buf[0]);
+    return buf[1] == MBOX_RESPONSE_OK ? 0 : -1;
+}
+
+// CPU cycle counter (PMU), for the maintenance benchmarks
+void cycle_counter_init(void) {
+#ifdef BCM2835
+    // ARM1176 PMNC: enable, reset CCNT
+    __asm__ volatile("mcr p15, 0, %0, c15, c12, 0" :: "r"(0x5));
+#else
+    // ARMv7 PMCR: enable, reset PMCCNTR; then PMCNTENSET: cycle counter
+    __asm__ volatile("mcr p15, 0, %0, c9, c12, 0" :: "r"(0x5));
+    __asm__ volatile("mcr p15, 0, %0, c9, c12, 1" :: "r"(0x80000000));
+#endif
+}
+
+uint32_t get_cycle_count(void) {
+    uint32_t cycles;
+#ifdef BCM2835
+    __asm__ volatile("mrc p15, 0, %0, c15, c12, 1" : "=r"(cycles));
+#else
+    __asm__ volatile("mrc p15, 0, %0, c9, c13, 0" : "=r"(cycles));
+#endif
+    return cycles;
 }
@@ -5,59 +5,1250 @@
 #include "terminal.h"
 #include "hardware.h"
 #include "protocols.h"
+#include "decompress.h"
+#include "crypto.h"
+#include "trace.h"
+#include "memmap.h"
+#include "fdt.h"
+#include "bootindex.h"
+#include "smp.h"
+#include "termlink.h"
+
+// Compressed images are read in chunks of this size, double buffered
+#define LOAD_CHUNK_SIZE     0x8000
+
+// Device trees without a load address go just above 128 MB, where the
+// ARM boot documentation puts them: inside lowmem and clear of the
+// kernel decompressor
+#define LOAD_DTB_MIN        0x08000000
+#define LOAD_DTB_ALIGN      8
+
+// Initrds go page aligned above everything the kernel uses before it
+// manages memory itself, and inside lowmem (3G/1G split, 240 MB vmalloc)
+#define LOAD_PAGE_SIZE      0x1000
+#define LOAD_INITRD_MAX     0x2F800000
+
+// A zImage decompresses its kernel to this offset into the 128 MB block
+// it runs from, with the first page tables 16 KB below
+#define ZIMAGE_TEXT_OFFSET  0x8000
+#define ZIMAGE_BLOCK_MASK   0xF8000000
+#define ZIMAGE_BLOCK_SIZE   0x08000000
+// Used past the end of a zImage: its BSS, stack and malloc arena
+#define ZIMAGE_WORKSPACE    0x00100000
+// Decompressed size assumed when a zImage has no size tag
+#define ZIMAGE_RATIO        4
 
 extern void jump_to_kernel_asm(uint32_t addr, uint32_t r0, uint32_t r1, uint32_t r2);
 
-int load_kernel(boot_entry_t* entry) {
+// End of the highest range the kernel claimed, including RAM a zImage
+// decompresses into. Nothing the kernel needs at start-up goes below.
+static uint32_t kernel_top;
+
+// Read exactly 'size' bytes at file offset 'offset'
+static int read_at(file_handle_t* fh, uint32_t offset, void* buf, uint32_t size) {
+    if (fs_seek(fh, offset) != 0) {
+        return -1;
+    }
+    return fs_read(fh, buf, size) == (int)size ? 0 : -1;
+}
+
+static int is_elf(const elf32_ehdr_t* eh) {
+    const uint8_t* id = eh->e_ident;
+    uint32_t magic = (uint32_t)id[0] | ((uint32_t)id[1] << 8) |
+                     ((uint32_t)id[2] << 16) | ((uint32_t)id[3] << 24);
+    return magic == ELF_MAGIC;
+}
+
+static int elf_check_header(const elf32_ehdr_t* eh, uint32_t file_size) {
+    const uint8_t* id = eh->e_ident;
+
+    if (id[4] != ELFCLASS32 || id[5] != ELFDATA2LSB ||
+        eh->e_type != ET_EXEC || eh->e_machine != EM_ARM) {
+        term_print("ERROR: Not a 32-bit little-endian ARM executable\n");
+        return -1;
+    }
+    if (eh->e_phentsize != sizeof(elf32_phdr_t) || eh->e_phnum == 0 ||
+        eh->e_phnum > ELF_MAX_PHDRS ||
+        eh->e_phoff > file_size ||
+        eh->e_phnum * sizeof(elf32_phdr_t) > file_size - eh->e_phoff) {
+        term_print("ERROR: Bad ELF program header table\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Validate PT_LOAD segments before anything is written to memory:
+// file data inside the image, sane alignment, no overlaps.
+static int elf_check_segments(const elf32_phdr_t* ph, int count, uint32_t file_size) {
+    for (int i = 0; i < count; i++) {
+        const elf32_phdr_t* p = &ph[i];
+        if (p->p_type != PT_LOAD || p->p_memsz == 0) {
+            continue;
+        }
+
+        if (p->p_filesz > p->p_memsz ||
+            p->p_offset > file_size || p->p_filesz > file_size - p->p_offset ||
+            p->p_paddr + p->p_memsz < p->p_paddr) {
+            term_printf("ERROR: Segment %d out of bounds\n", i);
+            return -1;
+        }
+
+        // Word-aligned placement; offset and address congruent mod p_align
+        if ((p->p_paddr & 3) != 0 ||
+            (p->p_align > 1 && ((p->p_align & (p->p_align - 1)) != 0 ||
+                                ((p->p_offset - p->p_vaddr) & (p->p_align - 1)) != 0))) {
+            term_printf("ERROR: Segment %d misaligned\n", i);
+            return -1;
+        }
+
+        for (int j = 0; j < i; j++) {
+            const elf32_phdr_t* q = &ph[j];
+            if (q->p_type != PT_LOAD || q->p_memsz == 0) {
+                continue;
+            }
+            if (p->p_paddr < q->p_paddr + q->p_memsz &&
+                q->p_paddr < p->p_paddr + p->p_memsz) {
+                term_printf("ERROR: Segments %d and %d overlap\n", j, i);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Reserve [addr, addr + size) for part of the image being loaded.
+// Refuses ranges outside RAM or over the bootloader, its heap or an
+// earlier part, before a single byte is written there.
+static int claim_range(uint32_t addr, uint32_t size, uint32_t kind) {
+    if (memmap_reserve(addr, size, kind) == 0) {
+        if (kind == MEMMAP_KERNEL && addr + size > kernel_top) {
+            kernel_top = addr + size;
+        }
+        return 0;
+    }
+    const memmap_region_t* r = memmap_overlap(addr, size);
+    if (r) {
+        term_printf("ERROR: 0x%08X-0x%08X overlaps %s at 0x%08X\n",
+                    addr, addr + size, memmap_kind_name(r->kind), r->base);
+    } else {
+        term_printf("ERROR: 0x%08X-0x%08X is not free RAM\n", addr, addr + size);
+    }
+    return -1;
+}
+
+// Output limit for a decompressor writing to 'addr': the free RAM
+// there, at most LOAD_MAX_IMAGE. The range is claimed once its size is
+// known.
+static uint32_t output_limit(uint32_t addr) {
+    uint32_t span = memmap_free_span(addr);
+    if (span == 0) {
+        term_printf("ERROR: 0x%08X is not free RAM\n", addr);
+    }
+    return span < LOAD_MAX_IMAGE ? span : LOAD_MAX_IMAGE;
+}
+
+// Bytes the kernel in a zImage stored at file 'offset' takes once
+// decompressed, BSS included, from the KRNL_SIZE extension tag. 0 if
+// the data is not a zImage.
+static uint32_t zimage_kernel_size(file_handle_t* fh, uint32_t offset, uint32_t size) {
+    zimage_header_t zh;
+    uint32_t tag[4];            // Size in words, tag, size_ptr, bss_size
+    uint32_t edata;
+
+    if (size < ZIMAGE_HEADER_OFFSET + sizeof(zh) ||
+        read_at(fh, offset + ZIMAGE_HEADER_OFFSET, &zh, sizeof(zh)) != 0 ||
+        zh.magic != ZIMAGE_MAGIC || zh.end <= zh.start || zh.end - zh.start > size) {
+        return 0;
+    }
+    uint32_t image_size = zh.end - zh.start;
+
+    // The extension tags are laid out like ATAGS and end with a 0 size
+    uint32_t off = zh.table_magic == ZIMAGE_TABLE_MAGIC ? zh.table : image_size;
+    while (off < image_size && image_size - off >= sizeof(tag) &&
+           read_at(fh, offset + off, tag, sizeof(tag)) == 0 && tag[0] >= 2) {
+        if (tag[1] == ZIMAGE_TAG_KRNL_SIZE && tag[0] >= 4 && tag[2] < image_size - 4 &&
+            read_at(fh, offset + tag[2], &edata, 4) == 0) {
+            return edata + tag[3];
+        }
+        off += tag[0] * 4;
+    }
+    return image_size * ZIMAGE_RATIO;
+}
+
+// Load address for a 'size'-byte zImage meant to run at 'load_addr'.
+// Left there, it would first copy itself out of the way of the kernel
+// it decompresses; placed just above that kernel it decompresses in
+// one pass. Claims the kernel's range and the zImage's workspace.
+static uint32_t place_zimage(uint32_t load_addr, uint32_t size, uint32_t kernel_size) {
+    uint32_t block = load_addr & ZIMAGE_BLOCK_MASK;
+    uint32_t base = block + ZIMAGE_TEXT_OFFSET;
+    uint32_t end = (base + kernel_size + LOAD_PAGE_SIZE - 1) & ~(LOAD_PAGE_SIZE - 1);
+    uint32_t addr = load_addr;
+
+    if (load_addr < end) {
+        addr = memmap_find(end, block + ZIMAGE_BLOCK_SIZE, size + ZIMAGE_WORKSPACE,
+                           LOAD_PAGE_SIZE, MEMMAP_LOW);
+    }
+    if (addr == 0 || memmap_overlap(base, end - base) ||
+        memmap_overlap(addr + size, ZIMAGE_WORKSPACE)) {
+        // No room: the zImage relocates itself to 'end' and runs there
+        uint32_t top = load_addr < end ? end + size + ZIMAGE_WORKSPACE : end;
+        if (top > kernel_top) {
+            kernel_top = top;
+        }
+        term_printf("zImage at 0x%08X will relocate itself\n", load_addr);
+        return load_addr;
+    }
+
+    claim_range(base, end - base, MEMMAP_KERNEL);
+    claim_range(addr + size, ZIMAGE_WORKSPACE, MEMMAP_KERNEL);
+    term_printf("zImage: kernel 0x%08X-0x%08X, image at 0x%08X\n", base, end, addr);
+    return addr;
+}
+
+// Page-aligned free RAM for a 'size'-byte initrd above the kernel
+static uint32_t place_initrd(uint32_t size) {
+    uint32_t addr = memmap_find(kernel_top, LOAD_INITRD_MAX, size, LOAD_PAGE_SIZE, MEMMAP_LOW);
+    if (addr == 0) {
+        term_print("ERROR: No room for the initrd\n");
+    }
+    return addr;
+}
+
+// Stream every PT_LOAD segment from the file straight to its physical
+// address and clear its .bss tail. The entry point is e_entry,
+// translated to a physical address through the segment holding it.
+// The program headers are left in 'ph' (ELF_MAX_PHDRS entries).
+static int load_elf(file_handle_t* fh, const elf32_ehdr_t* eh, elf32_phdr_t* ph,
+                    uint32_t* entry_point) {
+    int count = eh->e_phnum;
+
+    if (read_at(fh, eh->e_phoff, ph, count * sizeof(elf32_phdr_t)) != 0) {
+        term_print("ERROR: Cannot read program headers\n");
+        return -1;
+    }
+    if (elf_check_segments(ph, count, fh->size) != 0) {
+        return -1;
+    }
+
+    int found_entry = 0;
+    for (int i = 0; i < count; i++) {
+        const elf32_phdr_t* p = &ph[i];
+        if (p->p_type != PT_LOAD || p->p_memsz == 0) {
+            continue;
+        }
+
+        term_printf("  LOAD 0x%08X: %d bytes + %d zero\n",
+                    p->p_paddr, p->p_filesz, p->p_memsz - p->p_filesz);
+
+        if (claim_range(p->p_paddr, p->p_memsz, MEMMAP_KERNEL) != 0) {
+            return -1;
+        }
+        uint8_t* dest = PHYS_PTR(p->p_paddr);
+        if (p->p_filesz && read_at(fh, p->p_offset, dest, p->p_filesz) != 0) {
+            term_printf("ERROR: Failed to read segment %d\n", i);
+            return -1;
+        }
+        if (p->p_memsz > p->p_filesz) {
+            memset(dest + p->p_filesz, 0, p->p_memsz - p->p_filesz);
+        }
+
+        if (eh->e_entry >= p->p_vaddr && eh->e_entry - p->p_vaddr < p->p_memsz) {
+            *entry_point = eh->e_entry - p->p_vaddr + p->p_paddr;
+            found_entry = 1;
+        }
+    }
+
+    if (!found_entry) {
+        term_print("ERROR: Entry point outside loaded segments\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Byte sum used by the boot image header, a word at a time. Per-byte
+// lanes are folded every 128 words, before they can overflow.
+uint32_t loader_checksum(uint32_t sum, const uint8_t* p, uint32_t len) {
+    while (len && ((uintptr_t)p & 3)) {
+        sum += *p++;
+        len--;
+    }
+
+    const uint32_t* w = (const uint32_t*)p;
+    while (len >= 4) {
+        uint32_t n = len / 4 > 128 ? 128 : len / 4;
+        uint32_t lanes = 0;
+        len -= n * 4;
+        while (n--) {
+            uint32_t v = *w++;
+            lanes += (v & 0x00FF00FF) + ((v >> 8) & 0x00FF00FF);
+        }
+        sum += (lanes & 0xFFFF) + (lanes >> 16);
+    }
+
+    p = (const uint8_t*)w;
+    while (len--) {
+        sum += *p++;
+    }
+    return sum;
+}
+
+// Checksum and digest of one chunk, handed to a worker core (smp.c)
+// while core 0 reads and decompresses the next. A load has one job in
+// flight at a time, so its chunks are hashed in file order.
+typedef struct {
+    const uint8_t* data;
+    uint32_t len;
+    uint32_t offset;            // In the file, for sign_chunk()
+    uint32_t sum;               // Checksum of the chunks so far
+    uint32_t ticket;            // smp_wait() for the job in flight
+} hash_job_t;
+
+// Double-buffered reader feeding the decompressor: while one chunk is
+// being decompressed the card is already filling the other. Each chunk
+// goes to the hash job as it becomes current.
+typedef struct {
+    file_handle_t* fh;
+    uint32_t remaining;         // Bytes of the section not yet requested
+    uint32_t offset;            // File offset of the chunk in flight
+    hash_job_t hash;
+    int cur;                    // Buffer being consumed
+    int next_len;               // Bytes in flight to the other buffer
+    int error;
+} load_stream_t;
+
+static uint8_t stream_buf[2][LOAD_CHUNK_SIZE] __attribute__((aligned(64)));
+
+// Signed images (tools/sign_payload.py) carry an Ed25519 signature of
+// the SHA-256 digest of their first signed_len bytes. The digest is fed
+// in file order from the very buffers the load used: the header as it
+// was parsed, each chunk as it was checksummed, ELF headers and
+// segments once copied. Reading those bytes from the card a second time
+// would let a card show the digest something other than what boots, so
+// only bytes the load ignores (padding, ELF section data) are read just
+// for the digest.
+typedef struct {
+    int active;
+    int failed;                 // Verification failed, boot went ahead
+    int hashing;                // Digest open, sign_begin() to the end of the load
+    int unhashed;               // The load used bytes the digest could not cover
+    uint32_t signed_len;
+    uint32_t hashed;            // File bytes [0, hashed) are in ctx
+    sha256_ctx_t ctx;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+} sign_state_t;
+
+static sign_state_t sign;
+
+// A load can run underneath the boot menu (loader_prefetch()). The poll
+// hook gets a turn between chunks; once it returns nonzero the load
+// stops at the next chunk and fails.
+static loader_poll_fn poll_fn;
+static void* poll_ctx;
+static int load_cancelled;
+
+// Image loaded and verified ahead of its jump
+static struct {
+    const boot_entry_t* entry;  // NULL if none
+    uint32_t entry_point;
+    uint32_t load_time;
+    boot_params_t params;
+} ready;
+
+static int load_poll(void) {
+    // Console output drains while the card transfers
+    term_pump();
+    if (poll_fn && !load_cancelled && poll_fn(poll_ctx)) {
+        load_cancelled = 1;
+    }
+    return load_cancelled;
+}
+
+// Look for a signature trailer. When there is one the signature goes to
+// entry->signature and the file is cut down to the signed bytes, so the
+// parsers below never see it. Returns 1 if signed, 0 if not, -1 on error.
+static int sign_begin(file_handle_t* fh, boot_entry_t* entry) {
+    sign_trailer_t tr;
+
+    sign.active = 0;
+    sign.failed = 0;
+    sign.hashing = 0;
+    sign.unhashed = 0;
+    if (fh->size < ED25519_SIG_SIZE + sizeof(tr) ||
+        read_at(fh, fh->size - sizeof(tr), &tr, sizeof(tr)) != 0 ||
+        tr.magic != SIGN_MAGIC || tr.signed_len != fh->size - ED25519_SIG_SIZE - sizeof(tr)) {
+        return 0;
+    }
+    if (read_at(fh, tr.signed_len, entry->signature, ED25519_SIG_SIZE) != 0) {
+        return -1;
+    }
+
+    fh->size = tr.signed_len;
+    sign.active = 1;
+    sign.hashing = 1;
+    sign.signed_len = tr.signed_len;
+    sign.hashed = 0;
+    sha256_init(&sign.ctx);
+    return 1;
+}
+
+// Hash bytes the load used, read from file 'offset'. They must
+// continue the digest: anything before sign.hashed went in from another
+// read, and anything after it could only be read again later.
+static void sign_chunk(uint32_t offset, const uint8_t* data, uint32_t len) {
+    if (!sign.hashing) {
+        return;
+    }
+    if (offset != sign.hashed) {
+        sign.unhashed = 1;
+        return;
+    }
+    if (len > sign.signed_len - offset) {
+        len = sign.signed_len - offset;
+    }
+    sha256_update(&sign.ctx, data, len);
+    sign.hashed += len;
+}
+
+// Hash file bytes from sign.hashed up to 'end' with plain reads. Only
+// for bytes the load does not use.
+static int sign_read_through(file_handle_t* fh, uint32_t end) {
+    while (sign.hashing && sign.hashed < end) {
+        uint32_t len = end - sign.hashed;
+        if (len > LOAD_CHUNK_SIZE) {
+            len = LOAD_CHUNK_SIZE;
+        }
+        if (load_poll() || read_at(fh, sign.hashed, stream_buf[0], len) != 0) {
+            return -1;
+        }
+        sha256_update(&sign.ctx, stream_buf[0], len);
+        sign.hashed += len;
+    }
+    return 0;
+}
+
+static int sign_finish(file_handle_t* fh) {
+    if (!sign.active) {
+        return 0;
+    }
+    if (sign_read_through(fh, sign.signed_len) != 0) {
+        term_print("ERROR: Read error while hashing image\n");
+        return -1;
+    }
+    sha256_final(&sign.ctx, sign.digest);
+    if (sign.unhashed) {
+        term_print("Signed image parts overlap or are out of file order\n");
+    }
+    return 0;
+}
+
+// A part of the file the load used, still in RAM
+typedef struct {
+    uint32_t offset;
+    uint32_t len;
+    const uint8_t* data;
+} sign_span_t;
+
+// Hash what the load used from 'spans', which may overlap or come in
+// any order, reading only the gaps between them from the card. Bytes
+// two spans share must be equal, or one of them is not what was hashed.
+static int sign_spans(file_handle_t* fh, sign_span_t* spans, int count) {
+    if (!sign.hashing) {
+        return 0;
+    }
+
+    // Insertion sort by file offset
+    for (int i = 1; i < count; i++) {
+        sign_span_t s = spans[i];
+        int j = i;
+        for (; j > 0 && spans[j - 1].offset > s.offset; j--) {
+            spans[j] = spans[j - 1];
+        }
+        spans[j] = s;
+    }
+
+    for (int i = 0; i < count; i++) {
+        const sign_span_t* s = &spans[i];
+        uint32_t end = s->offset + s->len;
+        if (sign_read_through(fh, s->offset) != 0) {
+            return -1;
+        }
+        for (int j = 0; j < i; j++) {
+            const sign_span_t* t = &spans[j];
+            uint32_t lo = s->offset > t->offset ? s->offset : t->offset;
+            uint32_t hi = end < t->offset + t->len ? end : t->offset + t->len;
+            if (lo < hi && memcmp(s->data + (lo - s->offset), t->data + (lo - t->offset),
+                                  hi - lo) != 0) {
+                sign.unhashed = 1;
+            }
+        }
+        if (end > sign.hashed) {
+            sign_chunk(sign.hashed, s->data + (sign.hashed - s->offset), end - sign.hashed);
+        }
+    }
+    return 0;
+}
+
+// Digest of an ELF image from the file header, the program headers and
+// the segments as loaded
+static int sign_elf(file_handle_t* fh, const elf32_ehdr_t* eh, const elf32_phdr_t* ph) {
+    sign_span_t spans[2 + ELF_MAX_PHDRS];
+    int count = 0;
+
+    spans[count++] = (sign_span_t){ 0, sizeof(*eh), (const uint8_t*)eh };
+    spans[count++] = (sign_span_t){ eh->e_phoff, eh->e_phnum * sizeof(*ph), (const uint8_t*)ph };
+    for (int i = 0; i < eh->e_phnum; i++) {
+        if (ph[i].p_type == PT_LOAD && ph[i].p_memsz != 0 && ph[i].p_filesz != 0) {
+            spans[count++] = (sign_span_t){ ph[i].p_offset, ph[i].p_filesz, PHYS_PTR(ph[i].p_paddr) };
+        }
+    }
+    return sign_spans(fh, spans, count);
+}
+
+static void hash_job_run(void* arg) {
+    hash_job_t* job = arg;
+    job->sum = loader_checksum(job->sum, job->data, job->len);
+    sign_chunk(job->offset, job->data, job->len);
+}
+
+static void hash_chunk(hash_job_t* job, uint32_t offset, const uint8_t* data, uint32_t len) {
+    smp_wait(job->ticket);
+    job->data = data;
+    job->len = len;
+    job->offset = offset;
+    job->ticket = smp_submit(hash_job_run, job);
+}
+
+// Request the next chunk into 'buf'. A section starting part way into
+// a sector (v1 payloads follow the 24-byte header) has only the rest of
+// that sector read synchronously, so every later chunk is whole sectors
+// the card transfers in the background.
+static int stream_start(load_stream_t* ls, uint8_t* buf) {
+    uint32_t len = ls->remaining < LOAD_CHUNK_SIZE ? ls->remaining : LOAD_CHUNK_SIZE;
+    uint32_t head = ls->fh->position % FS_SECTOR_SIZE;
+    if (head && len > FS_SECTOR_SIZE - head) {
+        len = FS_SECTOR_SIZE - head;
+    }
+    int n = len && !load_poll() ? fs_read_start(ls->fh, buf, len) : 0;
+    if (n < 0 || load_cancelled) {
+        ls->error = 1;
+        return -1;
+    }
+    ls->remaining -= (uint32_t)n;
+    ls->next_len = n;
+    return 0;
+}
+
+static int stream_refill(decomp_src_t* src) {
+    load_stream_t* ls = src->ctx;
+
+    if (ls->next_len <= 0) {
+        return -1;
+    }
+    if (fs_read_finish() != 0) {
+        ls->error = 1;
+        ls->next_len = 0;
+        return -1;
+    }
+
+    uint32_t chunk_offset = ls->offset;
+    ls->offset += (uint32_t)ls->next_len;
+    ls->cur ^= 1;
+    src->pos = stream_buf[ls->cur];
+    src->end = src->pos + ls->next_len;
+
+    // The other buffer still holds the chunk being hashed
+    smp_wait(ls->hash.ticket);
+    if (stream_start(ls, stream_buf[ls->cur ^ 1]) != 0) {
+        ls->next_len = 0;
+    }
+    hash_chunk(&ls->hash, chunk_offset, src->pos, (uint32_t)(src->end - src->pos));
+    return 0;
+}
+
+// Start streaming 'size' bytes at file 'offset' through stream_buf;
+// each stream_refill() makes the next chunk current in 'src'
+static int stream_open(load_stream_t* ls, decomp_src_t* src, file_handle_t* fh,
+                       uint32_t offset, uint32_t size) {
+    ls->fh = fh;
+    ls->remaining = size;
+    ls->offset = offset;
+    memset(&ls->hash, 0, sizeof(ls->hash));
+    ls->cur = 1;
+    ls->error = 0;
+    src->pos = NULL;
+    src->end = NULL;
+    src->refill = stream_refill;
+    src->ctx = ls;
+
+    if (fs_seek(fh, offset) != 0 || stream_start(ls, stream_buf[0]) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Decompress 'size' stored bytes at file 'offset' straight to 'dest',
+// writing at most 'limit' bytes
+static int load_compressed(file_handle_t* fh, uint32_t offset, uint32_t size, int codec,
+                           uint8_t* dest, uint32_t limit, uint32_t* sum, uint32_t* out_size) {
+    load_stream_t ls;
+    decomp_src_t src;
+
+    if (limit == 0) {
+        return -1;
+    }
+    term_printf("Decompressing (%s) to address: 0x%08X\n",
+                decomp_codec_name(codec), PTR_PHYS(dest));
+
+    if (stream_open(&ls, &src, fh, offset, size) != 0) {
+        return -1;
+    }
+
+    TRACE_BEGIN(TRACE_DECOMPRESS, codec);
+    int produced = decomp_run(codec, &src, dest, limit);
+    TRACE_END(TRACE_DECOMPRESS, produced);
+
+    // Whatever the decoder left unread still counts towards the checksum
+    while (stream_refill(&src) == 0) {
+    }
+    smp_wait(ls.hash.ticket);
+    if (ls.error) {
+        term_print("ERROR: Read error during decompression\n");
+        return -1;
+    }
+    if (produced < 0) {
+        term_print("ERROR: Corrupt compressed image, or no room to decompress\n");
+        return -1;
+    }
+
+    term_printf("Decompressed %d -> %d bytes\n", size, produced);
+    *sum = ls.hash.sum;
+    *out_size = (uint32_t)produced;
+    return 0;
+}
+
+// Bytes that start part way into a sector keep that misalignment at
+// 'dest', where the card could only fill them synchronously. They are
+// streamed through the aligned stream_buf chunks and copied instead.
+static int load_copied(file_handle_t* fh, uint32_t offset, uint32_t size,
+                       uint8_t* dest, uint32_t* sum) {
+    load_stream_t ls;
+    decomp_src_t src;
+    uint32_t done = 0;
+
+    if (stream_open(&ls, &src, fh, offset, size) != 0) {
+        return -1;
+    }
+    while (stream_refill(&src) == 0) {
+        uint32_t len = (uint32_t)(src.end - src.pos);
+        memcpy(dest + done, src.pos, len);
+        done += len;
+    }
+    smp_wait(ls.hash.ticket);
+    *sum = ls.hash.sum;
+    return !ls.error && done == size ? 0 : -1;
+}
+
+// Stream 'size' bytes at file 'offset' to 'dest'. Each chunk is summed
+// and hashed while the card is already transferring the next one.
+static int load_plain(file_handle_t* fh, uint32_t offset, uint32_t size,
+                      uint8_t* dest, uint32_t* sum) {
+    hash_job_t hash;
+
+    term_printf("Loading to address: 0x%08X\n", PTR_PHYS(dest));
+
+    if (offset % FS_SECTOR_SIZE != 0) {
+        return load_copied(fh, offset, size, dest, sum);
+    }
+    if (fs_seek(fh, offset) != 0) {
+        return -1;
+    }
+
+    memset(&hash, 0, sizeof(hash));
+    uint32_t done = 0;
+    int rc = 0;
+    int len = fs_read_start(fh, dest, size < LOAD_CHUNK_SIZE ? size : LOAD_CHUNK_SIZE);
+    while (len > 0) {
+        if (fs_read_finish() != 0) {
+            rc = -1;
+            break;
+        }
+        uint8_t* chunk = dest + done;
+        done += (uint32_t)len;
+
+        int next = 0;
+        if (done < size) {
+            uint32_t want = size - done;
+            next = load_poll() ? -1 :
+                   fs_read_start(fh, dest + done, want < LOAD_CHUNK_SIZE ? want : LOAD_CHUNK_SIZE);
+        }
+        hash_chunk(&hash, offset + (uint32_t)(chunk - dest), chunk, (uint32_t)len);
+        len = next;
+    }
+    if (len < 0) {
+        fs_read_finish();
+        rc = -1;
+    }
+
+    // The last job reads 'hash' on this stack
+    smp_wait(hash.ticket);
+    *sum = hash.sum;
+    return rc == 0 && done == size ? 0 : -1;
+}
+
+// Parse the mkbootimg header at the start of the file into 'img'.
+// Returns 1 for a valid header, 0 if there is none and -1 if corrupt.
+// A file starting with BOOT_MAGIC is never reported as headerless: run
+// as a flat binary, it would jump into the header and whatever codec
+// stream follows it.
+int loader_parse_header(file_handle_t* fh, boot_image_t* img) {
+    union {
+        boot_header_t v1;
+        boot_header_v2_t v2;
+    } hdr;
+
+    if (fh->size < sizeof(hdr.v1.magic)) {
+        return 0;
+    }
+    if (read_at(fh, 0, &hdr.v1.magic, sizeof(hdr.v1.magic)) != 0) {
+        term_print("ERROR: Cannot read image header\n");
+        return -1;
+    }
+    if (hdr.v1.magic != BOOT_MAGIC) {
+        return 0;
+    }
+    if (fh->size < sizeof(hdr) || read_at(fh, 0, &hdr, sizeof(hdr)) != 0) {
+        term_print("ERROR: Truncated image header\n");
+        return -1;
+    }
+    sign_chunk(0, (const uint8_t*)&hdr, sizeof(hdr));
+
+    memset(img, 0, sizeof(*img));
+    img->version = hdr.v1.version;
+
+    if (BOOT_VERSION_MAJOR(hdr.v1.version) == 1) {
+        // v1: one kernel payload following the header, codec in bits 15:8
+        // of the type word since 1.1
+        boot_section_t* k = &img->sections[0];
+        img->type = hdr.v1.type & BOOT_TYPE_MASK;
+        img->num_sections = 1;
+        k->kind = BOOT_SECTION_KERNEL;
+        k->codec = (hdr.v1.type >> BOOT_CODEC_SHIFT) & 0xFF;
+        k->offset = sizeof(hdr.v1);
+        k->size = hdr.v1.size;
+        k->load_addr = hdr.v1.load_addr;
+        k->checksum = hdr.v1.checksum;
+    } else if (BOOT_VERSION_MAJOR(hdr.v1.version) == 2) {
+        const boot_header_v2_t* h2 = &hdr.v2;
+        if (h2->num_sections == 0 || h2->num_sections > BOOT_MAX_SECTIONS ||
+            h2->header_size != sizeof(hdr.v2) + h2->num_sections * sizeof(boot_section_t)) {
+            term_print("ERROR: Bad section table\n");
+            return -1;
+        }
+        img->type = h2->type & BOOT_TYPE_MASK;
+        img->num_sections = h2->num_sections;
+
+        uint32_t table_size = h2->num_sections * sizeof(boot_section_t);
+        if (read_at(fh, sizeof(hdr.v2), img->sections, table_size) != 0 ||
+            loader_checksum(0, (const uint8_t*)img->sections, table_size) != h2->table_checksum) {
+            term_print("ERROR: Section table checksum mismatch\n");
+            return -1;
+        }
+        sign_chunk(sizeof(hdr.v2), (const uint8_t*)img->sections, table_size);
+    } else {
+        term_printf("ERROR: Unsupported image version 0x%08X\n", hdr.v1.version);
+        return -1;
+    }
+
+    // Sections must lie inside the file, one of each kind, with a kernel
+    uint32_t kinds = 0;
+    for (uint32_t i = 0; i < img->num_sections; i++) {
+        const boot_section_t* sec = &img->sections[i];
+        if (sec->kind == 0 || sec->kind > BOOT_SECTION_DTB || (kinds & (1u << sec->kind)) ||
+            sec->codec > CODEC_GZIP ||
+            sec->offset > fh->size || sec->size > fh->size - sec->offset) {
+            term_printf("ERROR: Bad image section %d\n", i);
+            return -1;
+        }
+        kinds |= 1u << sec->kind;
+    }
+    if (!(kinds & (1u << BOOT_SECTION_KERNEL))) {
+        term_print("ERROR: Image has no kernel section\n");
+        return -1;
+    }
+    return 1;
+}
+
+static const boot_section_t* find_section(const boot_image_t* img, uint32_t kind) {
+    for (uint32_t i = 0; i < img->num_sections; i++) {
+        if (img->sections[i].kind == kind) {
+            return &img->sections[i];
+        }
+    }
+    return NULL;
+}
+
+// Fill in type, load address and size from the image header without
+// reading the payload. Files without a header are left as configured.
+int loader_probe(boot_entry_t* entry) {
+    boot_image_t img;
+
+    file_handle_t* fh = fs_open(entry->path);
+    if (!fh) {
+        return -1;
+    }
+
+    TRACE_BEGIN(TRACE_PROBE, 0);
+    int rc = sign_begin(fh, entry) < 0 ? -1 : loader_parse_header(fh, &img);
+    if (rc > 0) {
+        const boot_section_t* k = find_section(&img, BOOT_SECTION_KERNEL);
+        entry->type = (boot_type_t)img.type;
+        if (k->load_addr) {
+            entry->load_addr = k->load_addr;
+        }
+        entry->size = k->size;
+    } else if (rc == 0) {
+        entry->size = fh->size;
+    }
+
+    sign.hashing = 0;
+    fs_close(fh);
+    TRACE_END(TRACE_PROBE, entry->size);
+    return rc < 0 ? -1 : 0;
+}
+
+// Load one header section to 'addr', reserve the RAM it took and check
+// its stored bytes against the header checksum. A DTB's reservation
+// includes the slack the boot edits grow it into.
+static int load_section(file_handle_t* fh, const boot_section_t* sec, uint32_t addr,
+                        uint32_t* out_size) {
+    static const char* const names[] = { "", "Kernel", "Initrd", "DTB" };
+    static const uint32_t kinds[] = { 0, MEMMAP_KERNEL, MEMMAP_INITRD, MEMMAP_DTB };
+    uint32_t slack = sec->kind == BOOT_SECTION_DTB ? FDT_EDIT_SLACK : 0;
+    uint32_t sum;
+    uint32_t size = sec->size;
+    int rc;
+
+    term_printf("%s: %d bytes\n", names[sec->kind], sec->size);
+    if (sec->codec != CODEC_NONE) {
+        rc = load_compressed(fh, sec->offset, sec->size, sec->codec, PHYS_PTR(addr),
+                             output_limit(addr), &sum, &size);
+        if (rc == 0) {
+            rc = claim_range(addr, size + slack, kinds[sec->kind]);
+        }
+    } else {
+        rc = claim_range(addr, size + slack, kinds[sec->kind]);
+        if (rc == 0) {
+            rc = load_plain(fh, sec->offset, sec->size, PHYS_PTR(addr), &sum);
+        }
+    }
+    if (rc != 0) {
+        return -1;
+    }
+
+    if (sum != sec->checksum) {
+        term_printf("ERROR: %s checksum 0x%08X, expected 0x%08X\n",
+                    names[sec->kind], sum, sec->checksum);
+        return -1;
+    }
+    *out_size = size;
+    return 0;
+}
+
+// Free RAM for a device tree of 'size' bytes, edit slack included
+static uint32_t place_dtb(uint32_t size) {
+    uint32_t addr = memmap_find(LOAD_DTB_MIN, 0xFFFFFFFF, size, LOAD_DTB_ALIGN, MEMMAP_LOW);
+    if (addr == 0) {
+        addr = memmap_find(0, 0xFFFFFFFF, size, LOAD_DTB_ALIGN, MEMMAP_HIGH);
+    }
+    if (addr == 0) {
+        term_print("ERROR: No room for the device tree\n");
+    }
+    return addr;
+}
+
+// Load every section of a boot image, noting where the initrd and DTB
+// went in 'params'. The kernel goes first, so the sections the loader
+// places can go above it.
+static int load_image(file_handle_t* fh, const boot_image_t* img, boot_entry_t* entry,
+                      uint32_t* entry_point, boot_params_t* params) {
+    term_printf("Boot image v%d.%d, %d section(s)\n",
+                BOOT_VERSION_MAJOR(img->version), img->version & 0xFFFF, img->num_sections);
+
+    for (uint32_t kind = BOOT_SECTION_KERNEL; kind <= BOOT_SECTION_DTB; kind++) {
+        const boot_section_t* sec = find_section(img, kind);
+        if (!sec) {
+            continue;
+        }
+        uint32_t dest = sec->load_addr;
+
+        if (kind == BOOT_SECTION_KERNEL) {
+            if (dest == 0) {
+                dest = entry->load_addr;
+            }
+            uint32_t kernel_size;
+            if (sec->codec == CODEC_NONE &&
+                (kernel_size = zimage_kernel_size(fh, sec->offset, sec->size)) != 0) {
+                dest = place_zimage(dest, sec->size, kernel_size);
+            }
+            *entry_point = dest;
+        } else if (dest == 0 && kind == BOOT_SECTION_INITRD) {
+            // Compressed initrds get the free span there (output_limit())
+            dest = place_initrd(sec->size);
+        } else if (dest == 0) {
+            dest = place_dtb(sec->size + FDT_EDIT_SLACK);
+        }
+        if (dest == 0) {
+            return -1;
+        }
+
+        // Padding ahead of the section goes into the digest first
+        uint32_t size;
+        if (sign_read_through(fh, sec->offset) != 0 ||
+            load_section(fh, sec, dest, &size) != 0) {
+            return -1;
+        }
+        if (kind == BOOT_SECTION_INITRD) {
+            params->initrd_start = dest;
+            params->initrd_size = size;
+        } else if (kind == BOOT_SECTION_DTB) {
+            params->dtb = dest;
+            params->dtb_size = size + FDT_EDIT_SLACK;
+        }
+    }
+    return 0;
+}
+
+// Copy the device tree RETROS-BIOS passed to a buffer with room for the
+// boot edits, unless the image brought its own
+static int copy_firmware_dtb(boot_params_t* params) {
+    const void* fdt = firmware_fdt(boot_tags);
+    if (params->dtb || !fdt) {
+        return 0;
+    }
+
+    uint32_t size = fdt_total_size(fdt);
+    uint32_t addr = place_dtb(size + FDT_EDIT_SLACK);
+    if (addr == 0 || claim_range(addr, size + FDT_EDIT_SLACK, MEMMAP_DTB) != 0) {
+        return -1;
+    }
+    memcpy(PHYS_PTR(addr), fdt, size);
+    params->dtb = addr;
+    params->dtb_size = size + FDT_EDIT_SLACK;
+    return 0;
+}
+
+// Fill in the device tree, or build ATAGS without one, and return the
+// r1/r2 pair the kernel expects
+static int prepare_handoff(boot_params_t* params, uint32_t* r1, uint32_t* r2) {
+    if (copy_firmware_dtb(params) != 0) {
+        return -1;
+    }
+
+    if (params->dtb) {
+        void* fdt = PHYS_PTR(params->dtb);
+        if (fdt_open(fdt, params->dtb_size) != 0 || setup_fdt(fdt, params) != 0) {
+            term_print("ERROR: Bad or full device tree\n");
+            return -1;
+        }
+        term_printf("Device tree at 0x%08X\n", params->dtb);
+        *r1 = MACH_TYPE_DT;
+        *r2 = params->dtb;
+    } else {
+        *r1 = params->machine_type;
+        *r2 = create_atags(params);
+        term_printf("ATAGS at 0x%08X\n", *r2);
+    }
+    return 0;
+}
+
+// Termlink protocol: the boot block for r0, with the kernel's r1/r2
+// and what the loader knows about the image. 0 if it does not fit.
+static uint32_t termlink_block(const boot_entry_t* entry, const boot_params_t* params,
+                               uint32_t r1, uint32_t r2) {
+    termlink_boot_t boot;
+
+    memset(&boot, 0, sizeof(boot));
+    boot.boot_device = params->boot_device;
+    boot.boot_type = entry->type;
+    boot.entry_point = ready.entry_point;
+    boot.image_size = entry->size;
+    memcpy(boot.name, entry->name, sizeof(boot.name));
+    memcpy(boot.path, entry->path, sizeof(boot.path));
+    if (sign.active) {
+        boot.hash_state = sign.failed ? TERMLINK_HASH_FAILED : TERMLINK_HASH_VERIFIED;
+        memcpy(boot.sha256, sign.digest, sizeof(boot.sha256));
+    }
+
+    boot.machine_type = r1;
+    boot.boot_tags = r2;
+    boot.revision = params->revision;
+    boot.initrd_start = params->initrd_start;
+    boot.initrd_size = params->initrd_size;
+    boot.load_us = ready.load_time;
+
+    uint32_t addr = termlink_handoff(&boot);
+    if (addr == 0) {
+        term_print("ERROR: No room for the Termlink block\n");
+    }
+    return addr;
+}
+
+// Bare kernel file: compressed stream, ELF or flat binary
+static int load_bare(file_handle_t* fh, boot_entry_t* entry, uint32_t* entry_point) {
+    elf32_ehdr_t eh;
+    elf32_phdr_t ph[ELF_MAX_PHDRS];
+    int codec = CODEC_NONE;
+
+    memset(&eh, 0, sizeof(eh));
+    if (fh->size >= sizeof(eh) && read_at(fh, 0, &eh, sizeof(eh)) == 0) {
+        codec = decomp_detect((const uint8_t*)&eh, sizeof(eh));
+    }
+
+    if (codec != CODEC_NONE) {
+        uint32_t sum, size;
+        if (load_compressed(fh, 0, fh->size, codec, PHYS_PTR(entry->load_addr),
+                            output_limit(entry->load_addr), &sum, &size) != 0) {
+            return -1;
+        }
+        return claim_range(entry->load_addr, size, MEMMAP_KERNEL);
+    }
+    if (fh->size >= sizeof(eh) && is_elf(&eh)) {
+        term_print("ELF image\n");
+        if (elf_check_header(&eh, fh->size) != 0 || load_elf(fh, &eh, ph, entry_point) != 0) {
+            return -1;
+        }
+        return sign_elf(fh, &eh, ph);
+    }
+
+    uint32_t dest = entry->load_addr;
+    uint32_t kernel_size = zimage_kernel_size(fh, 0, fh->size);
+    if (kernel_size) {
+        dest = place_zimage(dest, fh->size, kernel_size);
+        *entry_point = dest;
+    }
+
+    uint32_t sum;
+    if (claim_range(dest, fh->size, MEMMAP_KERNEL) != 0) {
+        return -1;
+    }
+    return load_plain(fh, 0, fh->size, PHYS_PTR(dest), &sum);
+}
+
+// Stream the entry's separate initrd file above the kernel. Only the
+// kernel image is signed, so SECURE_BOOT builds take the initrd from
+// inside it instead.
+static int load_initrd_file(const boot_entry_t* entry, boot_params_t* params) {
+#ifdef SECURE_BOOT
+    term_printf("Ignoring unsigned initrd %s\n", entry->initrd_path);
+    (void)params;
+    return 0;
+#else
+    uint32_t sum;
+
+    term_printf("Opening initrd: %s\n", entry->initrd_path);
+    file_handle_t* fh = bootindex_open(entry->initrd_path);
+    if (!fh) {
+        fh = fs_open(entry->initrd_path);
+    }
+    if (!fh) {
+        term_print("ERROR: Cannot open initrd file\n");
+        return -1;
+    }
+
+    term_printf("Initrd: %d bytes\n", fh->size);
+    uint32_t dest = place_initrd(fh->size);
+    int rc = dest && claim_range(dest, fh->size, MEMMAP_INITRD) == 0 &&
+             load_plain(fh, 0, fh->size, PHYS_PTR(dest), &sum) == 0 ? 0 : -1;
+    if (rc == 0) {
+        params->initrd_start = dest;
+        params->initrd_size = fh->size;
+    }
+    fs_close(fh);
+    return rc;
+#endif
+}
+
+// Open, load and verify the entry's image into 'ready'
+static int load_verified(boot_entry_t* entry) {
+    ready.entry = NULL;
+    load_cancelled = 0;
     term_printf("Opening file: %s\n", entry->path);
     
-    file_handle_t* fh = fs_open(entry->path);
+    // Straight from the cached extents when the boot index has the file
+    file_handle_t* fh = bootindex_open(entry->path);
+    if (!fh) {
+        fh = fs_open(entry->path);
+    }
     if (!fh) {
         term_print("ERROR: Cannot open kernel file\n");
         return -1;
     }
     
-    // Load kernel to specified address
-    uint8_t* load_addr = (uint8_t*)entry->load_addr;
-    term_printf("Loading to address: 0x%08X\n", entry->load_addr);
-    
     // Read kernel data
-    if (fs_read(fh, load_addr, entry->size) != 0) {
-        term_print("ERROR: Failed to read kernel\n");
-        fs_close(fh);
-        return -1;
+    uint32_t load_start = get_timer_count();
+    TRACE_BEGIN(TRACE_LOAD, 0);
+    uint32_t entry_point = entry->load_addr;
+    boot_image_t img;
+    boot_params_t* params = &ready.params;
+    
+    kernel_top = 0;
+    setup_boot_params(params, boot_tags);
+    int rc = sign_begin(fh, entry);
+    if (rc > 0) {
+        term_printf("Signed image (%d bytes)\n", sign.signed_len);
+    }
+    if (rc >= 0) {
+        rc = loader_parse_header(fh, &img);
+    }
+    if (rc > 0) {
+        entry->type = (boot_type_t)img.type;
+        entry->size = find_section(&img, BOOT_SECTION_KERNEL)->size;
+        rc = load_image(fh, &img, entry, &entry_point, params);
+    } else if (rc == 0) {
+        entry->size = fh->size;
+        rc = load_bare(fh, entry, &entry_point);
     }
+    if (rc == 0) {
+        rc = sign_finish(fh);
+    }
+    sign.hashing = 0;
     
     fs_close(fh);
+    if (rc == 0 && params->initrd_size == 0 && entry->initrd_path[0]) {
+        rc = load_initrd_file(entry, params);
+    }
+    TRACE_END(TRACE_LOAD, entry->size);
+    if (rc != 0) {
+        term_print(load_cancelled ? "Load cancelled\n" : "ERROR: Failed to read kernel\n");
+        return -1;
+    }
+    uint32_t load_time = get_timer_count() - load_start;
+    
+    TRACE_BEGIN(TRACE_VERIFY, 0);
+    rc = verify_signature(entry);
+    TRACE_END(TRACE_VERIFY, rc);
+    if (rc != 0) {
+        return -1;
+    }
+    
+    ready.entry = entry;
+    ready.entry_point = entry_point;
+    ready.load_time = load_time;
+    return 0;
+}
+
+// Hook called between chunks of the next load; NULL to remove
+void loader_set_poll(loader_poll_fn fn, void* ctx) {
+    poll_fn = fn;
+    poll_ctx = ctx;
+}
+
+// Load and verify 'entry' without booting it, so load_kernel() can jump
+// straight away later. Whatever it reserved stays reserved until the
+// caller releases it, also when it fails.
+int loader_prefetch(boot_entry_t* entry) {
+    return load_verified(entry);
+}
+
+// The entry loader_prefetch() left in memory, if any
+const boot_entry_t* loader_prefetched(void) {
+    return ready.entry;
+}
+
+// Forget the prefetched image once its memory has been released
+void loader_discard(void) {
+    ready.entry = NULL;
+}
+
+int load_kernel(boot_entry_t* entry) {
+    if (ready.entry == entry) {
+        term_print("Kernel prefetched\n");
+        if (sign.failed) {
+            term_print("WARNING: Signature verification failed\n");
+        }
+    } else if (load_verified(entry) != 0) {
+        return -1;
+    }
+    ready.entry = NULL;
     
     term_print("Kernel loaded successfully\n");
-    delay_ms(500);
+    term_printf("Load time: %d us (%d bytes)\n", ready.load_time, entry->size);
+    boot_pause_ms(500);
     
-    // Setup boot parameters
-    boot_params_t params;
-    params.machine_type = 0;  // Generic ARM
-    params.boot_device = 0;   // SD card
-    strcpy(params.cmdline, "console=ttyAMA0,115200 root=/dev/mmcblk0p2 rootwait");
-    params.initrd_start = 0;
-    params.initrd_size = 0;
+    // Memory, command line and initrd for the kernel
+    uint32_t r0 = 0, r1, r2;
+    if (prepare_handoff(&ready.params, &r1, &r2) != 0) {
+        return -1;
+    }
+    // A Termlink kernel also gets the boot block in r0
+    if (ready.params.protocol == PROTOCOL_TERMLINK) {
+        r0 = termlink_block(entry, &ready.params, r1, r2);
+        if (r0 == 0) {
+            return -1;
+        }
+        term_printf("Termlink block at 0x%08X\n", r0);
+    }
+    
+    term_printf("Jumping to kernel at 0x%08X...\n\n", ready.entry_point);
+    boot_pause_ms(500);
     
-    term_print("Jumping to kernel...\n\n");
-    delay_ms(500);
+    TRACE_MARK(TRACE_JUMP, ready.entry_point);
+#ifdef TRACE_DUMP_ON_BOOT
+    trace_dump_uart();
+#endif
+    
+    // The kernel takes the UART over
+    term_flush();
     
     // Jump to kernel
-    jump_to_kernel(entry->load_addr, 0, 0, 0);
+    jump_to_kernel(ready.entry_point, r0, r1, r2);
     
     return 0;
 }
 
+// Check the signature of the image just loaded. With SECURE_BOOT only
+// images signed by a trusted key may boot; otherwise a bad or missing
+// signature is reported and the boot goes ahead.
 int verify_signature(boot_entry_t* entry) {
-    (void)entry;
-    // Signature verification would be implemented here
-    // For now, always return success
+    int rc;
+
+    if (!sign.active) {
+#ifdef SECURE_BOOT
+        term_print("ERROR: Image is not signed\n");
+        return -1;
+#else
+        return 0;
+#endif
+    }
+
+    uint32_t start = get_timer_count();
+    rc = sign.unhashed ? -1 : verify_boot_signature(sign.digest, sizeof(sign.digest),
+                                                    entry->signature);
+    uint32_t elapsed = get_timer_count() - start;
+
+    if (rc == 0) {
+        term_printf("Signature OK (%d us)\n", elapsed);
+        return 0;
+    }
+
+    if (load_public_keys() == 0) {
+        term_print("WARNING: No trusted keys built in\n");
+    }
+#ifdef SECURE_BOOT
+    term_print("ERROR: Signature verification failed\n");
+    return -1;
+#else
+    term_print("WARNING: Signature verification failed\n");
+    sign.failed = 1;
     return 0;
+#endif
 }
 
 void jump_to_kernel(uint32_t addr, uint32_t r0, uint32_t r1, uint32_t atags) {
+    // Secondary cores wait for the kernel to start them
+    smp_park();
+    
     // Call assembly wrapper
     jump_to_kernel_asm(addr, r0, r1, atags);
 }
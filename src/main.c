@@ -3,58 +3,147 @@
 #include "mfboot.h"
 #include "terminal.h"
 #include "memory_mgr.h"
+#include "memmap.h"
 #include "filesystem.h"
+#include "bcache.h"
 #include "loader.h"
 #include "hardware.h"
+#include "trace.h"
+#include "bootindex.h"
+#include "config.h"
+#include "smp.h"
+#include "termlink.h"
+#include "fbcon.h"
 
-// Boot entry storage
-static boot_entry_t boot_entries[8];
+// Boot entry storage: the kernel images found, then maintenance and
+// diagnostics
+#define MAX_BOOT_ENTRIES    8
+#define MAX_IMAGE_ENTRIES   (MAX_BOOT_ENTRIES - 2)
+
+static boot_entry_t boot_entries[MAX_BOOT_ENTRIES];
 static int num_boot_entries = 0;
 
+// Fast boot skips the pauses that only exist so the screen can be read
+#ifdef FAST_BOOT
+int fast_boot = 1;
+#else
+int fast_boot = 0;
+#endif
+
+uint32_t boot_tags;
+
+// What the terminal offers: the serial console and the framebuffer
+static termlink_info_t termlink;
+
+void boot_pause_ms(uint32_t ms) {
+    if (!fast_boot) {
+        delay_ms(ms);
+    }
+}
+
 void mfboot_main(uint32_t r0, uint32_t r1, uint32_t atags) {
     (void)r0;
     (void)r1;
-    (void)atags;
+    boot_tags = atags;
     
     // Initialize terminal from RETROS-BIOS state
     terminal_init();
     
+    // Initialize memory management: RAM from the ATAGS, then the heap
+    // at the top of it. The trace ring lives on the heap, so the earlier
+    // stages are recorded after the fact. This comes before the header
+    // so that the framebuffer console, which needs the heap, shows it.
+    uint32_t mem_start = get_timer_count();
+    int mem_status = memmap_init(atags);
+    if (mem_status == 0) {
+        mem_status = memory_init();
+    }
+    trace_init();
+    trace_record_at(stage2_entry_time, TRACE_STAGE2, TRACE_PHASE_MARK, 0);
+#ifdef ENABLE_MMU
+    trace_record_at(stage2_mmu_time, TRACE_MMU, TRACE_PHASE_MARK, 0);
+#endif
+    trace_record_at(mem_start, TRACE_MEMORY_INIT, TRACE_PHASE_BEGIN, 0);
+    TRACE_END(TRACE_MEMORY_INIT, 0);
+    
+    // From here on console output is queued and drains in the
+    // background, and shows on the HDMI framebuffer if RETROS-BIOS set
+    // one up
+    if (mem_status == 0) {
+        term_buffer_init();
+        termlink_init(&termlink);
+        fbcon_init(&termlink);
+    }
+    
     // Display boot agent header
     term_clear();
     term_print("MF Boot Agent v" MFBOOT_VERSION "\n");
     term_print(COPYRIGHT "\n");
     term_print("LOADER v1.1\n");
     term_print("EXEC VERSION 41.10\n");
-    delay_ms(200);
-    
-    // Initialize memory management
-    memory_init();
+    boot_pause_ms(200);
     
-    // Allocate upper memory
+    // The heap is handed out to subsystems as they initialize
     term_print("Initializing Upper Memory: ");
-    void* upper_mem = memory_allocate_upper(UPPERMEM_SIZE);
-    if (upper_mem) {
-        term_print("64 KB\n");
-        term_printf("Upper Memory Address: 0x%08X\n", (uint32_t)upper_mem);
+    if (mem_status == 0) {
+        mem_stats_t ms;
+        memory_get_stats(&ms);
+        term_printf("%d KB\n", UPPERMEM_SIZE / 1024);
+        term_printf("Upper Memory Address: 0x%08X\n", (uint32_t)(uintptr_t)memory_upper_base());
+        term_printf("Heap: %d KB\n", ms.total / 1024);
+        memmap_info_t mi;
+        memmap_get_info(&mi);
+        term_printf("RAM: %d MB", mi.ram_size >> 20);
+        if (mi.vc_size) {
+            term_printf(" (GPU %d MB)", mi.vc_size >> 20);
+        }
+        term_print("\n");
+        if (fbcon_active()) {
+            term_printf("Display: %ux%u, %u bpp\n",
+                        termlink.fb_width, termlink.fb_height, termlink.fb_depth);
+        }
     } else {
         term_print("FAILED\n");
         enter_emergency_mode();
     }
-    delay_ms(150);
+    
+    // Worker cores for the loader (BCM2836/7)
+    term_printf("Processor Cores: %d\n", smp_init());
+    
+    // Block cache for filesystem metadata
+    term_print("Initializing Block Cache: ");
+    TRACE_BEGIN(TRACE_BCACHE_INIT, 0);
+    if (bcache_init(BCACHE_DEFAULT_SIZE) == 0) {
+        term_printf("%d KB\n", BCACHE_DEFAULT_SIZE / 1024);
+    } else {
+        // Not fatal: the filesystem falls back to uncached reads
+        term_print("DISABLED\n");
+    }
+    TRACE_END(TRACE_BCACHE_INIT, 0);
+    boot_pause_ms(150);
     
     // Initialize filesystem
     term_print("Initializing Filesystem: ");
+    TRACE_BEGIN(TRACE_FS_INIT, 0);
     if (fs_init() == 0) {
         term_print("OK\n");
     } else {
         term_print("FAILED\n");
         enter_emergency_mode();
     }
-    delay_ms(100);
+    TRACE_END(TRACE_FS_INIT, 0);
+    boot_pause_ms(100);
+    
+    // Settings from the card; anything it leaves out keeps its default
+    static const char* const config_sources[] = { "defaults", "text", "precompiled" };
+    int config_src = config_load();
+    term_printf("Configuration: %s\n", config_sources[config_src]);
     
     // Scan for boot devices
     term_print("\nScanning for boot devices...\n");
+    TRACE_BEGIN(TRACE_SCAN, 0);
     boot_entry_t* entries = scan_boot_devices();
+    TRACE_END(TRACE_SCAN, num_boot_entries);
     
     // Check for holotape override
     if (check_holotape_present()) {
@@ -65,12 +154,17 @@ void mfboot_main(uint32_t r0, uint32_t r1, uint32_t atags) {
     }
     
     // Display boot menu or auto-boot
+    TRACE_MARK(TRACE_MENU, 0);
+    uint32_t timeout = config_int(CONFIG_MENU_TIMEOUT);
     if (gpio_read(BOOT_MENU_PIN) == 0 || get_boot_count() > 1) {
-        display_boot_menu(entries);
+        display_boot_menu(entries, 0);
+    } else if (timeout > 0) {
+        // Count down to the default entry, loading it meanwhile
+        display_boot_menu(entries, timeout);
     } else {
         // Auto-boot primary OS
         term_print("Auto-booting primary OS...\n");
-        delay_ms(500);
+        boot_pause_ms(500);
         auto_boot_primary();
     }
     
@@ -78,33 +172,117 @@ void mfboot_main(uint32_t r0, uint32_t r1, uint32_t atags) {
     enter_emergency_mode();
 }
 
+// Menu names for the stock kernel images; any other image found on a
+// search path is named after its file
+static const struct {
+    const char* path;
+    const char* name;
+    boot_type_t type;
+} boot_images[] = {
+    { "/boot/uos.img", "Unified Operating System", BOOT_TYPE_UOS },
+    { "/boot/pipos.img", "PIP-OS v7.1.0.8", BOOT_TYPE_PIPOS },
+};
+
+static void name_entry(boot_entry_t* entry) {
+    for (uint32_t i = 0; i < sizeof(boot_images) / sizeof(boot_images[0]); i++) {
+        if (strcmp(entry->path, boot_images[i].path) == 0) {
+            strcpy(entry->name, boot_images[i].name);
+            entry->type = boot_images[i].type;
+            return;
+        }
+    }
+
+    const char* base = entry->path;
+    for (const char* p = entry->path; *p; p++) {
+        if (*p == '/') {
+            base = p + 1;
+        }
+    }
+    uint32_t len = strlen(base);
+    if (len >= sizeof(entry->name)) {
+        len = sizeof(entry->name) - 1;
+    }
+    memcpy(entry->name, base, len);
+    entry->name[len] = '\0';
+    entry->type = BOOT_TYPE_UOS;
+}
+
+// Everything from the configuration that changes what a scan finds, so
+// a cached scan is not used after an edit
+static uint32_t scan_settings_crc(const char* const* paths, uint32_t num_paths) {
+    uint32_t crc = 0;
+    uint32_t load_addr = config_int(CONFIG_BOOT_LOAD_ADDRESS);
+    const char* initrd = config_string(CONFIG_BOOT_INITRD);
+
+    for (uint32_t i = 0; i < num_paths; i++) {
+        crc = crc32(crc, paths[i], strlen(paths[i]) + 1);
+    }
+    crc = crc32(crc, &load_addr, sizeof(load_addr));
+    return crc32(crc, initrd, strlen(initrd) + 1);
+}
+
+// A separate initrd for a kernel image: "<name>.rd" next to
+// "<name>.img", used when the image has no initrd section of its own
+static void find_initrd(boot_entry_t* entry) {
+    uint32_t len = strlen(entry->path);
+
+    entry->initrd_path[0] = '\0';
+    if (strcmp(config_string(CONFIG_BOOT_INITRD), "auto") != 0 ||
+        len < 4 || len >= sizeof(entry->initrd_path) ||
+        strcmp(entry->path + len - 4, ".img") != 0) {
+        return;
+    }
+    memcpy(entry->initrd_path, entry->path, len - 4);
+    strcpy(entry->initrd_path + len - 4, ".rd");
+    if (fs_exists(entry->initrd_path)) {
+        term_printf("  Initrd: %s\n", entry->initrd_path);
+    } else {
+        entry->initrd_path[0] = '\0';
+    }
+}
+
 boot_entry_t* scan_boot_devices(void) {
-    num_boot_entries = 0;
-    
-    // Scan for UOS kernel
-    if (fs_exists("/boot/uos.img")) {
-        boot_entry_t* entry = &boot_entries[num_boot_entries++];
-        strcpy(entry->name, "Unified Operating System");
-        strcpy(entry->path, "/boot/uos.img");
-        entry->type = BOOT_TYPE_UOS;
-        entry->load_addr = 0x8000;
-        term_print("  Found: UOS\n");
+    const char* const* paths = NULL;
+    uint32_t num_paths = 0;
+    if (config_int(CONFIG_SDCARD_ENABLED)) {
+        num_paths = config_list(CONFIG_SDCARD_SEARCH_PATHS, &paths);
     }
-    
-    // Scan for PIP-OS kernel
-    if (fs_exists("/boot/pipos.img")) {
-        boot_entry_t* entry = &boot_entries[num_boot_entries++];
-        strcpy(entry->name, "PIP-OS v7.1.0.8");
-        strcpy(entry->path, "/boot/pipos.img");
-        entry->type = BOOT_TYPE_PIPOS;
-        entry->load_addr = 0x8000;
-        term_print("  Found: PIP-OS\n");
+    uint32_t load_addr = config_int(CONFIG_BOOT_LOAD_ADDRESS);
+    uint32_t scan_key = scan_settings_crc(paths, num_paths);
+
+    num_boot_entries = bootindex_load(boot_entries, MAX_IMAGE_ENTRIES, scan_key);
+    if (num_boot_entries >= 0) {
+        term_print("  Boot index up to date\n");
+        for (int i = 0; i < num_boot_entries; i++) {
+            term_printf("  Found: %s (%d bytes)\n", boot_entries[i].name, boot_entries[i].size);
+        }
+    } else {
+        num_boot_entries = 0;
+        for (uint32_t i = 0; i < num_paths && num_boot_entries < MAX_IMAGE_ENTRIES; i++) {
+            if (strlen(paths[i]) >= sizeof(boot_entries[0].path) || !fs_exists(paths[i])) {
+                continue;
+            }
+            boot_entry_t* entry = &boot_entries[num_boot_entries++];
+            strcpy(entry->path, paths[i]);
+            name_entry(entry);
+            entry->load_addr = load_addr ? load_addr : KERNEL_LOAD_ADDR;
+            entry->size = 0;
+            if (loader_probe(entry) != 0) {
+                term_print("  WARNING: Bad image header\n");
+            }
+            term_printf("  Found: %s (%d bytes)\n", entry->name, entry->size);
+            find_initrd(entry);
+        }
+
+        // Saved with every path searched, so a new image is noticed too
+        bootindex_save(boot_entries, num_boot_entries, paths, (int)num_paths, scan_key);
     }
     
     // Always add maintenance mode
     boot_entry_t* maint = &boot_entries[num_boot_entries++];
     strcpy(maint->name, "Maintenance Mode");
     strcpy(maint->path, "");
+    strcpy(maint->initrd_path, "");
     maint->type = BOOT_TYPE_MAINTENANCE;
     maint->load_addr = 0;
     
@@ -112,6 +290,7 @@ boot_entry_t* scan_boot_devices(void) {
     boot_entry_t* diag = &boot_entries[num_boot_entries++];
     strcpy(diag->name, "Hardware Diagnostics");
     strcpy(diag->path, "");
+    strcpy(diag->initrd_path, "");
     diag->type = BOOT_TYPE_DIAGNOSTIC;
     diag->load_addr = 0;
     
@@ -124,7 +303,13 @@ int count_boot_entries(boot_entry_t* entries) {
 }
 
 void auto_boot_primary(void) {
-    // Try to boot the first available OS
+    // The configured default entry, else the first available OS
+    uint32_t def = config_int(CONFIG_MENU_DEFAULT);
+    if (def < (uint32_t)num_boot_entries) {
+        term_printf("Loading %s...\n", boot_entries[def].name);
+        boot_selected(&boot_entries[def]);
+        return;
+    }
     for (int i = 0; i < num_boot_entries; i++) {
         if (boot_entries[i].type == BOOT_TYPE_UOS || 
             boot_entries[i].type == BOOT_TYPE_PIPOS) {
@@ -139,7 +324,49 @@ void auto_boot_primary(void) {
     enter_emergency_mode();
 }
 
+// Free what a failed or unwanted kernel load allocated and reserved
+static void release_boot_memory(void) {
+    loader_discard();
+    memory_arena_reset(MEM_ARENA_BOOT);
+    memmap_release(MEMMAP_KERNEL);
+    memmap_release(MEMMAP_INITRD);
+    memmap_release(MEMMAP_DTB);
+    memmap_release(MEMMAP_TERMLINK);
+}
+
+// Load and verify a kernel entry while 'poll' keeps the menu running.
+// Output is muted; if the load fails, booting the entry later loads it
+// again and reports why. Returns 0 when boot_selected() can jump at once.
+int boot_prefetch(boot_entry_t* entry, int (*poll)(void* ctx), void* ctx) {
+    if (entry->type == BOOT_TYPE_MAINTENANCE || entry->type == BOOT_TYPE_DIAGNOSTIC) {
+        return -1;
+    }
+    boot_discard_prefetch();
+
+    int prev_arena = memory_arena_enter(MEM_ARENA_BOOT);
+    term_set_muted(1);
+    loader_set_poll(poll, ctx);
+    int rc = loader_prefetch(entry);
+    loader_set_poll(NULL, NULL);
+    term_set_muted(0);
+    memory_arena_enter(prev_arena);
+    if (rc != 0) {
+        release_boot_memory();
+    }
+    return rc;
+}
+
+// Drop a prefetched kernel before its memory is needed for anything else
+void boot_discard_prefetch(void) {
+    if (loader_prefetched()) {
+        release_boot_memory();
+    }
+}
+
 void boot_selected(boot_entry_t* entry) {
+    if (loader_prefetched() != entry) {
+        boot_discard_prefetch();
+    }
     if (entry->type == BOOT_TYPE_MAINTENANCE) {
         enter_maintenance_mode();
         return;
@@ -147,7 +374,7 @@ void boot_selected(boot_entry_t* entry) {
     
     if (entry->type == BOOT_TYPE_DIAGNOSTIC) {
         term_print("\nStarting Hardware Diagnostics...\n");
-        delay_ms(500);
+        boot_pause_ms(500);
         // Diagnostics would be implemented here
         extern void run_diagnostics(void);
         run_diagnostics();
@@ -158,7 +385,12 @@ void boot_selected(boot_entry_t* entry) {
     term_printf("\nLoading %s\n", entry->name);
     term_printf("Path: %s\n", entry->path);
     
-    if (load_kernel(entry) != 0) {
+    // Whatever the attempt allocates or reserves is released if it fails
+    int prev_arena = memory_arena_enter(MEM_ARENA_BOOT);
+    int rc = load_kernel(entry);
+    memory_arena_enter(prev_arena);
+    if (rc != 0) {
+        release_boot_memory();
         term_print("ERROR: Failed to load kernel\n");
         delay_ms(2000);
         enter_emergency_mode();
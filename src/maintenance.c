@@ -4,22 +4,23 @@
 #include "terminal.h"
 #include "hardware.h"
 #include "memory_mgr.h"
+#include "memmap.h"
+#include "bcache.h"
+#include "trace.h"
+#include "screen.h"
+#include "config.h"
 
 static void print_menu(void);
 static void show_system_info(void);
 static void show_memory_info(void);
 static void test_hardware(void);
+static void show_boot_trace(void);
 
 void enter_maintenance_mode(void) {
-    term_clear();
-    term_print("═══════════════════════════════════════\n");
-    term_print("    RobCo Maintenance Terminal v2.1    \n");
-    term_print("═══════════════════════════════════════\n\n");
-    
     while (1) {
         print_menu();
         
-        term_print("\nSelect option: ");
+        term_print("Select option: ");
         char key = wait_for_key();
         term_printf("%c\n\n", key);
         
@@ -40,6 +41,16 @@ void enter_maintenance_mode(void) {
             case '5':
                 enter_emergency_mode();
                 break;
+            case 'T':
+            case 't':
+                show_boot_trace();
+                break;
+            case 'B':
+            case 'b': {
+                extern void run_benchmarks(void);
+                run_benchmarks();
+                break;
+            }
             case 'R':
             case 'r':
                 term_print("Rebooting system...\n");
@@ -53,18 +64,36 @@ void enter_maintenance_mode(void) {
         
         term_print("\nPress any key to continue...");
         wait_for_key();
-        term_clear();
     }
 }
 
+// The option page, as a screen frame: after an option's output the
+// screen model starts over with a clear
 static void print_menu(void) {
-    term_print("Maintenance Options:\n");
-    term_print("  [1] System Information\n");
-    term_print("  [2] Memory Information\n");
-    term_print("  [3] Hardware Tests\n");
-    term_print("  [4] Return to Boot Menu\n");
-    term_print("  [5] Emergency Shell\n");
-    term_print("  [R] Reboot System\n");
+    static const char* const options[] = {
+        "Maintenance Options:",
+        "  [1] System Information",
+        "  [2] Memory Information",
+        "  [3] Hardware Tests",
+        "  [4] Return to Boot Menu",
+        "  [5] Emergency Shell",
+        "  [T] Boot Trace",
+        "  [B] Benchmarks",
+        "  [R] Reboot System",
+    };
+    uint8_t normal = (uint8_t)config_int(CONFIG_DISPLAY_COLOR_NORMAL);
+    int row = 0;
+
+    screen_begin();
+    screen_printf(row++, normal, "═══════════════════════════════════════");
+    screen_printf(row++, normal, "    RobCo Maintenance Terminal v2.1    ");
+    screen_printf(row++, normal, "═══════════════════════════════════════");
+    row++;
+    for (uint32_t i = 0; i < sizeof(options) / sizeof(options[0]); i++) {
+        screen_printf(row++, normal, "%s", options[i]);
+    }
+    screen_printf(row, normal, "");
+    screen_end();
 }
 
 static void show_system_info(void) {
@@ -88,6 +117,13 @@ static void show_system_info(void) {
     
     uint32_t timer = get_timer_count();
     term_printf("System Timer: %d us\n", timer);
+    term_printf("Stage2 Entry: %d us (%d us ago)\n",
+                stage2_entry_time, timer - stage2_entry_time);
+#ifdef ENABLE_MMU
+    term_printf("MMU/Caches: ON (setup %d us)\n", stage2_mmu_time - stage2_entry_time);
+#else
+    term_print("MMU/Caches: OFF\n");
+#endif
 }
 
 static void show_memory_info(void) {
@@ -97,8 +133,41 @@ static void show_memory_info(void) {
     term_printf("Kernel Load Address: 0x%08X\n", KERNEL_LOAD_ADDR);
     
     extern uint8_t __bss_start, __bss_end;
-    term_printf("BSS Start: 0x%08X\n", (uint32_t)&__bss_start);
-    term_printf("BSS End: 0x%08X\n", (uint32_t)&__bss_end);
+    term_printf("BSS Start: 0x%08X\n", (uint32_t)(uintptr_t)&__bss_start);
+    term_printf("BSS End: 0x%08X\n", (uint32_t)(uintptr_t)&__bss_end);
+    
+    term_print("\nMemory Map:\n");
+    memmap_show();
+    
+    mem_stats_t ms;
+    memory_get_stats(&ms);
+    term_print("\nHeap:\n");
+    term_printf("  Size: %d KB  In use: %d KB  Peak: %d KB\n",
+                ms.total / 1024, ms.used / 1024, ms.peak / 1024);
+    term_printf("  Free: %d KB in %d block(s), largest %d KB\n",
+                ms.free / 1024, ms.free_blocks, ms.largest_free / 1024);
+    // Share of free memory outside the largest block
+    term_printf("  Fragmentation: %d%%\n",
+                ms.free ? 100 - (uint32_t)((uint64_t)ms.largest_free * 100 / ms.free) : 0);
+    term_printf("  Allocs: %d  Frees: %d  Failed: %d\n", ms.allocs, ms.frees, ms.failures);
+    term_printf("  Slabs: %d KB\n", ms.slab_bytes / 1024);
+    for (int c = 0; c < MEM_NUM_CLASSES; c++) {
+        if (ms.class_peak[c]) {
+            term_printf("    %d bytes: %d live, peak %d\n",
+                        memory_class_size(c), ms.class_live[c], ms.class_peak[c]);
+        }
+    }
+    term_printf("  System arena: %d KB (peak %d KB)\n",
+                ms.arena_used[MEM_ARENA_SYSTEM] / 1024, ms.arena_peak[MEM_ARENA_SYSTEM] / 1024);
+    term_printf("  Boot arena: %d KB (peak %d KB)\n",
+                ms.arena_used[MEM_ARENA_BOOT] / 1024, ms.arena_peak[MEM_ARENA_BOOT] / 1024);
+    
+    bcache_stats_t cs;
+    bcache_get_stats(&cs);
+    term_print("\nBlock Cache:\n");
+    term_printf("  Size: %d blocks (%d-way)\n", cs.blocks, BCACHE_WAYS);
+    term_printf("  Hits: %d  Misses: %d\n", cs.hits, cs.misses);
+    term_printf("  Read-ahead: %d blocks, %d used\n", cs.readahead, cs.readahead_hits);
 }
 
 static void test_hardware(void) {
@@ -106,6 +175,7 @@ static void test_hardware(void) {
     term_print("─────────────────────────────────────\n");
     
     term_print("Testing UART... ");
+    term_flush();
     uart_putc('O');
     uart_putc('K');
     term_print("\n");
@@ -124,17 +194,40 @@ static void test_hardware(void) {
     term_print("\nAll tests completed\n");
 }
 
+static void show_boot_trace(void) {
+    trace_show();
+#ifdef ENABLE_TRACE
+    term_print("\nPress D to send the trace over UART (tools/trace_view.py), any other key to skip: ");
+    char key = wait_for_key();
+    term_print("\n");
+    if (key == 'D' || key == 'd') {
+        trace_dump_uart();
+        term_print("\nTrace sent\n");
+    }
+#endif
+}
+
 void enter_emergency_mode(void) {
-    term_clear();
-    term_print("═══════════════════════════════════════\n");
-    term_print("      EMERGENCY RECOVERY SHELL         \n");
-    term_print("═══════════════════════════════════════\n\n");
-    term_print("Critical boot failure detected.\n");
-    term_print("System halted for manual recovery.\n\n");
-    term_print("Available commands:\n");
-    term_print("  REBOOT - Restart system\n");
-    term_print("  INFO   - Show system information\n");
-    term_print("  MAINT  - Enter maintenance mode\n\n");
+    uint8_t normal = (uint8_t)config_int(CONFIG_DISPLAY_COLOR_NORMAL);
+    uint8_t error = (uint8_t)config_int(CONFIG_DISPLAY_COLOR_ERROR);
+    int row = 0;
+
+    // The shell's lines scroll below the page, so it is drawn once
+    screen_invalidate();
+    screen_begin();
+    screen_printf(row++, error, "═══════════════════════════════════════");
+    screen_printf(row++, error, "      EMERGENCY RECOVERY SHELL         ");
+    screen_printf(row++, error, "═══════════════════════════════════════");
+    row++;
+    screen_printf(row++, error, "Critical boot failure detected.");
+    screen_printf(row++, error, "System halted for manual recovery.");
+    row++;
+    screen_printf(row++, normal, "Available commands:");
+    screen_printf(row++, normal, "  REBOOT - Restart system");
+    screen_printf(row++, normal, "  INFO   - Show system information");
+    screen_printf(row++, normal, "  MAINT  - Enter maintenance mode");
+    screen_printf(row, normal, "");
+    screen_end();
     
     char buffer[64];
     int pos = 0;
@@ -157,7 +250,7 @@ void enter_emergency_mode(void) {
                 }
             } else if (pos < 63) {
                 buffer[pos++] = c;
-                uart_putc(c);
+                term_putc(c);
             }
         }
         
@@ -0,0 +1,289 @@
+// src/memmap.c - Physical memory map
+//
+// Finds the ARM's share of RAM and keeps the reserved ranges in it as a
+// short list sorted by address. The firmware area, the relocated
+// bootloader image and its stack are reserved at start-up; the heap,
+// the kernel and its companions claim their ranges as they are placed.
+// memmap_alloc() searches the gaps between reservations, so anything
+// placed that way is clear of everything else by construction.
+
+#include "memmap.h"
+#include "mfboot.h"
+#include "hardware.h"
+#include "protocols.h"
+#include "terminal.h"
+#include "fdt.h"
+
+#define ATAGS_MAX_TAGS      64
+
+static const char* const kind_names[MEMMAP_NUM_KINDS] = {
+    "firmware", "bootloader", "stack", "heap", "kernel", "initrd", "dtb", "scratch",
+    "termlink"
+};
+
+static memmap_region_t regions[MEMMAP_MAX_REGIONS];
+static int num_regions;
+static memmap_info_t info;
+
+// The ATAG_MEM bank holding the kernel load address. Anything that does
+// not start with ATAG_CORE (a device tree, or no list at all) is left
+// to the mailbox.
+static int parse_atags(uint32_t atags) {
+    if (atags == 0 || (atags & 3) || atags >= PERIPHERAL_BASE) {
+        return -1;
+    }
+
+    const atag_header_t* tag = PHYS_PTR(atags);
+    if (tag->tag != ATAG_CORE) {
+        return -1;
+    }
+
+    for (int n = 0; n < ATAGS_MAX_TAGS && tag->size >= 2 && tag->tag != ATAG_NONE; n++) {
+        if (tag->tag == ATAG_MEM) {
+            const atag_mem_t* mem = (const atag_mem_t*)(tag + 1);
+            if (mem->size && mem->start <= KERNEL_LOAD_ADDR &&
+                KERNEL_LOAD_ADDR - mem->start < mem->size) {
+                info.ram_base = mem->start;
+                info.ram_size = mem->size;
+                return 0;
+            }
+        }
+        tag = (const atag_header_t*)((const uint32_t*)tag + tag->size);
+    }
+    return -1;
+}
+
+// ARM and VideoCore memory from the firmware, in one property call
+static int query_mailbox(void) {
+    static uint32_t buf[16] __attribute__((aligned(16)));
+    uint32_t i = 0;
+
+    buf[i++] = sizeof(buf);
+    buf[i++] = MBOX_REQUEST;
+    buf[i++] = MBOX_TAG_ARM_MEMORY;
+    buf[i++] = 8;
+    buf[i++] = 0;
+    buf[i++] = 0;               // [5] base
+    buf[i++] = 0;               // [6] size
+    buf[i++] = MBOX_TAG_VC_MEMORY;
+    buf[i++] = 8;
+    buf[i++] = 0;
+    buf[i++] = 0;               // [10] base
+    buf[i++] = 0;               // [11] size
+    buf[i++] = MBOX_TAG_END;
+    while (i < sizeof(buf) / sizeof(buf[0])) {
+        buf[i++] = 0;
+    }
+
+    if (mbox_property(buf) != 0 || buf[6] == 0) {
+        return -1;
+    }
+    info.ram_base = buf[5];
+    info.ram_size = buf[6];
+    info.vc_base = buf[10];
+    info.vc_size = buf[11];
+    return 0;
+}
+
+int memmap_init(uint32_t atags) {
+    num_regions = 0;
+    memset(&info, 0, sizeof(info));
+
+    if (parse_atags(atags) == 0) {
+        info.source = MEMMAP_SRC_ATAGS;
+    } else if (query_mailbox() == 0) {
+        info.source = MEMMAP_SRC_MAILBOX;
+    } else {
+        info.ram_size = MEMMAP_DEFAULT_RAM;
+        info.source = MEMMAP_SRC_DEFAULT;
+    }
+    // RAM never reaches into the peripheral window
+    if (info.ram_base + info.ram_size > PERIPHERAL_BASE ||
+        info.ram_base + info.ram_size < info.ram_base) {
+        info.ram_size = PERIPHERAL_BASE - info.ram_base;
+    }
+
+    if (info.ram_base < MEMMAP_FIRMWARE_END) {
+        memmap_reserve(info.ram_base, MEMMAP_FIRMWARE_END - info.ram_base, MEMMAP_FIRMWARE);
+    }
+    // A firmware device tree stays put until the handoff copies it
+    const void* fdt = firmware_fdt(atags);
+    if (fdt) {
+        uint32_t start = atags > MEMMAP_FIRMWARE_END ? atags : MEMMAP_FIRMWARE_END;
+        uint32_t end = atags + fdt_total_size(fdt);
+        if (end > start) {
+            memmap_reserve(start, end - start, MEMMAP_FIRMWARE);
+        }
+    }
+
+#ifndef HOST_BUILD
+    // stage2.S moved the image here from 0x8000; the stack follows BSS
+    extern uint8_t _start, __stack_bottom, __stack_top;
+    uint32_t image = PTR_PHYS(&_start);
+    uint32_t stack = PTR_PHYS(&__stack_bottom);
+    if (memmap_reserve(image, stack - image, MEMMAP_BOOTLOADER) != 0 ||
+        memmap_reserve(stack, PTR_PHYS(&__stack_top) - stack, MEMMAP_STACK) != 0) {
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+// Claim [base, base + size) if it is RAM and overlaps no reservation
+int memmap_reserve(uint32_t base, uint32_t size, uint32_t kind) {
+    uint32_t ram_end = info.ram_base + info.ram_size;
+
+    if (size == 0 || kind >= MEMMAP_NUM_KINDS || num_regions == MEMMAP_MAX_REGIONS ||
+        base < info.ram_base || base >= ram_end || size > ram_end - base ||
+        memmap_overlap(base, size)) {
+        return -1;
+    }
+
+    int i = num_regions;
+    while (i > 0 && regions[i - 1].base > base) {
+        regions[i] = regions[i - 1];
+        i--;
+    }
+    regions[i].base = base;
+    regions[i].size = size;
+    regions[i].kind = kind;
+    num_regions++;
+    return 0;
+}
+
+// Lowest or highest 'align'-aligned (a power of two) address of a free
+// range of 'size' bytes inside [lo, hi), without reserving it. Returns
+// 0 when no gap is large enough; address 0 is always firmware.
+uint32_t memmap_find(uint32_t lo, uint32_t hi, uint32_t size, uint32_t align, int where) {
+    uint32_t found = 0;
+    uint32_t gap_start = info.ram_base;
+
+    if (size == 0 || align == 0 || (align & (align - 1))) {
+        return 0;
+    }
+
+    for (int i = 0; i <= num_regions; i++) {
+        uint32_t gap_end = i < num_regions ? regions[i].base : info.ram_base + info.ram_size;
+        uint32_t start = gap_start > lo ? gap_start : lo;
+        uint32_t end = gap_end < hi ? gap_end : hi;
+        if (end > start && end - start >= size) {
+            uint32_t first = (start + align - 1) & ~(align - 1);
+            uint32_t last = (end - size) & ~(align - 1);
+            if (first >= start && first <= last) {
+                found = where == MEMMAP_HIGH ? last : first;
+                if (where == MEMMAP_LOW) {
+                    break;
+                }
+            }
+        }
+        if (i < num_regions) {
+            gap_start = regions[i].base + regions[i].size;
+        }
+    }
+    return found;
+}
+
+// Find and reserve 'size' bytes anywhere in RAM; 0 if there is no room
+uint32_t memmap_alloc(uint32_t size, uint32_t align, uint32_t kind, int where) {
+    uint32_t base = memmap_find(0, 0xFFFFFFFF, size, align, where);
+
+    if (base == 0 || memmap_reserve(base, size, kind) != 0) {
+        return 0;
+    }
+    return base;
+}
+
+// Drop every reservation of one kind, e.g. the images of a failed boot
+void memmap_release(uint32_t kind) {
+    int j = 0;
+    for (int i = 0; i < num_regions; i++) {
+        if (regions[i].kind != kind) {
+            regions[j++] = regions[i];
+        }
+    }
+    num_regions = j;
+}
+
+// First reservation intersecting [base, base + size), or NULL
+const memmap_region_t* memmap_overlap(uint32_t base, uint32_t size) {
+    for (int i = 0; i < num_regions; i++) {
+        const memmap_region_t* r = &regions[i];
+        if (base < r->base + r->size && r->base < (uint64_t)base + size) {
+            return r;
+        }
+    }
+    return NULL;
+}
+
+// Copy up to 'max' reservations, lowest address first; returns how many
+uint32_t memmap_copy(memmap_region_t* out, uint32_t max) {
+    uint32_t n = (uint32_t)num_regions < max ? (uint32_t)num_regions : max;
+    for (uint32_t i = 0; i < n; i++) {
+        out[i] = regions[i];
+    }
+    return n;
+}
+
+// Free bytes from 'base' up to the next reservation or the end of RAM,
+// 0 if 'base' itself is taken or not RAM. Bounds output whose size is
+// only known once it is written, like a decompressed kernel.
+uint32_t memmap_free_span(uint32_t base) {
+    uint32_t end = info.ram_base + info.ram_size;
+
+    if (base < info.ram_base || base >= end) {
+        return 0;
+    }
+    for (int i = 0; i < num_regions; i++) {
+        const memmap_region_t* r = &regions[i];
+        if (base >= r->base && base - r->base < r->size) {
+            return 0;
+        }
+        if (r->base > base) {
+            end = r->base;
+            break;
+        }
+    }
+    return end - base;
+}
+
+void memmap_get_info(memmap_info_t* out) {
+    uint32_t gap_start = info.ram_base;
+
+    info.reserved = 0;
+    info.largest_free = 0;
+    for (int i = 0; i <= num_regions; i++) {
+        uint32_t gap_end = i < num_regions ? regions[i].base : info.ram_base + info.ram_size;
+        if (gap_end - gap_start > info.largest_free) {
+            info.largest_free = gap_end - gap_start;
+        }
+        if (i < num_regions) {
+            info.reserved += regions[i].size;
+            gap_start = regions[i].base + regions[i].size;
+        }
+    }
+    *out = info;
+}
+
+const char* memmap_kind_name(uint32_t kind) {
+    return kind < MEMMAP_NUM_KINDS ? kind_names[kind] : "?";
+}
+
+void memmap_show(void) {
+    static const char* const sources[] = { "default", "ATAGS", "mailbox" };
+    memmap_info_t mi;
+
+    memmap_get_info(&mi);
+    term_printf("RAM: 0x%08X-0x%08X, %d MB (%s)\n", mi.ram_base, mi.ram_base + mi.ram_size,
+                mi.ram_size >> 20, sources[mi.source]);
+    if (mi.vc_size) {
+        term_printf("GPU: 0x%08X-0x%08X, %d MB\n", mi.vc_base, mi.vc_base + mi.vc_size,
+                    mi.vc_size >> 20);
+    }
+    for (int i = 0; i < num_regions; i++) {
+        const memmap_region_t* r = &regions[i];
+        term_printf("  0x%08X-0x%08X %s (%d KB)\n", r->base, r->base + r->size,
+                    kind_names[r->kind], r->size >> 10);
+    }
+    term_printf("  Free: %d KB, largest %d KB\n",
+                (mi.ram_size - mi.reserved) >> 10, mi.largest_free >> 10);
+}
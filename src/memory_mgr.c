@@ -1,40 +1,441 @@
 // src/memory_mgr.c - Memory management
+//
+// Heap over the upper memory pool and a block of RAM reserved in the
+// memory map. Each block starts with a 16-byte header holding its size
+// and the size of the block before it, so a freed block merges with
+// free neighbours on both sides. Free blocks sit on one address-ordered
+// list and are handed out best fit. Requests up to MEM_SMALL_MAX are
+// rounded up to a power-of-two class and served from 4 KB slabs kept at
+// the top of the heap: small allocations neither search the list nor
+// leave holes between the large blocks. Blocks carry an arena tag so
+// everything a failed boot attempt allocated can be released in one
+// sweep.
 
 #include "memory_mgr.h"
+#include "memmap.h"
 #include "mfboot.h"
+#include "hardware.h"
 
-// Simple memory allocator for upper memory
-static uint8_t upper_memory[UPPERMEM_SIZE] __attribute__((aligned(16)));
-static size_t upper_used = 0;
+#define ALIGN               16
+#define HDR_SIZE            16
+#define MIN_BLOCK           64          // Header and free list links, rounded
+#define SLAB_SIZE           4096
+#define BLOCK_MAGIC         0x4D42      // "BM", catches frees of stray pointers
 
-void memory_init(void) {
-    upper_used = 0;
-    memset(upper_memory, 0, UPPERMEM_SIZE);
+// Flags in the low bits of block_t.size (sizes are multiples of ALIGN)
+#define F_USED              1
+#define F_SLAB              2           // Large block carved into small objects
+#define F_END               4           // Region end sentinel
+#define SIZE_MASK           (~(uint32_t)(ALIGN - 1))
+
+typedef struct {
+    uint32_t size;              // Bytes including this header, | flags
+    uint32_t prev_size;         // Block before this one, 0 at region start
+    uint16_t magic;
+    uint8_t arena;
+    uint8_t sclass;             // Size class + 1 for small objects
+    uint32_t reserved;
+} block_t;
+
+typedef struct free_block {
+    block_t hdr;
+    struct free_block* next;    // Address order
+    struct free_block* prev;
+} free_block_t;
+
+typedef struct small_obj {
+    block_t hdr;
+    struct small_obj* next;     // Class free list
+} small_obj_t;
+
+_Static_assert(sizeof(block_t) == HDR_SIZE, "block header size");
+_Static_assert(sizeof(free_block_t) <= MIN_BLOCK, "free block links");
+
+typedef struct {
+    uint8_t* base;
+    uint32_t size;
+} region_t;
+
+static uint8_t upper_memory[UPPERMEM_SIZE] __attribute__((aligned(ALIGN)));
+static region_t regions[MEM_MAX_REGIONS];
+static int num_regions;
+static free_block_t* free_list;
+static small_obj_t* class_free[MEM_NUM_CLASSES];
+static int current_arena;
+static mem_stats_t stats;
+
+static inline uint32_t block_size(const block_t* b) {
+    return b->size & SIZE_MASK;
+}
+
+static inline block_t* next_block(block_t* b) {
+    return (block_t*)((uint8_t*)b + block_size(b));
+}
+
+static inline uint32_t stride_of(int cls) {
+    return HDR_SIZE + (16u << cls);
+}
+
+// Set a block's size and flags, keeping the next block's back link
+static void set_size(block_t* b, uint32_t size, uint32_t flags) {
+    b->size = size | flags;
+    next_block(b)->prev_size = size;
+}
+
+static void list_insert(free_block_t* f) {
+    free_block_t* prev = NULL;
+    free_block_t* cur = free_list;
+
+    while (cur && (uintptr_t)cur < (uintptr_t)f) {
+        prev = cur;
+        cur = cur->next;
+    }
+    f->prev = prev;
+    f->next = cur;
+    if (cur) {
+        cur->prev = f;
+    }
+    if (prev) {
+        prev->next = f;
+    } else {
+        free_list = f;
+    }
+}
+
+static void list_remove(free_block_t* f) {
+    if (f->prev) {
+        f->prev->next = f->next;
+    } else {
+        free_list = f->next;
+    }
+    if (f->next) {
+        f->next->prev = f->prev;
+    }
 }
 
-void* memory_allocate_upper(size_t size) {
-    if (upper_used + size > UPPERMEM_SIZE) {
+static void account(int arena, uint32_t bytes, int add) {
+    if (add) {
+        stats.used += bytes;
+        stats.arena_used[arena] += bytes;
+        if (stats.used > stats.peak) {
+            stats.peak = stats.used;
+        }
+        if (stats.arena_used[arena] > stats.arena_peak[arena]) {
+            stats.arena_peak[arena] = stats.arena_used[arena];
+        }
+    } else {
+        stats.used -= bytes;
+        stats.arena_used[arena] -= bytes;
+    }
+}
+
+// Take 'need' bytes (header included) from the end of the highest free
+// block that fits. Slabs pack together at the top of the heap instead of
+// pinning holes between large blocks.
+static block_t* alloc_block_high(uint32_t need) {
+    free_block_t* last = NULL;
+
+    for (free_block_t* f = free_list; f; f = f->next) {
+        if (block_size(&f->hdr) >= need) {
+            last = f;
+        }
+    }
+    if (!last) {
         return NULL;
     }
-    
-    void* ptr = &upper_memory[upper_used];
-    upper_used += size;
-    
-    // Align to 16 bytes
-    upper_used = (upper_used + 15) & ~15;
-    
-    return ptr;
+
+    block_t* b = &last->hdr;
+    uint32_t size = block_size(b);
+    if (size - need >= MIN_BLOCK) {
+        set_size(b, size - need, 0);
+        b = next_block(b);
+        b->magic = BLOCK_MAGIC;
+        b->prev_size = size - need;
+        set_size(b, need, F_USED);
+    } else {
+        list_remove(last);
+        set_size(b, size, F_USED);
+    }
+    b->arena = (uint8_t)current_arena;
+    b->sclass = 0;
+    return b;
 }
 
-void memory_free_upper(void* ptr) {
-    // Simple allocator doesn't support free
-    (void)ptr;
+// Best-fit block of 'need' bytes (header included), split if the rest
+// can stand as a block of its own
+static block_t* alloc_block(uint32_t need) {
+    free_block_t* best = NULL;
+
+    for (free_block_t* f = free_list; f; f = f->next) {
+        uint32_t size = block_size(&f->hdr);
+        if (size >= need && (!best || size < block_size(&best->hdr))) {
+            best = f;
+            if (size == need) {
+                break;
+            }
+        }
+    }
+    if (!best) {
+        return NULL;
+    }
+
+    list_remove(best);
+    block_t* b = &best->hdr;
+    uint32_t size = block_size(b);
+    if (size - need >= MIN_BLOCK) {
+        block_t* rest = (block_t*)((uint8_t*)b + need);
+        set_size(b, need, F_USED);
+        rest->magic = BLOCK_MAGIC;
+        rest->arena = 0;
+        rest->sclass = 0;
+        set_size(rest, size - need, 0);
+        list_insert((free_block_t*)rest);
+    } else {
+        set_size(b, size, F_USED);
+    }
+    b->arena = (uint8_t)current_arena;
+    b->sclass = 0;
+    return b;
+}
+
+// Free a large block and merge it with free neighbours. Returns the
+// merged block, which may start before 'b'.
+static block_t* release_block(block_t* b) {
+    uint32_t size = block_size(b);
+
+    block_t* next = next_block(b);
+    if (!(next->size & F_USED)) {
+        list_remove((free_block_t*)next);
+        size += block_size(next);
+    }
+    if (b->prev_size) {
+        block_t* prev = (block_t*)((uint8_t*)b - b->prev_size);
+        if (!(prev->size & F_USED)) {
+            list_remove((free_block_t*)prev);
+            size += block_size(prev);
+            b = prev;
+        }
+    }
+
+    b->arena = 0;
+    b->sclass = 0;
+    set_size(b, size, 0);
+    list_insert((free_block_t*)b);
+    return b;
+}
+
+// Carve a slab into objects of class 'cls', lowest address first on the
+// free list. Slabs stay allocated once made.
+static int new_slab(int cls) {
+    uint32_t stride = stride_of(cls);
+    int saved = current_arena;
+
+    current_arena = MEM_ARENA_SYSTEM;
+    block_t* slab = alloc_block_high(HDR_SIZE + SLAB_SIZE);
+    current_arena = saved;
+    if (!slab) {
+        return -1;
+    }
+    slab->size |= F_SLAB;
+    slab->sclass = (uint8_t)(cls + 1);
+    stats.slab_bytes += block_size(slab);
+
+    uint8_t* objects = (uint8_t*)slab + HDR_SIZE;
+    for (uint32_t i = SLAB_SIZE / stride; i-- > 0;) {
+        small_obj_t* o = (small_obj_t*)(objects + i * stride);
+        o->hdr.size = stride;
+        o->hdr.prev_size = 0;
+        o->hdr.magic = BLOCK_MAGIC;
+        o->hdr.arena = 0;
+        o->hdr.sclass = (uint8_t)(cls + 1);
+        o->next = class_free[cls];
+        class_free[cls] = o;
+    }
+    return 0;
+}
+
+static void free_small(small_obj_t* o) {
+    int cls = o->hdr.sclass - 1;
+
+    account(o->hdr.arena, stride_of(cls), 0);
+    stats.class_live[cls]--;
+    o->hdr.size &= ~F_USED;
+    o->next = class_free[cls];
+    class_free[cls] = o;
+}
+
+int memory_init(void) {
+    num_regions = 0;
+    free_list = NULL;
+    current_arena = MEM_ARENA_SYSTEM;
+    memset(class_free, 0, sizeof(class_free));
+    memset(&stats, 0, sizeof(stats));
+
+    if (memory_add_region(upper_memory, UPPERMEM_SIZE) != 0) {
+        return -1;
+    }
+    // Not fatal: the pool alone still boots
+    memmap_info_t mi;
+    memmap_get_info(&mi);
+    uint32_t size = (mi.ram_size / 8) & ~(MEM_HEAP_ALIGN - 1);
+    if (size < MEM_HEAP_MIN) {
+        size = MEM_HEAP_MIN;
+    } else if (size > MEM_HEAP_MAX) {
+        size = MEM_HEAP_MAX;
+    }
+    uint32_t base = memmap_alloc(size, MEM_HEAP_ALIGN, MEMMAP_HEAP, MEMMAP_HIGH);
+    if (base) {
+        memory_add_region(PHYS_PTR(base), size);
+    }
+    return 0;
+}
+
+// Hand [base, base + size) to the heap as one free block, closed by a
+// sentinel header that is never free
+int memory_add_region(void* base, size_t size) {
+    uintptr_t start = ((uintptr_t)base + ALIGN - 1) & ~(uintptr_t)(ALIGN - 1);
+    uintptr_t end = ((uintptr_t)base + size) & ~(uintptr_t)(ALIGN - 1);
+
+    if (num_regions == MEM_MAX_REGIONS || end < start + MIN_BLOCK + HDR_SIZE) {
+        return -1;
+    }
+
+    block_t* first = (block_t*)start;
+    block_t* sentinel = (block_t*)(end - HDR_SIZE);
+    uint32_t bytes = (uint32_t)((uintptr_t)sentinel - start);
+
+    sentinel->size = HDR_SIZE | F_USED | F_END;
+    sentinel->magic = BLOCK_MAGIC;
+    first->prev_size = 0;
+    first->magic = BLOCK_MAGIC;
+    first->arena = 0;
+    first->sclass = 0;
+    set_size(first, bytes, 0);
+    list_insert((free_block_t*)first);
+
+    regions[num_regions].base = (uint8_t*)start;
+    regions[num_regions].size = (uint32_t)(end - start);
+    num_regions++;
+    stats.total += bytes;
+    return 0;
 }
 
 void* memory_alloc(size_t size) {
-    return memory_allocate_upper(size);
+    void* ptr = NULL;
+
+    if (size == 0 || size > MEM_HEAP_MAX) {
+        stats.failures++;
+        return NULL;
+    }
+
+    if (size <= MEM_SMALL_MAX) {
+        int cls = 0;
+        while ((16u << cls) < size) {
+            cls++;
+        }
+        if (class_free[cls] || new_slab(cls) == 0) {
+            small_obj_t* o = class_free[cls];
+            class_free[cls] = o->next;
+            o->hdr.size |= F_USED;
+            o->hdr.arena = (uint8_t)current_arena;
+            account(current_arena, stride_of(cls), 1);
+            if (++stats.class_live[cls] > stats.class_peak[cls]) {
+                stats.class_peak[cls] = stats.class_live[cls];
+            }
+            ptr = (uint8_t*)o + HDR_SIZE;
+        }
+    } else {
+        uint32_t need = ((uint32_t)size + HDR_SIZE + ALIGN - 1) & SIZE_MASK;
+        block_t* b = alloc_block(need);
+        if (b) {
+            account(current_arena, block_size(b), 1);
+            ptr = (uint8_t*)b + HDR_SIZE;
+        }
+    }
+
+    if (ptr) {
+        stats.allocs++;
+    } else {
+        stats.failures++;
+    }
+    return ptr;
 }
 
 void memory_free(void* ptr) {
-    memory_free_upper(ptr);
+    if (!ptr) {
+        return;
+    }
+
+    block_t* b = (block_t*)((uint8_t*)ptr - HDR_SIZE);
+    if (b->magic != BLOCK_MAGIC || !(b->size & F_USED) || (b->size & (F_SLAB | F_END))) {
+        return;     // Not ours, or already free
+    }
+
+    stats.frees++;
+    if (b->sclass) {
+        free_small((small_obj_t*)b);
+    } else {
+        account(b->arena, block_size(b), 0);
+        release_block(b);
+    }
+}
+
+// Make 'arena' current for the following allocations. Returns the
+// previous arena, to restore afterwards.
+int memory_arena_enter(int arena) {
+    int prev = current_arena;
+    if (arena >= 0 && arena < MEM_MAX_ARENAS) {
+        current_arena = arena;
+    }
+    return prev;
+}
+
+// Free every block allocated in 'arena', e.g. after a failed boot
+// attempt, by walking the block headers of each region
+void memory_arena_reset(int arena) {
+    for (int r = 0; r < num_regions; r++) {
+        block_t* b = (block_t*)regions[r].base;
+        while (!(b->size & F_END)) {
+            if ((b->size & (F_USED | F_SLAB)) == (F_USED | F_SLAB)) {
+                int cls = b->sclass - 1;
+                uint32_t stride = stride_of(cls);
+                uint8_t* objects = (uint8_t*)b + HDR_SIZE;
+                for (uint32_t i = 0; i < SLAB_SIZE / stride; i++) {
+                    small_obj_t* o = (small_obj_t*)(objects + i * stride);
+                    if ((o->hdr.size & F_USED) && o->hdr.arena == arena) {
+                        stats.frees++;
+                        free_small(o);
+                    }
+                }
+            } else if ((b->size & F_USED) && b->arena == arena) {
+                stats.frees++;
+                account(arena, block_size(b), 0);
+                b = release_block(b);
+            }
+            b = next_block(b);
+        }
+    }
+}
+
+void memory_get_stats(mem_stats_t* st) {
+    *st = stats;
+    st->free = 0;
+    st->free_blocks = 0;
+    st->largest_free = 0;
+    for (free_block_t* f = free_list; f; f = f->next) {
+        uint32_t size = block_size(&f->hdr);
+        st->free += size;
+        st->free_blocks++;
+        if (size > st->largest_free) {
+            st->largest_free = size;
+        }
+    }
+}
+
+uint32_t memory_class_size(int cls) {
+    return 16u << cls;
+}
+
+void* memory_upper_base(void) {
+    return upper_memory;
 }
@@ -1,97 +1,200 @@
 // src/menu.c - Interactive Boot Selection
+//
+// The default entry's kernel is loaded while the menu waits: the load
+// runs with menu_poll() as its poll hook, so keys and the countdown are
+// handled between chunks. Once it is in memory the same loop carries on
+// without it, and booting the default only has to jump.
 
 #include "mfboot.h"
 #include "terminal.h"
 #include "hardware.h"
+#include "config.h"
+#include "screen.h"
 
-void display_boot_menu(boot_entry_t* entries) {
-    int selection = 0;
-    int num_entries = count_boot_entries(entries);
-    
-    while (1) {
-        term_clear();
-        term_print("═══════════════════════════════════════\n");
-        term_print("    RobCo Industries Boot Selection    \n");
-        term_print("═══════════════════════════════════════\n\n");
-        
-        for (int i = 0; i < num_entries; i++) {
-            if (i == selection) {
-                term_print("> ");
-                term_set_color(COLOR_AMBER);
-            } else {
-                term_print("  ");
-            }
-            
-            term_printf("[%d] %s", i+1, entries[i].name);
-            
-            // Show device type
-            switch(entries[i].type) {
-                case BOOT_TYPE_UOS:
-                    term_print(" (Unified Operating System)");
-                    break;
-                case BOOT_TYPE_PIPOS:
-                    term_print(" (PIP-OS v7.1.0.8)");
-                    break;
-                case BOOT_TYPE_MAINTENANCE:
-                    term_print(" (Maintenance Mode)");
-                    break;
-                case BOOT_TYPE_DIAGNOSTIC:
-                    term_print(" (Hardware Diagnostics)");
-                    break;
+typedef struct {
+    boot_entry_t* entries;
+    int num_entries;
+    int selection;
+    int def;                    // Entry the countdown boots
+    uint32_t timeout;           // Countdown in seconds, 0 once stopped
+    uint32_t start;             // Timer when the countdown began
+    uint32_t shown;             // Seconds left as last drawn
+    int choice;                 // Entry to boot, -1 for none yet
+    char action;                // 'm', 'h' or 'r' key waiting, 0 for none
+} menu_t;
+
+static const char* type_name(uint32_t type) {
+    switch(type) {
+        case BOOT_TYPE_UOS:
+            return " (Unified Operating System)";
+        case BOOT_TYPE_PIPOS:
+            return " (PIP-OS v7.1.0.8)";
+        case BOOT_TYPE_MAINTENANCE:
+            return " (Maintenance Mode)";
+        case BOOT_TYPE_DIAGNOSTIC:
+            return " (Hardware Diagnostics)";
+    }
+    return "";
+}
+
+// Draw the menu as a screen frame; only the rows that changed since the
+// last one are sent
+static void draw_menu(menu_t* m) {
+    uint8_t normal = (uint8_t)config_int(CONFIG_DISPLAY_COLOR_NORMAL);
+    uint8_t highlight = (uint8_t)config_int(CONFIG_DISPLAY_COLOR_HIGHLIGHT);
+    int row = 0;
+
+    screen_begin();
+    screen_printf(row++, normal, "═══════════════════════════════════════");
+    screen_printf(row++, normal, "    RobCo Industries Boot Selection    ");
+    screen_printf(row++, normal, "═══════════════════════════════════════");
+    row++;
+
+    for (int i = 0; i < m->num_entries; i++) {
+        int selected = i == m->selection;
+        screen_printf(row++, selected ? highlight : normal, "%s[%d] %s%s",
+                      selected ? "> " : "  ", i + 1, m->entries[i].name,
+                      type_name(m->entries[i].type));
+    }
+
+    row++;
+    screen_printf(row++, normal, "[M] Maintenance Mode");
+    screen_printf(row++, normal, "[H] Holotape Boot");
+    screen_printf(row++, normal, "[R] Reboot");
+    row++;
+    screen_printf(row++, normal, "Use Arrow Keys to select, Enter to boot");
+    if (m->timeout) {
+        screen_printf(row, normal, "Booting %s in %u s, press any key to stop",
+                      m->entries[m->def].name, m->shown);
+    }
+    screen_end();
+}
+
+static void draw_countdown(menu_t* m, uint32_t left) {
+    m->shown = left;
+    draw_menu(m);
+}
+
+static void menu_key(menu_t* m, int key) {
+    int counting = m->timeout != 0;
+
+    // Any key stops the countdown; Enter during it boots the default
+    m->timeout = 0;
+    switch(key) {
+        case KEY_UP:
+            m->selection = (m->selection - 1 + m->num_entries) % m->num_entries;
+            break;
+        case KEY_DOWN:
+            m->selection = (m->selection + 1) % m->num_entries;
+            break;
+        case KEY_ENTER:     // '\r'
+        case '\n':
+            m->choice = m->selection;
+            return;
+        case 'M':
+        case 'm':
+        case 'H':
+        case 'h':
+        case 'R':
+        case 'r':
+            m->action = (char)(key | 0x20);
+            return;
+        case '1':
+        case '2':
+        case '3':
+        case '4':
+        case '5':
+        case '6':
+        case '7':
+        case '8':
+            if (key - '1' < m->num_entries) {
+                m->choice = key - '1';
+                return;
             }
-            
-            term_set_color(COLOR_GREEN);
-            term_print("\n");
+            break;
+    }
+    if (counting || key == KEY_UP || key == KEY_DOWN) {
+        draw_menu(m);
+    }
+}
+
+// One pass of the menu: a key if there is one, then the countdown
+static void menu_update(menu_t* m) {
+    int key = term_poll_key();
+    if (key >= 0) {
+        menu_key(m, key);
+    }
+    if (m->timeout) {
+        uint32_t elapsed = (get_timer_count() - m->start) / 1000000;
+        if (elapsed >= m->timeout) {
+            m->timeout = 0;
+            m->choice = m->def;
+        } else if (m->timeout - elapsed != m->shown) {
+            draw_countdown(m, m->timeout - elapsed);
         }
-        
-        term_print("\n[M] Maintenance Mode\n");
-        term_print("[H] Holotape Boot\n");
-        term_print("[R] Reboot\n");
-        term_print("\nUse Arrow Keys to select, Enter to boot\n");
-        
-        char key = wait_for_key();
-        
-        switch(key) {
-            case KEY_UP:
-                selection = (selection - 1 + num_entries) % num_entries;
-                break;
-            case KEY_DOWN:
-                selection = (selection + 1) % num_entries;
-                break;
-            case KEY_ENTER:
-            case '\r':
-            case '\n':
-                boot_selected(&entries[selection]);
-                break;
-            case 'M':
+    }
+}
+
+// Poll hook of the background load. The load keeps going while the
+// default may still be booted and stops once something else is picked.
+static int menu_poll(void* ctx) {
+    menu_t* m = ctx;
+
+    term_set_muted(0);
+    menu_update(m);
+    term_set_muted(1);
+    return m->action || (m->choice >= 0 && m->choice != m->def);
+}
+
+void display_boot_menu(boot_entry_t* entries, uint32_t timeout) {
+    menu_t m;
+
+    m.entries = entries;
+    m.num_entries = count_boot_entries(entries);
+    // Compared unsigned: a configured index of 0x80000000 or more must
+    // not become a negative one
+    uint32_t def = config_int(CONFIG_MENU_DEFAULT);
+    if (def >= (uint32_t)m.num_entries) {
+        def = 0;
+    }
+    m.def = (int)def;
+    m.selection = m.def;
+    m.timeout = timeout;
+    m.start = get_timer_count();
+    m.shown = timeout;
+    m.choice = -1;
+    m.action = 0;
+
+    draw_menu(&m);
+    boot_prefetch(&entries[m.def], menu_poll, &m);
+
+    while (1) {
+        menu_update(&m);
+
+        if (m.choice >= 0) {
+            int choice = m.choice;
+            m.choice = -1;
+            boot_selected(&entries[choice]);
+            draw_menu(&m);
+        }
+
+        switch(m.action) {
             case 'm':
+                boot_discard_prefetch();
                 enter_maintenance_mode();
+                draw_menu(&m);
                 break;
-            case 'H':
             case 'h':
+                boot_discard_prefetch();
                 load_holotape_boot();
                 break;
-            case 'R':
             case 'r':
                 term_print("\nRebooting...\n");
                 delay_ms(1000);
                 // Would trigger reboot here
-                break;
-            case '1':
-            case '2':
-            case '3':
-            case '4':
-            case '5':
-            case '6':
-            case '7':
-            case '8':
-                {
-                    int idx = key - '1';
-                    if (idx >= 0 && idx < num_entries) {
-                        boot_selected(&entries[idx]);
-                    }
-                }
+                draw_menu(&m);
                 break;
         }
+        m.action = 0;
     }
 }
@@ -0,0 +1,222 @@
+// src/protocols.c - Kernel boot parameters
+//
+// Hands the kernel what it would otherwise probe for at start-up: the
+// RAM bank, the command line, the initrd and the board revision. An
+// ATAG list (CORE, MEM, CMDLINE, INITRD2, REVISION) is built at
+// ATAGS_ADDR; a device tree gets the same facts patched into /memory
+// and /chosen.
+
+#include "protocols.h"
+#include "mfboot.h"
+#include "hardware.h"
+#include "memmap.h"
+#include "fdt.h"
+#include "config.h"
+
+#define ATAGS_MAX_TAGS      64
+#define FDT_MAX_SIZE        0x00100000  // Sanity bound for a firmware DTB
+
+_Static_assert(BOOT_CMDLINE_MAX + 64 <= ATAGS_MAX_SIZE, "ATAG list size");
+
+static inline atag_t* atag_next(atag_t* t) {
+    return (atag_t*)((uint32_t*)t + t->hdr.size);
+}
+
+// The device tree RETROS-BIOS passed in r2, or NULL for an ATAG list
+const void* firmware_fdt(uint32_t firmware_tags) {
+    if (firmware_tags == 0 || (firmware_tags & 3) || firmware_tags >= PERIPHERAL_BASE) {
+        return NULL;
+    }
+    const void* fdt = PHYS_PTR(firmware_tags);
+    return fdt_check(fdt, FDT_MAX_SIZE) == 0 ? fdt : NULL;
+}
+
+// The command line RETROS-BIOS was given, from its ATAGS or device tree
+static const char* firmware_cmdline(uint32_t firmware_tags) {
+    const void* fdt = firmware_fdt(firmware_tags);
+    if (fdt) {
+        uint32_t len;
+        const char* args = fdt_getprop(fdt, fdt_path_offset(fdt, "/chosen"), "bootargs", &len);
+        return args && len > 1 && args[len - 1] == '\0' ? args : NULL;
+    }
+
+    if (firmware_tags == 0 || (firmware_tags & 3) || firmware_tags >= PERIPHERAL_BASE) {
+        return NULL;
+    }
+    atag_t* t = PHYS_PTR(firmware_tags);
+    if (t->hdr.tag != ATAG_CORE) {
+        return NULL;
+    }
+    for (int n = 0; n < ATAGS_MAX_TAGS && t->hdr.size >= 2 && t->hdr.tag != ATAG_NONE; n++) {
+        if (t->hdr.tag == ATAG_CMDLINE && t->u.cmdline.cmdline[0]) {
+            return t->u.cmdline.cmdline;
+        }
+        t = atag_next(t);
+    }
+    return NULL;
+}
+
+static uint32_t query_revision(void) {
+    static uint32_t buf[8] __attribute__((aligned(16)));
+
+    buf[0] = sizeof(buf);
+    buf[1] = MBOX_REQUEST;
+    buf[2] = MBOX_TAG_BOARD_REVISION;
+    buf[3] = 4;
+    buf[4] = 0;
+    buf[5] = 0;
+    buf[6] = MBOX_TAG_END;
+    buf[7] = 0;
+    return mbox_property(buf) == 0 ? buf[5] : 0;
+}
+
+void setup_boot_params(boot_params_t* params, uint32_t firmware_tags) {
+    memmap_info_t mi;
+
+    memset(params, 0, sizeof(*params));
+    params->protocol = strcmp(config_string(CONFIG_BOOT_PROTOCOL), "termlink") == 0 ?
+                       PROTOCOL_TERMLINK : PROTOCOL_LINUX_ARM;
+    params->machine_type = MACH_TYPE_RPI;
+    params->boot_device = 0;    // SD card
+
+    // boot.cmdline from the configuration, else the firmware's. Left
+    // empty without either, so a DTB from the boot image keeps its own.
+    const char* cmdline = config_string(CONFIG_BOOT_CMDLINE);
+    if (!cmdline[0]) {
+        cmdline = firmware_cmdline(firmware_tags);
+    }
+    if (cmdline) {
+        uint32_t len = strlen(cmdline);
+        if (len >= BOOT_CMDLINE_MAX) {
+            len = BOOT_CMDLINE_MAX - 1;
+        }
+        memcpy(params->cmdline, cmdline, len);
+        params->cmdline[len] = '\0';
+    }
+
+    memmap_get_info(&mi);
+    params->mem_start = mi.ram_base;
+    params->mem_size = mi.ram_size;
+    params->revision = query_revision();
+}
+
+// Write the ATAG list at ATAGS_ADDR and return its address for r2
+uint32_t create_atags(const boot_params_t* params) {
+    atag_t* t = PHYS_PTR(ATAGS_ADDR);
+
+    t->hdr.tag = ATAG_CORE;
+    t->hdr.size = 5;
+    t->u.core.flags = 1;        // Root read-only
+    t->u.core.pagesize = 4096;
+    t->u.core.rootdev = 0;
+    t = atag_next(t);
+
+    t->hdr.tag = ATAG_MEM;
+    t->hdr.size = 4;
+    t->u.mem.start = params->mem_start;
+    t->u.mem.size = params->mem_size;
+    t = atag_next(t);
+
+    const char* cmdline = params->cmdline[0] ? params->cmdline : BOOT_DEFAULT_CMDLINE;
+    uint32_t len = strlen(cmdline) + 1;
+    t->hdr.tag = ATAG_CMDLINE;
+    t->hdr.size = 2 + (len + 3) / 4;
+    memset(t->u.cmdline.cmdline, 0, (len + 3) & ~3u);
+    memcpy(t->u.cmdline.cmdline, cmdline, len);
+    t = atag_next(t);
+
+    if (params->initrd_size) {
+        t->hdr.tag = ATAG_INITRD2;
+        t->hdr.size = 4;
+        t->u.initrd2.start = params->initrd_start;
+        t->u.initrd2.size = params->initrd_size;
+        t = atag_next(t);
+    }
+
+    if (params->revision) {
+        t->hdr.tag = ATAG_REVISION;
+        t->hdr.size = 3;
+        t->u.revision.rev = params->revision;
+        t = atag_next(t);
+    }
+
+    t->hdr.tag = ATAG_NONE;
+    t->hdr.size = 0;
+    return ATAGS_ADDR;
+}
+
+// Patch /memory, /chosen/bootargs and the initrd range into a tree
+// opened with fdt_open(). Nodes that are missing are added.
+int setup_fdt(void* fdt, const boot_params_t* params) {
+    uint32_t acells = 2;        // Defaults from the devicetree spec
+    uint32_t scells = 1;
+    uint32_t reg[4];
+    uint32_t len;
+    int n = 0;
+
+    int root = fdt_path_offset(fdt, "/");
+    if (root < 0) {
+        return -1;
+    }
+    const uint32_t* v = fdt_getprop(fdt, root, "#address-cells", &len);
+    if (v && len == 4) {
+        acells = fdt_be32(*v);
+    }
+    v = fdt_getprop(fdt, root, "#size-cells", &len);
+    if (v && len == 4) {
+        scells = fdt_be32(*v);
+    }
+    if (acells < 1 || acells > 2 || scells < 1 || scells > 2) {
+        return -1;
+    }
+
+    if (acells == 2) {
+        reg[n++] = 0;
+    }
+    reg[n++] = params->mem_start;
+    if (scells == 2) {
+        reg[n++] = 0;
+    }
+    reg[n++] = params->mem_size;
+
+    int mem = fdt_path_offset(fdt, "/memory");
+    if (mem < 0) {
+        mem = fdt_add_subnode(fdt, root, "memory");
+        if (mem < 0 || fdt_setprop(fdt, mem, "device_type", "memory", 7) != 0) {
+            return -1;
+        }
+    }
+    if (fdt_setprop_cells(fdt, mem, "reg", reg, n) != 0) {
+        return -1;
+    }
+
+    // Offsets after an edit may have moved; look the root up again
+    int chosen = fdt_add_subnode(fdt, fdt_path_offset(fdt, "/"), "chosen");
+    if (chosen < 0) {
+        return -1;
+    }
+    const char* cmdline = params->cmdline;
+    if (!cmdline[0]) {
+        if (fdt_getprop(fdt, chosen, "bootargs", &len)) {
+            cmdline = NULL;     // The tree's own
+        } else {
+            cmdline = BOOT_DEFAULT_CMDLINE;
+        }
+    }
+    if (cmdline && fdt_setprop(fdt, chosen, "bootargs", cmdline, strlen(cmdline) + 1) != 0) {
+        return -1;
+    }
+
+    if (params->initrd_size) {
+        uint32_t start = params->initrd_start;
+        uint32_t end = params->initrd_start + params->initrd_size;
+        if (fdt_setprop_cells(fdt, chosen, "linux,initrd-start", &start, 1) != 0 ||
+            fdt_setprop_cells(fdt, chosen, "linux,initrd-end", &end, 1) != 0) {
+            return -1;
+        }
+    } else if (fdt_delprop(fdt, chosen, "linux,initrd-start") != 0 ||
+               fdt_delprop(fdt, chosen, "linux,initrd-end") != 0) {
+        return -1;
+    }
+    return 0;
+}
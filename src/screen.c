@@ -0,0 +1,177 @@
+// src/screen.c - Screen model for full-screen pages
+//
+// A page is drawn as a frame: screen_begin(), one screen_printf() per
+// row, then screen_end(). The rows last shown are kept, and screen_end()
+// sends only what changed, moving the cursor with ANSI sequences: from
+// the first changed character of a row to its end (or its last changed
+// character, if the length is the same), then erasing the rest of the
+// line if the old row was wider. Moving the selection in the boot
+// menu rewrites two rows instead of the whole page.
+//
+// Anything printed outside a frame (a prompt, a payload's output) may
+// have scrolled or overwritten the page, so if the terminal's byte count
+// has moved since the last frame, or after screen_invalidate(), the next
+// frame clears the screen and draws every row.
+
+#include "screen.h"
+#include "terminal.h"
+#include "config.h"
+#include "format.h"
+#include "mfboot.h"
+
+typedef struct {
+    uint8_t color;
+    uint8_t len;
+    char text[SCREEN_LINE_MAX];
+} screen_row_t;
+
+static screen_row_t shown[SCREEN_ROWS];
+static screen_row_t next[SCREEN_ROWS];
+static int shown_rows;
+static int next_rows;
+static int valid;               // 'shown' is what the terminal has
+static uint32_t last_count;     // term_output_count() after the last frame
+static int cursor_row;          // Cursor position while a frame is sent,
+static uint32_t cursor_col;     // row -1 when not known
+
+// Columns taken by the first 'len' bytes of a UTF-8 row
+static uint32_t row_width(const char* text, uint32_t len) {
+    uint32_t width = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        if ((text[i] & 0xC0) != 0x80) {
+            width++;
+        }
+    }
+    return width;
+}
+
+void screen_invalidate(void) {
+    valid = 0;
+}
+
+void screen_begin(void) {
+    for (int i = 0; i < next_rows; i++) {
+        next[i].len = 0;
+    }
+    next_rows = 0;
+}
+
+// Set row 'row' of the frame; text longer than a row is cut short
+void screen_printf(int row, uint8_t color, const char* fmt, ...) {
+    if (row < 0 || row >= SCREEN_ROWS) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    int len = format_vsnprintf(next[row].text, SCREEN_LINE_MAX, fmt, args);
+    va_end(args);
+
+    if (len >= SCREEN_LINE_MAX) {
+        // Don't leave half a character at the cut
+        len = SCREEN_LINE_MAX - 1;
+        while (len > 0 && (next[row].text[len] & 0xC0) == 0x80) {
+            len--;
+        }
+        next[row].text[len] = '\0';
+    }
+    next[row].color = color;
+    next[row].len = (uint8_t)(len < 0 ? 0 : len);
+    if (row >= next_rows) {
+        next_rows = row + 1;
+    }
+}
+
+// Move the cursor, with the shortest sequence that will do
+static void move_to(int row, uint32_t col) {
+    if (row == cursor_row && col == cursor_col) {
+        return;
+    }
+    if (row == cursor_row + 1 && col == 0 && cursor_row >= 0) {
+        term_print("\r\n");
+    } else {
+        term_printf("\033[%d;%uH", row + 1, col + 1);
+    }
+    cursor_row = row;
+    cursor_col = col;
+}
+
+static void draw_row(int row, const screen_row_t* old, const screen_row_t* new) {
+    uint32_t start = 0;
+
+    // A color change repaints the row; otherwise start at the first
+    // differing character
+    if (new->len && old->len && new->color == old->color) {
+        while (start < new->len && start < old->len &&
+               new->text[start] == old->text[start]) {
+            start++;
+        }
+        while (start > 0 && (new->text[start] & 0xC0) == 0x80) {
+            start--;
+        }
+    }
+    if (start == new->len && start == old->len) {
+        return;
+    }
+
+    // A row of the same length (a countdown) keeps its unchanged end
+    uint32_t end = new->len;
+    if (start && new->len == old->len) {
+        while (end > start && new->text[end - 1] == old->text[end - 1]) {
+            end--;
+        }
+        while (end < new->len && (new->text[end] & 0xC0) == 0x80) {
+            end++;
+        }
+    }
+
+    uint32_t width = row_width(new->text, new->len);
+    move_to(row, row_width(new->text, start));
+    if (start < end) {
+        term_set_color(new->color);
+        term_printf("%.*s", (int)(end - start), new->text + start);
+        cursor_col = row_width(new->text, end);
+    }
+    if (row_width(old->text, old->len) > width) {
+        term_print("\033[K");
+    }
+}
+
+void screen_end(void) {
+    static const screen_row_t empty;
+
+    // The last frame parked the cursor below itself
+    cursor_row = shown_rows;
+    cursor_col = 0;
+    if (!valid || term_output_count() != last_count) {
+        term_clear();
+        cursor_row = 0;
+        for (int i = 0; i < shown_rows; i++) {
+            shown[i].len = 0;
+        }
+        shown_rows = 0;
+    }
+
+    int rows = next_rows > shown_rows ? next_rows : shown_rows;
+    for (int i = 0; i < rows; i++) {
+        draw_row(i, i < shown_rows ? &shown[i] : &empty,
+                 i < next_rows ? &next[i] : &empty);
+    }
+
+    // Park the cursor below the page, in the normal color, for whatever
+    // is printed next
+    move_to(next_rows, 0);
+    term_set_color((uint8_t)config_int(CONFIG_DISPLAY_COLOR_NORMAL));
+
+    for (int i = 0; i < next_rows; i++) {
+        shown[i].color = next[i].color;
+        shown[i].len = next[i].len;
+        memcpy(shown[i].text, next[i].text, next[i].len + 1u);
+    }
+    for (int i = next_rows; i < shown_rows; i++) {
+        shown[i].len = 0;
+    }
+    shown_rows = next_rows;
+    valid = 1;
+    last_count = term_output_count();
+}
@@ -0,0 +1,191 @@
+// src/smp.c - Secondary core workers
+//
+// RETROS-BIOS leaves cores 1-3 of the BCM2836/7 in the firmware spin
+// loop, each waiting for an address in its local mailbox 3. smp_init()
+// sends them to secondary_entry (stage2.S), which gives each core its
+// own stack and turns on its MMU with core 0's table, then calls
+// smp_worker().
+//
+// Workers take jobs from a ring with one producer, core 0, which fills a
+// slot and publishes it by moving 'head'. A worker claims the job at
+// 'tail' by moving 'tail' with a compare-and-swap and counts it in
+// 'done' when finished. Before the kernel jump smp_park() sends every
+// core it started, workers and any that came up too late to be one,
+// back to an equivalent spin loop with the MMU and caches off, so the
+// kernel can start the cores through mailbox 3 itself.
+//
+// Without SMP_ENABLED there are no workers and smp_submit() runs each job
+// on core 0 straight away.
+
+#include "smp.h"
+#include "mfboot.h"
+#include "hardware.h"
+#include "protocols.h"
+
+#ifdef SMP_ENABLED
+
+_Static_assert(ATAGS_ADDR + ATAGS_MAX_SIZE <= SMP_PARK_ADDR, "ATAG list overlaps the park loop");
+
+#define MAILBOX_SET(core, n)    ((volatile uint32_t*)(LOCAL_MAILBOX_SET + 0x10 * (core) + 4 * (n)))
+#define MAILBOX_CLR(core, n)    ((volatile uint32_t*)(LOCAL_MAILBOX_CLR + 0x10 * (core) + 4 * (n)))
+
+// Set in 'cores' once smp_init() stops waiting. A core that shows up
+// later takes no jobs and only waits to be parked with the workers.
+#define CORES_CLOSED            0x80000000
+
+typedef struct {
+    smp_job_fn fn;
+    void* arg;
+} smp_job_t;
+
+static struct {
+    smp_job_t jobs[SMP_QUEUE_SIZE];
+    uint32_t head;              // Jobs submitted
+    uint32_t tail;              // Jobs claimed
+    uint32_t done;              // Jobs finished
+} queue;
+
+static uint32_t cores;          // Bit n: core n is up, plus CORES_CLOSED
+static uint32_t workers;        // Cores taking jobs
+static uint32_t parking;        // Workers leave once the queue is empty
+
+// Stacks of cores 1-3; secondary_entry takes the top of its own
+uint8_t smp_stacks[SMP_MAX_CORES - 1][SMP_STACK_SIZE] __attribute__((aligned(16)));
+
+// stage2.S
+extern void secondary_entry(void);
+extern void smp_park_core(uint32_t core) __attribute__((noreturn));
+extern const uint8_t smp_park_stub[];
+extern const uint8_t smp_park_stub_end[];
+
+static inline void wake_cores(void) {
+    __asm__ volatile("dsb\n\tsev" ::: "memory");
+}
+
+static inline void wait_event(void) {
+    __asm__ volatile("wfe" ::: "memory");
+}
+
+// Runs on each secondary core once its MMU is on; never returns
+void smp_worker(uint32_t core) {
+    // Too late to be counted as a worker, but its caches are on all the
+    // same: it has to leave through smp_park_core() like the others.
+    // smp_park() sets 'parking' before it reads 'cores', so either it
+    // sees this core's bit and waits for it, or this core sees 'parking'.
+    if (__atomic_fetch_or(&cores, 1u << core, __ATOMIC_SEQ_CST) & CORES_CLOSED) {
+        while (!__atomic_load_n(&parking, __ATOMIC_SEQ_CST)) {
+            wait_event();
+        }
+        smp_park_core(core);
+    }
+
+    while (1) {
+        uint32_t tail = __atomic_load_n(&queue.tail, __ATOMIC_ACQUIRE);
+        if (tail == __atomic_load_n(&queue.head, __ATOMIC_ACQUIRE)) {
+            if (__atomic_load_n(&parking, __ATOMIC_ACQUIRE)) {
+                smp_park_core(core);
+            }
+            wait_event();
+            continue;
+        }
+
+        // The slot cannot be reused before this job is claimed and done,
+        // so a copy taken before a successful claim is the job claimed
+        smp_job_t job = queue.jobs[tail % SMP_QUEUE_SIZE];
+        if (!__atomic_compare_exchange_n(&queue.tail, &tail, tail + 1, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        job.fn(job.arg);
+        __atomic_fetch_add(&queue.done, 1, __ATOMIC_RELEASE);
+        wake_cores();
+    }
+}
+
+#endif // SMP_ENABLED
+
+// Release the secondary cores. Returns the number of cores working,
+// core 0 included.
+int smp_init(void) {
+#ifdef SMP_ENABLED
+    for (uint32_t core = 1; core < SMP_MAX_CORES; core++) {
+        *MAILBOX_SET(core, SMP_START_MAILBOX) = (uint32_t)(uintptr_t)secondary_entry;
+    }
+    wake_cores();
+
+    uint32_t all = ((1u << SMP_MAX_CORES) - 1) & ~1u;
+    uint32_t start = get_timer_count();
+    while ((__atomic_load_n(&cores, __ATOMIC_ACQUIRE) & all) != all &&
+           get_timer_count() - start < SMP_START_TIMEOUT_US) {
+    }
+    uint32_t online = __atomic_fetch_or(&cores, CORES_CLOSED, __ATOMIC_ACQ_REL) & all;
+
+    workers = 0;
+    for (uint32_t core = 1; core < SMP_MAX_CORES; core++) {
+        if (online & (1u << core)) {
+            workers++;
+        }
+    }
+    return 1 + (int)workers;
+#else
+    return 1;
+#endif
+}
+
+// Queue fn(arg) for a worker. Returns a ticket for smp_wait(). Jobs may
+// run in any order and at the same time as each other.
+uint32_t smp_submit(smp_job_fn fn, void* arg) {
+#ifdef SMP_ENABLED
+    if (workers) {
+        uint32_t head = queue.head;
+        while (head - __atomic_load_n(&queue.done, __ATOMIC_ACQUIRE) >= SMP_QUEUE_SIZE) {
+            wait_event();
+        }
+        queue.jobs[head % SMP_QUEUE_SIZE].fn = fn;
+        queue.jobs[head % SMP_QUEUE_SIZE].arg = arg;
+        __atomic_store_n(&queue.head, head + 1, __ATOMIC_RELEASE);
+        wake_cores();
+        return head + 1;
+    }
+#endif
+    fn(arg);
+    return 0;
+}
+
+// Wait until the job behind 'ticket', and every job submitted before it,
+// has finished. Ticket 0 (a job run in place) is always finished.
+void smp_wait(uint32_t ticket) {
+#ifdef SMP_ENABLED
+    while ((int32_t)(__atomic_load_n(&queue.done, __ATOMIC_ACQUIRE) - ticket) < 0) {
+        wait_event();
+    }
+#else
+    (void)ticket;
+#endif
+}
+
+// Send the idle workers back to a mailbox spin loop for the kernel.
+// The loop is copied into place only now, since the firmware's device
+// tree may sit there until the handoff has copied it.
+void smp_park(void) {
+#ifdef SMP_ENABLED
+    uint32_t size = (uint32_t)(smp_park_stub_end - smp_park_stub);
+    memcpy(PHYS_PTR(SMP_PARK_ADDR), smp_park_stub, size);
+    dcache_clean_inv_range(SMP_PARK_ADDR, size);
+
+    // Workers and late cores alike
+    __atomic_store_n(&parking, 1, __ATOMIC_SEQ_CST);
+    wake_cores();
+    uint32_t online = __atomic_load_n(&cores, __ATOMIC_SEQ_CST) & ~CORES_CLOSED;
+    if (!online) {
+        return;
+    }
+
+    uint32_t start = get_timer_count();
+    while ((*MAILBOX_CLR(0, SMP_PARK_MAILBOX) & online) != online &&
+           get_timer_count() - start < SMP_START_TIMEOUT_US) {
+    }
+    *MAILBOX_CLR(0, SMP_PARK_MAILBOX) = online;
+    workers = 0;
+#endif
+}
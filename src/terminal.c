@@ -3,120 +3,154 @@
 #include "terminal.h"
 #include "hardware.h"
 #include "mfboot.h"
+#include "memory_mgr.h"
+#include "format.h"
 
 static uint8_t current_color = COLOR_GREEN;
+static int color_sent;          // The terminal is showing current_color
+static int output_muted;       // Benchmarks time term_printf without the UART
+static uint32_t output_count;   // Bytes printed so far
+
+// Output is queued in a ring from the system arena once term_buffer_init()
+// has run, and term_pump() moves it into the UART FIFO whenever there is
+// room: after each print and wherever the boot waits anyway (key polls,
+// delays, between the loader's card reads). Before that, or when the
+// ring is full, printing waits on the UART.
+static char* tx_ring;
+static uint32_t tx_head;        // Bytes queued
+static uint32_t tx_tail;        // Bytes handed to the UART
+
+// Consoles that mirror the UART (the framebuffer); each is handed the
+// same runs of output
+static const term_console_t* consoles[TERM_MAX_CONSOLES];
+static int num_consoles;
 
 void terminal_init(void) {
     // UART already initialized by RETROS-BIOS
     // Just set default color
     current_color = COLOR_GREEN;
+    color_sent = 0;
+}
+
+int term_buffer_init(void) {
+    tx_ring = memory_alloc(TERM_TX_RING_SIZE);
+    return tx_ring ? 0 : -1;
+}
+
+int term_add_console(const term_console_t* con) {
+    if (num_consoles == TERM_MAX_CONSOLES) {
+        return -1;
+    }
+    consoles[num_consoles++] = con;
+    return 0;
+}
+
+// Fill the transmit FIFO from the ring, up to its 16 bytes, and let the
+// other consoles catch up
+void term_pump(void) {
+    while (tx_tail != tx_head && uart_tx_ready()) {
+        uart_putc(tx_ring[tx_tail++ % TERM_TX_RING_SIZE]);
+    }
+    for (int i = 0; i < num_consoles; i++) {
+        consoles[i]->update(0);
+    }
+}
+
+// Wait until everything printed has left the UART and is on every
+// console
+void term_flush(void) {
+    while (tx_tail != tx_head) {
+        term_pump();
+    }
+    for (int i = 0; i < num_consoles; i++) {
+        consoles[i]->update(1);
+    }
+    while (!uart_tx_idle()) {
+    }
+}
+
+static void term_write(const char* s, uint32_t len) {
+    output_count += len;
+    for (int i = 0; i < num_consoles; i++) {
+        consoles[i]->write(s, len);
+    }
+    if (!tx_ring) {
+        while (len--) {
+            uart_putc(*s++);
+        }
+        return;
+    }
+    while (len--) {
+        while (tx_head - tx_tail == TERM_TX_RING_SIZE) {
+            term_pump();
+        }
+        tx_ring[tx_head++ % TERM_TX_RING_SIZE] = *s++;
+    }
 }
 
 void term_clear(void) {
     // Send ANSI clear screen sequence
-    uart_putc(27);  // ESC
-    uart_putc('[');
-    uart_putc('2');
-    uart_putc('J');
-    uart_putc(27);  // ESC
-    uart_putc('[');
-    uart_putc('H');
+    term_print("\033[2J\033[H");
+}
+
+void term_putc(char c) {
+    if (output_muted) {
+        return;
+    }
+    term_write(&c, 1);
+    term_pump();
 }
 
 void term_print(const char* str) {
-    while (*str) {
-        uart_putc(*str++);
+    if (output_muted) {
+        return;
     }
+    term_write(str, strlen(str));
+    term_pump();
+}
+
+static void term_sink(void* ctx, const char* s, uint32_t len) {
+    (void)ctx;
+    term_write(s, len);
 }
 
+// Formats straight into the transmit ring. Muted output is still
+// formatted, into no sink, so benchmarks time the conversions.
 void term_printf(const char* fmt, ...) {
-    char buffer[256];
     va_list args;
     va_start(args, fmt);
-    
-    // Simple printf implementation
-    int i = 0;
-    const char* p = fmt;
-    
-    while (*p && i < 255) {
-        if (*p == '%') {
-            p++;
-            if (*p == 's') {
-                // String
-                const char* s = va_arg(args, const char*);
-                while (*s && i < 255) {
-                    buffer[i++] = *s++;
-                }
-            } else if (*p == 'd') {
-                // Decimal integer
-                int val = va_arg(args, int);
-                if (val < 0) {
-                    buffer[i++] = '-';
-                    val = -val;
-                }
-                char temp[16];
-                int j = 0;
-                do {
-                    temp[j++] = '0' + (val % 10);
-                    val /= 10;
-                } while (val > 0);
-                while (j > 0 && i < 255) {
-                    buffer[i++] = temp[--j];
-                }
-            } else if (*p == 'x' || *p == 'X') {
-                // Hexadecimal
-                uint32_t val = va_arg(args, uint32_t);
-                char temp[16];
-                int j = 0;
-                do {
-                    int digit = val & 0xF;
-                    temp[j++] = digit < 10 ? '0' + digit : 'A' + digit - 10;
-                    val >>= 4;
-                } while (val > 0);
-                while (j > 0 && i < 255) {
-                    buffer[i++] = temp[--j];
-                }
-            } else if (*p == '0') {
-                // Padded hex (e.g., %08X)
-                p++;
-                int width = *p - '0';
-                p++;
-                if (*p == 'x' || *p == 'X') {
-                    uint32_t val = va_arg(args, uint32_t);
-                    char temp[16];
-                    int j = 0;
-                    for (int k = 0; k < width; k++) {
-                        int digit = (val >> ((width - 1 - k) * 4)) & 0xF;
-                        temp[j++] = digit < 10 ? '0' + digit : 'A' + digit - 10;
-                    }
-                    while (j > 0 && i < 255) {
-                        buffer[i++] = temp[--j];
-                    }
-                }
-            } else if (*p == '%') {
-                buffer[i++] = '%';
-            }
-            p++;
-        } else {
-            buffer[i++] = *p++;
-        }
-    }
-    
-    buffer[i] = '\0';
+    format_vprint(output_muted ? NULL : term_sink, NULL, fmt, args);
     va_end(args);
-    term_print(buffer);
+    term_pump();
 }
 
+// SGR foreground color, sent only when it changes. Colors 0-7 are the
+// ANSI set (COLOR_AMBER is its yellow), 8-15 the bright ones.
 void term_set_color(uint8_t color) {
+    if (output_muted || (color_sent && color == current_color)) {
+        return;
+    }
     current_color = color;
-    // For now, we don't implement color codes
-    // Would need ANSI escape sequences for framebuffer
+    color_sent = 1;
+    term_printf("\033[%um", color < 8 ? 30u + color : 90u + (color & 7));
 }
 
-char wait_for_key(void) {
-    // Wait for and return a key press
-    while (!uart_readable()) {
-        // Busy wait
+void term_set_muted(int muted) {
+    output_muted = muted;
+}
+
+// Bytes printed since boot; screen.c compares it to notice output that
+// went around the screen model
+uint32_t term_output_count(void) {
+    return output_count;
+}
+
+// Key press if one is waiting, else -1. Never blocks, so loops that
+// have other work (a countdown, a load) can call it every pass.
+int term_poll_key(void) {
+    term_pump();
+    if (!uart_readable()) {
+        return -1;
     }
     
     char c = uart_getc();
@@ -139,5 +173,14 @@ char wait_for_key(void) {
         }
     }
     
-    return c;
+    return (uint8_t)c;
+}
+
+char wait_for_key(void) {
+    // Wait for and return a key press
+    int key;
+    while ((key = term_poll_key()) < 0) {
+        // Busy wait
+    }
+    return (char)key;
 }
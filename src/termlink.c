@@ -0,0 +1,139 @@
+// src/termlink.c - RobCo Termlink terminal state
+//
+// termlink_init() collects what the terminal offers the boot agent and
+// the OS: the serial console, always, and the framebuffer RETROS-BIOS
+// set up for HDMI. The framebuffer is found through the VideoCore
+// mailbox; asking it to allocate one returns the buffer already in use.
+//
+// termlink_handoff() writes the Termlink protocol's boot block for the
+// kernel: that terminal state, the boot block the loader filled in, the
+// memory map and the boot trace, in one reserved range.
+
+#include "termlink.h"
+#include "hardware.h"
+#include "mfboot.h"
+#include "memmap.h"
+#include "trace.h"
+
+// Bus addresses of the framebuffer carry a cache alias in the top bits
+#define BUS_ADDR_MASK   0x3FFFFFFF
+
+// Trace events the boot block has room for
+#ifdef ENABLE_TRACE
+#define HANDOFF_TRACE_MAX   TRACE_RING_SIZE
+#else
+#define HANDOFF_TRACE_MAX   0
+#endif
+
+// What termlink_init() found, for the handoff
+static const termlink_info_t* terminal;
+
+static int query_framebuffer(termlink_info_t* info) {
+    static uint32_t buf[28] __attribute__((aligned(16)));
+    uint32_t i = 0;
+
+    buf[i++] = sizeof(buf);
+    buf[i++] = MBOX_REQUEST;
+    buf[i++] = MBOX_TAG_FB_PHYS_SIZE;
+    buf[i++] = 8;
+    buf[i++] = 0;
+    buf[i++] = 0;               // [5] width
+    buf[i++] = 0;               // [6] height
+    buf[i++] = MBOX_TAG_FB_DEPTH;
+    buf[i++] = 4;
+    buf[i++] = 0;
+    buf[i++] = 0;               // [10] bits per pixel
+    buf[i++] = MBOX_TAG_FB_PIXEL_ORDER;
+    buf[i++] = 4;
+    buf[i++] = 0;
+    buf[i++] = 0;               // [14] pixel order
+    buf[i++] = MBOX_TAG_FB_ALLOCATE;
+    buf[i++] = 8;
+    buf[i++] = 0;
+    buf[i++] = 16;              // [18] alignment, then base
+    buf[i++] = 0;               // [19] size
+    buf[i++] = MBOX_TAG_FB_PITCH;
+    buf[i++] = 4;
+    buf[i++] = 0;
+    buf[i++] = 0;               // [23] pitch
+    buf[i++] = MBOX_TAG_END;
+    while (i < sizeof(buf) / sizeof(buf[0])) {
+        buf[i++] = 0;
+    }
+
+    if (mbox_property(buf) != 0 || buf[18] == 0 || buf[5] == 0 || buf[6] == 0) {
+        return -1;
+    }
+    info->fb_addr = buf[18] & BUS_ADDR_MASK;
+    info->fb_width = buf[5];
+    info->fb_height = buf[6];
+    info->fb_depth = buf[10];
+    info->fb_pixel_order = buf[14];
+    info->fb_pitch = buf[23];
+    return 0;
+}
+
+void termlink_init(termlink_info_t* info) {
+    memset(info, 0, sizeof(*info));
+    info->magic = TERMLINK_MAGIC;
+    info->version = TERMLINK_VERSION;
+    info->capabilities = TERM_CAP_SERIAL;
+    info->peripheral_base = PERIPHERAL_BASE;
+
+    if (query_framebuffer(info) == 0) {
+        info->capabilities |= TERM_CAP_FRAMEBUF;
+    }
+    terminal = info;
+}
+
+// Reserve and write the boot block, completing 'boot' with the memory
+// map and timing. Returns its address for r0, 0 if there is no room.
+uint32_t termlink_handoff(termlink_boot_t* boot) {
+    memmap_info_t mi;
+    uint32_t mem_offset = sizeof(termlink_info_t) + sizeof(termlink_boot_t);
+    uint32_t max_size = mem_offset + MEMMAP_MAX_REGIONS * sizeof(memmap_region_t) +
+                        HANDOFF_TRACE_MAX * sizeof(trace_entry_t);
+    uint32_t reserve = (max_size + TERMLINK_BLOCK_ALIGN - 1) & ~(TERMLINK_BLOCK_ALIGN - 1);
+
+    // At the top of RAM, clear of the kernel's BSS and early allocations
+    uint32_t addr = memmap_alloc(reserve, TERMLINK_BLOCK_ALIGN, MEMMAP_TERMLINK, MEMMAP_HIGH);
+    if (addr == 0) {
+        return 0;
+    }
+    uint8_t* block = PHYS_PTR(addr);
+    memset(block, 0, reserve);
+
+    termlink_info_t* info = (termlink_info_t*)block;
+    if (terminal) {
+        *info = *terminal;
+    } else {
+        termlink_init(info);
+    }
+
+    boot->magic = TERMLINK_BOOT_MAGIC;
+    boot->version = TERMLINK_BOOT_VERSION;
+
+    // The map is copied after the reservation above, so it lists the block
+    memmap_get_info(&mi);
+    boot->ram_base = mi.ram_base;
+    boot->ram_size = mi.ram_size;
+    boot->vc_base = mi.vc_base;
+    boot->vc_size = mi.vc_size;
+    boot->mem_offset = mem_offset;
+    boot->mem_count = memmap_copy((memmap_region_t*)(block + mem_offset), MEMMAP_MAX_REGIONS);
+    boot->mem_entry_size = sizeof(memmap_region_t);
+
+    boot->trace_offset = mem_offset + boot->mem_count * sizeof(memmap_region_t);
+    boot->trace_count = trace_copy((trace_entry_t*)(block + boot->trace_offset),
+                                   HANDOFF_TRACE_MAX, &boot->trace_lost);
+    boot->trace_entry_size = sizeof(trace_entry_t);
+    boot->stage2_time = stage2_entry_time;
+    boot->handoff_time = get_timer_count();
+
+    boot->size = boot->trace_offset + boot->trace_count * sizeof(trace_entry_t);
+    boot->checksum = 0;
+    termlink_boot_t* out = (termlink_boot_t*)(info + 1);
+    *out = *boot;
+    out->checksum = crc32(0, block, boot->size);
+    return addr;
+}
@@ -0,0 +1,210 @@
+// src/trace.c - Boot-phase timing trace
+//
+// Events are appended to a ring in upper memory with a TIMER_CLO
+// timestamp. The maintenance screen folds begin/end pairs into a
+// per-stage breakdown; the UART dump sends the raw ring for
+// tools/trace_view.py to draw as a timeline.
+
+#include "trace.h"
+#include "mfboot.h"
+#include "terminal.h"
+#include "hardware.h"
+#include "memory_mgr.h"
+
+#define TRACE_MAX_DEPTH     8
+
+#ifdef ENABLE_TRACE
+
+static const char* const event_names[TRACE_NUM_EVENTS] = {
+    "stage2", "mmu", "memory_init", "bcache_init", "fs_init", "scan",
+    "fs_exists", "probe", "menu", "load", "read", "read_async",
+    "decompress", "verify", "jump"
+};
+
+static trace_entry_t* ring;
+static uint32_t ring_count;     // Events recorded; the ring keeps the last TRACE_RING_SIZE
+
+void trace_init(void) {
+    ring = memory_alloc(TRACE_RING_SIZE * sizeof(trace_entry_t));
+    ring_count = 0;
+}
+
+void trace_record_at(uint32_t time, uint32_t event, uint32_t phase, uint32_t arg) {
+    if (!ring) {
+        return;
+    }
+    trace_entry_t* e = &ring[ring_count++ & (TRACE_RING_SIZE - 1)];
+    e->time = time;
+    e->event = (uint8_t)event;
+    e->phase = (uint8_t)phase;
+    e->reserved = 0;
+    e->arg = arg;
+}
+
+void trace_record(uint32_t event, uint32_t phase, uint32_t arg) {
+    trace_record_at(get_timer_count(), event, phase, arg);
+}
+
+static uint32_t trace_first(void) {
+    return ring_count > TRACE_RING_SIZE ? ring_count - TRACE_RING_SIZE : 0;
+}
+
+static const trace_entry_t* trace_at(uint32_t index) {
+    return &ring[index & (TRACE_RING_SIZE - 1)];
+}
+
+void trace_show(void) {
+    uint32_t total_us[TRACE_NUM_EVENTS];
+    uint32_t max_us[TRACE_NUM_EVENTS];
+    uint32_t spans[TRACE_NUM_EVENTS];
+    const trace_entry_t* open[TRACE_MAX_DEPTH];
+    int depth = 0;
+
+    term_print("Boot Trace:\n");
+    term_print("─────────────────────────────────────\n");
+    if (!ring || ring_count == 0) {
+        term_print("No events recorded\n");
+        return;
+    }
+
+    uint32_t first = trace_first();
+    uint32_t base = trace_at(first)->time;
+    if (first) {
+        term_printf("(%u oldest events overwritten)\n", first);
+    }
+
+    memset(total_us, 0, sizeof(total_us));
+    memset(max_us, 0, sizeof(max_us));
+    memset(spans, 0, sizeof(spans));
+
+    // Timeline of the outer stages, listed as they finish; extent reads
+    // and probes only count towards the totals below
+    term_print("   Start us    Time us  Stage\n");
+    for (uint32_t i = first; i < ring_count; i++) {
+        const trace_entry_t* e = trace_at(i);
+        if (e->event >= TRACE_NUM_EVENTS) {
+            continue;
+        }
+
+        if (e->phase == TRACE_PHASE_MARK) {
+            term_printf("%11u          -  %s\n", e->time - base, event_names[e->event]);
+        } else if (e->phase == TRACE_PHASE_BEGIN) {
+            if (depth < TRACE_MAX_DEPTH) {
+                open[depth++] = e;
+            }
+        } else {
+            // Reads complete out of order with other stages, so match
+            // the innermost open span of the same event
+            int j = depth - 1;
+            while (j >= 0 && open[j]->event != e->event) {
+                j--;
+            }
+            if (j < 0) {
+                continue;
+            }
+
+            uint32_t us = e->time - open[j]->time;
+            total_us[e->event] += us;
+            spans[e->event]++;
+            if (us > max_us[e->event]) {
+                max_us[e->event] = us;
+            }
+            if (e->event != TRACE_READ && e->event != TRACE_READ_ASYNC &&
+                e->event != TRACE_FS_EXISTS && e->event != TRACE_PROBE) {
+                term_printf("%11u%11u  %s\n", open[j]->time - base, us, event_names[e->event]);
+            }
+
+            for (; j < depth - 1; j++) {
+                open[j] = open[j + 1];
+            }
+            depth--;
+        }
+    }
+
+    term_print("\n  Event          Count   Total us     Max us\n");
+    for (uint32_t ev = 0; ev < TRACE_NUM_EVENTS; ev++) {
+        if (spans[ev]) {
+            term_printf("  %-13s%6u%11u%11u\n", event_names[ev], spans[ev], total_us[ev], max_us[ev]);
+        }
+    }
+    term_printf("\n  Elapsed: %u us since stage2 entry\n", get_timer_count() - stage2_entry_time);
+}
+
+static void dump_bytes(const void* data, uint32_t len, uint32_t* sum) {
+    const uint8_t* p = data;
+    while (len--) {
+        *sum += *p;
+        uart_putc((char)*p++);
+    }
+}
+
+// Frame: magic, version, entry size, count, lost, entries, byte sum of
+// everything after the magic. All fields little-endian.
+void trace_dump_uart(void) {
+    uint32_t first;
+    uint32_t header[4];
+    uint32_t sum = 0;
+
+    if (!ring) {
+        return;
+    }
+
+    // Queued console text goes out ahead of the raw dump
+    term_flush();
+
+    first = trace_first();
+    header[0] = TRACE_DUMP_MAGIC;
+    header[1] = TRACE_DUMP_VERSION | (sizeof(trace_entry_t) << 16);
+    header[2] = ring_count - first;
+    header[3] = first;
+
+    dump_bytes(&header[0], 4, &sum);
+    sum = 0;
+    dump_bytes(&header[1], 12, &sum);
+    for (uint32_t i = first; i < ring_count; i++) {
+        dump_bytes(trace_at(i), sizeof(trace_entry_t), &sum);
+    }
+    uint32_t check = sum;
+    dump_bytes(&check, 4, &sum);
+}
+
+// Copy the newest 'max' events, oldest first; 'lost' gets how many
+// older ones are not in the copy
+uint32_t trace_copy(trace_entry_t* out, uint32_t max, uint32_t* lost) {
+    uint32_t first = trace_first();
+    uint32_t n = ring_count - first;
+
+    if (!ring) {
+        *lost = 0;
+        return 0;
+    }
+    if (n > max) {
+        first = ring_count - max;
+        n = max;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        out[i] = *trace_at(first + i);
+    }
+    *lost = first;
+    return n;
+}
+
+#else
+
+void trace_show(void) {
+    term_print("Boot Trace:\n");
+    term_print("─────────────────────────────────────\n");
+    term_print("Tracing disabled (build with TRACE=1)\n");
+}
+
+void trace_dump_uart(void) {
+}
+
+uint32_t trace_copy(trace_entry_t* out, uint32_t max, uint32_t* lost) {
+    (void)out;
+    (void)max;
+    *lost = 0;
+    return 0;
+}
+
+#endif // ENABLE_TRACE
@@ -0,0 +1,11 @@
+// src/trusted_keys.c - Public keys accepted for signed boot images
+//
+// Generated by tools/sign_payload.py export-keys; do not edit.
+
+#include "crypto.h"
+
+const uint8_t trusted_keys[][ED25519_KEY_SIZE] = {
+    { 0 },  // Placeholder; no keys are trusted
+};
+
+const uint32_t trusted_key_count = 0;
@@ -2,26 +2,290 @@
 
 #include "mfboot.h"
 
+// Word type that may alias any object; the block routines below move
+// arbitrary caller data through it.
+typedef uint32_t __attribute__((may_alias)) word_t;
+
+// Copies shorter than this are done bytewise; aligning is not worth it
+#define MEMOPS_SMALL 16
+
+#if defined(BCM2836) || defined(BCM2837)
+
+// Cortex-A7/A53: NEON 64-byte block copy. vld1.8/vst1.8 only require
+// byte alignment, so the source may be misaligned relative to dest.
+static inline void copy_blocks(uint8_t* d, const uint8_t* s, size_t blocks) {
+    __asm__ volatile(
+        "1:\n"
+        "   pld     [%[s], #192]\n"
+        "   vld1.8  {d0-d3}, [%[s]]!\n"
+        "   vld1.8  {d4-d7}, [%[s]]!\n"
+        "   subs    %[n], %[n], #1\n"
+        "   vst1.8  {d0-d3}, [%[d]]!\n"
+        "   vst1.8  {d4-d7}, [%[d]]!\n"
+        "   bne     1b\n"
+        : [d] "+r" (d), [s] "+r" (s), [n] "+r" (blocks)
+        :
+        : "d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7", "cc", "memory");
+}
+
+static inline void fill_blocks(uint8_t* d, uint32_t pattern, size_t blocks) {
+    __asm__ volatile(
+        "   vdup.32 q0, %[p]\n"
+        "   vmov    q1, q0\n"
+        "1:\n"
+        "   subs    %[n], %[n], #1\n"
+        "   vst1.8  {d0-d3}, [%[d]]!\n"
+        "   vst1.8  {d0-d3}, [%[d]]!\n"
+        "   bne     1b\n"
+        : [d] "+r" (d), [n] "+r" (blocks)
+        : [p] "r" (pattern)
+        : "d0", "d1", "d2", "d3", "cc", "memory");
+}
+
+#define MEMOPS_BLOCK        64
+#define MEMOPS_ANY_SRC      1   // block copy tolerates misaligned source
+
+#elif defined(BCM2835)
+
+// ARM1176: 32-byte ldm/stm burst through eight registers. r7 and fp are
+// left alone so the compiler keeps its frame registers.
+static inline void copy_blocks(uint8_t* d, const uint8_t* s, size_t blocks) {
+    __asm__ volatile(
+        "1:\n"
+        "   pld     [%[s], #64]\n"
+        "   ldmia   %[s]!, {r3-r6, r8-r10, r12}\n"
+        "   subs    %[n], %[n], #1\n"
+        "   stmia   %[d]!, {r3-r6, r8-r10, r12}\n"
+        "   bne     1b\n"
+        : [d] "+r" (d), [s] "+r" (s), [n] "+r" (blocks)
+        :
+        : "r3", "r4", "r5", "r6", "r8", "r9", "r10", "r12", "cc", "memory");
+}
+
+static inline void fill_blocks(uint8_t* d, uint32_t pattern, size_t blocks) {
+    __asm__ volatile(
+        "   mov     r3, %[p]\n"
+        "   mov     r4, %[p]\n"
+        "   mov     r5, %[p]\n"
+        "   mov     r6, %[p]\n"
+        "   mov     r8, %[p]\n"
+        "   mov     r9, %[p]\n"
+        "   mov     r10, %[p]\n"
+        "   mov     r12, %[p]\n"
+        "1:\n"
+        "   subs    %[n], %[n], #1\n"
+        "   stmia   %[d]!, {r3-r6, r8-r10, r12}\n"
+        "   bne     1b\n"
+        : [d] "+r" (d), [n] "+r" (blocks)
+        : [p] "r" (pattern)
+        : "r3", "r4", "r5", "r6", "r8", "r9", "r10", "r12", "cc", "memory");
+}
+
+#define MEMOPS_BLOCK        32
+#define MEMOPS_ANY_SRC      0   // ldm needs a word-aligned source
+
+#else
+
+// Portable fallback (non-ARM builds): unrolled word loop
+static inline void copy_blocks(uint8_t* d, const uint8_t* s, size_t blocks) {
+    word_t* wd = (word_t*)d;
+    const word_t* ws = (const word_t*)s;
+    while (blocks--) {
+        wd[0] = ws[0]; wd[1] = ws[1]; wd[2] = ws[2]; wd[3] = ws[3];
+        wd[4] = ws[4]; wd[5] = ws[5]; wd[6] = ws[6]; wd[7] = ws[7];
+        wd += 8;
+        ws += 8;
+    }
+}
+
+static inline void fill_blocks(uint8_t* d, uint32_t pattern, size_t blocks) {
+    word_t* wd = (word_t*)d;
+    while (blocks--) {
+        wd[0] = pattern; wd[1] = pattern; wd[2] = pattern; wd[3] = pattern;
+        wd[4] = pattern; wd[5] = pattern; wd[6] = pattern; wd[7] = pattern;
+        wd += 8;
+    }
+}
+
+#define MEMOPS_BLOCK        32
+#define MEMOPS_ANY_SRC      0
+
+#endif
+
+// Copy whole words from a source that is not word aligned. Only aligned
+// loads are issued (unaligned access faults while the MMU is off); each
+// output word is stitched together from two neighbouring source words.
+// The final load stays inside the word holding the last source byte.
+static void copy_words_shifted(uint8_t* d, const uint8_t* s, size_t words) {
+    uint32_t shift = ((uintptr_t)s & 3) * 8;
+    const word_t* ws = (const word_t*)((uintptr_t)s & ~(uintptr_t)3);
+    word_t* wd = (word_t*)d;
+    uint32_t cur = *ws++;
+
+    while (words--) {
+        uint32_t next = *ws++;
+        *wd++ = (cur >> shift) | (next << (32 - shift));
+        cur = next;
+    }
+}
+
 void* memset(void* s, int c, size_t n) {
-    unsigned char* p = s;
+    uint8_t* p = s;
+    uint8_t b = (uint8_t)c;
+
+    if (n >= MEMOPS_SMALL) {
+        // Head: bring destination to a word boundary
+        while ((uintptr_t)p & 3) {
+            *p++ = b;
+            n--;
+        }
+
+        uint32_t pattern = b * 0x01010101u;
+        size_t blocks = n / MEMOPS_BLOCK;
+        if (blocks) {
+            fill_blocks(p, pattern, blocks);
+            p += blocks * MEMOPS_BLOCK;
+            n -= blocks * MEMOPS_BLOCK;
+        }
+
+        word_t* wp = (word_t*)p;
+        while (n >= 4) {
+            *wp++ = pattern;
+            n -= 4;
+        }
+        p = (uint8_t*)wp;
+    }
+
+    // Tail
     while (n--) {
-        *p++ = (unsigned char)c;
+        *p++ = b;
     }
     return s;
 }
 
 void* memcpy(void* dest, const void* src, size_t n) {
-    unsigned char* d = dest;
-    const unsigned char* s = src;
+    uint8_t* d = dest;
+    const uint8_t* s = src;
+
+    if (n >= MEMOPS_SMALL) {
+        // Head: bring destination to a word boundary
+        while ((uintptr_t)d & 3) {
+            *d++ = *s++;
+            n--;
+        }
+
+        int src_aligned = ((uintptr_t)s & 3) == 0;
+
+        if (src_aligned || MEMOPS_ANY_SRC) {
+            size_t blocks = n / MEMOPS_BLOCK;
+            if (blocks) {
+                copy_blocks(d, s, blocks);
+                d += blocks * MEMOPS_BLOCK;
+                s += blocks * MEMOPS_BLOCK;
+                n -= blocks * MEMOPS_BLOCK;
+            }
+        }
+
+        size_t words = n / 4;
+        if (words) {
+            if (src_aligned) {
+                word_t* wd = (word_t*)d;
+                const word_t* ws = (const word_t*)s;
+                for (size_t i = 0; i < words; i++) {
+                    wd[i] = ws[i];
+                }
+            } else {
+                copy_words_shifted(d, s, words);
+            }
+            d += words * 4;
+            s += words * 4;
+            n -= words * 4;
+        }
+    }
+
+    // Tail
     while (n--) {
         *d++ = *s++;
     }
     return dest;
 }
 
+// Copy between ranges that may overlap. Moving down runs forwards and
+// moving up runs backwards, a word at a time when both ends share an
+// alignment; disjoint ranges take memcpy().
+void* memmove(void* dest, const void* src, size_t n) {
+    uint8_t* d = dest;
+    const uint8_t* s = src;
+
+    if (d == s || n == 0) {
+        return dest;
+    }
+    if (d + n <= s || s + n <= d) {
+        return memcpy(dest, src, n);
+    }
+
+    int words = (((uintptr_t)d ^ (uintptr_t)s) & 3) == 0;
+    if (d < s) {
+        while (n && ((uintptr_t)d & 3)) {
+            *d++ = *s++;
+            n--;
+        }
+        if (words) {
+            for (; n >= 4; n -= 4, d += 4, s += 4) {
+                *(word_t*)d = *(const word_t*)s;
+            }
+        }
+        while (n--) {
+            *d++ = *s++;
+        }
+    } else {
+        d += n;
+        s += n;
+        while (n && ((uintptr_t)d & 3)) {
+            *--d = *--s;
+            n--;
+        }
+        if (words) {
+            for (; n >= 4; n -= 4) {
+                d -= 4;
+                s -= 4;
+                *(word_t*)d = *(const word_t*)s;
+            }
+        }
+        while (n--) {
+            *--d = *--s;
+        }
+    }
+    return dest;
+}
+
 int memcmp(const void* s1, const void* s2, size_t n) {
-    const unsigned char* p1 = s1;
-    const unsigned char* p2 = s2;
+    const uint8_t* p1 = s1;
+    const uint8_t* p2 = s2;
+
+    // Word-at-a-time scan when both pointers share the same alignment;
+    // the first differing word is resolved bytewise below.
+    if (n >= MEMOPS_SMALL && (((uintptr_t)p1 ^ (uintptr_t)p2) & 3) == 0) {
+        while ((uintptr_t)p1 & 3) {
+            if (*p1 != *p2) {
+                return *p1 - *p2;
+            }
+            p1++;
+            p2++;
+            n--;
+        }
+
+        const word_t* w1 = (const word_t*)p1;
+        const word_t* w2 = (const word_t*)p2;
+        while (n >= 4 && *w1 == *w2) {
+            w1++;
+            w2++;
+            n -= 4;
+        }
+        p1 = (const uint8_t*)w1;
+        p2 = (const uint8_t*)w2;
+    }
+
     while (n--) {
         if (*p1 != *p2) {
             return *p1 - *p2;
@@ -53,3 +317,117 @@ int strcmp(const char* s1, const char* s2) {
     }
     return *(const unsigned char*)s1 - *(const unsigned char*)s2;
 }
+
+// CRC-32 (IEEE, reflected), byte-wise table
+static const uint32_t crc_table[256] = {
+    0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA,
+    0x076DC419, 0x706AF48F, 0xE963A535, 0x9E6495A3,
+    0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988,
+    0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91,
+    0x1DB71064, 0x6AB020F2, 0xF3B97148, 0x84BE41DE,
+    0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
+    0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC,
+    0x14015C4F, 0x63066CD9, 0xFA0F3D63, 0x8D080DF5,
+    0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172,
+    0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B,
+    0x35B5A8FA, 0x42B2986C, 0xDBBBC9D6, 0xACBCF940,
+    0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
+    0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116,
+    0x21B4F4B5, 0x56B3C423, 0xCFBA9599, 0xB8BDA50F,
+    0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924,
+    0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D,
+    0x76DC4190, 0x01DB7106, 0x98D220BC, 0xEFD5102A,
+    0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
+    0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818,
+    0x7F6A0DBB, 0x086D3D2D, 0x91646C97, 0xE6635C01,
+    0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E,
+    0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457,
+    0x65B0D9C6, 0x12B7E950, 0x8BBEB8EA, 0xFCB9887C,
+    0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
+    0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2,
+    0x4ADFA541, 0x3DD895D7, 0xA4D1C46D, 0xD3D6F4FB,
+    0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0,
+    0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9,
+    0x5005713C, 0x270241AA, 0xBE0B1010, 0xC90C2086,
+    0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
+    0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4,
+    0x59B33D17, 0x2EB40D81, 0xB7BD5C3B, 0xC0BA6CAD,
+    0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A,
+    0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683,
+    0xE3630B12, 0x94643B84, 0x0D6D6A3E, 0x7A6A5AA8,
+    0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
+    0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE,
+    0xF762575D, 0x806567CB, 0x196C3671, 0x6E6B06E7,
+    0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC,
+    0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5,
+    0xD6D6A3E8, 0xA1D1937E, 0x38D8C2C4, 0x4FDFF252,
+    0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
+    0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60,
+    0xDF60EFC3, 0xA867DF55, 0x316E8EEF, 0x4669BE79,
+    0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236,
+    0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F,
+    0xC5BA3BBE, 0xB2BD0B28, 0x2BB45A92, 0x5CB36A04,
+    0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
+    0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A,
+    0x9C0906A9, 0xEB0E363F, 0x72076785, 0x05005713,
+    0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38,
+    0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21,
+    0x86D3D2D4, 0xF1D4E242, 0x68DDB3F8, 0x1FDA836E,
+    0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
+    0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C,
+    0x8F659EFF, 0xF862AE69, 0x616BFFD3, 0x166CCF45,
+    0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2,
+    0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB,
+    0xAED16A4A, 0xD9D65ADC, 0x40DF0B66, 0x37D83BF0,
+    0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
+    0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6,
+    0xBAD03605, 0xCDD70693, 0x54DE5729, 0x23D967BF,
+    0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94,
+    0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
+};
+
+// Slicing by eight: crc_slices[k] is crc_table advanced by k + 1 more
+// zero bytes, so two aligned words take eight independent lookups
+// instead of eight dependent steps. Built from crc_table on first use,
+// in BSS rather than the image.
+static uint32_t crc_slices[7][256];
+static int crc_slices_ready;
+
+static void crc_init_slices(void) {
+    for (int i = 0; i < 256; i++) {
+        uint32_t c = crc_table[i];
+        for (int k = 0; k < 7; k++) {
+            c = (c >> 8) ^ crc_table[c & 0xFF];
+            crc_slices[k][i] = c;
+        }
+    }
+    crc_slices_ready = 1;
+}
+
+// Chains like zlib's: crc32(crc32(0, a, n), b, m) is the CRC of a
+// followed by b
+uint32_t crc32(uint32_t crc, const void* data, size_t len) {
+    const uint8_t* p = data;
+
+    if (!crc_slices_ready) {
+        crc_init_slices();
+    }
+    crc = ~crc;
+    while (len && ((uintptr_t)p & 7)) {
+        crc = (crc >> 8) ^ crc_table[(crc ^ *p++) & 0xFF];
+        len--;
+    }
+    // Little-endian words: the first byte is the low one
+    for (; len >= 8; len -= 8, p += 8) {
+        uint32_t lo = crc ^ ((const word_t*)p)[0];
+        uint32_t hi = ((const word_t*)p)[1];
+        crc = crc_slices[6][lo & 0xFF] ^ crc_slices[5][(lo >> 8) & 0xFF] ^
+              crc_slices[4][(lo >> 16) & 0xFF] ^ crc_slices[3][lo >> 24] ^
+              crc_slices[2][hi & 0xFF] ^ crc_slices[1][(hi >> 8) & 0xFF] ^
+              crc_slices[0][(hi >> 16) & 0xFF] ^ crc_table[hi >> 24];
+    }
+    while (len--) {
+        crc = (crc >> 8) ^ crc_table[(crc ^ *p++) & 0xFF];
+    }
+    return ~crc;
+}
@@ -0,0 +1,251 @@
+// tests/bcache_test.c - src/bcache.c counters and read-ahead window
+//
+// Runs the block cache over a stand-in card that logs every
+// mmc_read_blocks() request. Checks the size of each request as the
+// read-ahead window doubles on sequential misses, the hit, miss and
+// read-ahead counters for sequential and random access, and that a
+// failed bcache_init() gives back what it had allocated.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bcache.h"
+#include "memory_mgr.h"
+#include "mmc.h"
+#include "test.h"
+
+#define CARD_BLOCKS     0x100000        // 512 MB card
+#define MAX_REQUESTS    4096
+
+typedef struct {
+    uint32_t lba;
+    uint32_t count;
+} request_t;
+
+static request_t requests[MAX_REQUESTS];
+static int num_requests;
+
+static int alloc_countdown;             // Fail the Nth allocation from now; 0 never
+static int allocs, frees;
+
+void* memory_alloc(size_t size) {
+    if (alloc_countdown > 0 && --alloc_countdown == 0) {
+        return NULL;
+    }
+    allocs++;
+    return malloc(size);
+}
+
+void memory_free(void* ptr) {
+    if (ptr) {
+        frees++;
+    }
+    free(ptr);
+}
+
+static uint8_t block_byte(uint32_t lba, uint32_t offset) {
+    return (uint8_t)(lba * 31 + offset * 7 + (lba >> 8));
+}
+
+// Reads running past the end of the card fail, as on hardware
+int mmc_read_blocks(uint32_t lba, uint32_t count, void* buffer) {
+    if (num_requests < MAX_REQUESTS) {
+        requests[num_requests].lba = lba;
+        requests[num_requests].count = count;
+    }
+    num_requests++;
+    if (lba >= CARD_BLOCKS || count > CARD_BLOCKS - lba) {
+        return -1;
+    }
+    uint8_t* p = buffer;
+    for (uint32_t b = 0; b < count; b++) {
+        for (uint32_t i = 0; i < BCACHE_BLOCK_SIZE; i++) {
+            *p++ = block_byte(lba + b, i);
+        }
+    }
+    return 0;
+}
+
+static int get_ok(uint32_t lba) {
+    const uint8_t* block = bcache_get(lba);
+    if (!block) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < BCACHE_BLOCK_SIZE; i++) {
+        if (block[i] != block_byte(lba, i)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void check_stats(const char* what, uint32_t hits, uint32_t misses,
+                        uint32_t readahead, uint32_t readahead_hits) {
+    bcache_stats_t st;
+    bcache_get_stats(&st);
+    CHECK_MSG(st.hits == hits && st.misses == misses && st.readahead == readahead &&
+              st.readahead_hits == readahead_hits,
+              "%s: %u/%u/%u/%u hits/misses/readahead/readahead_hits, want %u/%u/%u/%u", what,
+              st.hits, st.misses, st.readahead, st.readahead_hits,
+              hits, misses, readahead, readahead_hits);
+}
+
+static void start(size_t size) {
+    alloc_countdown = 0;
+    CHECK(bcache_init(size) == 0);
+    num_requests = 0;
+}
+
+// Each allocation bcache_init() makes fails in turn. Whatever was
+// allocated before it must be freed, and bcache_get() must still read
+// through to the card.
+static void test_init_failure(void) {
+    for (int n = 1; n <= 3; n++) {
+        int a = allocs, f = frees;
+        alloc_countdown = n;
+        CHECK_MSG(bcache_init(BCACHE_DEFAULT_SIZE) != 0, "allocation %d failed, init succeeded", n);
+        CHECK_MSG(allocs - a == frees - f, "allocation %d failed: %d allocated, %d freed",
+                  n, allocs - a, frees - f);
+        alloc_countdown = 0;
+
+        num_requests = 0;
+        CHECK_MSG(get_ok(77) && get_ok(77), "allocation %d failed: uncached read", n);
+        CHECK_MSG(num_requests == 2 && requests[0].count == 1 && requests[1].count == 1,
+                  "allocation %d failed: %d requests, want 2 single blocks", n, num_requests);
+    }
+
+    // Too small for a single set
+    CHECK(bcache_init(BCACHE_BLOCK_SIZE) != 0);
+}
+
+// A sequential walk misses with a window of 1, 2, 4 then 8 blocks, and
+// every block fetched ahead is then hit. The walk ends on a request
+// boundary, within the 64 blocks of the default cache.
+static void test_sequential(void) {
+    static const uint32_t want[] = { 1, 2, 4, 8, 8, 8, 8, 8 };
+    const uint32_t first = 1000, total = 47;
+    int nwant = (int)(sizeof(want) / sizeof(want[0]));
+
+    start(BCACHE_DEFAULT_SIZE);
+    for (uint32_t lba = first; lba < first + total; lba++) {
+        CHECK_MSG(get_ok(lba), "sequential: block %u", lba);
+    }
+
+    CHECK_EQ(num_requests, nwant);
+    uint32_t next = first, fetched = 0;
+    for (int i = 0; i < num_requests && i < nwant; i++) {
+        CHECK_MSG(requests[i].lba == next && requests[i].count == want[i],
+                  "sequential: request %d read %u+%u, want %u+%u", i,
+                  requests[i].lba, requests[i].count, next, want[i]);
+        next += want[i];
+        fetched += want[i];
+    }
+
+    // Misses are the requests; everything else came from read-ahead
+    uint32_t misses = (uint32_t)nwant;
+    uint32_t hits = total - misses;
+    check_stats("sequential", hits, misses, fetched - misses, hits);
+
+    // Going over the same blocks again is all hits, with no read-ahead
+    // credit the second time
+    num_requests = 0;
+    for (uint32_t lba = first; lba < first + total; lba++) {
+        CHECK_MSG(get_ok(lba), "sequential again: block %u", lba);
+    }
+    CHECK_EQ(num_requests, 0);
+    check_stats("sequential again", hits + total, misses, fetched - misses, hits);
+}
+
+// The window never exceeds the number of sets, so read-ahead cannot
+// evict the block asked for
+static void test_small_cache(void) {
+    const uint32_t sets = 2;
+    start(sets * BCACHE_WAYS * BCACHE_BLOCK_SIZE);
+    for (uint32_t lba = 0; lba < 32; lba++) {
+        CHECK_MSG(get_ok(lba), "small cache: block %u", lba);
+    }
+    uint32_t largest = 0;
+    for (int i = 0; i < num_requests; i++) {
+        if (requests[i].count > largest) {
+            largest = requests[i].count;
+        }
+    }
+    CHECK_EQ(largest, sets);
+}
+
+// Scattered blocks miss one at a time and never grow the window.
+// Touching the most recent ones again hits.
+static void test_random(void) {
+    enum { COUNT = 200, RECENT = 16 };
+    uint32_t lbas[COUNT];
+    uint32_t x = 12345;
+
+    start(BCACHE_DEFAULT_SIZE);
+    for (int i = 0; i < COUNT; i++) {
+        do {
+            x = x * 1103515245 + 12345;
+            lbas[i] = (x >> 8) % (CARD_BLOCKS - 16);
+        } while (i > 0 && (lbas[i] - lbas[i - 1] <= BCACHE_MAX_READAHEAD ||
+                           lbas[i - 1] - lbas[i] <= BCACHE_MAX_READAHEAD));
+        CHECK_MSG(get_ok(lbas[i]), "random: block %u", lbas[i]);
+    }
+    CHECK_EQ(num_requests, COUNT);
+    for (int i = 0; i < num_requests && i < COUNT; i++) {
+        CHECK_MSG(requests[i].lba == lbas[i] && requests[i].count == 1,
+                  "random: request %d read %u+%u, want %u+1", i,
+                  requests[i].lba, requests[i].count, lbas[i]);
+    }
+    check_stats("random", 0, COUNT, 0, 0);
+
+    // The last few are still cached unless a later block took their way
+    num_requests = 0;
+    int hits = 0;
+    for (int i = COUNT - RECENT; i < COUNT; i++) {
+        int before = num_requests;
+        CHECK_MSG(get_ok(lbas[i]), "random again: block %u", lbas[i]);
+        hits += num_requests == before;
+    }
+    CHECK_MSG(hits >= RECENT / 2, "random again: %d of %d recent blocks hit", hits, RECENT);
+    check_stats("random again", (uint32_t)hits, COUNT + RECENT - (uint32_t)hits, 0, 0);
+}
+
+// A jump ends the sequential run and the window starts again at 1
+static void test_window_reset(void) {
+    static const uint32_t want[] = { 1, 2, 4, 1, 2 };
+    start(BCACHE_DEFAULT_SIZE);
+    for (uint32_t lba = 500; lba < 507; lba++) {
+        CHECK(get_ok(lba));
+    }
+    CHECK(get_ok(9000));
+    CHECK(get_ok(9001));
+    CHECK_EQ(num_requests, 5);
+    for (int i = 0; i < num_requests && i < 5; i++) {
+        CHECK_MSG(requests[i].count == want[i], "window reset: request %d read %u blocks, want %u",
+                  i, requests[i].count, want[i]);
+    }
+
+    // After bcache_invalidate() the window starts over too
+    bcache_invalidate();
+    num_requests = 0;
+    CHECK(get_ok(9003));
+    CHECK(num_requests == 1 && requests[0].count == 1);
+}
+
+// Read-ahead past the last block fails and falls back to the one block
+static void test_end_of_card(void) {
+    start(BCACHE_DEFAULT_SIZE);
+    for (uint32_t lba = CARD_BLOCKS - 8; lba < CARD_BLOCKS; lba++) {
+        CHECK_MSG(get_ok(lba), "end of card: block %u", lba);
+    }
+    CHECK(bcache_get(CARD_BLOCKS) == NULL);
+}
+
+int main(void) {
+    test_init_failure();
+    test_sequential();
+    test_small_cache();
+    test_random();
+    test_window_reset();
+    test_end_of_card();
+    return test_summary("bcache");
+}
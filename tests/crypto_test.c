@@ -0,0 +1,189 @@
+// tests/crypto_test.c - src/crypto.c against published vectors
+//
+// Checks SHA-256 against the FIPS 180 examples, fed whole and split at
+// every point, and Ed25519 against RFC 8032 section 7.1. A signature
+// with a bit flipped in any byte, a changed message, another key and an
+// S of L or more must all be rejected. verify_boot_signature() runs over a
+// stand-in key list instead of src/trusted_keys.c.
+
+#include <stdio.h>
+#include <string.h>
+#include "crypto.h"
+#include "test.h"
+
+typedef struct {
+    const char* pub;
+    const char* msg;
+    const char* sig;
+} ed25519_vector_t;
+
+// RFC 8032 section 7.1, tests 1-3 (the secret keys are not needed)
+static const ed25519_vector_t vectors[] = {
+    { "d75a980182b10ab7d54bfed3c964073a0ee172f3daa62325af021a68f707511a",
+      "",
+      "e5564300c360ac729086e2cc806e828a84877f1eb8e5d974d873e065224901555"
+      "fb8821590a33bacc61e39701cf9b46bd25bf5f0595bbe24655141438e7a100b" },
+    { "3d4017c3e843895a92b70aa74d1b7ebc9c982ccf2ec4968cc0cd55f12af4660c",
+      "72",
+      "92a009a9f0d4cab8720e820b5f642540a2b27b5416503f8fb3762223ebdb69da0"
+      "85ac1e43e15996e458f3613d0f11d8c387b2eaeb4302aeeb00d291612bb0c00" },
+    { "fc51cd8e6218a1a38da47ed00230f0580816ed13ba3303ac5deb911548908025",
+      "af82",
+      "6291d657deec24024827e69c3abe01a30ce548a284743a445e3680d7db5ac3ac1"
+      "8ff9b538d16f290ae67f760984dc6594a7c15e9716ed28dc027beceea1ec40a" },
+};
+
+#define NUM_VECTORS     (sizeof(vectors) / sizeof(vectors[0]))
+
+// The group order L, little-endian as S is stored
+static const char* order_l = "edd3f55c1a631258d69cf7a2def9de1400000000000000000000000000000010";
+
+// Stand-in for src/trusted_keys.c: the keys of tests 1 and 3
+const uint8_t trusted_keys[][ED25519_KEY_SIZE] = {
+    { 0xd7, 0x5a, 0x98, 0x01, 0x82, 0xb1, 0x0a, 0xb7, 0xd5, 0x4b, 0xfe, 0xd3, 0xc9, 0x64, 0x07, 0x3a,
+      0x0e, 0xe1, 0x72, 0xf3, 0xda, 0xa6, 0x23, 0x25, 0xaf, 0x02, 0x1a, 0x68, 0xf7, 0x07, 0x51, 0x1a },
+    { 0xfc, 0x51, 0xcd, 0x8e, 0x62, 0x18, 0xa1, 0xa3, 0x8d, 0xa4, 0x7e, 0xd0, 0x02, 0x30, 0xf0, 0x58,
+      0x08, 0x16, 0xed, 0x13, 0xba, 0x33, 0x03, 0xac, 0x5d, 0xeb, 0x91, 0x15, 0x48, 0x90, 0x80, 0x25 },
+};
+const uint32_t trusted_key_count = 2;
+
+static size_t from_hex(uint8_t* out, const char* hex) {
+    size_t n = strlen(hex) / 2;
+    for (size_t i = 0; i < n; i++) {
+        unsigned int b;
+        sscanf(hex + i * 2, "%2x", &b);
+        out[i] = (uint8_t)b;
+    }
+    return n;
+}
+
+static void sha256_of(const void* data, size_t len, uint8_t digest[SHA256_DIGEST_SIZE]) {
+    sha256_ctx_t ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, len);
+    sha256_final(&ctx, digest);
+}
+
+static void check_digest(const char* name, const uint8_t* got, const char* want_hex) {
+    uint8_t want[SHA256_DIGEST_SIZE];
+    from_hex(want, want_hex);
+    CHECK_MSG(memcmp(got, want, sizeof(want)) == 0, "sha256 %s", name);
+}
+
+static void test_sha256_vectors(void) {
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    static uint8_t million[1000000];
+
+    sha256_of("", 0, digest);
+    check_digest("\"\"", digest, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    sha256_of("abc", 3, digest);
+    check_digest("\"abc\"", digest, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    sha256_of("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 56, digest);
+    check_digest("448-bit", digest, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    sha256_of("abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmno"
+              "ijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", 112, digest);
+    check_digest("896-bit", digest, "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1");
+
+    // One million 'a', in odd-sized pieces that straddle the blocks
+    sha256_ctx_t ctx;
+    memset(million, 'a', sizeof(million));
+    sha256_init(&ctx);
+    for (size_t off = 0, step = 1; off < sizeof(million); off += step, step = step * 3 % 997 + 1) {
+        size_t n = sizeof(million) - off < step ? sizeof(million) - off : step;
+        sha256_update(&ctx, million + off, n);
+    }
+    sha256_final(&ctx, digest);
+    check_digest("1M 'a'", digest, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+// Two updates give the same digest as one, wherever the split falls
+static void test_sha256_splits(void) {
+    uint8_t data[200], whole[SHA256_DIGEST_SIZE], split[SHA256_DIGEST_SIZE];
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 37 + 11);
+    }
+    for (size_t len = 0; len <= sizeof(data); len++) {
+        sha256_of(data, len, whole);
+        for (size_t cut = 0; cut <= len; cut++) {
+            sha256_ctx_t ctx;
+            sha256_init(&ctx);
+            sha256_update(&ctx, data, cut);
+            sha256_update(&ctx, data + cut, len - cut);
+            sha256_final(&ctx, split);
+            CHECK_MSG(memcmp(whole, split, sizeof(whole)) == 0, "sha256 of %zu bytes split at %zu",
+                      len, cut);
+        }
+    }
+}
+
+static void test_ed25519(void) {
+    for (size_t i = 0; i < NUM_VECTORS; i++) {
+        uint8_t pub[ED25519_KEY_SIZE], other[ED25519_KEY_SIZE], sig[ED25519_SIG_SIZE];
+        uint8_t msg[8] = { 0 };
+
+        from_hex(pub, vectors[i].pub);
+        from_hex(other, vectors[(i + 1) % NUM_VECTORS].pub);
+        from_hex(sig, vectors[i].sig);
+        size_t len = from_hex(msg, vectors[i].msg);
+
+        CHECK_MSG(ed25519_verify(sig, msg, len, pub) == 0, "rfc8032 test %zu", i + 1);
+        CHECK_MSG(ed25519_verify(sig, msg, len, other) == -1, "test %zu with another key", i + 1);
+
+        // A flipped bit in any byte of R or S is rejected
+        for (int byte = 0; byte < ED25519_SIG_SIZE; byte++) {
+            uint8_t bit = (uint8_t)(1 << ((byte + i) % 8));
+            sig[byte] ^= bit;
+            CHECK_MSG(ed25519_verify(sig, msg, len, pub) == -1, "test %zu, signature byte %d changed",
+                      i + 1, byte);
+            sig[byte] ^= bit;
+        }
+
+        msg[0] ^= 0x01;
+        CHECK_MSG(ed25519_verify(sig, msg, len ? len : 1, pub) == -1, "test %zu, message changed",
+                  i + 1);
+        msg[0] ^= 0x01;
+        if (len) {
+            CHECK_MSG(ed25519_verify(sig, msg, len - 1, pub) == -1, "test %zu, message cut", i + 1);
+        }
+
+        // S + L verifies mathematically but is malleable; S >= L is refused
+        uint8_t big[ED25519_SIG_SIZE];
+        uint8_t l[32];
+        from_hex(l, order_l);
+        memcpy(big, sig, 32);
+        for (int j = 0, carry = 0; j < 32; j++) {
+            int sum = sig[32 + j] + l[j] + carry;
+            big[32 + j] = (uint8_t)sum;
+            carry = sum >> 8;
+        }
+        CHECK_MSG(ed25519_verify(big, msg, len, pub) == -1, "test %zu with S + L", i + 1);
+        memcpy(big + 32, l, 32);
+        CHECK_MSG(ed25519_verify(big, msg, len, pub) == -1, "test %zu with S = L", i + 1);
+    }
+}
+
+// Accepted under any trusted key, refused under none
+static void test_boot_signature(void) {
+    uint8_t sig[ED25519_SIG_SIZE], msg[8];
+
+    CHECK_EQ(load_public_keys(), 2);
+
+    for (size_t i = 0; i < NUM_VECTORS; i++) {
+        from_hex(sig, vectors[i].sig);
+        size_t len = from_hex(msg, vectors[i].msg);
+        int want = i == 1 ? -1 : 0;
+        CHECK_MSG(verify_boot_signature(msg, len, sig) == want, "boot signature, test %zu", i + 1);
+        sig[0] ^= 0x40;
+        CHECK_MSG(verify_boot_signature(msg, len, sig) == -1, "tampered boot signature, test %zu",
+                  i + 1);
+    }
+}
+
+int main(void) {
+    test_sha256_vectors();
+    test_sha256_splits();
+    test_ed25519();
+    test_boot_signature();
+    return test_summary("crypto");
+}
@@ -0,0 +1,111 @@
+#!/bin/bash
+# tests/elf_test.sh - ELF kernels through the host bootloader
+#
+# Boots build/host/mfboot-host from volumes holding one ELF image each,
+# built by tests/mkelf.py. A valid multi-segment image must load every
+# segment at its physical address and jump to the translated entry
+# point. Images with overlapping segments, misaligned offsets or
+# addresses, more file than memory bytes, or segments outside RAM must
+# be refused with the loader's message and never reach the jump.
+#
+#   tests/elf_test.sh build/host/mfboot-host
+
+HOST_BIN=${1:?usage: $0 mfboot-host}
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+failed=0
+
+head -c 5000 /dev/urandom > "$tmp/text"
+head -c 3000 /dev/urandom > "$tmp/data"
+head -c 700 /dev/urandom > "$tmp/rodata"
+# .data followed by its zeroed .bss
+{ cat "$tmp/data"; head -c 5192 /dev/zero; } > "$tmp/data+bss"
+
+# build MKELF_ARGS...: volume $tmp/$name.img holding the image as uos.img
+build() {
+    python3 tests/mkelf.py "$tmp/kernel.elf" "$@" >/dev/null || exit 1
+    python3 tools/mkdiskimg.py "$tmp/$name.img" "boot/uos.img=$tmp/kernel.elf" >/dev/null || exit 1
+}
+
+# run HOST_ARGS...: boot $tmp/$name.img, console in $tmp/$name.log
+run() {
+    "$HOST_BIN" "$@" "$tmp/$name.img" </dev/null > "$tmp/$name.log" 2>&1
+}
+
+# accept NAME EXPECTS -- MKELF_ARGS...
+accept() {
+    name=$1
+    local expects=()
+    shift
+    while [ "$1" != -- ]; do
+        expects+=(-e "$1")
+        shift
+    done
+    shift
+    build "$@"
+    echo "  $name"
+    if ! run "${expects[@]}"; then
+        echo "    FAIL: not loaded as expected"
+        sed 's/^/    | /' "$tmp/$name.log"
+        failed=1
+    fi
+}
+
+# reject NAME MESSAGE MKELF_ARGS...
+reject() {
+    name=$1
+    local message=$2
+    shift 2
+    build "$@"
+    echo "  $name"
+    run
+    if grep -q '\[host\] Jump' "$tmp/$name.log" || ! grep -q "ERROR: $message" "$tmp/$name.log"; then
+        echo "    FAIL: want \"ERROR: $message\" and no jump"
+        sed 's/^/    | /' "$tmp/$name.log"
+        failed=1
+    fi
+}
+
+# Linked at 0xC0008000 like a kernel, loaded at its physical address.
+# The entry point is a virtual address inside the first segment.
+accept "valid, three segments" \
+    "0x8000=$tmp/text" "0x20000=$tmp/data+bss" "0x30000=$tmp/rodata" -- \
+    -e 0xC0008040 \
+    "0x8000:$tmp/text,vaddr=0xC0008000" \
+    "0x20000:$tmp/data,vaddr=0xC0020000,memsz=8192" \
+    "0x30000:$tmp/rodata,vaddr=0xC0030000,align=4"
+grep -q "Jump to 0x00008040" "$tmp/$name.log" || {
+    echo "    FAIL: entry point not translated to 0x00008040"
+    failed=1
+}
+
+reject "overlapping file data" "Segments 0 and 1 overlap" \
+    "0x8000:$tmp/text" "0x9000:$tmp/data"
+reject "second segment in the first's .bss" "Segments 0 and 1 overlap" \
+    "0x8000:$tmp/text,memsz=0x10000" "0x10000:$tmp/data"
+reject "overlap with a later segment" "Segments 0 and 2 overlap" \
+    "0x20000:$tmp/text" "0x8000:$tmp/data" "0x21000:$tmp/rodata"
+reject "p_offset not congruent to p_vaddr" "Segment 0 misaligned" \
+    "0x8000:$tmp/text,offset=0x1004" "0x20000:$tmp/data"
+reject "p_vaddr not congruent to p_offset" "Segment 0 misaligned" \
+    "0x8000:$tmp/text,vaddr=0x8010,offset=0x1000"
+reject "p_paddr not word aligned" "Segment 1 misaligned" \
+    "0x8000:$tmp/text" "0x20002:$tmp/data,vaddr=0x20000"
+reject "p_align not a power of two" "Segment 0 misaligned" \
+    "0x8000:$tmp/text,align=0x1800"
+reject "p_filesz > p_memsz" "Segment 1 out of bounds" \
+    "0x8000:$tmp/text" "0x20000:$tmp/data,memsz=2999"
+reject "file data past the end of the file" "Segment 0 out of bounds" \
+    "0x8000:$tmp/text,filesz=0x100000"
+reject "segment wrapping the address space" "Segment 0 out of bounds" \
+    -e 0xFFFFF000 "0xFFFFF000:$tmp/text,memsz=0x2000"
+reject "segment in the peripherals" "0x20200000-.* is not free RAM" \
+    -e 0x20200000 "0x20200000:$tmp/text"
+reject "segment past the end of RAM" "0x3F000000-.* is not free RAM" \
+    -e 0x3F000000 "0x3F000000:$tmp/text"
+reject "segment over the firmware area" "0x00000000-.* overlaps firmware" \
+    -e 0x8000 "0x8000:$tmp/text" "0x0:$tmp/data"
+reject "entry point outside the segments" "Entry point outside loaded segments" \
+    -e 0x100000 "0x8000:$tmp/text"
+
+exit $failed
@@ -0,0 +1,588 @@
+// tests/emmc_model.c - Software model of the EMMC controller and an SD card
+//
+// Enough of the Arasan SDHCI controller, an SD card and DMA channel 4
+// for src/drivers/mmc.c: command completion and responses, the card
+// identification sequence, CMD6 status blocks, PIO reads with one
+// READ_RDY per block, DREQ-paced DMA reads, auto-CMD12 after a
+// multi-block read, single block writes, and line resets. Card blocks
+// hold a fixed pattern (emmc_model_byte()), overlaid by any blocks the
+// driver writes.
+//
+// A DMA transfer only runs when the driver first polls DMA_CS after
+// issuing the command, so until then the data phase stays in flight
+// exactly as a slow card would leave it.
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "hardware.h"
+#include "emmc_model.h"
+
+// Register offsets from EMMC_BASE
+#define REG_BLKSIZECNT      0x04
+#define REG_ARG1            0x08
+#define REG_CMDTM           0x0C
+#define REG_RESP0           0x10
+#define REG_RESP3           0x1C
+#define REG_DATA            0x20
+#define REG_STATUS          0x24
+#define REG_CONTROL0        0x28
+#define REG_CONTROL1        0x2C
+#define REG_INTERRUPT       0x30
+#define REG_IRPT_MASK       0x34
+#define REG_IRPT_EN         0x38
+#define REG_CONTROL2        0x3C
+
+// CMDTM, STATUS, CONTROL1 and INTERRUPT bits
+#define CMD_ISDATA          (1 << 21)
+#define CMD_RSPNS_48B       (3 << 16)
+#define CMD_RSPNS_MASK      (3 << 16)
+#define TM_MULTI_BLOCK      (1 << 5)
+#define TM_DAT_DIR_READ     (1 << 4)
+#define TM_AUTO_CMD12       (1 << 2)
+#define SR_DAT_INHIBIT      (1 << 1)
+#define C1_CLK_INTLEN       (1 << 0)
+#define C1_CLK_STABLE       (1 << 1)
+#define C1_CLK_EN           (1 << 2)
+#define C1_SRST_HC          (1 << 24)
+#define C1_SRST_CMD         (1 << 25)
+#define C1_SRST_DATA        (1 << 26)
+#define INT_CMD_DONE        (1 << 0)
+#define INT_DATA_DONE       (1 << 1)
+#define INT_WRITE_RDY       (1 << 4)
+#define INT_READ_RDY        (1 << 5)
+#define INT_CTO_ERR         (1 << 16)
+#define INT_DCRC_ERR        (1 << 21)
+
+// DMA channel 4
+#define DMA_CHANNEL         4
+#define DMA_CS_ADDR         ((uint32_t)DMA_BASE + DMA_CHANNEL * 0x100)
+#define DMA_CONBLK_ADDR     (DMA_CS_ADDR + 0x04)
+#define DMA_ENABLE_ADDR     ((uint32_t)DMA_BASE + 0xFF0)
+#define DMA_CS_ACTIVE       (1 << 0)
+#define DMA_CS_END          (1 << 1)
+#define DMA_CS_ERROR        (1 << 8)
+#define DMA_CS_RESET        (1u << 31)
+#define DMA_TI_DEST_INC     (1 << 4)
+#define DMA_TI_SRC_DREQ     (1 << 10)
+#define DMA_TI_PERMAP(ti)   (((ti) >> 16) & 0x1F)
+#define DMA_DREQ_EMMC       11
+#define EMMC_DATA_BUS       (BUS_PERIPHERAL_BASE + 0x300020)
+
+#define EMMC_BASE_CLOCK     250000000
+#define OCR_BUSY            (1u << 31)
+#define OCR_CCS             (1u << 30)
+#define CARD_RCA            0xB368
+#define R1_READY            0x00000900  // Transfer state, ready for data
+#define MAX_WRITTEN         16
+
+static emmc_model_config_t cfg;
+static int fail_cmd = -1;
+static int fail_data;
+
+static struct {
+    uint32_t blksizecnt;
+    uint32_t arg1;
+    uint32_t control0;
+    uint32_t control1;
+    uint32_t interrupt;
+    uint32_t resp[4];
+    uint32_t clock_hz;
+
+    // Card
+    int app;                    // Last command was CMD55
+    int polls;                  // ACMD41 answers so far
+    uint32_t rca;
+    int selected;
+
+    // Data phase
+    int active;
+    int dma;                    // Served by the DMA channel
+    int write;
+    int multi;                  // Ends with auto-CMD12
+    int fail;                   // Ends in a CRC error
+    const uint8_t* status;      // CMD6 status block instead of card blocks
+    uint32_t lba;
+    uint32_t blocks;            // Blocks left
+    uint32_t block_size;
+    uint32_t offset;            // Bytes of the current block transferred
+    uint8_t block[512];
+
+    // DMA channel
+    uint32_t dma_cs;
+    uint32_t dma_conblk;
+    uint32_t dma_enable;
+    uint32_t dma_reads;
+} m;
+
+static uint8_t switch_status[64];
+
+static struct {
+    uint32_t lba;
+    uint8_t data[512];
+} written[MAX_WRITTEN];
+static int num_written;
+
+static emmc_event_t events[EMMC_MODEL_MAX_EVENTS];
+static int num_events;
+static int violations;
+static char last_violation[160];
+
+static void violation(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(last_violation, sizeof(last_violation), fmt, args);
+    va_end(args);
+    violations++;
+}
+
+static emmc_event_t* log_event(uint8_t type, uint8_t index, uint32_t arg) {
+    static emmc_event_t overflow;
+    if (num_events == EMMC_MODEL_MAX_EVENTS) {
+        violation("event log full");
+        return &overflow;
+    }
+    emmc_event_t* e = &events[num_events++];
+    memset(e, 0, sizeof(*e));
+    e->type = type;
+    e->index = index;
+    e->arg = arg;
+    return e;
+}
+
+void emmc_model_reset(const emmc_model_config_t* config) {
+    memset(&m, 0, sizeof(m));
+    cfg = *config;
+    fail_cmd = -1;
+    fail_data = 0;
+    num_written = 0;
+    num_events = 0;
+    violations = 0;
+    last_violation[0] = '\0';
+}
+
+void emmc_model_fail_command(int index) {
+    fail_cmd = index;
+}
+
+void emmc_model_fail_data(void) {
+    fail_data = 1;
+}
+
+void emmc_model_clear_log(void) {
+    num_events = 0;
+}
+
+int emmc_model_events(const emmc_event_t** out) {
+    *out = events;
+    return num_events;
+}
+
+uint8_t emmc_model_byte(uint32_t lba, uint32_t offset) {
+    for (int i = 0; i < num_written; i++) {
+        if (written[i].lba == lba) {
+            return written[i].data[offset];
+        }
+    }
+    uint32_t x = (lba * 0x9E3779B1u) ^ (offset * 0x85EBCA6Bu);
+    x ^= x >> 15;
+    return (uint8_t)(x * 0x2C1B3C6Du >> 24);
+}
+
+int emmc_model_transfer_pending(void) {
+    return m.active;
+}
+
+uint32_t emmc_model_clock_hz(void) {
+    return m.clock_hz;
+}
+
+uint32_t emmc_model_control0(void) {
+    return m.control0;
+}
+
+uint32_t emmc_model_dma_reads(void) {
+    return m.dma_reads;
+}
+
+int emmc_model_violations(const char** last) {
+    *last = last_violation;
+    return violations;
+}
+
+static void load_block(void) {
+    for (uint32_t i = 0; i < m.block_size; i++) {
+        m.block[i] = m.status ? m.status[i] : emmc_model_byte(m.lba, i);
+    }
+    m.offset = 0;
+}
+
+static void data_done(void) {
+    if (m.multi) {
+        log_event(EMMC_EV_AUTO_CMD12, 12, 0);
+    }
+    m.active = 0;
+    m.interrupt |= INT_DATA_DONE;
+}
+
+// Next block of a PIO read is in the FIFO
+static void next_block(void) {
+    if (m.fail) {
+        m.interrupt |= INT_DCRC_ERR;
+        return;
+    }
+    load_block();
+    m.interrupt |= INT_READ_RDY;
+}
+
+static uint32_t card_lba(uint32_t arg) {
+    if (!cfg.sdsc) {
+        return arg;
+    }
+    if (arg % 512) {
+        violation("byte address 0x%X on a standard capacity card is not block aligned", arg);
+    }
+    return arg / 512;
+}
+
+static void start_data(uint32_t cmdtm, int index, uint32_t lba, emmc_event_t* ev) {
+    m.block_size = m.blksizecnt & 0x3FF;
+    m.blocks = (cmdtm & TM_MULTI_BLOCK) ? m.blksizecnt >> 16 : 1;
+    m.multi = (cmdtm & TM_MULTI_BLOCK) != 0;
+    m.write = !(cmdtm & TM_DAT_DIR_READ);
+    m.lba = lba;
+    m.status = index == 6 ? switch_status : NULL;
+    m.active = 1;
+    m.fail = fail_data && !m.write;
+    fail_data = fail_data && m.write;
+    ev->blocks = m.blocks;
+
+    if (!(cmdtm & CMD_ISDATA) || m.write != (index == 24)) {
+        violation("CMD%d: wrong data direction flags 0x%08X", index, cmdtm);
+    }
+    if (m.multi && (m.blocks == 0 || !(cmdtm & TM_AUTO_CMD12))) {
+        violation("CMD%d: %u blocks, auto-CMD12 %s", index, m.blocks,
+                  cmdtm & TM_AUTO_CMD12 ? "on" : "off");
+    }
+    if (m.block_size != (m.status ? 64u : 512u)) {
+        violation("CMD%d: block size %u", index, m.block_size);
+    }
+
+    if (m.write) {
+        m.offset = 0;
+        m.interrupt |= INT_WRITE_RDY;
+        return;
+    }
+    // The DMA channel must be waiting on the EMMC DREQ before the card
+    // starts sending
+    m.dma = (m.dma_cs & DMA_CS_ACTIVE) != 0;
+    ev->dma = (uint8_t)m.dma;
+    if (!m.dma) {
+        next_block();
+    }
+}
+
+static void command(uint32_t cmdtm) {
+    int index = (int)((cmdtm >> 24) & 0x3F);
+    int app = m.app;
+    uint32_t arg = m.arg1;
+
+    emmc_event_t* ev = log_event(EMMC_EV_CMD, (uint8_t)index, arg);
+    ev->app = (uint8_t)app;
+    m.app = 0;
+    m.dma_reads = 0;
+
+    if (m.active) {
+        violation("CMD%d issued during a data phase", index);
+    }
+    if (index == fail_cmd) {
+        m.interrupt |= INT_CTO_ERR;
+        return;
+    }
+    m.interrupt |= INT_CMD_DONE;
+    memset(m.resp, 0, sizeof(m.resp));
+    m.resp[0] = R1_READY;
+
+    if (app) {
+        switch (index) {
+        case 41:
+            if (!(arg & OCR_CCS)) {
+                violation("ACMD41 without HCS after a CMD8 answer");
+            }
+            m.resp[0] = 0x00FF8000;
+            if (m.polls++ >= cfg.busy_polls) {
+                m.resp[0] |= OCR_BUSY | (cfg.sdsc ? 0 : OCR_CCS);
+            }
+            return;
+        case 6:
+            if (arg != 2) {
+                violation("ACMD6 bus width argument %u", arg);
+            }
+            return;
+        default:
+            violation("unexpected ACMD%d", index);
+            return;
+        }
+    }
+
+    if (index != 0 && index != 8 && index != 55 && index != 2 && index != 3 &&
+        !m.selected && index != 7) {
+        violation("CMD%d before the card was selected", index);
+    }
+
+    switch (index) {
+    case 0:
+        m.rca = 0;
+        m.selected = 0;
+        m.polls = 0;
+        break;
+    case 8:
+        m.resp[0] = arg & 0xFFF;
+        break;
+    case 55:
+        if ((arg >> 16) != m.rca) {
+            violation("CMD55 for RCA 0x%X, card has 0x%X", arg >> 16, m.rca);
+        }
+        m.app = 1;
+        m.resp[0] = R1_READY | (1 << 5);
+        break;
+    case 2:
+        m.resp[0] = 0x52424F43;
+        m.resp[1] = 0x4D464254;
+        m.resp[2] = 0x32323031;
+        m.resp[3] = 0x00524F42;
+        break;
+    case 3:
+        m.rca = CARD_RCA;
+        m.resp[0] = (CARD_RCA << 16) | 0x0500;
+        break;
+    case 7:
+        if ((arg >> 16) != m.rca || m.rca == 0) {
+            violation("CMD7 selects RCA 0x%X, card has 0x%X", arg >> 16, m.rca);
+        }
+        m.selected = 1;
+        // R1b: busy ends at once
+        if ((cmdtm & CMD_RSPNS_MASK) == CMD_RSPNS_48B) {
+            m.interrupt |= INT_DATA_DONE;
+        }
+        break;
+    case 16:
+        if (!cfg.sdsc || arg != 512) {
+            violation("CMD16 block length %u on a %s card", arg, cfg.sdsc ? "SDSC" : "SDHC");
+        }
+        break;
+    case 6:
+        // Group 1 function 1 (high speed) support and selection
+        memset(switch_status, 0, sizeof(switch_status));
+        switch_status[13] = cfg.no_high_speed ? 0x01 : 0x03;
+        switch_status[16] = cfg.no_high_speed ? 0x0F : 0x01;
+        start_data(cmdtm, index, 0, ev);
+        break;
+    case 17:
+    case 18:
+    case 24:
+        start_data(cmdtm, index, card_lba(arg), ev);
+        break;
+    default:
+        violation("unexpected CMD%d", index);
+        break;
+    }
+}
+
+static uint32_t read_fifo(void) {
+    if (!m.active || m.dma || m.write || !m.blocks || m.fail) {
+        violation("DATA read with no block in the FIFO");
+        return 0;
+    }
+    uint32_t word = (uint32_t)m.block[m.offset] | ((uint32_t)m.block[m.offset + 1] << 8) |
+                    ((uint32_t)m.block[m.offset + 2] << 16) | ((uint32_t)m.block[m.offset + 3] << 24);
+    m.offset += 4;
+    if (m.offset == m.block_size) {
+        m.lba++;
+        if (--m.blocks) {
+            next_block();
+        } else {
+            data_done();
+        }
+    }
+    return word;
+}
+
+static void write_fifo(uint32_t value) {
+    if (!m.active || !m.write) {
+        violation("DATA write outside a write data phase");
+        return;
+    }
+    memcpy(&m.block[m.offset], &value, 4);
+    m.offset += 4;
+    if (m.offset < m.block_size) {
+        return;
+    }
+    int slot = 0;
+    while (slot < num_written && written[slot].lba != m.lba) {
+        slot++;
+    }
+    if (slot == MAX_WRITTEN) {
+        violation("more than %d blocks written", MAX_WRITTEN);
+        slot = MAX_WRITTEN - 1;
+    } else if (slot == num_written) {
+        num_written++;
+    }
+    written[slot].lba = m.lba;
+    memcpy(written[slot].data, m.block, sizeof(m.block));
+    m.active = 0;
+    m.interrupt |= INT_DATA_DONE;
+}
+
+// The channel's first status poll after the command runs the transfer
+static uint32_t read_dma_cs(void) {
+    m.dma_reads++;
+    if (!(m.dma_cs & DMA_CS_ACTIVE) || !m.active || !m.dma) {
+        return m.dma_cs;
+    }
+
+    const uint32_t* cb = PHYS_PTR(m.dma_conblk & ~0xC0000000u);
+    uint32_t ti = cb[0], src = cb[1], dest = cb[2], len = cb[3];
+    if (!(m.dma_enable & (1 << DMA_CHANNEL))) {
+        violation("DMA channel %d not enabled", DMA_CHANNEL);
+    }
+    if ((m.dma_conblk & 31) || !(ti & DMA_TI_SRC_DREQ) || DMA_TI_PERMAP(ti) != DMA_DREQ_EMMC ||
+        !(ti & DMA_TI_DEST_INC) || src != EMMC_DATA_BUS) {
+        violation("DMA control block: ti 0x%08X source 0x%08X", ti, src);
+    }
+    if (len != m.blocks * m.block_size || (dest & 63)) {
+        violation("DMA of %u bytes to 0x%08X for %u blocks", len, dest, m.blocks);
+    }
+
+    if (m.fail) {
+        m.dma_cs = (m.dma_cs & ~DMA_CS_ACTIVE) | DMA_CS_ERROR;
+        m.interrupt |= INT_DCRC_ERR;
+        return m.dma_cs;
+    }
+
+    uint8_t* dst = PHYS_PTR(dest & ~0xC0000000u);
+    while (m.blocks) {
+        load_block();
+        memcpy(dst, m.block, m.block_size);
+        dst += m.block_size;
+        m.lba++;
+        m.blocks--;
+    }
+    data_done();
+    m.dma_cs = (m.dma_cs & ~DMA_CS_ACTIVE) | DMA_CS_END;
+    return m.dma_cs;
+}
+
+static void write_control1(uint32_t value) {
+    if (value & C1_SRST_HC) {
+        uint32_t clock = m.clock_hz;
+        memset(m.resp, 0, sizeof(m.resp));
+        m.control0 = m.control1 = m.interrupt = m.blksizecnt = 0;
+        m.active = 0;
+        m.clock_hz = clock;
+        return;
+    }
+    if (value & (C1_SRST_CMD | C1_SRST_DATA)) {
+        log_event(EMMC_EV_RESET, 0, value & (C1_SRST_CMD | C1_SRST_DATA));
+        m.active = 0;
+        m.fail = 0;
+        value &= ~(C1_SRST_CMD | C1_SRST_DATA);
+    }
+    m.control1 = value;
+    if (value & C1_CLK_EN) {
+        uint32_t div = ((value >> 8) & 0xFF) | (((value >> 6) & 0x3) << 8);
+        m.clock_hz = div ? EMMC_BASE_CLOCK / (2 * div) : EMMC_BASE_CLOCK;
+    }
+}
+
+uint32_t mmc_model_read(uint32_t addr) {
+    if (addr == DMA_CS_ADDR) {
+        return read_dma_cs();
+    }
+    if (addr == DMA_CONBLK_ADDR) {
+        return m.dma_conblk;
+    }
+    if (addr == DMA_ENABLE_ADDR) {
+        return m.dma_enable;
+    }
+
+    switch (addr - (uint32_t)EMMC_BASE) {
+    case REG_BLKSIZECNT:
+        return m.blksizecnt;
+    case REG_ARG1:
+        return m.arg1;
+    case REG_RESP0:
+    case REG_RESP0 + 4:
+    case REG_RESP0 + 8:
+    case REG_RESP3:
+        return m.resp[(addr - (uint32_t)EMMC_BASE - REG_RESP0) / 4];
+    case REG_DATA:
+        return read_fifo();
+    case REG_STATUS:
+        return m.active ? SR_DAT_INHIBIT : 0;
+    case REG_CONTROL0:
+        return m.control0;
+    case REG_CONTROL1:
+        return m.control1 | (m.control1 & C1_CLK_INTLEN ? C1_CLK_STABLE : 0);
+    case REG_INTERRUPT:
+        return m.interrupt;
+    }
+    violation("read of unmodelled register 0x%08X", addr);
+    return 0;
+}
+
+void mmc_model_write(uint32_t addr, uint32_t value) {
+    if (addr == DMA_CS_ADDR) {
+        if (value & DMA_CS_RESET) {
+            m.dma_cs = 0;
+            if (m.active && m.dma) {
+                m.dma = 0;      // Data left in the FIFO until the line reset
+            }
+        }
+        if (value & DMA_CS_END) {
+            m.dma_cs &= ~DMA_CS_END;
+        }
+        if (value & DMA_CS_ACTIVE) {
+            m.dma_cs |= DMA_CS_ACTIVE;
+            m.dma_cs &= ~DMA_CS_ERROR;
+        }
+        return;
+    }
+    if (addr == DMA_CONBLK_ADDR) {
+        m.dma_conblk = value;
+        return;
+    }
+    if (addr == DMA_ENABLE_ADDR) {
+        m.dma_enable = value;
+        return;
+    }
+
+    switch (addr - (uint32_t)EMMC_BASE) {
+    case REG_BLKSIZECNT:
+        m.blksizecnt = value;
+        return;
+    case REG_ARG1:
+        m.arg1 = value;
+        return;
+    case REG_CMDTM:
+        command(value);
+        return;
+    case REG_DATA:
+        write_fifo(value);
+        return;
+    case REG_CONTROL0:
+        m.control0 = value;
+        return;
+    case REG_CONTROL1:
+        write_control1(value);
+        return;
+    case REG_INTERRUPT:
+        m.interrupt &= ~value;
+        return;
+    case REG_IRPT_MASK:
+    case REG_IRPT_EN:
+    case REG_CONTROL2:
+        return;
+    }
+    violation("write of unmodelled register 0x%08X", addr);
+}
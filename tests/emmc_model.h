@@ -0,0 +1,58 @@
+// tests/emmc_model.h - Software model of the EMMC controller and an SD card
+//
+// src/drivers/mmc.c built with MMC_MODEL sends every register access to
+// mmc_model_read()/mmc_model_write(). The model answers like the
+// Arasan controller with one SD card behind it and the DMA channel mmc.c
+// uses, and logs each command the card sees, so a test can assert on
+// the command sequence rather than only on the data.
+
+#ifndef EMMC_MODEL_H
+#define EMMC_MODEL_H
+
+#include <stdint.h>
+
+#define EMMC_MODEL_MAX_EVENTS   256
+
+// Logged events
+#define EMMC_EV_CMD             0   // Command from CMDTM
+#define EMMC_EV_AUTO_CMD12      1   // STOP_TRANSMISSION sent by the controller
+#define EMMC_EV_RESET           2   // SRST_CMD | SRST_DATA line reset
+
+typedef struct {
+    uint8_t type;
+    uint8_t index;              // Command index
+    uint8_t app;                // ACMD (after CMD55)
+    uint8_t dma;                // Data phase served by the DMA channel
+    uint32_t arg;
+    uint32_t blocks;            // Blocks in the data phase
+} emmc_event_t;
+
+// Card settings for emmc_model_reset()
+typedef struct {
+    int sdsc;                   // Standard capacity: byte addresses, CMD16
+    int no_high_speed;          // CMD6 reports no high-speed function
+    int busy_polls;             // ACMD41 answers before power-up completes
+} emmc_model_config_t;
+
+void emmc_model_reset(const emmc_model_config_t* config);
+
+// Faults: command 'index' times out until cleared with -1; the next
+// read data phase ends in a CRC error
+void emmc_model_fail_command(int index);
+void emmc_model_fail_data(void);
+void emmc_model_clear_log(void);
+int emmc_model_events(const emmc_event_t** events);
+
+// Byte 'offset' of card block 'lba', as the model serves it
+uint8_t emmc_model_byte(uint32_t lba, uint32_t offset);
+
+int emmc_model_transfer_pending(void);     // Data phase still running
+uint32_t emmc_model_clock_hz(void);         // Card clock last enabled
+uint32_t emmc_model_control0(void);
+uint32_t emmc_model_dma_reads(void);        // DMA_CS reads since the last command
+
+// Protocol violations seen (command during a data phase, FIFO read with
+// no block ready, bad DMA control block, ...), with the last message
+int emmc_model_violations(const char** last);
+
+#endif // EMMC_MODEL_H
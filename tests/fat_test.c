@@ -0,0 +1,322 @@
+// tests/fat_test.c - src/filesystem.c against the files a FAT image holds
+//
+// Mounts a disk image through the file-backed SD card of host/hal.c and
+// reads every file a manifest lists in each way the bootloader does:
+// whole, in odd-sized chunks, from offsets either side of every sector
+// and cluster boundary (backwards too, so the extent window is remapped
+// from the start), streamed through fs_read_start(), and reopened from
+// fs_locate(). Each read is compared with the host copy of the file.
+// The whole pass runs once uncached and once through the block cache.
+// tests/fat_test.sh builds the images and the manifests.
+//
+//   fat_test disk.img manifest
+//
+// Manifest lines are tab-separated:
+//   PATH <tab> HOST_FILE [<tab> EXTENTS]   file, fragmented into at least
+//                                          EXTENTS runs if given
+//   !PATH                                  must not be found
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "filesystem.h"
+#include "bcache.h"
+#include "memory_mgr.h"
+#include "host.h"
+#include "test.h"
+
+#define MAX_ENTRIES     256
+#define STREAM_CHUNK    0x10000         // As the loader streams
+#define SPAN_MAX        1100            // Bytes read at each boundary
+
+typedef struct {
+    char path[512];
+    char host_file[512];
+    uint32_t extents;
+    int missing;
+    uint8_t* data;
+    size_t size;
+} entry_t;
+
+static entry_t entries[MAX_ENTRIES];
+static int num_entries;
+
+// The cache comes from the heap; the test heap is malloc
+void* memory_alloc(size_t size) {
+    return malloc(size);
+}
+
+void memory_free(void* ptr) {
+    free(ptr);
+}
+
+void host_exit(int code) {
+    exit(code);
+}
+
+static uint8_t* load_file(const char* path, size_t* size) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t* data = malloc(len > 0 ? (size_t)len : 1);
+    if (!data || fread(data, 1, (size_t)len, f) != (size_t)len) {
+        fclose(f);
+        free(data);
+        return NULL;
+    }
+    fclose(f);
+    *size = (size_t)len;
+    return data;
+}
+
+static int load_manifest(const char* path) {
+    char line[1200];
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') {
+            continue;
+        }
+        if (num_entries == MAX_ENTRIES) {
+            fclose(f);
+            return -1;
+        }
+        entry_t* e = &entries[num_entries++];
+        memset(e, 0, sizeof(*e));
+        if (line[0] == '!') {
+            e->missing = 1;
+            snprintf(e->path, sizeof(e->path), "%s", line + 1);
+            continue;
+        }
+        char* host_file = strchr(line, '\t');
+        if (!host_file) {
+            fclose(f);
+            return -1;
+        }
+        *host_file++ = '\0';
+        char* extents = strchr(host_file, '\t');
+        if (extents) {
+            *extents++ = '\0';
+            e->extents = (uint32_t)strtoul(extents, NULL, 0);
+        }
+        snprintf(e->path, sizeof(e->path), "%s", line);
+        snprintf(e->host_file, sizeof(e->host_file), "%s", host_file);
+        e->data = load_file(e->host_file, &e->size);
+        if (!e->data) {
+            printf("cannot read %s\n", e->host_file);
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+static int same(const entry_t* e, size_t offset, const uint8_t* got, size_t len) {
+    return offset + len <= e->size && memcmp(e->data + offset, got, len) == 0;
+}
+
+static void check_whole(const entry_t* e, uint8_t* buf) {
+    file_handle_t* fh = fs_open(e->path);
+    CHECK_MSG(fh != NULL, "%s: fs_open failed", e->path);
+    if (!fh) {
+        return;
+    }
+    CHECK_MSG(fh->size == e->size, "%s: size %u, want %zu", e->path, fh->size, e->size);
+
+    if (e->extents > FS_MAX_EXTENTS) {
+        CHECK_MSG(fh->num_extents == FS_MAX_EXTENTS && fh->map_next != 0,
+                  "%s: %u extents mapped, want a full window of %d with more to follow",
+                  e->path, fh->num_extents, FS_MAX_EXTENTS);
+    } else if (e->extents) {
+        CHECK_MSG(fh->num_extents >= e->extents, "%s: %u extents, want at least %u",
+                  e->path, fh->num_extents, e->extents);
+    }
+
+    int n = fs_read(fh, buf, e->size + 1);
+    CHECK_MSG(n == (int)e->size && same(e, 0, buf, e->size), "%s: whole read returned %d", e->path, n);
+    CHECK_MSG(fs_read(fh, buf, 1) == 0, "%s: read at end of file", e->path);
+    fs_close(fh);
+}
+
+// Sequential reads of awkward sizes, so chunks start and end at every
+// alignment relative to sectors and clusters
+static void check_chunks(const entry_t* e, uint8_t* buf) {
+    static const size_t sizes[] = { 1, 3, 511, 512, 513, 1024, 1537, 4095, 4096, 4097, 32769 };
+    file_handle_t* fh = fs_open(e->path);
+    if (!fh) {
+        return;
+    }
+    size_t pos = 0;
+    for (int i = 0; pos < e->size; i++) {
+        size_t len = sizes[i % (sizeof(sizes) / sizeof(sizes[0]))];
+        int n = fs_read(fh, buf, len);
+        size_t want = len < e->size - pos ? len : e->size - pos;
+        CHECK_MSG(n == (int)want && same(e, pos, buf, want), "%s: %zu-byte read at %zu returned %d",
+                  e->path, len, pos, n);
+        if (n <= 0) {
+            break;
+        }
+        pos += (size_t)n;
+    }
+    fs_close(fh);
+}
+
+static void check_span(file_handle_t* fh, const entry_t* e, uint8_t* buf, size_t offset) {
+    for (size_t len = 1; len <= SPAN_MAX; len = len * 3 + 1) {
+        if (fs_seek(fh, (uint32_t)offset) != 0) {
+            CHECK_MSG(0, "%s: seek to %zu failed", e->path, offset);
+            return;
+        }
+        int n = fs_read(fh, buf, len);
+        size_t want = len < e->size - offset ? len : e->size - offset;
+        CHECK_MSG(n == (int)want && same(e, offset, buf, want), "%s: %zu bytes at %zu returned %d",
+                  e->path, len, offset, n);
+    }
+}
+
+// Reads straddling sector boundaries, visited forwards then backwards.
+// Large files are sampled at every 37th sector plus both ends.
+static void check_boundaries(const entry_t* e, uint8_t* buf) {
+    file_handle_t* fh = fs_open(e->path);
+    if (!fh) {
+        return;
+    }
+    size_t sectors = (e->size + FS_SECTOR_SIZE - 1) / FS_SECTOR_SIZE;
+    size_t stride = sectors > 256 ? 37 : 1;
+
+    for (int backwards = 0; backwards < 2; backwards++) {
+        for (size_t i = 0; i <= sectors; i++) {
+            size_t s = backwards ? sectors - i : i;
+            if (s % stride != 0 && s > 2 && s + 2 < sectors) {
+                continue;
+            }
+            size_t offset = s * FS_SECTOR_SIZE;
+            if (offset > 0 && offset - 1 <= e->size) {
+                check_span(fh, e, buf, offset - 1);
+            }
+            if (offset <= e->size) {
+                check_span(fh, e, buf, offset);
+            }
+            if (offset + 1 <= e->size) {
+                check_span(fh, e, buf, offset + 1);
+            }
+        }
+    }
+    fs_close(fh);
+}
+
+// fs_read_start()/fs_read_finish() in the chunks the loader streams
+static void check_stream(const entry_t* e, uint8_t* buf) {
+    file_handle_t* fh = fs_open(e->path);
+    if (!fh) {
+        return;
+    }
+    size_t pos = 0;
+    while (pos < e->size) {
+        int n = fs_read_start(fh, buf + pos, STREAM_CHUNK);
+        int rc = fs_read_finish();
+        CHECK_MSG(n > 0 && rc == 0, "%s: streamed read at %zu returned %d/%d", e->path, pos, n, rc);
+        if (n <= 0 || rc != 0) {
+            break;
+        }
+        pos += (size_t)n;
+    }
+    CHECK_MSG(pos == e->size && same(e, 0, buf, e->size), "%s: streamed data differs", e->path);
+    fs_close(fh);
+}
+
+static void check_location(const entry_t* e, uint8_t* buf) {
+    fs_location_t loc;
+    CHECK_MSG(fs_locate(e->path, &loc) == 0, "%s: fs_locate failed", e->path);
+    if (loc.size != e->size) {
+        CHECK_MSG(0, "%s: located size %u, want %zu", e->path, loc.size, e->size);
+        return;
+    }
+    file_handle_t* fh = fs_open_location(&loc);
+    CHECK_MSG(fh != NULL, "%s: fs_open_location failed", e->path);
+    if (!fh) {
+        return;
+    }
+    int n = fs_read(fh, buf, e->size);
+    CHECK_MSG(n == (int)e->size && same(e, 0, buf, e->size), "%s: read after fs_locate returned %d",
+              e->path, n);
+    fs_close(fh);
+}
+
+// Names match whatever the case
+static void check_case(const entry_t* e) {
+    char path[sizeof(e->path)];
+    for (int upper = 0; upper < 2; upper++) {
+        for (size_t i = 0; i <= strlen(e->path); i++) {
+            char c = e->path[i];
+            path[i] = (char)(upper ? toupper((unsigned char)c) : tolower((unsigned char)c));
+        }
+        CHECK_MSG(fs_exists(path), "%s: not found as %s", e->path, path);
+    }
+}
+
+static void run_pass(uint8_t* buf) {
+    for (int i = 0; i < num_entries; i++) {
+        const entry_t* e = &entries[i];
+        if (e->missing) {
+            CHECK_MSG(!fs_exists(e->path) && fs_open(e->path) == NULL, "%s: found", e->path);
+            continue;
+        }
+        CHECK_MSG(fs_exists(e->path), "%s: not found", e->path);
+        check_case(e);
+        check_whole(e, buf);
+        check_chunks(e, buf);
+        check_boundaries(e, buf);
+        check_stream(e, buf);
+        check_location(e, buf);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        printf("usage: %s disk.img manifest\n", argv[0]);
+        return 2;
+    }
+    if (host_open_disk(argv[1]) != 0 || load_manifest(argv[2]) != 0) {
+        printf("cannot load %s or %s\n", argv[1], argv[2]);
+        return 2;
+    }
+
+    size_t largest = 0;
+    for (int i = 0; i < num_entries; i++) {
+        if (entries[i].size > largest) {
+            largest = entries[i].size;
+        }
+    }
+    uint8_t* buf = malloc(largest + STREAM_CHUNK);
+    if (!buf) {
+        return 2;
+    }
+
+    CHECK(fs_init() == 0);
+    if (failures) {
+        return test_summary("fat");
+    }
+    run_pass(buf);
+
+    CHECK(bcache_init(BCACHE_DEFAULT_SIZE) == 0);
+    CHECK(fs_init() == 0);
+    run_pass(buf);
+
+    bcache_stats_t st;
+    bcache_get_stats(&st);
+    CHECK_MSG(st.hits > 0 && st.readahead > 0, "block cache unused: %u hits, %u read ahead",
+              st.hits, st.readahead);
+
+    printf("%s: %d files, ", argv[1], num_entries);
+    return test_summary("fat");
+}
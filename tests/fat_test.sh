@@ -0,0 +1,118 @@
+#!/bin/bash
+# tests/fat_test.sh - FAT32 volumes for tests/fat_test.c
+#
+# Builds volumes holding fragmented files, long names (one LFN entry
+# exactly full, names spread over several entries, long directory
+# names), directories spanning several clusters and files ending either
+# side of sector and cluster boundaries, then checks that fat_test reads
+# every file back. tools/mkdiskimg.py images are always tested, with
+# 512-byte, 4 KB and 32 KB clusters; an mkfs.vfat volume filled with
+# mtools as well when both are installed.
+#
+#   tests/fat_test.sh build/host/tests/fat_test
+
+FAT_TEST=${1:?usage: $0 fat_test}
+FRAGMENTED=17       # More runs than a file handle maps at once (FS_MAX_EXTENTS)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+tree="$tmp/tree"
+files=()
+
+add_file() {
+    mkdir -p "$(dirname "$tree/$1")"
+    head -c "$2" /dev/urandom > "$tree/$1"
+    files+=("$1")
+}
+
+for size in 0 1 511 512 513 4095 4096 4097 8191 8192 8193 32767 32768 32769; do
+    add_file "size/$size.bin" "$size"
+done
+add_file "Kernel Image v2.1.bin" 20000
+add_file "name with spaces.txt" 100
+add_file "two.dots.here.img" 700
+add_file "MixedCase.Config" 50
+add_file "thirteen.char" 13                 # One LFN entry, no terminator
+add_file "twenty-six-characters.long" 26    # Two, no terminator
+add_file "Long Directory Name/Nested Directory Two/deep file.bin" 5000
+add_file "Long Directory Name/a very long file name spread over seven LFN entries of thirteen characters.dat" 1000
+for i in $(seq -w 1 40); do
+    add_file "many/file number $i.bin" 100
+done
+
+missing=(
+    "size/2.bin"
+    "Kernel Image v2.1.bi"
+    "Kernel Image v2.1.bin.old"
+    "many/file number 41.bin"
+    "Long Directory Name/Nested Directory Two/deep"
+    "size/0.bin/0.bin"
+)
+
+# manifest FILE [BIG_PATH BIG_EXTENTS]
+manifest() {
+    {
+        for f in "${files[@]}"; do
+            printf '%s\t%s\n' "$f" "$tree/$f"
+        done
+        if [ -n "$2" ]; then
+            printf '%s\t%s\t%s\n' "$2" "$tmp/big.bin" "$3"
+        fi
+        for f in "${missing[@]}"; do
+            printf '!%s\n' "$f"
+        done
+    } > "$1"
+}
+
+run() {
+    echo "  $1"
+    "$FAT_TEST" "$2" "$3" || exit 1
+}
+
+# mkdiskimg.py: the large file fragmented into runs of 3 and 1 clusters,
+# then contiguous
+head -c 300000 /dev/urandom > "$tmp/big.bin"
+specs=()
+for f in "${files[@]}"; do
+    specs+=("$f=$tree/$f")
+done
+for layout in "1 3" "8 1" "64 0"; do
+    set -- $layout
+    img="$tmp/mkdiskimg-$1.img"
+    python3 tools/mkdiskimg.py -s 16 -c "$1" -f "$2" "$img" "${specs[@]}" \
+        "big/fragmented.bin=$tmp/big.bin" >/dev/null || exit 1
+    if [ "$2" != 0 ]; then
+        manifest "$tmp/manifest" big/fragmented.bin $FRAGMENTED
+    else
+        manifest "$tmp/manifest" big/fragmented.bin 1
+    fi
+    run "mkdiskimg.py, $1 sector clusters, fragment $2" "$img" "$tmp/manifest"
+done
+
+# mkfs.vfat volume with 512-byte clusters. It is filled with 64 KB
+# files, every other one is deleted, and the large file goes into the
+# holes.
+if command -v mkfs.vfat >/dev/null 2>&1 && command -v mcopy >/dev/null 2>&1; then
+    export MTOOLS_SKIP_CHECK=1
+    img="$tmp/mkfs.img"
+    mkfs.vfat -F 32 -s 1 -S 512 -n MFTEST -C "$img" 40960 >/dev/null || exit 1
+    (cd "$tree" && mcopy -s -i "$img" * ::/) || exit 1
+
+    mkdir "$tmp/fill"
+    head -c 65536 /dev/urandom > "$tmp/fill/f0000"
+    for i in $(seq -w 1 999); do
+        ln "$tmp/fill/f0000" "$tmp/fill/f0$i"
+    done
+    mmd -i "$img" ::/fill || exit 1
+    # Runs out of space part way through
+    mcopy -i "$img" "$tmp"/fill/* ::/fill/ </dev/null >/dev/null 2>&1
+    mdel -i "$img" $(for i in $(seq 0 2 999); do printf '::/fill/f%04d ' "$i"; done) 2>/dev/null
+
+    head -c 1500000 /dev/urandom > "$tmp/big.bin"
+    mmd -i "$img" ::/big || exit 1
+    mcopy -i "$img" "$tmp/big.bin" ::/big/fragmented.bin || exit 1
+    manifest "$tmp/manifest" big/fragmented.bin $FRAGMENTED
+    run "mkfs.vfat, 1 sector clusters, fragmented by mtools" "$img" "$tmp/manifest"
+else
+    echo "  mkfs.vfat or mcopy not installed, mkfs.vfat volume skipped"
+fi
@@ -0,0 +1,230 @@
+// tests/memops_test.c - src/utils.c memory routines against naive loops
+//
+// memcpy, memmove, memset and memcmp are checked byte for byte against
+// one-byte-at-a-time references for every source and destination
+// offset 0-7 and every length 0-300, plus a few large sizes, with guard
+// bytes either side of the destination. On the host utils.c builds its
+// portable word/block path (MEMOPS_BLOCK 32); the ARM ldm/stm and NEON
+// block routines need target hardware.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "mfboot.h"
+#include "test.h"
+
+#define MAX_OFFSET      8
+#define MAX_SMALL       300
+#define GUARD           32
+#define GUARD_BYTE      0xE5
+
+static const size_t large_sizes[] = { 4096, 4096 + 3, 65536 + 31, (1 << 20) + 7 };
+
+// References. Built with -fno-builtin so they stay byte loops.
+static void ref_copy(uint8_t* d, const uint8_t* s, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        d[i] = s[i];
+    }
+}
+
+static void ref_move(uint8_t* d, const uint8_t* s, size_t n) {
+    if (d < s) {
+        for (size_t i = 0; i < n; i++) {
+            d[i] = s[i];
+        }
+    } else {
+        for (size_t i = n; i > 0; i--) {
+            d[i - 1] = s[i - 1];
+        }
+    }
+}
+
+static int ref_cmp(const uint8_t* a, const uint8_t* b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+static int sign(int v) {
+    return (v > 0) - (v < 0);
+}
+
+static uint32_t rng_state = 0x2201;
+
+static uint8_t rng_byte(void) {
+    rng_state = rng_state * 1103515245u + 12345u;
+    return (uint8_t)(rng_state >> 16);
+}
+
+static void fill_random(uint8_t* p, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        p[i] = rng_byte();
+    }
+}
+
+// Index of the first differing byte, or -1
+static long first_diff(const uint8_t* a, const uint8_t* b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != b[i]) {
+            return (long)i;
+        }
+    }
+    return -1;
+}
+
+// Buffers are 8-byte aligned so offsets 0-7 reach every alignment
+static uint8_t* alloc_buffer(size_t n) {
+    uint8_t* p = aligned_alloc(8, (n + 7) & ~(size_t)7);
+    if (!p) {
+        printf("out of memory\n");
+        exit(2);
+    }
+    return p;
+}
+
+static void check_memcpy(size_t len, size_t max_offset) {
+    size_t span = len + 2 * GUARD + MAX_OFFSET;
+    uint8_t* src = alloc_buffer(span);
+    uint8_t* got = alloc_buffer(span);
+    uint8_t* want = alloc_buffer(span);
+
+    for (size_t so = 0; so < max_offset; so++) {
+        for (size_t dof = 0; dof < max_offset; dof++) {
+            fill_random(src, span);
+            for (size_t i = 0; i < span; i++) {
+                got[i] = want[i] = GUARD_BYTE;
+            }
+            uint8_t* ret = memcpy(got + GUARD + dof, src + so, len);
+            ref_copy(want + GUARD + dof, src + so, len);
+
+            long at = first_diff(got, want, span);
+            CHECK_MSG(at < 0, "memcpy src+%zu dst+%zu len %zu: byte %ld of the buffer differs",
+                      so, dof, len, at - (long)(GUARD + dof));
+            CHECK_MSG(ret == got + GUARD + dof, "memcpy src+%zu dst+%zu len %zu: bad return",
+                      so, dof, len);
+        }
+    }
+    free(src);
+    free(got);
+    free(want);
+}
+
+// Overlapping moves in both directions within one buffer, then a
+// disjoint move that memmove hands to memcpy
+static void check_memmove(size_t len, size_t max_offset) {
+    size_t span = 2 * len + 2 * GUARD + 2 * MAX_OFFSET;
+    uint8_t* got = alloc_buffer(span);
+    uint8_t* want = alloc_buffer(span);
+
+    for (size_t so = 0; so < 2 * max_offset; so++) {
+        for (size_t dof = 0; dof < 2 * max_offset; dof++) {
+            fill_random(got, span);
+            ref_copy(want, got, span);
+            uint8_t* ret = memmove(got + GUARD + dof, got + GUARD + so, len);
+            ref_move(want + GUARD + dof, want + GUARD + so, len);
+
+            long at = first_diff(got, want, span);
+            CHECK_MSG(at < 0, "memmove src+%zu dst+%zu len %zu (overlapping): byte %ld differs",
+                      so, dof, len, at - (long)GUARD);
+            CHECK_MSG(ret == got + GUARD + dof, "memmove src+%zu dst+%zu len %zu: bad return",
+                      so, dof, len);
+        }
+    }
+
+    for (size_t so = 0; so < max_offset; so++) {
+        for (size_t dof = 0; dof < max_offset; dof++) {
+            fill_random(got, span);
+            ref_copy(want, got, span);
+            size_t dst = GUARD + len + MAX_OFFSET + dof;
+            memmove(got + dst, got + GUARD + so, len);
+            ref_move(want + dst, want + GUARD + so, len);
+
+            long at = first_diff(got, want, span);
+            CHECK_MSG(at < 0, "memmove src+%zu dst+%zu len %zu (disjoint): byte %ld differs",
+                      so, dof, len, at - (long)GUARD);
+        }
+    }
+    free(got);
+    free(want);
+}
+
+static void check_memset(size_t len, size_t max_offset) {
+    // 0x1A5 checks that only the low byte of c is stored
+    static const int values[] = { 0x00, 0x5A, 0xFF, 0x1A5 };
+    size_t span = len + 2 * GUARD + MAX_OFFSET;
+    uint8_t* got = alloc_buffer(span);
+    uint8_t* want = alloc_buffer(span);
+
+    for (size_t off = 0; off < max_offset; off++) {
+        for (size_t v = 0; v < sizeof(values) / sizeof(values[0]); v++) {
+            for (size_t i = 0; i < span; i++) {
+                got[i] = want[i] = GUARD_BYTE;
+            }
+            uint8_t* ret = memset(got + GUARD + off, values[v], len);
+            for (size_t i = 0; i < len; i++) {
+                want[GUARD + off + i] = (uint8_t)values[v];
+            }
+
+            long at = first_diff(got, want, span);
+            CHECK_MSG(at < 0, "memset dst+%zu len %zu value 0x%X: byte %ld differs",
+                      off, len, values[v], at - (long)(GUARD + off));
+            CHECK_MSG(ret == got + GUARD + off, "memset dst+%zu len %zu: bad return", off, len);
+        }
+    }
+    free(got);
+    free(want);
+}
+
+// Equal buffers, then a single differing byte at a spread of positions
+// with values either side of 0x80 so a signed compare would show up
+static void check_memcmp(size_t len, size_t max_offset) {
+    uint8_t* a = alloc_buffer(len + MAX_OFFSET);
+    uint8_t* b = alloc_buffer(len + MAX_OFFSET);
+
+    for (size_t ao = 0; ao < max_offset; ao++) {
+        for (size_t bo = 0; bo < max_offset; bo++) {
+            fill_random(a + ao, len);
+            ref_copy(b + bo, a + ao, len);
+            CHECK_MSG(memcmp(a + ao, b + bo, len) == 0, "memcmp a+%zu b+%zu len %zu: equal buffers",
+                      ao, bo, len);
+
+            size_t step = len <= 64 ? 1 : len / 17;
+            for (size_t pos = 0; pos < len; pos += step) {
+                if (pos + step >= len) {
+                    pos = len - 1;      // Always try the last byte
+                }
+                uint8_t saved = b[bo + pos];
+                a[ao + pos] = 0x7F;
+                b[bo + pos] = 0x80;
+                int want = ref_cmp(a + ao, b + bo, len);
+                int got = memcmp(a + ao, b + bo, len);
+                CHECK_MSG(sign(got) == want, "memcmp a+%zu b+%zu len %zu diff at %zu: got %d, want %d",
+                          ao, bo, len, pos, got, want);
+                got = memcmp(b + bo, a + ao, len);
+                CHECK_MSG(sign(got) == -want, "memcmp b+%zu a+%zu len %zu diff at %zu: got %d, want %d",
+                          bo, ao, len, pos, got, -want);
+                a[ao + pos] = b[bo + pos] = saved;
+            }
+        }
+    }
+    free(a);
+    free(b);
+}
+
+int main(void) {
+    for (size_t len = 0; len <= MAX_SMALL; len++) {
+        check_memcpy(len, MAX_OFFSET);
+        check_memmove(len, MAX_OFFSET);
+        check_memset(len, MAX_OFFSET);
+        check_memcmp(len, MAX_OFFSET);
+    }
+    for (size_t i = 0; i < sizeof(large_sizes) / sizeof(large_sizes[0]); i++) {
+        check_memcpy(large_sizes[i], 4);
+        check_memmove(large_sizes[i], 2);
+        check_memset(large_sizes[i], 4);
+        check_memcmp(large_sizes[i], 2);
+    }
+    return test_summary("memops");
+}
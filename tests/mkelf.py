@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+"""
+tests/mkelf.py - ELF32 ARM executables for tests/elf_test.sh
+
+Lays out one PT_LOAD segment per SEGMENT argument, in order, each at a
+file offset congruent to its virtual address modulo its alignment as a
+linker would. Header fields can then be overridden one by one, to build
+images the loader has to refuse.
+
+    mkelf.py [-e ENTRY] OUT SEGMENT...
+
+SEGMENT is ADDR:FILE[,FIELD=VALUE...]: FILE's bytes loaded at physical
+address ADDR. FIELD is one of vaddr (default ADDR), memsz (default the
+file size), align (default 0x1000), and filesz, offset, paddr, which
+replace the laid-out value in the program header only.
+"""
+
+import argparse
+import struct
+import sys
+
+ELF_HEADER = struct.Struct('<16sHHIIIIIHHHHHH')
+PHDR = struct.Struct('<IIIIIIII')
+
+PT_LOAD = 1
+PF_RWX = 7
+
+
+def number(text):
+    return int(text, 0)
+
+
+def parse_segment(spec):
+    addr, _, rest = spec.partition(':')
+    path, *fields = rest.split(',')
+    with open(path, 'rb') as f:
+        data = f.read()
+    seg = {'paddr': number(addr), 'data': data}
+    for field in fields:
+        key, _, value = field.partition('=')
+        if key not in ('vaddr', 'memsz', 'align', 'filesz', 'offset', 'paddr'):
+            raise ValueError(f'unknown field {key} in {spec}')
+        seg[key] = number(value)
+    return seg
+
+
+def build(entry, segments):
+    phoff = ELF_HEADER.size
+    cursor = phoff + PHDR.size * len(segments)
+    phdrs = []
+
+    for seg in segments:
+        vaddr = seg.get('vaddr', seg['paddr'])
+        align = seg.get('align', 0x1000)
+        data = seg['data']
+        offset = cursor
+        if align > 1:
+            offset += (vaddr - offset) % align
+        seg['laid_out'] = offset
+        cursor = offset + len(data)
+        phdrs.append((PT_LOAD, seg.get('offset', offset), vaddr, seg['paddr'],
+                      seg.get('filesz', len(data)), seg.get('memsz', len(data)),
+                      PF_RWX, align))
+
+    out = bytearray(cursor)
+    ident = b'\x7fELF' + bytes([1, 1, 1]) + bytes(9)
+    out[0:ELF_HEADER.size] = ELF_HEADER.pack(ident, 2, 40, 1, entry, phoff, 0, 0x5000200,
+                                             ELF_HEADER.size, PHDR.size, len(phdrs), 0, 0, 0)
+    for i, ph in enumerate(phdrs):
+        start = phoff + i * PHDR.size
+        out[start:start + PHDR.size] = PHDR.pack(*ph)
+    for seg in segments:
+        out[seg['laid_out']:seg['laid_out'] + len(seg['data'])] = seg['data']
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Build an ELF32 ARM executable')
+    parser.add_argument('-e', '--entry', type=number, help='entry point (default: first vaddr)')
+    parser.add_argument('output')
+    parser.add_argument('segments', nargs='+', metavar='SEGMENT')
+    args = parser.parse_args()
+
+    try:
+        segments = [parse_segment(s) for s in args.segments]
+    except (OSError, ValueError) as e:
+        print(f'mkelf.py: {e}', file=sys.stderr)
+        return 1
+    entry = args.entry
+    if entry is None:
+        entry = segments[0].get('vaddr', segments[0]['paddr'])
+
+    with open(args.output, 'wb') as f:
+        f.write(build(entry, segments))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,313 @@
+// tests/mmc_test.c - src/drivers/mmc.c against the EMMC model
+//
+// Runs the driver on tests/emmc_model.c and checks the commands the card
+// receives as well as the data: the identification sequence for SDHC
+// and SDSC cards, with and without high speed; CMD17 for one block and
+// CMD18 followed by auto-CMD12 for more; DMA for cache-line aligned
+// buffers, PIO for word-aligned ones and the bounce buffer for the
+// rest; mmc_read_start() leaving its transfer in flight until
+// mmc_read_finish(); and the line reset after a failed command or data
+// phase.
+
+#include <stdio.h>
+#include <string.h>
+#include "mmc.h"
+#include "hardware.h"
+#include "emmc_model.h"
+#include "test.h"
+
+#define CMD(n)              (n)
+#define ACMD(n)             (0x100 | (n))
+#define AUTO_CMD12          0x200
+#define RESET               0x400
+#define END                 -1
+
+#define MAX_BLOCKS_PER_CMD  0xFFFF
+#define BIG_BLOCKS          (MAX_BLOCKS_PER_CMD + 9)
+#define MAX_CACHE_OPS       16
+
+// Guest RAM for PHYS_PTR()/PTR_PHYS(): physical addresses are offsets
+// from host_ram, set below every static buffer and the driver's DMA
+// control block
+uint8_t* host_ram;
+
+static uint8_t big_buf[BIG_BLOCKS * MMC_BLOCK_SIZE + 64] __attribute__((aligned(64)));
+static uint8_t buf[64 * MMC_BLOCK_SIZE + 64] __attribute__((aligned(64)));
+
+static uint32_t timer;
+static struct {
+    uint32_t start;
+    uint32_t len;
+    int events;                 // Commands logged before the call
+} cache_ops[MAX_CACHE_OPS];
+static int num_cache_ops;
+
+uint32_t get_timer_count(void) {
+    return timer++;
+}
+
+void delay_us(uint32_t us) {
+    timer += us;
+}
+
+void dcache_clean_inv_range(uint32_t start, uint32_t len) {
+    const emmc_event_t* ev;
+    if (num_cache_ops < MAX_CACHE_OPS) {
+        cache_ops[num_cache_ops].start = start;
+        cache_ops[num_cache_ops].len = len;
+        cache_ops[num_cache_ops].events = emmc_model_events(&ev);
+        num_cache_ops++;
+    }
+}
+
+static const emmc_model_config_t sdhc = { .busy_polls = 2 };
+
+// Compare the logged events with 'want', a list of CMD(n), ACMD(n),
+// AUTO_CMD12 and RESET ending in END
+static void check_sequence(const char* what, const int* want) {
+    const emmc_event_t* ev;
+    int n = emmc_model_events(&ev);
+    int i = 0;
+
+    for (; want[i] != END; i++) {
+        int got = -1;
+        if (i < n) {
+            got = ev[i].type == EMMC_EV_RESET ? RESET :
+                  ev[i].type == EMMC_EV_AUTO_CMD12 ? AUTO_CMD12 :
+                  (ev[i].app ? ACMD(ev[i].index) : CMD(ev[i].index));
+        }
+        CHECK_MSG(got == want[i], "%s: event %d is 0x%X, want 0x%X", what, i, got, want[i]);
+        if (got != want[i]) {
+            return;
+        }
+    }
+    CHECK_MSG(n == i, "%s: %d events, want %d", what, n, i);
+}
+
+static void check_no_violations(const char* what) {
+    const char* msg;
+    int v = emmc_model_violations(&msg);
+    CHECK_MSG(v == 0, "%s: %d protocol violation(s), last: %s", what, v, msg);
+}
+
+static int check_data(const uint8_t* data, uint32_t lba, uint32_t count) {
+    for (uint32_t b = 0; b < count; b++) {
+        for (uint32_t i = 0; i < MMC_BLOCK_SIZE; i++) {
+            if (data[b * MMC_BLOCK_SIZE + i] != emmc_model_byte(lba + b, i)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static const emmc_event_t* event(int i) {
+    const emmc_event_t* ev;
+    int n = emmc_model_events(&ev);
+    return i < n ? &ev[i] : NULL;
+}
+
+static void init_card(const emmc_model_config_t* config) {
+    emmc_model_reset(config);
+    CHECK(mmc_init() == 0);
+    emmc_model_clear_log();
+}
+
+static void test_init_sdhc(void) {
+    static const int want[] = {
+        CMD(0), CMD(8), CMD(55), ACMD(41), CMD(55), ACMD(41), CMD(55), ACMD(41),
+        CMD(2), CMD(3), CMD(7), CMD(55), ACMD(6), CMD(6), CMD(6), END
+    };
+    emmc_model_reset(&sdhc);
+    CHECK(mmc_init() == 0);
+    check_sequence("SDHC init", want);
+    CHECK_EQ(event(1)->arg, 0x1AA);
+    CHECK_EQ(event(10)->arg, 0xB368u << 16);
+    CHECK_EQ(event(13)->arg, 0x00FFFFF1);
+    CHECK_EQ(event(14)->arg, 0x80FFFFF1);
+    CHECK_EQ(emmc_model_control0() & 0x6, 0x6);     // 4-bit bus, high speed
+    CHECK_EQ(emmc_model_clock_hz(), 41666666);      // 50 MHz rounded down
+    check_no_violations("SDHC init");
+}
+
+static void test_init_sdsc(void) {
+    static const int want[] = {
+        CMD(0), CMD(8), CMD(55), ACMD(41), CMD(2), CMD(3), CMD(7), CMD(16),
+        CMD(55), ACMD(6), CMD(6), END
+    };
+    emmc_model_config_t config = { .sdsc = 1, .no_high_speed = 1 };
+    emmc_model_reset(&config);
+    CHECK(mmc_init() == 0);
+    check_sequence("SDSC init", want);
+    CHECK_EQ(emmc_model_control0() & 0x6, 0x2);     // 4-bit bus, normal speed
+    CHECK_EQ(emmc_model_clock_hz(), 25000000);
+
+    // Byte addresses
+    emmc_model_clear_log();
+    CHECK(mmc_read_blocks(100, 2, buf) == 0);
+    CHECK_EQ(event(0)->arg, 100 * 512);
+    CHECK(check_data(buf, 100, 2));
+    check_no_violations("SDSC read");
+}
+
+// Cache-line aligned buffers: DMA, cleaned before the command and
+// invalidated after the transfer
+static void test_dma_reads(void) {
+    static const int single[] = { CMD(17), END };
+    static const int multi[] = { CMD(18), AUTO_CMD12, END };
+    init_card(&sdhc);
+
+    num_cache_ops = 0;
+    CHECK(mmc_read_blocks(7, 1, buf) == 0);
+    check_sequence("aligned single block", single);
+    CHECK(event(0)->dma && event(0)->arg == 7 && event(0)->blocks == 1);
+    CHECK(check_data(buf, 7, 1));
+
+    emmc_model_clear_log();
+    num_cache_ops = 0;
+    CHECK(mmc_read_blocks(1000, 64, buf) == 0);
+    check_sequence("aligned multi-block", multi);
+    CHECK(event(0)->dma && event(0)->arg == 1000 && event(0)->blocks == 64);
+    CHECK(check_data(buf, 1000, 64));
+
+    int before = 0, after = 0;
+    for (int i = 0; i < num_cache_ops; i++) {
+        if (cache_ops[i].start == PTR_PHYS(buf) && cache_ops[i].len == 64 * MMC_BLOCK_SIZE) {
+            before += cache_ops[i].events == 0;
+            after += cache_ops[i].events == 2;
+        }
+    }
+    CHECK_MSG(before == 1 && after == 1, "buffer cache maintenance: %d before CMD18, %d after", before, after);
+    check_no_violations("DMA reads");
+}
+
+// Word-aligned buffers are drained by the CPU, anything else through
+// the bounce buffer
+static void test_pio_reads(void) {
+    static const int multi[] = { CMD(18), AUTO_CMD12, END };
+    static const int single[] = { CMD(17), END };
+    init_card(&sdhc);
+
+    for (int offset = 1; offset < 64; offset += offset < 4 ? 1 : 30) {
+        memset(buf, 0, sizeof(buf));
+        emmc_model_clear_log();
+        CHECK(mmc_read_blocks(50, 3, buf + offset) == 0);
+        check_sequence("unaligned multi-block", multi);
+        CHECK_MSG(!event(0)->dma, "buffer offset %d: served by DMA", offset);
+        CHECK_MSG(check_data(buf + offset, 50, 3), "buffer offset %d: data differs", offset);
+        CHECK_MSG(buf[offset - 1] == 0 && buf[offset + 3 * MMC_BLOCK_SIZE] == 0,
+                  "buffer offset %d: wrote outside the buffer", offset);
+
+        emmc_model_clear_log();
+        CHECK(mmc_read_blocks(9, 1, buf + offset) == 0);
+        check_sequence("unaligned single block", single);
+        CHECK(check_data(buf + offset, 9, 1));
+    }
+    check_no_violations("PIO reads");
+}
+
+// Longer than BLKCNT can express: split into CMD18 runs
+static void test_large_read(void) {
+    static const int want[] = { CMD(18), AUTO_CMD12, CMD(18), AUTO_CMD12, END };
+    init_card(&sdhc);
+
+    CHECK(mmc_read_blocks(3, BIG_BLOCKS, big_buf) == 0);
+    check_sequence("large read", want);
+    CHECK(event(0)->arg == 3 && event(0)->blocks == MAX_BLOCKS_PER_CMD);
+    CHECK(event(2)->arg == 3 + MAX_BLOCKS_PER_CMD && event(2)->blocks == BIG_BLOCKS - MAX_BLOCKS_PER_CMD);
+    CHECK(check_data(big_buf, 3, BIG_BLOCKS));
+    check_no_violations("large read");
+}
+
+static void test_background_read(void) {
+    static const int want[] = { CMD(18), AUTO_CMD12, CMD(17), END };
+    init_card(&sdhc);
+
+    memset(buf, 0xAA, sizeof(buf));
+    CHECK(mmc_read_start(200, 16, buf) == 0);
+    CHECK_MSG(emmc_model_transfer_pending(), "mmc_read_start() waited for its transfer");
+    CHECK_EQ(emmc_model_dma_reads(), 0);
+    CHECK(buf[0] == 0xAA && buf[16 * MMC_BLOCK_SIZE - 1] == 0xAA);
+
+    CHECK(mmc_read_finish() == 0);
+    CHECK(!emmc_model_transfer_pending());
+    CHECK(check_data(buf, 200, 16));
+
+    // The next read collects a pending one first
+    CHECK(mmc_read_start(300, 4, buf) == 0);
+    CHECK(mmc_read_blocks(400, 1, buf + 4 * MMC_BLOCK_SIZE) == 0);
+    CHECK(check_data(buf, 300, 4) && check_data(buf + 4 * MMC_BLOCK_SIZE, 400, 1));
+    emmc_model_clear_log();
+    CHECK(mmc_read_start(8, 2, buf) == 0 && mmc_read_finish() == 0);
+    CHECK(mmc_read_start(16, 1, buf) == 0 && mmc_read_finish() == 0);
+    check_sequence("background reads", want);
+
+    // Unaligned buffers are read before mmc_read_start() returns
+    CHECK(mmc_read_start(500, 2, buf + 4) == 0);
+    CHECK(!emmc_model_transfer_pending());
+    CHECK(check_data(buf + 4, 500, 2));
+    CHECK(mmc_read_finish() == 0);
+    check_no_violations("background reads");
+}
+
+// A failed command or data phase resets the lines once and leaves the
+// card usable
+static void test_errors(void) {
+    static const int cmd_fail[] = { CMD(18), RESET, CMD(18), AUTO_CMD12, END };
+    static const int dma_fail[] = { CMD(18), RESET, CMD(18), AUTO_CMD12, END };
+    static const int pio_fail[] = { CMD(17), RESET, CMD(17), END };
+    init_card(&sdhc);
+
+    emmc_model_fail_command(18);
+    CHECK(mmc_read_blocks(10, 4, buf) == -1);
+    emmc_model_fail_command(-1);
+    CHECK(mmc_read_blocks(10, 4, buf) == 0);
+    check_sequence("CMD18 timeout", cmd_fail);
+    CHECK(check_data(buf, 10, 4));
+
+    emmc_model_clear_log();
+    emmc_model_fail_data();
+    CHECK(mmc_read_blocks(20, 4, buf) == -1);
+    CHECK(mmc_read_blocks(20, 4, buf) == 0);
+    check_sequence("DMA data error", dma_fail);
+    CHECK(check_data(buf, 20, 4));
+
+    emmc_model_clear_log();
+    emmc_model_fail_data();
+    CHECK(mmc_read_blocks(11, 1, buf + 1) == -1);
+    CHECK(mmc_read_blocks(11, 1, buf + 1) == 0);
+    check_sequence("PIO data error", pio_fail);
+    CHECK(check_data(buf + 1, 11, 1));
+    check_no_violations("errors");
+}
+
+static void test_write(void) {
+    static const int want[] = { CMD(24), CMD(17), END };
+    uint8_t block[MMC_BLOCK_SIZE];
+    init_card(&sdhc);
+
+    for (int i = 0; i < MMC_BLOCK_SIZE; i++) {
+        block[i] = (uint8_t)(i * 7 + 1);
+    }
+    CHECK(mmc_write_block(77, block) == 0);
+    CHECK(mmc_read_blocks(77, 1, buf) == 0);
+    check_sequence("write", want);
+    CHECK(event(0)->arg == 77);
+    CHECK(memcmp(buf, block, MMC_BLOCK_SIZE) == 0);
+    check_no_violations("write");
+}
+
+int main(void) {
+    uintptr_t low = (uintptr_t)buf < (uintptr_t)big_buf ? (uintptr_t)buf : (uintptr_t)big_buf;
+    host_ram = (uint8_t*)((low & ~(uintptr_t)0xFFFFF) - 0x10000000);
+
+    test_init_sdhc();
+    test_init_sdsc();
+    test_dma_reads();
+    test_pio_reads();
+    test_large_read();
+    test_background_read();
+    test_errors();
+    test_write();
+    return test_summary("mmc");
+}
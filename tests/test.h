@@ -0,0 +1,45 @@
+// tests/test.h - Check macros shared by the host unit tests
+//
+// Each test is a plain host program: CHECK() counts a check and prints
+// the first few failures with their source line, test_summary() prints
+// the totals and gives the exit status. Build and run them all with
+// `make test`.
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+#define TEST_MAX_REPORTS    20
+
+static int failures;
+static int checks;
+
+#define CHECK(cond) \
+    CHECK_MSG(cond, "%s", #cond)
+
+// CHECK() with a printf-style description of the failing case
+#define CHECK_MSG(cond, ...) do { \
+        checks++; \
+        if (!(cond)) { \
+            if (failures < TEST_MAX_REPORTS) { \
+                printf("  FAIL %s:%d: ", __FILE__, __LINE__); \
+                printf(__VA_ARGS__); \
+                printf("\n"); \
+            } \
+            failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(got, want) do { \
+        unsigned long long got_ = (unsigned long long)(got); \
+        unsigned long long want_ = (unsigned long long)(want); \
+        CHECK_MSG(got_ == want_, "%s = %llu, want %llu", #got, got_, want_); \
+    } while (0)
+
+static inline int test_summary(const char* name) {
+    printf("%s: %d checks, %d failed\n", name, checks, failures);
+    return failures ? 1 : 0;
+}
+
+#endif // TEST_H
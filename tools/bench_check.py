@@ -0,0 +1,250 @@
+#!/usr/bin/env python3
+"""
+bench_check.py - Boot path benchmark regression check
+Copyright 2201-2203 Robco Ind.
+
+Compares the BENCH lines printed by the maintenance benchmarks ([B] in
+the maintenance menu, or `mfboot-host --bench`) against a baseline and
+fails when a case got more than --threshold percent slower. Throughput
+cases compare MB/s, the others ns per operation. Given several captures
+the best run of each case counts; pass the same number of captures as
+--runs when the baseline was recorded.
+
+--update splits the captures into sets of --runs, takes the best run of
+each case in every set, and records the median of those as the
+baseline. noise= is how many percent the slowest set fell behind the
+median: the spread of the very figure the check compares. A case whose
+noise is not below the threshold cannot tell a regression from a bad
+set, so the check reports it without failing on it. Record the baseline
+on a quiet machine; nothing widens the threshold.
+
+    bench_check.py check tools/bench_baseline.txt run1.txt [run2.txt ...]
+    bench_check.py check --update -r 5 tools/bench_baseline.txt run1.txt [...]
+    bench_check.py payload kernel.bin
+
+`payload` writes the deterministic, kernel-like test payload that
+`make bench` packs into the benchmark disk image.
+"""
+
+import sys
+import random
+import struct
+import argparse
+
+DEFAULT_THRESHOLD = 10.0
+
+
+def parse_bench(lines):
+    """Map case name -> dict of metrics from BENCH lines."""
+    results = {}
+    for line in lines:
+        line = line.strip()
+        if not line.startswith('BENCH '):
+            continue
+        fields = line.split()
+        name = fields[1]
+        if len(fields) > 2 and fields[2] == 'FAILED':
+            results[name] = None
+            continue
+        metrics = {}
+        for field in fields[2:]:
+            key, sep, value = field.partition('=')
+            if sep:
+                metrics[key] = float(value)
+        results[name] = metrics
+    return results
+
+
+def better(a, b):
+    """True if run 'a' of a case beats run 'b'."""
+    if 'mbps' in a and 'mbps' in b:
+        return a['mbps'] > b['mbps']
+    return a['ns_op'] < b['ns_op']
+
+
+def merge_best(runs):
+    """Best result of each case over several parsed captures."""
+    best = {}
+    for run in runs:
+        for name, metrics in run.items():
+            if metrics is None:
+                best.setdefault(name, None)
+            elif best.get(name) is None or better(metrics, best[name]):
+                best[name] = metrics
+    return best
+
+
+def change(base, cur):
+    """Metric compared and percent change from 'base' to 'cur'. Positive
+    change is always an improvement."""
+    if 'mbps' in base and 'mbps' in cur:
+        metric = 'mbps'
+        pct = (cur[metric] - base[metric]) / base[metric] * 100 if base[metric] else 0.0
+    else:
+        metric = 'ns_op'
+        pct = (base[metric] - cur[metric]) / base[metric] * 100 if base[metric] else 0.0
+    return metric, pct
+
+
+def merge_median(runs):
+    """Median result of each case over several parsed captures, with an
+    even number of runs the slower of the middle two. Its noise= field is
+    how many percent the slowest run fell behind the median."""
+    results = {}
+    for name in {name: None for run in runs for name in run}:
+        ok = [run[name] for run in runs if run.get(name) is not None]
+        if not ok:
+            results[name] = None
+            continue
+        ok.sort(key=lambda m: -m['mbps'] if 'mbps' in m else m['ns_op'])
+        median = dict(ok[len(ok) // 2])
+        median['noise'] = round(max(0.0, -change(median, ok[-1])[1]), 1)
+        results[name] = median
+    return results
+
+
+def bench_line(name, metrics):
+    fields = ' '.join(f"{k}={v:.12g}" for k, v in metrics.items())
+    return f"BENCH {name} {fields}"
+
+
+def merge_sets(runs, size):
+    """Median over consecutive sets of 'size' captures of the best run of
+    each case in a set, with the spread of the set bests as noise=."""
+    sets = [runs[i:i + size] for i in range(0, len(runs), size)]
+    return merge_median([merge_best(s) for s in sets])
+
+
+def compare(baseline, current, threshold):
+    """Print a comparison table; return the number of regressions. Cases
+    whose baseline noise reaches the threshold are shown, not counted."""
+    failures = 0
+    print(f"{'case':<18}{'metric':>8}{'baseline':>12}{'current':>12}{'change':>9}{'noise':>8}")
+    for name, base in baseline.items():
+        cur = current.get(name)
+        if name not in current or cur is None:
+            print(f"{name:<18}{'':>8}{'':>12}{'FAILED' if name in current else 'missing':>12}")
+            failures += 1
+            continue
+
+        metric, pct = change(base, cur)
+        noise = base.get('noise', 0.0)
+        flag = ''
+        if noise >= threshold:
+            flag = '  not gated'
+        elif pct < -threshold:
+            flag = '  REGRESSION'
+            failures += 1
+        print(f"{name:<18}{metric:>8}{base[metric]:>12g}{cur[metric]:>12g}{pct:>+8.1f}%"
+              f"{noise:>7.1f}%{flag}")
+
+    for name in current:
+        if name not in baseline:
+            print(f"{name:<18}{'':>8}{'new':>12}")
+    return failures
+
+
+def cmd_check(args):
+    runs = []
+    for capture in args.captures:
+        try:
+            with open(capture, errors='replace') if capture != '-' else sys.stdin as f:
+                runs.append(parse_bench(f))
+        except OSError as e:
+            print(f"Error: {e}", file=sys.stderr)
+            return 1
+
+    if args.runs < 1:
+        print("Error: --runs must be at least 1", file=sys.stderr)
+        return 1
+    current = merge_sets(runs, args.runs) if args.update else merge_best(runs)
+    if not current:
+        print("Error: No BENCH lines in the capture", file=sys.stderr)
+        return 1
+
+    if args.update:
+        with open(args.baseline, 'w') as f:
+            f.write("# Boot path benchmark baseline (tools/bench_check.py check --update)\n")
+            for name, metrics in current.items():
+                if metrics is not None:
+                    f.write(bench_line(name, metrics) + '\n')
+        print(f"Baseline written to {args.baseline} ({len(current)} cases)")
+        return 0
+
+    try:
+        with open(args.baseline) as f:
+            baseline = parse_bench(f)
+    except OSError as e:
+        print(f"Error: {e}", file=sys.stderr)
+        return 1
+
+    failures = compare(baseline, current, args.threshold)
+    if failures:
+        print(f"\n{failures} case(s) regressed by more than {args.threshold:g}%")
+        return 1
+    print(f"\nNo regressions beyond {args.threshold:g}%")
+    return 0
+
+
+def kernel_payload(size, seed):
+    """ARM-kernel-like bytes: a skewed instruction mix plus string tables,
+    compressing about as well as a real zImage payload."""
+    rng = random.Random(seed)
+    common = [rng.getrandbits(32) for _ in range(256)]
+    conds = [0xE5, 0xE1, 0xE3, 0xEB, 0xE2, 0x1A, 0x0A, 0xE8, 0xE9, 0xEA]
+    words = ['error', 'device', 'driver', 'memory', 'failed', 'init', 'kernel',
+             'irq', 'clock', 'probe', 'unable', 'to', 'the', 'for', 'of', '%d', '%s']
+
+    out = bytearray()
+    while len(out) < size:
+        if rng.random() < 0.1:
+            text = ' '.join(rng.choice(words) for _ in range(rng.randint(2, 8)))
+            out += text.encode() + b'\n\0'
+            continue
+        for _ in range(rng.randint(16, 256)):
+            if rng.random() < 0.7:
+                word = rng.choice(common[:rng.choice((16, 64, 256))])
+            else:
+                word = (rng.choice(conds) << 24) | rng.getrandbits(rng.choice((8, 12, 16, 20)))
+            out += struct.pack('<I', word)
+    return bytes(out[:size])
+
+
+def cmd_payload(args):
+    data = kernel_payload(args.size * 1024 * 1024, args.seed)
+    try:
+        with open(args.output, 'wb') as f:
+            f.write(data)
+    except OSError as e:
+        print(f"Error: {e}", file=sys.stderr)
+        return 1
+    print(f"Created {args.output}: {len(data)} bytes")
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Check boot path benchmarks for regressions')
+    sub = parser.add_subparsers(dest='command', required=True)
+
+    check = sub.add_parser('check', help='Compare a capture against a baseline')
+    check.add_argument('baseline', help='Baseline file (BENCH lines)')
+    check.add_argument('captures', nargs='+', metavar='capture',
+                       help="Console capture with BENCH lines, or '-' for stdin")
+    check.add_argument('-t', '--threshold', type=float, default=DEFAULT_THRESHOLD,
+                       help='Allowed slowdown in percent (default 10)')
+    check.add_argument('--update', action='store_true',
+                       help='Write the median of the set bests as the new baseline')
+    check.add_argument('-r', '--runs', type=int, default=1,
+                       help='With --update, captures per set (default 1)')
+
+    payload = sub.add_parser('payload', help='Write the benchmark kernel payload')
+    payload.add_argument('output', help='Output file')
+    payload.add_argument('-s', '--size', type=int, default=4, help='Size in MB (default 4)')
+    payload.add_argument('--seed', type=int, default=2201, help='Generator seed')
+
+    args = parser.parse_args()
+    return cmd_check(args) if args.command == 'check' else cmd_payload(args)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
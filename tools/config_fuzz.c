@@ -0,0 +1,402 @@
+// tools/config_fuzz.c - Host fuzzer for src/config.c
+//
+// Mutates the seed files (and a few built-in snippets) and parses each
+// result into a fresh table, with the text in a buffer of exactly
+// len + 1 bytes so AddressSanitizer catches any access past it. Every
+// string and list item must lie inside that buffer, be trimmed and hold
+// no newline or (list) comma. The parsed table is then written out as a
+// blob, read back with config_load_blob() and compared, and the blob is
+// mutated with its checksum fixed up so the record checks get exercised
+// too. A few fixed inputs that once got through are checked first.
+// Build and run with `make fuzz`.
+//
+//   config_fuzz [-n iterations] [-s seed] file.conf ...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "filesystem.h"
+
+#define MAX_INPUT       4096
+#define MAX_SEEDS       16
+
+static const char* const builtin_seeds[] = {
+    "[menu]\ntimeout = 5\ndefault=0\n",
+    "[devices]\nsdcard.search_paths = /a, /b ,,/c # x\n[boot]\ncmdline=a,b#c d # e\n",
+    "[boot]\nload_address = 0xFFFFFFFF\ninitrd=none\r\n[search]\nmax_depth=4294967295",
+    "[ menu ]\n default = 1 \n[display]\nborder = yes\n[",
+};
+
+// config.c reads the card through these; the fuzzer only parses buffers
+file_handle_t* fs_open(const char* path) {
+    (void)path;
+    return NULL;
+}
+
+int fs_read(file_handle_t* fh, void* buf, size_t size) {
+    (void)fh;
+    (void)buf;
+    (void)size;
+    return -1;
+}
+
+void fs_close(file_handle_t* fh) {
+    (void)fh;
+}
+
+void term_print(const char* str) {
+    (void)str;
+}
+
+void term_printf(const char* fmt, ...) {
+    (void)fmt;
+}
+
+uint32_t crc32(uint32_t crc, const void* data, size_t len) {
+    const uint8_t* p = data;
+    crc = ~crc;
+    while (len--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static uint32_t rng_state;
+
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void fail(const char* what, uint32_t iter, const char* input, size_t len) {
+    fprintf(stderr, "FAIL iteration %u: %s\ninput (%zu bytes):\n", iter, what, len);
+    fwrite(input, 1, len, stderr);
+    fputc('\n', stderr);
+    exit(1);
+}
+
+// Characters the parser treats specially, favoured by the mutator
+static char interesting(void) {
+    static const char chars[] = "[]=#;,\n\r\t 0x\0";
+    return chars[rng() % (sizeof(chars) - 1)];
+}
+
+static size_t mutate(char* buf, size_t len, size_t cap) {
+    int rounds = 1 + (int)(rng() % 8);
+    while (rounds--) {
+        size_t pos = len ? rng() % len : 0;
+        switch (rng() % 6) {
+        case 0:                 // Flip a byte
+            if (len) {
+                buf[pos] = (char)rng();
+            }
+            break;
+        case 1:                 // Replace with a special character
+            if (len) {
+                buf[pos] = interesting();
+            }
+            break;
+        case 2:                 // Insert a special character
+            if (len < cap) {
+                memmove(buf + pos + 1, buf + pos, len - pos);
+                buf[pos] = interesting();
+                len++;
+            }
+            break;
+        case 3:                 // Delete a run
+            if (len) {
+                size_t n = 1 + rng() % 16;
+                if (n > len - pos) {
+                    n = len - pos;
+                }
+                memmove(buf + pos, buf + pos + n, len - pos - n);
+                len -= n;
+            }
+            break;
+        case 4:                 // Duplicate a run
+            if (len) {
+                size_t n = 1 + rng() % 64;
+                if (n > len - pos) {
+                    n = len - pos;
+                }
+                if (len + n <= cap) {
+                    memmove(buf + pos + n, buf + pos, len - pos);
+                    len += n;
+                }
+            }
+            break;
+        default:                // Truncate
+            len = pos;
+            break;
+        }
+    }
+    return len;
+}
+
+static int inside(const char* s, const char* buf, size_t len) {
+    return s >= buf && s <= buf + len && memchr(s, '\0', (size_t)(buf + len + 1 - s)) != NULL;
+}
+
+static int is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// A value from 'buf': inside it and, when parsed from text, trimmed
+// and on one line
+static int check_string(const char* s, const char* buf, size_t len, int list, int text) {
+    if (!inside(s, buf, len)) {
+        return -1;
+    }
+    if (!text) {
+        return 0;
+    }
+    if (strchr(s, '\n') || (list && (strchr(s, ',') || !*s))) {
+        return -1;
+    }
+    size_t n = strlen(s);
+    return n && (is_blank(s[0]) || is_blank(s[n - 1])) ? -1 : 0;
+}
+
+static const char* check_table(const config_t* cfg, const config_t* def,
+                               const char* buf, size_t len, int text) {
+    if (cfg->pool_used > CONFIG_LIST_POOL) {
+        return "list pool overrun";
+    }
+    for (uint32_t k = 0; k < CONFIG_NUM_KEYS; k++) {
+        const config_value_t* v = &cfg->values[k];
+        if (v->type != def->values[k].type) {
+            return "type changed";
+        }
+        if (v->type == CONFIG_TYPE_BOOL && v->v.i > 1) {
+            return "bool out of range";
+        }
+        if (v->type == CONFIG_TYPE_STRING && v->v.s != def->values[k].v.s &&
+            check_string(v->v.s, buf, len, 0, text) != 0) {
+            return "bad string value";
+        }
+        if (v->type == CONFIG_TYPE_LIST && v->v.list != def->values[k].v.list) {
+            if (v->v.list < cfg->pool || v->v.list + v->count > cfg->pool + cfg->pool_used) {
+                return "list outside the pool";
+            }
+            for (uint32_t i = 0; i < v->count; i++) {
+                if (check_string(v->v.list[i], buf, len, 1, text) != 0) {
+                    return "bad list item";
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+static void put(uint8_t* blob, size_t* off, const void* data, size_t n) {
+    memcpy(blob + *off, data, n);
+    *off += n;
+}
+
+// The blob tools/mkconfig.py would write for the values set in 'cfg'
+static size_t write_blob(const config_t* cfg, uint8_t* blob, size_t cap) {
+    config_blob_header_t hdr = { CONFIG_BLOB_MAGIC, CONFIG_BLOB_VERSION, 0, 0,
+                                 config_schema(), 0 };
+    size_t off = sizeof(hdr);
+
+    for (uint32_t k = 0; k < CONFIG_NUM_KEYS; k++) {
+        const config_value_t* v = &cfg->values[k];
+        uint8_t payload[MAX_INPUT + 4];
+        size_t n = 0;
+        if (!v->set) {
+            continue;
+        }
+        if (v->type == CONFIG_TYPE_INT || v->type == CONFIG_TYPE_BOOL) {
+            put(payload, &n, &v->v.i, 4);
+        } else if (v->type == CONFIG_TYPE_STRING) {
+            put(payload, &n, v->v.s, strlen(v->v.s) + 1);
+        } else {
+            for (uint32_t i = 0; i < v->count; i++) {
+                put(payload, &n, v->v.list[i], strlen(v->v.list[i]) + 1);
+            }
+        }
+        config_record_t rec = { config_hash(config_key_name(k)), v->type,
+                                (uint8_t)v->count, (uint16_t)n };
+        size_t padded = (n + 3) & ~(size_t)3;
+        if (off + sizeof(rec) + padded > cap) {
+            return 0;
+        }
+        put(blob, &off, &rec, sizeof(rec));
+        memset(payload + n, 0, padded - n);
+        put(blob, &off, payload, padded);
+        hdr.count++;
+    }
+    hdr.size = (uint32_t)off;
+    hdr.checksum = crc32(0, blob + sizeof(hdr), off - sizeof(hdr));
+    memcpy(blob, &hdr, sizeof(hdr));
+    return off;
+}
+
+static int same_values(const config_t* a, const config_t* b) {
+    for (uint32_t k = 0; k < CONFIG_NUM_KEYS; k++) {
+        const config_value_t* x = &a->values[k];
+        const config_value_t* y = &b->values[k];
+        if (x->type == CONFIG_TYPE_STRING) {
+            if (strcmp(x->v.s, y->v.s) != 0) {
+                return 0;
+            }
+        } else if (x->type == CONFIG_TYPE_LIST) {
+            if (x->count != y->count) {
+                return 0;
+            }
+            for (uint32_t i = 0; i < x->count; i++) {
+                if (strcmp(x->v.list[i], y->v.list[i]) != 0) {
+                    return 0;
+                }
+            }
+        } else if (x->v.i != y->v.i) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Inputs that once got through, checked before the random ones
+static void fixed_cases(void) {
+    // "menu.nxjjjlb" has the FNV-1a hash of "menu.advanced"
+    static const char collision[] = "[menu]\nnxjjjlb = true\n";
+    char* text = malloc(sizeof(collision));
+    memcpy(text, collision, sizeof(collision));
+    config_t cfg;
+    config_defaults(&cfg);
+    if (config_parse(&cfg, text, sizeof(collision) - 1, NULL) != 1 ||
+        cfg.values[CONFIG_MENU_ADVANCED].set) {
+        fail("unknown key with a known key's hash accepted", 0, collision, sizeof(collision) - 1);
+    }
+    free(text);
+
+    // A BOOL record with no payload, last in a blob of exactly its size
+    config_blob_header_t hdr = { CONFIG_BLOB_MAGIC, CONFIG_BLOB_VERSION, 1, 0,
+                                 config_schema(), 0 };
+    config_record_t rec = { config_hash("menu.advanced"), CONFIG_TYPE_BOOL, 0, 0 };
+    hdr.size = sizeof(hdr) + sizeof(rec);
+    hdr.checksum = crc32(0, &rec, sizeof(rec));
+    uint8_t* blob = malloc(hdr.size);
+    memcpy(blob, &hdr, sizeof(hdr));
+    memcpy(blob + sizeof(hdr), &rec, sizeof(rec));
+    config_defaults(&cfg);
+    if (config_load_blob(&cfg, blob, hdr.size) == 0) {
+        fail("empty BOOL record accepted", 0, (const char*)blob, hdr.size);
+    }
+    free(blob);
+}
+
+static char* read_file(const char* path, size_t* size) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    char* buf = malloc(MAX_INPUT);
+    *size = buf ? fread(buf, 1, MAX_INPUT, f) : 0;
+    fclose(f);
+    return buf;
+}
+
+int main(int argc, char** argv) {
+    const char* seeds[MAX_SEEDS];
+    size_t seed_len[MAX_SEEDS];
+    int num_seeds = 0;
+    int num_files;
+    uint32_t iterations = 200000;
+    uint32_t accepted = 0;
+    uint32_t blobs_accepted = 0;
+    config_t def, cfg, back;
+
+    rng_state = 0x2201;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            iterations = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            rng_state = (uint32_t)strtoul(argv[++i], NULL, 0) | 1;
+        } else if (num_seeds < MAX_SEEDS) {
+            char* data = read_file(argv[i], &seed_len[num_seeds]);
+            if (!data) {
+                fprintf(stderr, "Cannot read %s\n", argv[i]);
+                return 1;
+            }
+            seeds[num_seeds++] = data;
+        }
+    }
+    num_files = num_seeds;
+    for (size_t i = 0; i < sizeof(builtin_seeds) / sizeof(builtin_seeds[0]) &&
+                       num_seeds < MAX_SEEDS; i++) {
+        seed_len[num_seeds] = strlen(builtin_seeds[i]);
+        seeds[num_seeds++] = builtin_seeds[i];
+    }
+
+    fixed_cases();
+    config_defaults(&def);
+    for (uint32_t iter = 0; iter < iterations; iter++) {
+        char work[MAX_INPUT];
+        int s = (int)(rng() % (uint32_t)num_seeds);
+        size_t len = seed_len[s];
+        memcpy(work, seeds[s], len);
+        if (iter) {
+            len = mutate(work, len, sizeof(work));
+        }
+
+        // Exactly len + 1 bytes: the parser may write the terminator
+        char* buf = malloc(len + 1);
+        memcpy(buf, work, len);
+        buf[len] = 'X';
+        config_defaults(&cfg);
+        uint32_t bad_line;
+        if (config_parse(&cfg, buf, (uint32_t)len, &bad_line) == 0) {
+            accepted++;
+        }
+        const char* err = check_table(&cfg, &def, buf, len, 1);
+        if (err) {
+            fail(err, iter, work, len);
+        }
+
+        // Round trip through a blob, then damage it
+        static uint8_t blob[2 * MAX_INPUT] __attribute__((aligned(4)));
+        size_t blob_len = write_blob(&cfg, blob, sizeof(blob));
+        if (blob_len) {
+            config_defaults(&back);
+            if (config_load_blob(&back, blob, (uint32_t)blob_len) != 0) {
+                fail("own blob rejected", iter, work, len);
+            }
+            if (!same_values(&cfg, &back)) {
+                fail("blob round trip differs", iter, work, len);
+            }
+
+            uint8_t* copy = malloc(blob_len);
+            memcpy(copy, blob, blob_len);
+            size_t n = 1 + rng() % 4;
+            while (n--) {
+                copy[rng() % blob_len] = (uint8_t)rng();
+            }
+            config_blob_header_t* hdr = (config_blob_header_t*)copy;
+            hdr->checksum = crc32(0, copy + sizeof(*hdr), blob_len - sizeof(*hdr));
+            config_defaults(&back);
+            if (config_load_blob(&back, copy, (uint32_t)blob_len) == 0) {
+                blobs_accepted++;
+                err = check_table(&back, &def, (const char*)copy, blob_len - 1, 0);
+                if (err) {
+                    fail(err, iter, work, len);
+                }
+            }
+            free(copy);
+        }
+        free(buf);
+    }
+
+    for (int i = 0; i < num_files; i++) {
+        free((void*)seeds[i]);
+    }
+    printf("%u iterations: %u inputs without bad lines, %u damaged blobs accepted\n",
+           iterations, accepted, blobs_accepted);
+    return 0;
+}
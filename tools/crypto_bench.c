@@ -0,0 +1,264 @@
+// tools/crypto_bench.c - Host test vectors and benchmark for src/crypto.c
+//
+// Checks SHA-256, SHA-512 and Ed25519 against the FIPS 180 and RFC 8032
+// vectors, then times SHA-256 over a buffer fed in LOAD_CHUNK sized
+// pieces, as the loader does, and one signature verification. Build
+// with `make bench`.
+//
+//   crypto_bench [-n iterations] [-s megabytes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "crypto.h"
+
+#define CHUNK_SIZE      0x8000
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLES     1
+static uint64_t read_cycles(void) { return __rdtsc(); }
+#else
+#define HAVE_CYCLES     0
+static uint64_t read_cycles(void) { return 0; }
+#endif
+
+typedef struct {
+    const char* seed;           // Unused by the bootloader, kept for reference
+    const char* pub;
+    const char* msg;
+    const char* sig;
+} ed25519_vector_t;
+
+// RFC 8032 section 7.1, tests 1-3
+static const ed25519_vector_t ed25519_vectors[] = {
+    { "9d61b19deffd5a60ba844af492ec2cc44449c5697b326919703bac031cae7f60",
+      "d75a980182b10ab7d54bfed3c964073a0ee172f3daa62325af021a68f707511a",
+      "",
+      "e5564300c360ac729086e2cc806e828a84877f1eb8e5d974d873e065224901555"
+      "fb8821590a33bacc61e39701cf9b46bd25bf5f0595bbe24655141438e7a100b" },
+    { "4ccd089b28ff96da9db6c346ec114e0f5b8a319f35aba624da8cf6ed4fb8a6fb",
+      "3d4017c3e843895a92b70aa74d1b7ebc9c982ccf2ec4968cc0cd55f12af4660c",
+      "72",
+      "92a009a9f0d4cab8720e820b5f642540a2b27b5416503f8fb3762223ebdb69da0"
+      "85ac1e43e15996e458f3613d0f11d8c387b2eaeb4302aeeb00d291612bb0c00" },
+    { "c5aa8df43f9f837bedb7442f31dcb7b166d38535076f094b85ce3a2e0b4458f7",
+      "fc51cd8e6218a1a38da47ed00230f0580816ed13ba3303ac5deb911548908025",
+      "af82",
+      "6291d657deec24024827e69c3abe01a30ce548a284743a445e3680d7db5ac3ac1"
+      "8ff9b538d16f290ae67f760984dc6594a7c15e9716ed28dc027beceea1ec40a" },
+};
+
+static int failures;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t from_hex(uint8_t* out, const char* hex) {
+    size_t n = strlen(hex) / 2;
+    for (size_t i = 0; i < n; i++) {
+        unsigned int b;
+        sscanf(hex + i * 2, "%2x", &b);
+        out[i] = (uint8_t)b;
+    }
+    return n;
+}
+
+static void check(const char* name, const uint8_t* got, const char* want_hex) {
+    uint8_t want[64];
+    size_t n = from_hex(want, want_hex);
+    int ok = memcmp(got, want, n) == 0;
+    printf("  %-32s %s\n", name, ok ? "ok" : "FAIL");
+    failures += !ok;
+}
+
+static void check_rc(const char* name, int rc, int want) {
+    int ok = rc == want;
+    printf("  %-32s %s\n", name, ok ? "ok" : "FAIL");
+    failures += !ok;
+}
+
+static void sha256_vectors(void) {
+    sha256_ctx_t ctx;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    static uint8_t million[1000000];
+
+    sha256_init(&ctx);
+    sha256_final(&ctx, digest);
+    check("sha256 \"\"", digest,
+          "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, "abc", 3);
+    sha256_final(&ctx, digest);
+    check("sha256 \"abc\"", digest,
+          "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 56);
+    sha256_final(&ctx, digest);
+    check("sha256 448-bit", digest,
+          "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+    // Odd update sizes exercise the partial block path
+    memset(million, 'a', sizeof(million));
+    sha256_init(&ctx);
+    for (size_t off = 0, step = 1; off < sizeof(million); off += step, step = step * 3 % 997 + 1) {
+        size_t n = sizeof(million) - off < step ? sizeof(million) - off : step;
+        sha256_update(&ctx, million + off, n);
+    }
+    sha256_final(&ctx, digest);
+    check("sha256 1M 'a'", digest,
+          "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+static void sha512_vectors(void) {
+    sha512_ctx_t ctx;
+    uint8_t digest[SHA512_DIGEST_SIZE];
+
+    sha512_init(&ctx);
+    sha512_final(&ctx, digest);
+    check("sha512 \"\"", digest,
+          "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
+          "47d0d13c5d85f2b0ff8318d2877eec2f63b931bd47417a81a538327af927da3e");
+
+    sha512_init(&ctx);
+    sha512_update(&ctx, "abc", 3);
+    sha512_final(&ctx, digest);
+    check("sha512 \"abc\"", digest,
+          "ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a"
+          "2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f");
+}
+
+static void ed25519_vectors_run(void) {
+    for (size_t i = 0; i < sizeof(ed25519_vectors) / sizeof(ed25519_vectors[0]); i++) {
+        const ed25519_vector_t* v = &ed25519_vectors[i];
+        uint8_t pub[ED25519_KEY_SIZE], sig[ED25519_SIG_SIZE], msg[8] = { 0 };
+        char name[40];
+
+        from_hex(pub, v->pub);
+        from_hex(sig, v->sig);
+        size_t len = from_hex(msg, v->msg);
+
+        snprintf(name, sizeof(name), "ed25519 rfc8032 test %zu", i + 1);
+        check_rc(name, ed25519_verify(sig, msg, len, pub), 0);
+
+        // Any flipped bit in R, S or the message must be rejected
+        sig[5] ^= 0x01;
+        snprintf(name, sizeof(name), "ed25519 test %zu bad R", i + 1);
+        check_rc(name, ed25519_verify(sig, msg, len, pub), -1);
+        sig[5] ^= 0x01;
+        sig[40] ^= 0x80;
+        snprintf(name, sizeof(name), "ed25519 test %zu bad S", i + 1);
+        check_rc(name, ed25519_verify(sig, msg, len, pub), -1);
+        sig[40] ^= 0x80;
+        msg[0] ^= 0x01;
+        snprintf(name, sizeof(name), "ed25519 test %zu bad message", i + 1);
+        check_rc(name, ed25519_verify(sig, msg, len + (len == 0), pub), -1);
+    }
+
+    // S >= L is malleable and rejected outright
+    uint8_t pub[ED25519_KEY_SIZE], sig[ED25519_SIG_SIZE];
+    from_hex(pub, ed25519_vectors[0].pub);
+    from_hex(sig, ed25519_vectors[0].sig);
+    memset(sig + 32, 0xFF, 32);
+    check_rc("ed25519 non-canonical S", ed25519_verify(sig, NULL, 0, pub), -1);
+}
+
+static void bench_sha256(int iterations, size_t size) {
+    uint8_t* data = malloc(size);
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    double best = 0;
+    uint64_t best_cycles = 0;
+
+    if (!data) {
+        return;
+    }
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (uint8_t)(i * 2654435761u >> 24);
+    }
+
+    for (int n = 0; n < iterations; n++) {
+        sha256_ctx_t ctx;
+        double start = now_seconds();
+        uint64_t c0 = read_cycles();
+
+        sha256_init(&ctx);
+        for (size_t off = 0; off < size; off += CHUNK_SIZE) {
+            size_t len = size - off < CHUNK_SIZE ? size - off : CHUNK_SIZE;
+            sha256_update(&ctx, data + off, len);
+        }
+        sha256_final(&ctx, digest);
+
+        uint64_t cycles = read_cycles() - c0;
+        double elapsed = now_seconds() - start;
+        if (n == 0 || elapsed < best) {
+            best = elapsed;
+            best_cycles = cycles;
+        }
+    }
+
+    printf("  sha256 %zu bytes: %.1f MB/s", size, size / best / 1e6);
+    if (HAVE_CYCLES) {
+        printf(", %.2f cycles/byte", (double)best_cycles / size);
+    }
+    printf("\n");
+    free(data);
+}
+
+static void bench_ed25519(int iterations) {
+    uint8_t pub[ED25519_KEY_SIZE], sig[ED25519_SIG_SIZE], msg[8];
+    double best = 0;
+
+    from_hex(pub, ed25519_vectors[1].pub);
+    from_hex(sig, ed25519_vectors[1].sig);
+    size_t len = from_hex(msg, ed25519_vectors[1].msg);
+
+    for (int n = 0; n < iterations; n++) {
+        double start = now_seconds();
+        ed25519_verify(sig, msg, len, pub);
+        double elapsed = now_seconds() - start;
+        if (n == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    printf("  ed25519 verify: %.2f ms\n", best * 1e3);
+}
+
+int main(int argc, char** argv) {
+    int iterations = 10;
+    size_t size = 16u * 1024 * 1024;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-n") == 0) {
+            iterations = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            size = (size_t)atoi(argv[i + 1]) * 1024 * 1024;
+        } else {
+            break;
+        }
+    }
+    if (iterations <= 0 || size == 0 || (argc > 1 && argc % 2 == 0)) {
+        fprintf(stderr, "usage: %s [-n iterations] [-s megabytes]\n", argv[0]);
+        return 2;
+    }
+
+    printf("Test vectors:\n");
+    sha256_vectors();
+    sha512_vectors();
+    ed25519_vectors_run();
+
+    printf("Benchmark:\n");
+    bench_sha256(iterations, size);
+    bench_ed25519(iterations);
+
+    if (failures) {
+        printf("%d test vector(s) FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+// tools/decompress_bench.c - Host throughput benchmark for src/decompress.c
+//
+// Feeds each input file to the bootloader's decompressor in LOAD_CHUNK
+// sized pieces, as load_kernel() does with card reads, and reports the
+// output rate per codec. Build with `make bench`.
+//
+//   decompress_bench [-n iterations] file.lz4 file.gz ...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "decompress.h"
+
+#define CHUNK_SIZE      0x8000
+#define OUT_MAX         (256u * 1024 * 1024)
+
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    size_t offset;
+} bench_input_t;
+
+static int bench_refill(decomp_src_t* src) {
+    bench_input_t* in = src->ctx;
+    if (in->offset >= in->size) {
+        return -1;
+    }
+    size_t n = in->size - in->offset;
+    if (n > CHUNK_SIZE) {
+        n = CHUNK_SIZE;
+    }
+    src->pos = in->data + in->offset;
+    src->end = src->pos + n;
+    in->offset += n;
+    return 0;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint8_t* read_file(const char* path, size_t* size) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t* buf = malloc(len > 0 ? (size_t)len : 1);
+    if (buf && fread(buf, 1, (size_t)len, f) != (size_t)len) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    *size = (size_t)len;
+    return buf;
+}
+
+int main(int argc, char** argv) {
+    int iterations = 10;
+    int first = 1;
+    int rc = 0;
+
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        iterations = atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc || iterations <= 0) {
+        fprintf(stderr, "usage: %s [-n iterations] file...\n", argv[0]);
+        return 2;
+    }
+
+    uint8_t* out = malloc(OUT_MAX);
+    if (!out) {
+        return 1;
+    }
+
+    printf("%-6s %10s %10s %10s %10s  %s\n",
+           "codec", "in", "out", "MB/s out", "MB/s in", "file");
+
+    for (int i = first; i < argc; i++) {
+        size_t size;
+        uint8_t* data = read_file(argv[i], &size);
+        if (!data) {
+            fprintf(stderr, "%s: cannot read\n", argv[i]);
+            rc = 1;
+            continue;
+        }
+
+        int codec = decomp_detect(data, (uint32_t)size);
+        if (codec == CODEC_NONE) {
+            fprintf(stderr, "%s: not LZ4 frame or gzip\n", argv[i]);
+            free(data);
+            rc = 1;
+            continue;
+        }
+
+        int produced = 0;
+        double best = 0;
+        for (int n = 0; n < iterations; n++) {
+            bench_input_t in = { data, size, 0 };
+            decomp_src_t src = { NULL, NULL, bench_refill, &in };
+
+            double start = now_seconds();
+            produced = decomp_run(codec, &src, out, OUT_MAX);
+            double elapsed = now_seconds() - start;
+
+            if (produced < 0) {
+                break;
+            }
+            if (n == 0 || elapsed < best) {
+                best = elapsed;
+            }
+        }
+
+        if (produced < 0) {
+            fprintf(stderr, "%s: decompression failed\n", argv[i]);
+            rc = 1;
+        } else {
+            printf("%-6s %10zu %10d %10.1f %10.1f  %s\n",
+                   decomp_codec_name(codec), size, produced,
+                   produced / best / 1e6, size / best / 1e6, argv[i]);
+        }
+        free(data);
+    }
+
+    free(out);
+    return rc;
+}
@@ -0,0 +1,308 @@
+// tools/format_bench.c - Host conformance checks and benchmark for src/format.c
+//
+// Compares format_snprintf() with the C library's snprintf: a table of
+// edge cases, every truncation length of a few lines, and random
+// conversions built from all the flags, widths, precisions and length
+// modifiers format.c accepts, with random (mostly 64-bit) arguments.
+// Then times both on the lines the bootloader prints most, and
+// format_vprint() into a sink that drops the text, as term_printf does
+// while muted. Build with `make bench`.
+//
+//   format_bench [-n iterations] [-s seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include "format.h"
+
+#define OUT_SIZE        512
+
+static int failures;
+static int checks;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+// Random value with a random number of significant bits, so every digit
+// count turns up
+static uint64_t rng_value(void) {
+    int bits = (int)(rng() % 65);
+    return bits ? rng() >> (64 - bits) : 0;
+}
+
+static void check_args(const char* fmt, va_list args) {
+    char got[OUT_SIZE], want[OUT_SIZE];
+    va_list a;
+
+    va_copy(a, args);
+    int got_n = format_vsnprintf(got, sizeof(got), fmt, a);
+    int want_n = vsnprintf(want, sizeof(want), fmt, args);
+    va_end(a);
+
+    checks++;
+    if (got_n != want_n || strcmp(got, want) != 0) {
+        if (failures < 20) {
+            printf("  FAIL \"%s\": got \"%s\" (%d), want \"%s\" (%d)\n",
+                   fmt, got, got_n, want, want_n);
+        }
+        failures++;
+    }
+}
+
+static __attribute__((format(printf, 1, 2))) void check(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    check_args(fmt, args);
+    va_end(args);
+}
+
+// Formats the compiler would warn about, on purpose
+static void check_odd(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    check_args(fmt, args);
+    va_end(args);
+}
+
+static void edge_cases(void) {
+    static const char long_text[] =
+        "RobCo Industries (TM) Termlink Protocol - Enter password now";
+
+    check("plain text");
+    check("%%");
+    check("100%% done%%");
+    check("[%d] [%i] [%d] [%d]", 0, 42, -42, INT_MIN);
+    check("[%u] [%u] [%u]", 0u, 1234567890u, UINT_MAX);
+    check("[%x] [%X] [%o]", 0xDEADBEEFu, 0xDEADBEEFu, 0755u);
+    check("[%08X] [%08x] [%8X] [%-8X]", 0x12345u, 0xABCu, 0x1Fu, 0x1Fu);
+    check("[%02X] [%04X] [%016llX]", 0xAu, 0x10000u, 0x0123456789ABCDEFull);
+    check("[%5d] [%-5d] [%05d] [%+d] [% d] [%+5d] [%-+5d]", 42, 42, 42, 42, 42, 42, 42);
+    check("[%05d] [%+05d] [% 05d] [%05d]", -42, 42, 42, 0);
+    check("[%.3d] [%.3d] [%8.3d] [%-8.3d]", 7, -7, 7, -7);
+    check_odd("[%08.3d] [%y] [%5k]", 7, 1, 2);
+    check("[%.0d] [%.0u] [%.0x] [%5.0d] [%+.0d]", 0, 0u, 0u, 0, 0);
+    check("[%#x] [%#X] [%#o] [%#x] [%#o] [%#.3o] [%#.0o]", 255u, 255u, 8u, 0u, 0u, 8u, 0u);
+    check("[%#010x] [%#-10x] [%#10.4x]", 0xBEEFu, 0xBEEFu, 0xBEEFu);
+    check("[%*d] [%-*d] [%*d] [%.*d] [%.*d]", 6, 1, 6, 1, -6, 1, 4, 9, -1, 9);
+    check("[%c] [%3c] [%-3c]", 'A', 'B', 'C');
+    check("[%s] [%10s] [%-10s] [%.3s] [%10.3s] [%-*.*s]", "abc", "abc", "abc",
+          "abcdef", "abcdef", 8, 2, "abcdef");
+    check("[%s]", long_text);
+    check("[%s]", "");
+    check("[%p] [%20p] [%-20p]", (void*)0x8000, (void*)0x8000, (void*)&failures);
+    check("[%p] [%10p]", (void*)0, (void*)0);
+    check("[%hhd] [%hhu] [%hd] [%hu] [%hx]", 300, 300, 70000, 70000, 0x12345);
+    check("[%ld] [%lu] [%lx]", LONG_MIN, ULONG_MAX, ULONG_MAX);
+    check("[%lld] [%llu] [%llx] [%llo]", LLONG_MIN, ULLONG_MAX, ULLONG_MAX, ULLONG_MAX);
+    check("[%jd] [%zu] [%zd] [%td]", (intmax_t)-1, (size_t)123456, (ssize_t)-5, (ptrdiff_t)-9);
+    check("RAM: 0x%08X-0x%08X, %d MB (%s)\n", 0u, 0x1C000000u, 448, "firmware");
+    check("%11u%11u  %s\n", 123456u, 7u, "fs_read");
+    check("  %-13s%6u%11u%11u\n", "extent", 42u, 199999u, 4000000000u);
+
+    // Decimal conversion around every power of ten
+    uint64_t p = 1;
+    for (int i = 0; i < 20; i++) {
+        check("%llu %llu %llu", (unsigned long long)(p - 1), (unsigned long long)p,
+              (unsigned long long)(p + 1));
+        check("%u %u %u", (unsigned)(p - 1), (unsigned)p, (unsigned)(p + 1));
+        p *= 10;
+    }
+}
+
+// Every buffer size from 0 to past the end of each line
+static void truncation(void) {
+    static const char* const lines[] = {
+        "Loading %s: %d bytes at 0x%08X (%x)\n",
+        "%-20s|%+08d|%#x",
+    };
+
+    for (size_t l = 0; l < sizeof(lines) / sizeof(lines[0]); l++) {
+        for (size_t size = 0; size < 48; size++) {
+            char got[64], want[64];
+            memset(got, '#', sizeof(got));
+            memset(want, '#', sizeof(want));
+            int got_n = format_snprintf(got, size, lines[l], "/boot/uos.img", 123456, 0x80000u, 0xBEEFu);
+            int want_n = snprintf(want, size, lines[l], "/boot/uos.img", 123456, 0x80000u, 0xBEEFu);
+            checks++;
+            if (got_n != want_n || memcmp(got, want, sizeof(got)) != 0) {
+                printf("  FAIL truncation of \"%s\" to %zu bytes\n", lines[l], size);
+                failures++;
+            }
+        }
+    }
+}
+
+static void random_conversions(int iterations) {
+    static const char flags[] = "-0+ #";
+    static const char* const lengths[] = { "", "hh", "h", "l", "ll", "j", "z", "t" };
+    static const char convs[] = "diuoxXcsp";
+
+    for (int n = 0; n < iterations; n++) {
+        char fmt[48];
+        char* f = fmt;
+        char conv = convs[rng() % (sizeof(convs) - 1)];
+        const char* length = "";
+
+        *f++ = '%';
+        for (int i = 0; i < 5; i++) {
+            if (rng() % 3 == 0) {
+                *f++ = flags[i];
+            }
+        }
+        if (rng() % 2) {
+            f += sprintf(f, "%d", (int)(rng() % 30));
+        }
+        if (rng() % 2) {
+            f += sprintf(f, ".%d", (int)(rng() % 25));
+        }
+        if (conv != 'c' && conv != 's' && conv != 'p') {
+            length = lengths[rng() % (sizeof(lengths) / sizeof(lengths[0]))];
+        }
+        f += sprintf(f, "%s%c|", length, conv);
+        *f = '\0';
+
+        // The C library leaves some flag and conversion pairs undefined;
+        // check only the ones it defines
+        if (((conv == 'c' || conv == 'p') && strpbrk(fmt, "0+ #.")) ||
+            (conv == 's' && strpbrk(fmt, "0+ #")) ||
+            (strchr(fmt, '#') && !strchr("oxX", conv))) {
+            continue;
+        }
+
+        uint64_t v = rng_value();
+        static const char* const strings[] = { "", "a", "holotape", "/boot/pipos.img" };
+        if (conv == 'c') {
+            check(fmt, (int)(v % 95) + ' ');
+        } else if (conv == 's') {
+            check(fmt, strings[v % 4]);
+        } else if (conv == 'p') {
+            check(fmt, (void*)(uintptr_t)v);
+        } else if (!strcmp(length, "ll") || !strcmp(length, "j")) {
+            check(fmt, (long long)v);
+        } else if (!strcmp(length, "l")) {
+            check(fmt, (long)v);
+        } else if (!strcmp(length, "z") || !strcmp(length, "t")) {
+            check(fmt, (size_t)v);
+        } else {
+            check(fmt, (int)v);
+        }
+    }
+}
+
+static void null_sink(void* ctx, const char* s, uint32_t len) {
+    (void)s;
+    *(uint32_t*)ctx += len;
+}
+
+static void vprint_null(uint32_t* total, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    format_vprint(null_sink, total, fmt, args);
+    va_end(args);
+}
+
+typedef enum { BENCH_FORMAT, BENCH_LIBC, BENCH_SINK } bench_kind_t;
+
+// Best of 'iterations' runs of 'calls' lines
+static double bench_line(bench_kind_t kind, int line, int iterations, int calls, uint32_t* bytes) {
+    char out[128];
+    double best = 0;
+
+    for (int n = 0; n < iterations; n++) {
+        uint32_t total = 0;
+        double start = now_seconds();
+        for (int i = 0; i < calls; i++) {
+            uint32_t v = (uint32_t)i * 2654435761u;
+            if (line == 0) {
+                if (kind == BENCH_FORMAT) {
+                    total += format_snprintf(out, sizeof(out), "Loading %s: %d bytes at 0x%08X (%x)\n",
+                                             "/boot/uos.img", i, v, v);
+                } else if (kind == BENCH_LIBC) {
+                    total += snprintf(out, sizeof(out), "Loading %s: %d bytes at 0x%08X (%x)\n",
+                                      "/boot/uos.img", i, v, v);
+                } else {
+                    vprint_null(&total, "Loading %s: %d bytes at 0x%08X (%x)\n",
+                                "/boot/uos.img", i, v, v);
+                }
+            } else {
+                if (kind == BENCH_FORMAT) {
+                    total += format_snprintf(out, sizeof(out), "%11u%11u%11u%11u\n", v, v >> 7, v >> 15, i);
+                } else if (kind == BENCH_LIBC) {
+                    total += snprintf(out, sizeof(out), "%11u%11u%11u%11u\n", v, v >> 7, v >> 15, i);
+                } else {
+                    vprint_null(&total, "%11u%11u%11u%11u\n", v, v >> 7, v >> 15, i);
+                }
+            }
+            __asm__ volatile("" : : "r"(out) : "memory");
+        }
+        double elapsed = now_seconds() - start;
+        if (n == 0 || elapsed < best) {
+            best = elapsed;
+        }
+        *bytes = total;
+    }
+    return best;
+}
+
+static void bench(int iterations) {
+    static const char* const names[] = { "load line", "decimal columns" };
+    static const char* const kinds[] = { "format_snprintf", "libc snprintf", "format_vprint sink" };
+    const int calls = 200000;
+
+    for (int line = 0; line < 2; line++) {
+        for (int kind = 0; kind < 3; kind++) {
+            uint32_t bytes = 0;
+            double t = bench_line((bench_kind_t)kind, line, iterations, calls, &bytes);
+            printf("  %-16s %-19s %6.1f ns/line, %6.1f MB/s\n",
+                   names[line], kinds[kind], t * 1e9 / calls, bytes / t / 1e6);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    int iterations = 10;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-n") == 0) {
+            iterations = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            rng_state = strtoull(argv[i + 1], NULL, 0) | 1;
+        } else {
+            break;
+        }
+    }
+    if (iterations <= 0 || (argc > 1 && argc % 2 == 0)) {
+        fprintf(stderr, "usage: %s [-n iterations] [-s seed]\n", argv[0]);
+        return 2;
+    }
+
+    printf("Conformance:\n");
+    edge_cases();
+    truncation();
+    random_conversions(200000);
+    printf("  %d checks, %d failed\n", checks, failures);
+
+    printf("Benchmark:\n");
+    bench(iterations);
+
+    if (failures) {
+        printf("%d conformance check(s) FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""
+menu_bytes.py - Console bytes per menu interaction
+Copyright 2201-2203 Robco Ind.
+
+Runs the host build with the boot menu shown, sends it a fixed series of
+keys one at a time and counts the bytes the console sends back for each,
+waiting for the output to go quiet in between. At 115200 baud a byte
+takes about 87 us, so the table shows what each key costs on a serial
+console. Fails when an arrow key costs more than --limit bytes, which
+catches a menu that redraws the whole page again.
+
+    menu_bytes.py [--limit N] build/host/mfboot-host sd.img
+"""
+
+import os
+import sys
+import time
+import select
+import argparse
+import subprocess
+
+DEFAULT_LIMIT = 200
+QUIET_S = 0.5
+BAUD_US_PER_BYTE = 10 * 1000000 / 115200
+
+KEY_UP = b'\x1b[A'
+KEY_DOWN = b'\x1b[B'
+
+# (name, keys, arrow key?, seconds of quiet that end it); leaving the
+# maintenance menu pauses for a second before the boot menu comes back
+INTERACTIONS = [
+    ('down', KEY_DOWN, True, QUIET_S),
+    ('down', KEY_DOWN, True, QUIET_S),
+    ('up', KEY_UP, True, QUIET_S),
+    ('maintenance', b'm', False, QUIET_S),
+    ('back to menu', b'4', False, 1.5),
+]
+
+CLEAR = b'\x1b[2J'
+
+
+def read_quiet(proc, quiet=QUIET_S, limit=10.0):
+    """Read stdout until nothing arrives for 'quiet' seconds."""
+    data = b''
+    fd = proc.stdout.fileno()
+    end = time.monotonic() + limit
+    while time.monotonic() < end:
+        ready, _, _ = select.select([fd], [], [], quiet)
+        if not ready:
+            break
+        chunk = os.read(fd, 65536)
+        if not chunk:
+            break
+        data += chunk
+    return data
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[1])
+    parser.add_argument('-l', '--limit', type=int, default=DEFAULT_LIMIT,
+                        help=f'bytes an arrow key may cost (default {DEFAULT_LIMIT})')
+    parser.add_argument('host', help='mfboot-host binary')
+    parser.add_argument('image', help='disk image')
+    args = parser.parse_args()
+
+    proc = subprocess.Popen([args.host, '-m', args.image], stdin=subprocess.PIPE,
+                            stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+    results = []
+    try:
+        # The boot log and the first draw of the menu, which starts with
+        # a clear
+        startup = read_quiet(proc)
+        pos = startup.rfind(CLEAR)
+        if pos < 0:
+            print('menu_bytes: no menu in the console output', file=sys.stderr)
+            return 1
+        results.append(('first draw', len(startup) - pos, False))
+
+        for name, keys, arrow, quiet in INTERACTIONS:
+            proc.stdin.write(keys)
+            proc.stdin.flush()
+            results.append((name, len(read_quiet(proc, quiet)), arrow))
+    finally:
+        proc.stdin.close()
+        proc.wait(timeout=10)
+
+    failed = 0
+    print(f'{"interaction":<16}{"bytes":>8}{"ms @115200":>12}')
+    for name, count, arrow in results:
+        over = arrow and count > args.limit
+        failed |= over
+        print(f'{name:<16}{count:>8}{count * BAUD_US_PER_BYTE / 1000:>12.1f}'
+              + ('  > limit' if over else ''))
+    if failed:
+        print(f'menu_bytes: an arrow key sent more than {args.limit} bytes', file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
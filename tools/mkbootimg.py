@@ -5,6 +5,7 @@ Copyright 2201-2203 Robco Ind.
 """
 
 import sys
+import gzip
 import struct
 import argparse
 from pathlib import Path
@@ -12,7 +13,175 @@ from pathlib import Path
 # Boot image magic number
 BOOT_MAGIC = 0x544F4F42  # "BOOT"
 
-def create_boot_image(kernel_path, output_path, load_addr=0x8000, boot_type=0):
+# Header version: 1.1 adds the codec in bits 15:8 of the type word,
+# 2.0 replaces the single payload with a section table
+BOOT_VERSION = 0x00010001
+BOOT_VERSION_2 = 0x00020000
+
+# v2 section kinds (must match include/loader.h)
+SECTION_KERNEL = 1
+SECTION_INITRD = 2
+SECTION_DTB = 3
+
+SECTOR_SIZE = 512
+
+# Payload codecs (must match include/decompress.h)
+CODECS = {'none': 0, 'lz4': 1, 'gzip': 2}
+
+LZ4_FRAME_MAGIC = 0x184D2204
+LZ4_BLOCK_MAX = 4 * 1024 * 1024     # Block maximum size id 7
+LZ4_MIN_MATCH = 4
+LZ4_LAST_LITERALS = 5               # Format rule: a block ends in >= 5 literals
+LZ4_MATCH_LIMIT = 12                # ... and no match starts in its last 12 bytes
+
+XXH_PRIME32 = (0x9E3779B1, 0x85EBCA77, 0xC2B2AE3D, 0x27D4EB2F, 0x165667B1)
+
+def _rotl32(x, r):
+    return ((x << r) | (x >> (32 - r))) & 0xFFFFFFFF
+
+def xxh32(data, seed=0):
+    """XXH32, used for the LZ4 frame descriptor checksum."""
+    p1, p2, p3, p4, p5 = XXH_PRIME32
+    n = len(data)
+    i = 0
+    if n >= 16:
+        v = [(seed + p1 + p2) & 0xFFFFFFFF, (seed + p2) & 0xFFFFFFFF,
+             seed, (seed - p1) & 0xFFFFFFFF]
+        while i + 16 <= n:
+            for k in range(4):
+                lane = struct.unpack_from('<I', data, i + 4 * k)[0]
+                v[k] = (_rotl32((v[k] + lane * p2) & 0xFFFFFFFF, 13) * p1) & 0xFFFFFFFF
+            i += 16
+        h = (_rotl32(v[0], 1) + _rotl32(v[1], 7) + _rotl32(v[2], 12) + _rotl32(v[3], 18))
+    else:
+        h = seed + p5
+    h = (h + n) & 0xFFFFFFFF
+    while i + 4 <= n:
+        h = (h + struct.unpack_from('<I', data, i)[0] * p3) & 0xFFFFFFFF
+        h = (_rotl32(h, 17) * p4) & 0xFFFFFFFF
+        i += 4
+    while i < n:
+        h = (h + data[i] * p5) & 0xFFFFFFFF
+        h = (_rotl32(h, 11) * p1) & 0xFFFFFFFF
+        i += 1
+    h ^= h >> 15
+    h = (h * p2) & 0xFFFFFFFF
+    h ^= h >> 13
+    h = (h * p3) & 0xFFFFFFFF
+    h ^= h >> 16
+    return h
+
+def _lz4_length(out, n):
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+
+def lz4_compress_block(data):
+    """Greedy single-probe LZ4 block compressor."""
+    n = len(data)
+    out = bytearray()
+    table = {}
+    anchor = 0
+    i = 0
+    limit = n - LZ4_MATCH_LIMIT
+    while i < limit:
+        key = data[i:i + 4]
+        ref = table.get(key)
+        table[key] = i
+        if ref is None or i - ref > 0xFFFF:
+            i += 1
+            continue
+
+        # Extend the match, keeping the mandatory literal tail
+        end = n - LZ4_LAST_LITERALS
+        m = i + 4
+        r = ref + 4
+        while m < end and data[m] == data[r]:
+            m += 1
+            r += 1
+
+        lit = i - anchor
+        match = m - i - LZ4_MIN_MATCH
+        out.append((min(lit, 15) << 4) | min(match, 15))
+        if lit >= 15:
+            _lz4_length(out, lit - 15)
+        out += data[anchor:i]
+        out += struct.pack('<H', i - ref)
+        if match >= 15:
+            _lz4_length(out, match - 15)
+
+        i = anchor = m
+
+    lit = n - anchor
+    out.append(min(lit, 15) << 4)
+    if lit >= 15:
+        _lz4_length(out, lit - 15)
+    out += data[anchor:]
+    return bytes(out)
+
+def lz4_compress_frame(data):
+    """LZ4 frame: independent 4 MB blocks, content size recorded."""
+    flg = 0x40 | 0x20 | 0x08        # Version 1, independent blocks, content size
+    bd = 7 << 4
+    desc = struct.pack('<BBQ', flg, bd, len(data))
+    out = bytearray(struct.pack('<I', LZ4_FRAME_MAGIC))
+    out += desc
+    out.append((xxh32(desc) >> 8) & 0xFF)
+
+    for pos in range(0, len(data), LZ4_BLOCK_MAX):
+        raw = data[pos:pos + LZ4_BLOCK_MAX]
+        block = lz4_compress_block(raw)
+        if len(block) >= len(raw):
+            out += struct.pack('<I', len(raw) | 0x80000000)
+            out += raw
+        else:
+            out += struct.pack('<I', len(block))
+            out += block
+
+    out += struct.pack('<I', 0)     # End mark
+    return bytes(out)
+
+def compress_payload(data, codec):
+    if codec == 'lz4':
+        return lz4_compress_frame(data)
+    if codec == 'gzip':
+        return gzip.compress(data, compresslevel=9, mtime=0)
+    return data
+
+def build_v2_image(sections, boot_type):
+    """
+    Assemble a v2 image: header, section table, then each section's
+    stored bytes padded to a sector boundary so the loader can DMA them.
+
+    Args:
+        sections: List of (kind, codec, data, load_addr) tuples
+        boot_type: Boot type
+    """
+    header_size = 24 + 24 * len(sections)
+    offset = (header_size + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1)
+    table = b''
+    payload = b''
+    for kind, codec, data, addr in sections:
+        table += struct.pack('<IIIIII', kind, CODECS[codec], offset, len(data), addr,
+                             sum(data) & 0xFFFFFFFF)
+        padded = data + b'\0' * (-len(data) % SECTOR_SIZE)
+        payload += padded
+        offset += len(padded)
+
+    header = struct.pack('<IIIIII',
+                         BOOT_MAGIC,                    # Magic
+                         BOOT_VERSION_2,                # Version 2.0
+                         boot_type,                     # Boot type
+                         header_size,                   # Header plus table
+                         len(sections),                 # Section count
+                         sum(table) & 0xFFFFFFFF)       # Table byte sum
+    head = header + table
+    return head + b'\0' * (-len(head) % SECTOR_SIZE) + payload
+
+def create_boot_image(kernel_path, output_path, load_addr=0x8000, boot_type=0,
+                      codec='none', initrd_path=None, initrd_addr=0,
+                      dtb_path=None, dtb_addr=0):
     """
     Create a boot image from a kernel file.
     
@@ -21,43 +190,53 @@ def create_boot_image(kernel_path, output_path, load_addr=0x8000, boot_type=0):
         output_path: Path to output boot image
         load_addr: Load address for kernel (default 0x8000)
         boot_type: Boot type (0=UOS, 1=PipOS, 2=Maint, 3=Diag)
+        codec: Payload compression ('none', 'lz4' or 'gzip')
+        initrd_path, dtb_path: Optional extra sections (v2 image)
+        initrd_addr, dtb_addr: Their load addresses (0 = loader decides)
     """
     try:
         # Read kernel file
         with open(kernel_path, 'rb') as f:
-            kernel_data = f.read()
+            raw_data = f.read()
         
+        kernel_data = compress_payload(raw_data, codec)
         kernel_size = len(kernel_data)
-        
-        # Create boot image header
-        # Format: magic (4), version (4), type (4), load_addr (4), size (4), checksum (4)
-        header = struct.pack('<IIIIII', 
-                           BOOT_MAGIC,      # Magic
-                           0x00010000,      # Version 1.0
-                           boot_type,       # Boot type
-                           load_addr,       # Load address
-                           kernel_size,     # Kernel size
-                           0)               # Checksum (placeholder)
-        
-        # Calculate simple checksum
         checksum = sum(kernel_data) & 0xFFFFFFFF
-        header = struct.pack('<IIIIII',
-                           BOOT_MAGIC,
-                           0x00010000,
-                           boot_type,
-                           load_addr,
-                           kernel_size,
-                           checksum)
+        
+        if initrd_path or dtb_path:
+            sections = [(SECTION_KERNEL, codec, kernel_data, load_addr)]
+            for kind, path, addr in ((SECTION_INITRD, initrd_path, initrd_addr),
+                                     (SECTION_DTB, dtb_path, dtb_addr)):
+                if path:
+                    sections.append((kind, 'none', Path(path).read_bytes(), addr))
+            image = build_v2_image(sections, boot_type)
+        else:
+            # Format: magic (4), version (4), type (4), load_addr (4), size (4), checksum (4)
+            # Size and checksum cover the stored (possibly compressed) payload
+            header = struct.pack('<IIIIII',
+                               BOOT_MAGIC,                          # Magic
+                               BOOT_VERSION,                        # Version 1.1
+                               boot_type | (CODECS[codec] << 8),    # Boot type, codec
+                               load_addr,                           # Load address
+                               kernel_size,                         # Payload size
+                               checksum)                            # Byte sum
+            image = header + kernel_data
         
         # Write boot image
         with open(output_path, 'wb') as f:
-            f.write(header)
-            f.write(kernel_data)
+            f.write(image)
         
         print(f"Boot image created: {output_path}")
-        print(f"  Kernel size: {kernel_size} bytes")
+        print(f"  Kernel size: {len(raw_data)} bytes")
+        if codec != 'none':
+            print(f"  Compressed ({codec}): {kernel_size} bytes "
+                  f"({100 * kernel_size // max(len(raw_data), 1)}%)")
         print(f"  Load address: 0x{load_addr:08X}")
         print(f"  Checksum: 0x{checksum:08X}")
+        if initrd_path:
+            print(f"  Initrd: {initrd_path} at 0x{initrd_addr:08X}")
+        if dtb_path:
+            print(f"  DTB: {dtb_path} at 0x{dtb_addr:08X}")
         
         return 0
         
@@ -73,14 +252,25 @@ def main():
                        help='Load address (default: 0x8000)')
     parser.add_argument('-t', '--type', type=int, choices=[0, 1, 2, 3], default=0,
                        help='Boot type: 0=UOS, 1=PipOS, 2=Maintenance, 3=Diagnostic')
+    parser.add_argument('-c', '--compress', choices=sorted(CODECS), default='none',
+                       help='Compress the payload (default: none)')
+    parser.add_argument('--initrd', help='Initial ramdisk (makes a v2 image)')
+    parser.add_argument('--initrd-addr', type=lambda x: int(x, 0), default=0,
+                       help='Initrd load address (default: chosen by the loader)')
+    parser.add_argument('--dtb', help='Device tree blob (makes a v2 image)')
+    parser.add_argument('--dtb-addr', type=lambda x: int(x, 0), default=0,
+                       help='DTB load address (default: chosen by the loader)')
     
     args = parser.parse_args()
     
-    if not Path(args.kernel).exists():
-        print(f"Error: Kernel file not found: {args.kernel}", file=sys.stderr)
-        return 1
+    for path in (args.kernel, args.initrd, args.dtb):
+        if path and not Path(path).exists():
+            print(f"Error: File not found: {path}", file=sys.stderr)
+            return 1
     
-    return create_boot_image(args.kernel, args.output, args.addr, args.type)
+    return create_boot_image(args.kernel, args.output, args.addr, args.type,
+                             args.compress, args.initrd, args.initrd_addr,
+                             args.dtb, args.dtb_addr)
 
 if __name__ == '__main__':
     sys.exit(main())
@@ -0,0 +1,173 @@
+#!/usr/bin/env python3
+"""
+mkconfig.py - Precompile boot configuration for MFBootAgent
+Copyright 2201-2203 Robco Ind.
+
+Parses config/bootmenu.conf and config/devices.conf the way src/config.c
+does and writes the values, already converted, as the blob the
+bootloader reads from /boot/config.bin instead of the text files:
+
+    mkconfig.py -o config.bin config/bootmenu.conf config/devices.conf
+
+Unlike the bootloader, which skips lines it does not understand, this
+fails on them, so a typo is caught when the card is built.
+"""
+
+import re
+import sys
+import struct
+import zlib
+import argparse
+
+# Blob framing (must match include/config.h)
+BLOB_MAGIC = 0x46434D46  # "MFCF"
+BLOB_VERSION = 1
+HEADER = struct.Struct('<IHHIII')
+RECORD = struct.Struct('<IBBH')
+
+TYPE_INT, TYPE_BOOL, TYPE_STRING, TYPE_LIST = range(4)
+
+# Key table in CONFIG_* order (must match src/config.c)
+KEYS = [
+    ('menu.timeout', TYPE_INT),
+    ('menu.default', TYPE_INT),
+    ('menu.advanced', TYPE_BOOL),
+    ('display.color_normal', TYPE_INT),
+    ('display.color_highlight', TYPE_INT),
+    ('display.color_error', TYPE_INT),
+    ('display.border', TYPE_BOOL),
+    ('display.show_timestamps', TYPE_BOOL),
+    ('security.password_required', TYPE_BOOL),
+    ('security.secure_boot', TYPE_BOOL),
+    ('devices.sdcard.enabled', TYPE_BOOL),
+    ('devices.sdcard.search_paths', TYPE_LIST),
+    ('devices.usb.enabled', TYPE_BOOL),
+    ('devices.usb.search_paths', TYPE_LIST),
+    ('devices.network.enabled', TYPE_BOOL),
+    ('devices.network.server', TYPE_STRING),
+    ('devices.network.filename', TYPE_STRING),
+    ('devices.holotape.enabled', TYPE_BOOL),
+    ('devices.holotape.device', TYPE_STRING),
+    ('search.kernel_patterns', TYPE_LIST),
+    ('search.max_depth', TYPE_INT),
+    ('search.ignore_hidden', TYPE_BOOL),
+    ('boot.protocol', TYPE_STRING),
+    ('boot.cmdline', TYPE_STRING),
+    ('boot.load_address', TYPE_INT),
+    ('boot.initrd', TYPE_STRING),
+]
+KEY_TYPES = dict(KEYS)
+
+BOOLS = {'true': 1, 'yes': 1, 'on': 1, '1': 1, 'false': 0, 'no': 0, 'off': 0, '0': 0}
+BLANKS = ' \t\r'
+
+
+def fnv1a(data):
+    h = 0x811C9DC5
+    for b in data:
+        h = ((h ^ b) * 0x01000193) & 0xFFFFFFFF
+    return h
+
+
+def schema():
+    """config_schema(): CRC-32 over each key name, NUL and type."""
+    crc = 0
+    for name, kind in KEYS:
+        crc = zlib.crc32(name.encode() + b'\0' + bytes([kind]), crc)
+    return crc
+
+
+def strip_comment(value):
+    """A '#' at the start of the value or after a blank begins a comment."""
+    for i, c in enumerate(value):
+        if c == '#' and (i == 0 or value[i - 1] in BLANKS):
+            return value[:i]
+    return value
+
+
+def convert(kind, value):
+    if kind == TYPE_INT:
+        if not re.fullmatch(r'0[xX][0-9a-fA-F]+|[0-9]+', value):
+            raise ValueError
+        v = int(value, 0) if value[:2].lower() == '0x' else int(value, 10)
+        if v > 0xFFFFFFFF:
+            raise ValueError
+        return v
+    if kind == TYPE_BOOL:
+        return BOOLS[value]
+    if kind == TYPE_STRING:
+        return value
+    return [item.strip(BLANKS) for item in value.split(',') if item.strip(BLANKS)]
+
+
+def parse(path, values):
+    section = ''
+    with open(path, encoding='utf-8') as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.strip(BLANKS + '\n')
+            if not line or line[0] in '#;':
+                continue
+            if line[0] == '[':
+                if ']' not in line:
+                    raise ValueError(f"{path}:{lineno}: unterminated section")
+                section = line[1:line.index(']')].strip(BLANKS) + '.'
+                continue
+            key, sep, value = line.partition('=')
+            name = section + key.rstrip(BLANKS)
+            if not sep or not key:
+                raise ValueError(f"{path}:{lineno}: expected key = value")
+            if name not in KEY_TYPES:
+                raise ValueError(f"{path}:{lineno}: unknown key '{name}'")
+            value = strip_comment(value).strip(BLANKS)
+            try:
+                values[name] = convert(KEY_TYPES[name], value)
+            except (ValueError, KeyError):
+                raise ValueError(f"{path}:{lineno}: bad value for '{name}': '{value}'")
+
+
+def build_blob(values):
+    records = b''
+    for name, kind in KEYS:
+        if name not in values:
+            continue
+        v = values[name]
+        count = 0
+        if kind in (TYPE_INT, TYPE_BOOL):
+            payload = struct.pack('<I', v)
+        elif kind == TYPE_STRING:
+            payload = v.encode() + b'\0'
+        else:
+            payload = b''.join(item.encode() + b'\0' for item in v)
+            count = len(v)
+        if len(payload) > 0xFFFF or count > 0xFF:
+            raise ValueError(f"value of '{name}' too long")
+        records += RECORD.pack(fnv1a(name.encode()), kind, count, len(payload))
+        records += payload + bytes(-len(payload) % 4)
+    header = HEADER.pack(BLOB_MAGIC, BLOB_VERSION, len(values), HEADER.size + len(records),
+                         schema(), zlib.crc32(records))
+    return header + records
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Precompile MFBootAgent configuration')
+    parser.add_argument('files', nargs='+', help='INI files, later ones override earlier')
+    parser.add_argument('-o', '--output', required=True, help='Output blob')
+    args = parser.parse_args()
+
+    values = {}
+    try:
+        for path in args.files:
+            parse(path, values)
+        blob = build_blob(values)
+        with open(args.output, 'wb') as f:
+            f.write(blob)
+    except (OSError, ValueError) as e:
+        print(f"Error: {e}", file=sys.stderr)
+        return 1
+
+    print(f"Created {args.output}: {len(values)} key(s), {len(blob)} bytes")
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
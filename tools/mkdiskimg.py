@@ -0,0 +1,260 @@
+#!/usr/bin/env python3
+"""
+mkdiskimg.py - Create FAT32 SD card images for the host build
+Copyright 2201-2203 Robco Ind.
+
+Builds an MBR-partitioned disk image holding one FAT32 volume with the
+given files, for build/host/mfboot-host to boot from:
+
+    mkdiskimg.py sd.img boot/uos.img=build/uos.img boot/pipos.img=pi.img
+
+Names that fit 8.3 are stored as short entries, others as long (LFN)
+entries with a generated NAME~N.EXT alias. Files are laid out
+contiguously unless --fragment leaves a free cluster after every N, as
+on a well-used card. --boot-index preallocates the file the bootloader
+caches its scan in.
+"""
+
+import sys
+import struct
+import argparse
+
+SECTOR_SIZE = 512
+PART_START = 2048           # First partition LBA, 1 MB aligned
+RESERVED_SECTORS = 32
+NUM_FATS = 2
+ROOT_CLUSTER = 2
+PART_FAT32_LBA = 0x0C
+
+ATTR_VOLUME = 0x08
+ATTR_DIRECTORY = 0x10
+ATTR_ARCHIVE = 0x20
+ATTR_LFN = 0x0F
+FAT_EOC = 0x0FFFFFFF
+
+LFN_LAST = 0x40
+LFN_CHARS = 13
+LFN_MAX = 255
+SHORT_NAME_CHARS = set("ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!#$%&'()-@^_`{}~")
+
+BOOT_INDEX_PATH = 'boot/mfboot.idx'
+BOOT_INDEX_SIZE = 4096       # Room for bootindex_t, rewritten in place
+
+
+def short_name(name):
+    """8.3 directory name for 'name', or None if it does not fit."""
+    base, _, ext = name.upper().partition('.')
+    if not base or len(base) > 8 or len(ext) > 3 or '.' in ext:
+        return None
+    if not set(base + ext) <= SHORT_NAME_CHARS:
+        return None
+    return (base.ljust(8) + ext.ljust(3)).encode('ascii')
+
+
+def short_alias(name, taken):
+    """NAME~N.EXT alias for a long name, unique among 'taken'."""
+    stem, dot, ext = name.upper().rpartition('.')
+    if not dot or not stem:
+        stem, ext = name.upper(), ''
+    stem = ''.join(c for c in stem if c in SHORT_NAME_CHARS) or 'FILE'
+    ext = ''.join(c for c in ext if c in SHORT_NAME_CHARS)[:3]
+    for n in range(1, 1000000):
+        tail = f'~{n}'
+        alias = (stem[:8 - len(tail)] + tail).ljust(8) + ext.ljust(3)
+        if alias.encode('ascii') not in taken:
+            return alias.encode('ascii')
+    raise ValueError(f"no free short name for '{name}'")
+
+
+def lfn_checksum(short):
+    total = 0
+    for b in short:
+        total = (((total & 1) << 7) + (total >> 1) + b) & 0xFF
+    return total
+
+
+def lfn_entries(name, short):
+    """LFN entries for 'name', last part first as they are stored."""
+    chars = [ord(c) for c in name]
+    if len(chars) % LFN_CHARS:
+        chars.append(0)
+    chars += [0xFFFF] * (-len(chars) % LFN_CHARS)
+    count = len(chars) // LFN_CHARS
+    checksum = lfn_checksum(short)
+    entries = []
+    for seq in range(count, 0, -1):
+        part = chars[(seq - 1) * LFN_CHARS:seq * LFN_CHARS]
+        e = struct.pack('<B5HBBB6HH2H', seq | (LFN_LAST if seq == count else 0), *part[0:5],
+                        ATTR_LFN, 0, checksum, *part[5:11], 0, *part[11:13])
+        entries.append(e)
+    return b''.join(entries)
+
+
+class Volume:
+    def __init__(self, sectors, sectors_per_cluster, fragment=0):
+        self.spc = sectors_per_cluster
+        self.fragment = fragment
+        self.cluster_bytes = SECTOR_SIZE * sectors_per_cluster
+        clusters = sectors // sectors_per_cluster
+        self.fat_sectors = (clusters * 4 + 2 * 4 + SECTOR_SIZE - 1) // SECTOR_SIZE
+        self.data_start = RESERVED_SECTORS + NUM_FATS * self.fat_sectors
+        self.cluster_count = (sectors - self.data_start) // sectors_per_cluster
+        self.sectors = sectors
+        self.fat = [0x0FFFFFF8, FAT_EOC]
+        self.data = {}                  # first cluster -> bytes
+        self.chains = {}                # first cluster -> its clusters
+        self.root = []                  # directory entries
+        self.dirs = {(): self.root}
+        self.alloc(self.cluster_bytes)  # Root directory, cluster 2
+
+    def alloc(self, size):
+        """Allocate and chain clusters for 'size' bytes, return the first."""
+        count = max(1, (size + self.cluster_bytes - 1) // self.cluster_bytes)
+        chain = []
+        while len(chain) < count:
+            if self.fragment and chain and len(chain) % self.fragment == 0:
+                self.fat.append(0)      # Left free, splitting the run
+            chain.append(len(self.fat))
+            self.fat.append(FAT_EOC)
+        if chain[-1] - 2 >= self.cluster_count:
+            raise ValueError("image too small for its files")
+        for cur, nxt in zip(chain, chain[1:]):
+            self.fat[cur] = nxt
+        self.chains[chain[0]] = chain
+        return chain[0]
+
+    def add_entry(self, entries, name, attr, target, size):
+        taken = {e[1] for e in entries}
+        short = short_name(name)
+        if short is not None and short not in taken:
+            entries.append((None, short, attr, target, size))
+            return
+        if len(name) > LFN_MAX or not name.isascii():
+            raise ValueError(f"'{name}' is not a valid long name")
+        entries.append((name, short_alias(name, taken), attr, target, size))
+
+    def directory(self, parts):
+        key = tuple(parts)
+        if key not in self.dirs:
+            parent = self.directory(parts[:-1])
+            entries = []
+            self.dirs[key] = entries
+            self.add_entry(parent, parts[-1], ATTR_DIRECTORY, key, 0)
+        return self.dirs[key]
+
+    def add_file(self, path, data):
+        parts = [p for p in path.split('/') if p]
+        # Empty files own no clusters
+        cluster = self.alloc(len(data)) if data else 0
+        if data:
+            self.data[cluster] = data
+        self.add_entry(self.directory(parts[:-1]), parts[-1], ATTR_ARCHIVE, cluster, len(data))
+
+    @staticmethod
+    def dirent(name, attr, cluster, size):
+        return (name + struct.pack('<BBBHHHHHHHI', attr, 0, 0, 0, 0, 0,
+                                   cluster >> 16, 0, 0, cluster & 0xFFFF, size))
+
+    def write_dirs(self):
+        clusters = {(): ROOT_CLUSTER}
+        # Parents before children, so each directory knows its own cluster.
+        # A directory that fills its last cluster exactly has no end marker.
+        for key in sorted(self.dirs, key=len):
+            entries = self.dirs[key]
+            size = (len(entries) + (2 if key else 1)) * 32
+            size += sum(len(lfn_entries(e[0], e[1])) for e in entries if e[0])
+            if key:
+                clusters[key] = self.alloc(size)
+            elif size > self.cluster_bytes:
+                # The root grows past cluster 2
+                more = self.alloc(size - self.cluster_bytes)
+                self.fat[ROOT_CLUSTER] = more
+                self.chains[ROOT_CLUSTER] = [ROOT_CLUSTER] + self.chains.pop(more)
+        for key, entries in self.dirs.items():
+            raw = b''
+            if key:
+                parent = clusters[key[:-1]]
+                raw += self.dirent(b'.          ', ATTR_DIRECTORY, clusters[key], 0)
+                raw += self.dirent(b'..         ', ATTR_DIRECTORY,
+                                   0 if parent == ROOT_CLUSTER else parent, 0)
+            else:
+                raw += self.dirent(b'MFBOOT     ', ATTR_VOLUME, 0, 0)
+            for long_name, short, attr, target, size in entries:
+                if attr == ATTR_DIRECTORY:
+                    target = clusters[target]
+                if long_name:
+                    raw += lfn_entries(long_name, short)
+                raw += self.dirent(short, attr, target, size)
+            self.data[clusters[key]] = raw
+
+    def image(self):
+        self.write_dirs()
+        img = bytearray((PART_START + self.sectors) * SECTOR_SIZE)
+
+        mbr = bytearray(SECTOR_SIZE)
+        struct.pack_into('<B3sB3sII', mbr, 446, 0x80, b'\xFE\xFF\xFF', PART_FAT32_LBA,
+                         b'\xFE\xFF\xFF', PART_START, self.sectors)
+        mbr[510:512] = b'\x55\xAA'
+        img[0:SECTOR_SIZE] = mbr
+
+        base = PART_START * SECTOR_SIZE
+        bs = bytearray(SECTOR_SIZE)
+        bs[0:11] = b'\xEB\x58\x90MSWIN4.1'
+        struct.pack_into('<HBHBHHBHHHII', bs, 11, SECTOR_SIZE, self.spc, RESERVED_SECTORS,
+                         NUM_FATS, 0, 0, 0xF8, 0, 63, 255, PART_START, self.sectors)
+        struct.pack_into('<IHHIHH', bs, 36, self.fat_sectors, 0, 0, ROOT_CLUSTER, 1, 6)
+        struct.pack_into('<BBBI11s8s', bs, 64, 0x80, 0, 0x29, 0x4D464254,
+                         b'MFBOOT     ', b'FAT32   ')
+        bs[510:512] = b'\x55\xAA'
+        img[base:base + SECTOR_SIZE] = bs
+
+        fat = b''.join(struct.pack('<I', v) for v in self.fat)
+        for i in range(NUM_FATS):
+            off = base + (RESERVED_SECTORS + i * self.fat_sectors) * SECTOR_SIZE
+            img[off:off + len(fat)] = fat
+
+        for first, data in self.data.items():
+            for i, cluster in enumerate(self.chains[first]):
+                piece = data[i * self.cluster_bytes:(i + 1) * self.cluster_bytes]
+                off = base + (self.data_start + (cluster - 2) * self.spc) * SECTOR_SIZE
+                img[off:off + len(piece)] = piece
+        return img
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Create a FAT32 SD card image')
+    parser.add_argument('output', help='Output disk image')
+    parser.add_argument('files', nargs='+', metavar='PATH=FILE',
+                        help='Store FILE at PATH on the volume (e.g. boot/uos.img=kernel.img)')
+    parser.add_argument('-s', '--size', type=int, default=64, help='Volume size in MB (default 64)')
+    parser.add_argument('-c', '--cluster', type=int, default=8, choices=[1, 2, 4, 8, 16, 32, 64],
+                        help='Sectors per cluster (default 8)')
+    parser.add_argument('-i', '--boot-index', action='store_true',
+                        help=f'Allocate {BOOT_INDEX_PATH} for the boot entry index')
+    parser.add_argument('-f', '--fragment', type=int, default=0, metavar='N',
+                        help='Leave a free cluster after every N clusters of a file or directory')
+    args = parser.parse_args()
+
+    try:
+        vol = Volume(args.size * 1024 * 1024 // SECTOR_SIZE, args.cluster, args.fragment)
+        for spec in args.files:
+            path, sep, src = spec.partition('=')
+            if not sep:
+                raise ValueError(f"expected PATH=FILE, got '{spec}'")
+            with open(src, 'rb') as f:
+                vol.add_file(path, f.read())
+        if args.boot_index:
+            vol.add_file(BOOT_INDEX_PATH, bytes(BOOT_INDEX_SIZE))
+        img = vol.image()
+        with open(args.output, 'wb') as f:
+            f.write(img)
+    except (OSError, ValueError) as e:
+        print(f"Error: {e}", file=sys.stderr)
+        return 1
+
+    print(f"Created {args.output}: {args.size} MB FAT32, {len(args.files)} file(s)")
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
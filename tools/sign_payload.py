@@ -2,130 +2,343 @@
 """
 sign_payload.py - Sign OS images for secure boot
 Copyright 2201-2203 Robco Ind.
+
+Signed image layout (checked by src/loader.c):
+
+    image bytes | Ed25519 signature (64) | "MFSG" magic (4) | signed length (4)
+
+The signature covers the SHA-256 digest of the image bytes, which the
+bootloader computes while it streams the image from the card. Keys are
+stored as hex: the 32-byte seed in the .key file and the 32-byte public
+key in the .pub file.
 """
 
+import os
 import sys
+import struct
 import argparse
 import hashlib
 from pathlib import Path
 
+SIGN_MAGIC = 0x4753464D  # "MFSG"
+SIG_SIZE = 64
+TRAILER_SIZE = 8
+
+# Ed25519 (RFC 8032), pure python so no extra packages are needed
+P = 2**255 - 19
+L = 2**252 + 27742317777372353535851937790883648493
+D = -121665 * pow(121666, P - 2, P) % P
+SQRT_M1 = pow(2, (P - 1) // 4, P)
+
+
+def _recover_x(y, sign):
+    if y >= P:
+        return None
+    x2 = (y * y - 1) * pow(D * y * y + 1, P - 2, P)
+    if x2 == 0:
+        return None if sign else 0
+    x = pow(x2, (P + 3) // 8, P)
+    if (x * x - x2) % P != 0:
+        x = x * SQRT_M1 % P
+    if (x * x - x2) % P != 0:
+        return None
+    if (x & 1) != sign:
+        x = P - x
+    return x
+
+
+_BY = 4 * pow(5, P - 2, P) % P
+_BX = _recover_x(_BY, 0)
+BASE = (_BX, _BY, 1, _BX * _BY % P)
+
+
+def _point_add(p, q):
+    a = (p[1] - p[0]) * (q[1] - q[0]) % P
+    b = (p[1] + p[0]) * (q[1] + q[0]) % P
+    c = 2 * p[3] * q[3] * D % P
+    d = 2 * p[2] * q[2] % P
+    e, f, g, h = b - a, d - c, d + c, b + a
+    return (e * f % P, g * h % P, f * g % P, e * h % P)
+
+
+def _point_mul(s, p):
+    q = (0, 1, 1, 0)
+    while s > 0:
+        if s & 1:
+            q = _point_add(q, p)
+        p = _point_add(p, p)
+        s >>= 1
+    return q
+
+
+def _point_equal(p, q):
+    if (p[0] * q[2] - q[0] * p[2]) % P != 0:
+        return False
+    return (p[1] * q[2] - q[1] * p[2]) % P == 0
+
+
+def _point_compress(p):
+    zinv = pow(p[2], P - 2, P)
+    x = p[0] * zinv % P
+    y = p[1] * zinv % P
+    return int.to_bytes(y | ((x & 1) << 255), 32, 'little')
+
+
+def _point_decompress(s):
+    if len(s) != 32:
+        return None
+    y = int.from_bytes(s, 'little')
+    sign = y >> 255
+    y &= (1 << 255) - 1
+    x = _recover_x(y, sign)
+    if x is None:
+        return None
+    return (x, y, 1, x * y % P)
+
+
+def _sha512_modl(*parts):
+    h = hashlib.sha512()
+    for part in parts:
+        h.update(part)
+    return int.from_bytes(h.digest(), 'little') % L
+
+
+def _expand_seed(seed):
+    h = hashlib.sha512(seed).digest()
+    a = int.from_bytes(h[:32], 'little')
+    a &= (1 << 254) - 8
+    a |= 1 << 254
+    return a, h[32:]
+
+
+def ed25519_public_key(seed):
+    a, _ = _expand_seed(seed)
+    return _point_compress(_point_mul(a, BASE))
+
+
+def ed25519_sign(seed, msg):
+    a, prefix = _expand_seed(seed)
+    pub = _point_compress(_point_mul(a, BASE))
+    r = _sha512_modl(prefix, msg)
+    rs = _point_compress(_point_mul(r, BASE))
+    k = _sha512_modl(rs, pub, msg)
+    s = (r + k * a) % L
+    return rs + int.to_bytes(s, 32, 'little')
+
+
+def ed25519_verify(pub, msg, sig):
+    if len(sig) != SIG_SIZE:
+        return False
+    a = _point_decompress(pub)
+    r = _point_decompress(sig[:32])
+    if a is None or r is None:
+        return False
+    s = int.from_bytes(sig[32:], 'little')
+    if s >= L:
+        return False
+    k = _sha512_modl(sig[:32], pub, msg)
+    return _point_equal(_point_mul(s, BASE), _point_add(r, _point_mul(k, a)))
+
+
+def read_hex_key(path):
+    key = bytes.fromhex(Path(path).read_text().strip())
+    if len(key) != 32:
+        raise ValueError(f"{path}: expected 32-byte hex key")
+    return key
+
+
+def split_signed(data):
+    """Return (signed bytes, signature) or None if there is no trailer."""
+    if len(data) < SIG_SIZE + TRAILER_SIZE:
+        return None
+    magic, signed_len = struct.unpack('<II', data[-TRAILER_SIZE:])
+    if magic != SIGN_MAGIC or signed_len != len(data) - SIG_SIZE - TRAILER_SIZE:
+        return None
+    return data[:signed_len], data[signed_len:signed_len + SIG_SIZE]
+
+
+def generate_key(key_path):
+    """Write a new signing seed to key_path and its public key to <key>.pub."""
+    try:
+        seed = os.urandom(32)
+        pub = ed25519_public_key(seed)
+        pub_path = Path(key_path).with_suffix('.pub')
+
+        fd = os.open(key_path, os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o600)
+        with os.fdopen(fd, 'w') as f:
+            f.write(seed.hex() + '\n')
+        pub_path.write_text(pub.hex() + '\n')
+
+        print(f"Private key: {key_path}")
+        print(f"Public key:  {pub_path} ({pub.hex()})")
+        return 0
+
+    except Exception as e:
+        print(f"Error: {e}", file=sys.stderr)
+        return 1
+
+
 def sign_payload(image_path, key_path, output_path):
     """
     Sign a boot image for secure boot verification.
-    
+
     Args:
         image_path: Path to boot image
-        key_path: Path to private key (PEM format)
+        key_path: Path to private key (hex seed)
         output_path: Path to output signed image
     """
     try:
         # Read image file
         with open(image_path, 'rb') as f:
             image_data = f.read()
-        
-        # Calculate SHA-256 hash
-        hash_obj = hashlib.sha256()
-        hash_obj.update(image_data)
-        image_hash = hash_obj.digest()
-        
+
+        if split_signed(image_data) is not None:
+            print("Error: Image is already signed", file=sys.stderr)
+            return 1
+
+        seed = read_hex_key(key_path)
+        image_hash = hashlib.sha256(image_data).digest()
+        signature = ed25519_sign(seed, image_hash)
+        trailer = struct.pack('<II', SIGN_MAGIC, len(image_data))
+
         print(f"Image hash (SHA-256): {image_hash.hex()}")
-        
-        # In a real implementation, this would:
-        # 1. Load the private key from key_path
-        # 2. Sign the hash using RSA or ECDSA
-        # 3. Append signature to the image
-        
-        # For now, create a dummy signature
-        dummy_signature = b'\x00' * 64  # 64-byte signature placeholder
-        
+
         # Write signed image
         with open(output_path, 'wb') as f:
             f.write(image_data)
-            f.write(dummy_signature)
-        
+            f.write(signature)
+            f.write(trailer)
+
         print(f"Signed image created: {output_path}")
         print(f"  Original size: {len(image_data)} bytes")
-        print(f"  Signature size: {len(dummy_signature)} bytes")
-        print(f"  Total size: {len(image_data) + len(dummy_signature)} bytes")
-        
-        print("\nWARNING: This is a stub implementation!")
-        print("Real cryptographic signing should be implemented for production use.")
-        
+        print(f"  Signature size: {len(signature) + len(trailer)} bytes")
+        print(f"  Total size: {len(image_data) + len(signature) + len(trailer)} bytes")
+
         return 0
-        
+
     except Exception as e:
         print(f"Error: {e}", file=sys.stderr)
         return 1
 
+
 def verify_payload(image_path, pubkey_path):
     """
     Verify a signed boot image.
-    
+
     Args:
         image_path: Path to signed boot image
-        pubkey_path: Path to public key (PEM format)
+        pubkey_path: Path to public key (hex)
     """
     try:
         with open(image_path, 'rb') as f:
             data = f.read()
-        
-        # Split image and signature
-        if len(data) < 64:
-            print("Error: Image too small to contain signature", file=sys.stderr)
+
+        signed = split_signed(data)
+        if signed is None:
+            print("Error: Image has no signature trailer", file=sys.stderr)
             return 1
-        
-        image_data = data[:-64]
-        signature = data[-64:]
-        
-        # Calculate hash
-        hash_obj = hashlib.sha256()
-        hash_obj.update(image_data)
-        image_hash = hash_obj.digest()
-        
+
+        image_data, signature = signed
+        image_hash = hashlib.sha256(image_data).digest()
+
         print(f"Image hash (SHA-256): {image_hash.hex()}")
         print(f"Signature: {signature.hex()}")
-        
-        # In a real implementation, verify signature with public key
-        print("\nWARNING: This is a stub implementation!")
-        print("Real signature verification should be implemented for production use.")
-        
+
+        if not ed25519_verify(read_hex_key(pubkey_path), image_hash, signature):
+            print("Signature INVALID", file=sys.stderr)
+            return 1
+
+        print("Signature OK")
+        return 0
+
+    except Exception as e:
+        print(f"Error: {e}", file=sys.stderr)
+        return 1
+
+
+def export_keys(pub_paths, output_path):
+    """Write the trusted key table compiled into the bootloader."""
+    try:
+        keys = [read_hex_key(p) for p in pub_paths]
+
+        lines = [
+            "// src/trusted_keys.c - Public keys accepted for signed boot images",
+            "//",
+            "// Generated by tools/sign_payload.py export-keys; do not edit.",
+            "",
+            "#include \"crypto.h\"",
+            "",
+            "const uint8_t trusted_keys[][ED25519_KEY_SIZE] = {",
+        ]
+        for path, key in zip(pub_paths, keys):
+            lines.append(f"    // {Path(path).name}")
+            lines.append("    {")
+            for i in range(0, 32, 8):
+                row = ", ".join(f"0x{b:02x}" for b in key[i:i + 8])
+                lines.append(f"        {row},")
+            lines.append("    },")
+        if not keys:
+            lines.append("    { 0 },  // Placeholder; no keys are trusted")
+        lines.append("};")
+        lines.append("")
+        lines.append(f"const uint32_t trusted_key_count = {len(keys)};")
+
+        Path(output_path).write_text("\n".join(lines) + "\n")
+        print(f"Wrote {len(keys)} key(s) to {output_path}")
         return 0
-        
+
     except Exception as e:
         print(f"Error: {e}", file=sys.stderr)
         return 1
 
+
 def main():
     parser = argparse.ArgumentParser(description='Sign OS images for MFBootAgent secure boot')
     subparsers = parser.add_subparsers(dest='command', help='Commands')
-    
+
+    # Genkey command
+    genkey_parser = subparsers.add_parser('genkey', help='Generate an Ed25519 signing key')
+    genkey_parser.add_argument('key', help='Private key file to create (public key goes to .pub)')
+
     # Sign command
     sign_parser = subparsers.add_parser('sign', help='Sign a boot image')
     sign_parser.add_argument('image', help='Boot image file')
-    sign_parser.add_argument('-k', '--key', required=True, help='Private key file (PEM)')
+    sign_parser.add_argument('-k', '--key', required=True, help='Private key file')
     sign_parser.add_argument('-o', '--output', required=True, help='Output signed image file')
-    
+
     # Verify command
     verify_parser = subparsers.add_parser('verify', help='Verify a signed boot image')
     verify_parser.add_argument('image', help='Signed boot image file')
-    verify_parser.add_argument('-k', '--key', required=True, help='Public key file (PEM)')
-    
+    verify_parser.add_argument('-k', '--key', required=True, help='Public key file')
+
+    # Export command
+    export_parser = subparsers.add_parser('export-keys', help='Generate src/trusted_keys.c')
+    export_parser.add_argument('keys', nargs='*', help='Public key files')
+    export_parser.add_argument('-o', '--output', default='src/trusted_keys.c',
+                               help='Output C file (default: src/trusted_keys.c)')
+
     args = parser.parse_args()
-    
+
     if not args.command:
         parser.print_help()
         return 1
-    
+
+    if args.command == 'genkey':
+        return generate_key(args.key)
+    if args.command == 'export-keys':
+        return export_keys(args.keys, args.output)
+
     if not Path(args.image).exists():
         print(f"Error: Image file not found: {args.image}", file=sys.stderr)
         return 1
-    
+
     if args.command == 'sign':
         return sign_payload(args.image, args.key, args.output)
     elif args.command == 'verify':
         return verify_payload(args.image, args.key)
-    
+
     return 0
 
+
 if __name__ == '__main__':
     sys.exit(main())
@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""
+termlink_view.py - Termlink boot block viewer
+Copyright 2201-2203 Robco Ind.
+
+Decodes the block a boot.protocol = termlink boot passes to the kernel
+in r0, as saved by the host build (mfboot-host -T FILE) or read out of
+RAM: the terminal, the boot device and image, the image digest, the
+memory map and the boot trace, shown as trace_view.py shows a dump.
+
+    termlink_view.py [-w width] block.bin
+"""
+
+import sys
+import zlib
+import struct
+import argparse
+
+from trace_view import build_spans, print_timeline
+
+TERMLINK_MAGIC = 0x524F4243
+TERMLINK_BOOT_MAGIC = 0x4B4E4C54
+TERMLINK_BOOT_VERSION = 1
+
+# termlink_info_t and termlink_boot_t (include/termlink.h)
+INFO_FORMAT = '<10I'
+BOOT_FORMAT = '<8I32s256sI32s5I10I7I'
+INFO_FIELDS = ['magic', 'version', 'capabilities', 'fb_addr', 'fb_width', 'fb_height',
+               'fb_pitch', 'fb_depth', 'peripheral_base', 'fb_pixel_order']
+BOOT_FIELDS = ['magic', 'version', 'size', 'checksum', 'boot_device', 'boot_type',
+               'entry_point', 'image_size', 'name', 'path', 'hash_state', 'sha256',
+               'machine_type', 'boot_tags', 'revision', 'initrd_start', 'initrd_size',
+               'ram_base', 'ram_size', 'vc_base', 'vc_size', 'mem_offset', 'mem_count',
+               'mem_entry_size', 'stage2_time', 'handoff_time', 'load_us',
+               'trace_offset', 'trace_count', 'trace_entry_size', 'trace_lost']
+CHECKSUM_OFFSET = struct.calcsize(INFO_FORMAT) + 12
+
+CAPABILITIES = ['serial', 'framebuffer', 'audio', 'gpio']
+DEVICES = ['SD card', 'USB', 'network', 'holotape']
+BOOT_TYPES = ['UOS', 'PIP-OS', 'maintenance', 'diagnostic']
+HASH_STATES = ['none (unsigned)', 'verified', 'FAILED verification']
+
+# Same order as the enum in include/memmap.h
+MEMMAP_KINDS = ['firmware', 'bootloader', 'stack', 'heap', 'kernel', 'initrd', 'dtb',
+                'scratch', 'termlink']
+
+
+def name_of(names, value):
+    return names[value] if value < len(names) else f'? ({value})'
+
+
+def parse(data):
+    """Return (info, boot) dicts, or raise ValueError."""
+    info_size = struct.calcsize(INFO_FORMAT)
+    header_size = info_size + struct.calcsize(BOOT_FORMAT)
+    if len(data) < header_size:
+        raise ValueError('file too short for a Termlink block')
+    info = dict(zip(INFO_FIELDS, struct.unpack_from(INFO_FORMAT, data, 0)))
+    boot = dict(zip(BOOT_FIELDS, struct.unpack_from(BOOT_FORMAT, data, info_size)))
+
+    if info['magic'] != TERMLINK_MAGIC or boot['magic'] != TERMLINK_BOOT_MAGIC:
+        raise ValueError('bad magic')
+    if boot['version'] != TERMLINK_BOOT_VERSION:
+        raise ValueError(f"unknown boot block version {boot['version']}")
+    if boot['size'] < header_size or boot['size'] > len(data):
+        raise ValueError(f"block size {boot['size']} does not fit the file")
+
+    body = bytearray(data[:boot['size']])
+    body[CHECKSUM_OFFSET:CHECKSUM_OFFSET + 4] = bytes(4)
+    if zlib.crc32(body) != boot['checksum']:
+        raise ValueError('checksum mismatch')
+    return info, boot
+
+
+def table(data, offset, count, entry_size, fmt):
+    return [struct.unpack_from(fmt, data, offset + i * entry_size) for i in range(count)]
+
+
+def cstr(raw):
+    return raw.split(b'\0', 1)[0].decode('utf-8', 'replace')
+
+
+def show(data, width):
+    info, boot = parse(data)
+
+    caps = [n for i, n in enumerate(CAPABILITIES) if info['capabilities'] & (1 << i)]
+    print(f"Termlink v{info['version'] >> 16}.{info['version'] & 0xFFFF}, "
+          f"boot block v{boot['version']}, {boot['size']} bytes")
+    print(f"  Capabilities: {', '.join(caps) or 'none'}")
+    print(f"  Peripherals:  0x{info['peripheral_base']:08X}")
+    if info['capabilities'] & 2:
+        order = 'RGB' if info['fb_pixel_order'] else 'BGR'
+        print(f"  Framebuffer:  0x{info['fb_addr']:08X}, {info['fb_width']}x{info['fb_height']}, "
+              f"{info['fb_depth']} bpp {order}, pitch {info['fb_pitch']}")
+
+    print()
+    print(f"Boot: {cstr(boot['name'])} ({name_of(BOOT_TYPES, boot['boot_type'])}) "
+          f"from {name_of(DEVICES, boot['boot_device'])}")
+    print(f"  Path:         {cstr(boot['path'])}, {boot['image_size']} bytes")
+    print(f"  Entry point:  0x{boot['entry_point']:08X}")
+    print(f"  r1, r2:       0x{boot['machine_type']:08X}, 0x{boot['boot_tags']:08X}")
+    if boot['revision']:
+        print(f"  Revision:     0x{boot['revision']:06X}")
+    if boot['initrd_size']:
+        print(f"  Initrd:       0x{boot['initrd_start']:08X}, {boot['initrd_size']} bytes")
+    print(f"  Digest:       {name_of(HASH_STATES, boot['hash_state'])}")
+    if boot['hash_state']:
+        print(f"                {boot['sha256'].hex()}")
+
+    print()
+    print(f"RAM: 0x{boot['ram_base']:08X}-0x{boot['ram_base'] + boot['ram_size']:08X}, "
+          f"{boot['ram_size'] >> 20} MB")
+    if boot['vc_size']:
+        print(f"GPU: 0x{boot['vc_base']:08X}-0x{boot['vc_base'] + boot['vc_size']:08X}, "
+              f"{boot['vc_size'] >> 20} MB")
+    for base, size, kind in table(data, boot['mem_offset'], boot['mem_count'],
+                                  boot['mem_entry_size'], '<III'):
+        print(f"  0x{base:08X}-0x{base + size:08X} {name_of(MEMMAP_KINDS, kind)} "
+              f"({size >> 10} KB)")
+
+    print()
+    print(f"Handoff {boot['handoff_time'] - boot['stage2_time']} us after stage2 entry, "
+          f"image load {boot['load_us']} us")
+    if boot['trace_lost']:
+        print(f"({boot['trace_lost']} oldest trace events overwritten)")
+    entries = [(t, ev, ph, arg) for t, ev, ph, _, arg in
+               table(data, boot['trace_offset'], boot['trace_count'],
+                     boot['trace_entry_size'], '<IBBHI')]
+    if entries:
+        print()
+        spans, marks = build_spans(entries)
+        print_timeline(spans, marks, width)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[1])
+    parser.add_argument('block', help='Termlink block (mfboot-host -T)')
+    parser.add_argument('-w', '--width', type=int, default=60, help='Timeline width in columns')
+    args = parser.parse_args()
+
+    try:
+        with open(args.block, 'rb') as f:
+            data = f.read()
+        show(data, args.width)
+    except (OSError, ValueError) as e:
+        print(f"Error: {e}", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
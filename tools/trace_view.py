@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""
+trace_view.py - Boot trace timeline viewer
+Copyright 2201-2203 Robco Ind.
+
+Reads a serial capture containing a boot trace dump (maintenance menu
+[T] then D, or a TRACE=2 build just before the kernel jump) and prints
+the spans as an indented timeline with proportional bars. --json writes
+Chrome trace events for chrome://tracing, Perfetto or speedscope.
+"""
+
+import sys
+import json
+import struct
+import argparse
+
+TRACE_DUMP_MAGIC = b'MFTR'
+TRACE_DUMP_VERSION = 1
+
+PHASE_BEGIN, PHASE_END, PHASE_MARK = 0, 1, 2
+
+# Same order as the enum in include/trace.h
+EVENT_NAMES = [
+    'stage2', 'mmu', 'memory_init', 'bcache_init', 'fs_init', 'scan',
+    'fs_exists', 'probe', 'menu', 'load', 'read', 'read_async',
+    'decompress', 'verify', 'jump',
+]
+
+# Spans that overlap the stage they run under instead of nesting in it
+ASYNC_EVENTS = {'read_async'}
+
+
+def event_name(event):
+    return EVENT_NAMES[event] if event < len(EVENT_NAMES) else f'event{event}'
+
+
+def find_dump(data):
+    """Return the entries of the last valid dump frame in a capture."""
+    pos = data.rfind(TRACE_DUMP_MAGIC)
+    while pos >= 0:
+        try:
+            entries = parse_frame(data, pos + len(TRACE_DUMP_MAGIC))
+            if entries is not None:
+                return entries
+        except struct.error:
+            pass
+        pos = data.rfind(TRACE_DUMP_MAGIC, 0, pos)
+    return None
+
+
+def parse_frame(data, off):
+    version, entry_size, count, lost = struct.unpack_from('<HHII', data, off)
+    if version != TRACE_DUMP_VERSION or entry_size < 12:
+        return None
+    body_len = 12 + count * entry_size
+    body = data[off:off + body_len]
+    (check,) = struct.unpack_from('<I', data, off + body_len)
+    if len(body) != body_len or (sum(body) & 0xFFFFFFFF) != check:
+        return None
+    if lost:
+        print(f"note: {lost} oldest events were overwritten", file=sys.stderr)
+
+    entries = []
+    for i in range(count):
+        time, event, phase, _, arg = struct.unpack_from('<IBBHI', body, 12 + i * entry_size)
+        entries.append((time, event, phase, arg))
+    return entries
+
+
+def build_spans(entries):
+    """Pair begin/end events into (start, end, depth, name, arg) spans."""
+    spans, marks, open_spans = [], [], []
+    for time, event, phase, arg in entries:
+        name = event_name(event)
+        if phase == PHASE_MARK:
+            marks.append((time, name, arg))
+        elif phase == PHASE_BEGIN:
+            depth = sum(1 for s in open_spans if s[1] not in ASYNC_EVENTS)
+            open_spans.append([time, name, depth])
+        elif phase == PHASE_END:
+            for j in range(len(open_spans) - 1, -1, -1):
+                if open_spans[j][1] == name:
+                    start, _, depth = open_spans.pop(j)
+                    spans.append((start, time, depth, name, arg))
+                    break
+    spans.sort()
+    return spans, marks
+
+
+def print_timeline(spans, marks, width):
+    times = [s[0] for s in spans] + [s[1] for s in spans] + [m[0] for m in marks]
+    if not times:
+        print("No events")
+        return
+    base = min(times)
+    total = max(max(times) - base, 1)
+    scale = width / total
+
+    rows = [(s[0], 0, s) for s in spans] + [(m[0], 1, m) for m in marks]
+    rows.sort(key=lambda r: (r[0], r[1]))
+
+    print(f"{'start us':>10} {'time us':>9}  timeline ({total} us)")
+    for _, kind, row in rows:
+        if kind == 1:
+            time, name, arg = row
+            col = int((time - base) * scale)
+            print(f"{time - base:>10} {'':>9}  {' ' * col}| {name}")
+            continue
+        start, end, depth, name, arg = row
+        col = int((start - base) * scale)
+        bar = max(1, int((end - start) * scale))
+        label = '  ' * depth + name
+        if arg:
+            label += f" ({arg})"
+        print(f"{start - base:>10} {end - start:>9}  {' ' * col}{'#' * bar} {label}")
+
+    print()
+    print(f"{'event':<13}{'count':>6}{'total us':>11}{'max us':>11}")
+    totals = {}
+    for start, end, _, name, _ in spans:
+        count, tot, longest = totals.get(name, (0, 0, 0))
+        totals[name] = (count + 1, tot + end - start, max(longest, end - start))
+    for name in EVENT_NAMES:
+        if name in totals:
+            count, tot, longest = totals[name]
+            print(f"{name:<13}{count:>6}{tot:>11}{longest:>11}")
+
+
+def write_chrome_trace(spans, marks, path):
+    events = []
+    for start, end, _, name, arg in spans:
+        events.append({'name': name, 'ph': 'X', 'ts': start, 'dur': end - start,
+                       'pid': 1, 'tid': 2 if name in ASYNC_EVENTS else 1,
+                       'args': {'arg': arg}})
+    for time, name, arg in marks:
+        events.append({'name': name, 'ph': 'i', 'ts': time, 's': 'g',
+                       'pid': 1, 'tid': 1, 'args': {'arg': arg}})
+    with open(path, 'w') as f:
+        json.dump({'traceEvents': events, 'displayTimeUnit': 'ms'}, f)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Show an MFBootAgent boot trace')
+    parser.add_argument('capture', help='Serial capture containing a trace dump')
+    parser.add_argument('-w', '--width', type=int, default=60, help='Timeline width in columns')
+    parser.add_argument('--json', help='Also write Chrome trace events to this file')
+    args = parser.parse_args()
+
+    try:
+        with open(args.capture, 'rb') as f:
+            data = f.read()
+    except OSError as e:
+        print(f"Error: {e}", file=sys.stderr)
+        return 1
+
+    entries = find_dump(data)
+    if entries is None:
+        print("Error: No valid trace dump found", file=sys.stderr)
+        return 1
+
+    spans, marks = build_spans(entries)
+    print_timeline(spans, marks, args.width)
+    if args.json:
+        write_chrome_trace(spans, marks, args.json)
+        print(f"\nChrome trace written to {args.json}")
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
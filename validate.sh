@@ -128,6 +128,9 @@ echo "Checking tool files..."
 tool_files=(
     "tools/mkbootimg.py"
     "tools/sign_payload.py"
+    "tools/mkdiskimg.py"
+    "tools/mkconfig.py"
+    "tools/bench_check.py"
 )
 
 for file in "${tool_files[@]}"; do
@@ -186,6 +189,41 @@ for tool in tools/*.py; do
 done
 echo ""
 
+# Host boot: compile the core for this machine and boot a generated image
+echo "Checking host boot..."
+if command -v "${HOSTCC:-cc}" >/dev/null 2>&1; then
+    tmp=$(mktemp -d)
+    head -c 65536 /dev/urandom > "$tmp/kernel.bin"
+    if make -s host >/dev/null &&
+       python3 tools/mkbootimg.py -c lz4 -o "$tmp/uos.img" "$tmp/kernel.bin" >/dev/null &&
+       python3 tools/mkdiskimg.py "$tmp/sd.img" "boot/uos.img=$tmp/uos.img" >/dev/null &&
+       build/host/mfboot-host -q -e "0x8000=$tmp/kernel.bin" "$tmp/sd.img" </dev/null 2>/dev/null; then
+        echo "  ✓ build/host/mfboot-host boots and loads the kernel"
+    else
+        echo "  ✗ host boot failed (run: build/host/mfboot-host -e 0x8000=kernel.bin sd.img)"
+        rm -rf "$tmp"
+        exit 1
+    fi
+    rm -rf "$tmp"
+else
+    echo "  ⚠ no host compiler, skipped"
+fi
+echo ""
+
+# Host unit tests
+echo "Running host unit tests..."
+if command -v "${HOSTCC:-cc}" >/dev/null 2>&1; then
+    if make -s test; then
+        echo "  ✓ make test passed"
+    else
+        echo "  ✗ host unit tests failed (run: make test)"
+        exit 1
+    fi
+else
+    echo "  ⚠ no host compiler, skipped"
+fi
+echo ""
+
 echo "=============================="
 echo "✓ All validation checks passed!"
 echo ""